@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Count heap allocations by interposing glibc's allocator. Only
+ * threads that opted in via phoc_bench_alloc_track_thread() are
+ * counted so the synthetic clients don't skew the compositor's numbers.
+ */
+
+#include "benchlib.h"
+
+#include <errno.h>
+#include <stddef.h>
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+
+static __thread gboolean track_thread;
+static guint64 n_allocs;
+
+
+static inline void
+count_alloc (void)
+{
+  if (G_UNLIKELY (track_thread))
+    __atomic_fetch_add (&n_allocs, 1, __ATOMIC_RELAXED);
+}
+
+
+void *
+malloc (size_t size)
+{
+  count_alloc ();
+  return __libc_malloc (size);
+}
+
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  count_alloc ();
+  return __libc_calloc (nmemb, size);
+}
+
+
+void *
+realloc (void *ptr, size_t size)
+{
+  count_alloc ();
+  return __libc_realloc (ptr, size);
+}
+
+
+void *
+memalign (size_t alignment, size_t size)
+{
+  count_alloc ();
+  return __libc_memalign (alignment, size);
+}
+
+
+void *
+aligned_alloc (size_t alignment, size_t size)
+{
+  count_alloc ();
+  return __libc_memalign (alignment, size);
+}
+
+/* glibc doesn't export __libc_posix_memalign so check arguments like it does */
+int
+posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+  void *mem;
+
+  if (alignment % sizeof (void *) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0)
+    return EINVAL;
+
+  count_alloc ();
+  mem = __libc_memalign (alignment, size);
+  if (mem == NULL)
+    return ENOMEM;
+
+  *memptr = mem;
+  return 0;
+}
+
+/**
+ * phoc_bench_alloc_track_thread:
+ * @track: Whether to count allocations
+ *
+ * Whether allocations in the calling thread should be counted.
+ */
+void
+phoc_bench_alloc_track_thread (gboolean track)
+{
+  track_thread = track;
+}
+
+/**
+ * phoc_bench_alloc_get_count:
+ *
+ * Get the number of allocations in all tracked threads so far. This
+ * can be called from any thread.
+ *
+ * Returns: The number of allocations
+ */
+guint64
+phoc_bench_alloc_get_count (void)
+{
+  return __atomic_load_n (&n_allocs, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,974 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Replay recorded input traces into phoc at their original timing and
+ * measure the latency from injecting an event until the client
+ * receives it and until the client's reaction got presented.
+ *
+ * Traces are text files with one event per line, loosely following
+ * `libinput debug-events`:
+ *
+ *   # time(s)  event                    arguments
+ *   0.000      TOUCH_DOWN               <slot> <x> <y>
+ *   0.008      TOUCH_MOTION             <slot> <x> <y>
+ *   0.016      TOUCH_UP                 <slot>
+ *   0.016      TOUCH_FRAME
+ *   1.000      KEYBOARD_KEY             <evdev keycode> pressed|released
+ *   2.000      POINTER_MOTION_ABSOLUTE  <x> <y>
+ *   2.100      POINTER_BUTTON           <evdev button> pressed|released
+ *
+ * Coordinates are normalized to [0, 1] like libinput's transformed
+ * absolute coordinates.
+ */
+
+#include "benchlib.h"
+
+#include "input.h"
+#include "seat.h"
+#include "server.h"
+
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/interfaces/wlr_touch.h>
+
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_TIMEOUT_SECONDS   300
+/* How long to wait for events the compositor didn't pass on */
+#define BENCH_SETTLE_TIMEOUT_US (2 * G_USEC_PER_SEC)
+
+typedef enum {
+  BENCH_INPUT_CLASS_TOUCH,
+  BENCH_INPUT_CLASS_KEYBOARD,
+  BENCH_INPUT_CLASS_POINTER,
+  BENCH_INPUT_CLASS_LAST,
+  BENCH_INPUT_CLASS_NONE = BENCH_INPUT_CLASS_LAST,
+} BenchInputClass;
+
+static const char *input_class_names[] = { "touch", "keyboard", "pointer" };
+
+typedef enum {
+  BENCH_TRACE_TOUCH_DOWN,
+  BENCH_TRACE_TOUCH_MOTION,
+  BENCH_TRACE_TOUCH_UP,
+  BENCH_TRACE_TOUCH_FRAME,
+  BENCH_TRACE_KEYBOARD_KEY,
+  BENCH_TRACE_POINTER_MOTION_ABSOLUTE,
+  BENCH_TRACE_POINTER_BUTTON,
+} BenchTraceEventType;
+
+typedef struct _BenchTraceEvent {
+  gint64              time_us;
+  BenchTraceEventType type;
+  int                 code; /* slot, keycode or button */
+  double              x, y;
+  gboolean            pressed;
+} BenchTraceEvent;
+
+typedef struct _BenchReplay {
+  char                *name;
+  char                *filename;
+  GArray              *events;
+
+  /* Compositor side */
+  struct wlr_touch     touch;
+  struct wlr_keyboard  keyboard;
+  struct wlr_pointer   pointer;
+  guint                next;
+  gint64               start_us;
+  int                  done;
+  GMutex               devices_lock;
+  GCond                devices_cond;
+  gboolean             devices_finished;
+
+  /* Injection times, consumed by the client in order */
+  GMutex               lock;
+  GArray              *injected_us[BENCH_INPUT_CLASS_LAST];
+  guint                n_delivered[BENCH_INPUT_CLASS_LAST];
+
+  /* Client side */
+  PhocBenchSamples     delivery_us[BENCH_INPUT_CLASS_LAST];
+  PhocBenchSamples     commit_us[BENCH_INPUT_CLASS_LAST];
+} BenchReplay;
+
+typedef struct _BenchInputClient {
+  PhocTestClientGlobals *globals;
+  BenchReplay           *replay;
+  struct wl_seat        *seat;
+  struct wl_touch       *touch;
+  struct wl_keyboard    *keyboard;
+  struct wl_pointer     *pointer;
+  PhocBenchSurface      *surface;
+  guint                  redraws;
+  /* Events waiting to be presented and those in the current frame */
+  GArray                *pending_us[BENCH_INPUT_CLASS_LAST];
+  GArray                *in_flight_us[BENCH_INPUT_CLASS_LAST];
+  gint64                 last_event_us;
+} BenchInputClient;
+
+static char *output_file;
+static char **trace_files;
+
+static PhocBenchReport *report;
+
+static const struct wlr_touch_impl bench_touch_impl = {
+  .name = "phoc-bench-touch",
+};
+
+static const struct wlr_keyboard_impl bench_keyboard_impl = {
+  .name = "phoc-bench-keyboard",
+};
+
+static const struct wlr_pointer_impl bench_pointer_impl = {
+  .name = "phoc-bench-pointer",
+};
+
+/* Trace parsing */
+
+static gboolean
+parse_pressed (const char *str, gboolean *pressed)
+{
+  if (g_strcmp0 (str, "pressed") == 0)
+    *pressed = TRUE;
+  else if (g_strcmp0 (str, "released") == 0)
+    *pressed = FALSE;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+
+static gboolean
+parse_trace_line (const char *line, BenchTraceEvent *event, GError **error)
+{
+  g_auto (GStrv) fields = NULL;
+  g_autoptr (GPtrArray) args = g_ptr_array_new ();
+  const char *time_str;
+  char *end;
+  double time_s;
+  guint n_args;
+
+  fields = g_strsplit_set (line, " \t", -1);
+  for (int i = 0; fields[i]; i++) {
+    if (fields[i][0] != '\0')
+      g_ptr_array_add (args, fields[i]);
+  }
+
+  if (args->len < 2) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Not enough fields in '%s'", line);
+    return FALSE;
+  }
+
+  /* Accept libinput's "+1.234s" as well as plain seconds */
+  time_str = g_ptr_array_index (args, 0);
+  if (time_str[0] == '+')
+    time_str++;
+  time_s = g_ascii_strtod (time_str, &end);
+  if (end == time_str || (*end != '\0' && g_strcmp0 (end, "s") != 0) || time_s < 0) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid timestamp in '%s'", line);
+    return FALSE;
+  }
+  event->time_us = time_s * G_USEC_PER_SEC;
+
+#define ARG(n) ((const char *)g_ptr_array_index (args, (n) + 2))
+  n_args = args->len - 2;
+  if (g_str_equal (g_ptr_array_index (args, 1), "TOUCH_DOWN") && n_args == 3) {
+    event->type = BENCH_TRACE_TOUCH_DOWN;
+  } else if (g_str_equal (g_ptr_array_index (args, 1), "TOUCH_MOTION") && n_args == 3) {
+    event->type = BENCH_TRACE_TOUCH_MOTION;
+  } else if (g_str_equal (g_ptr_array_index (args, 1), "TOUCH_UP") && n_args == 1) {
+    event->type = BENCH_TRACE_TOUCH_UP;
+  } else if (g_str_equal (g_ptr_array_index (args, 1), "TOUCH_FRAME") && n_args == 0) {
+    event->type = BENCH_TRACE_TOUCH_FRAME;
+  } else if (g_str_equal (g_ptr_array_index (args, 1), "KEYBOARD_KEY") && n_args == 2) {
+    event->type = BENCH_TRACE_KEYBOARD_KEY;
+  } else if (g_str_equal (g_ptr_array_index (args, 1), "POINTER_MOTION_ABSOLUTE") && n_args == 2) {
+    event->type = BENCH_TRACE_POINTER_MOTION_ABSOLUTE;
+  } else if (g_str_equal (g_ptr_array_index (args, 1), "POINTER_BUTTON") && n_args == 2) {
+    event->type = BENCH_TRACE_POINTER_BUTTON;
+  } else {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid event in '%s'", line);
+    return FALSE;
+  }
+
+  switch (event->type) {
+  case BENCH_TRACE_TOUCH_DOWN:
+  case BENCH_TRACE_TOUCH_MOTION:
+    event->code = atoi (ARG (0));
+    event->x = g_ascii_strtod (ARG (1), NULL);
+    event->y = g_ascii_strtod (ARG (2), NULL);
+    break;
+  case BENCH_TRACE_TOUCH_UP:
+    event->code = atoi (ARG (0));
+    break;
+  case BENCH_TRACE_KEYBOARD_KEY:
+  case BENCH_TRACE_POINTER_BUTTON:
+    event->code = atoi (ARG (0));
+    if (!parse_pressed (ARG (1), &event->pressed)) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid key state in '%s'", line);
+      return FALSE;
+    }
+    break;
+  case BENCH_TRACE_POINTER_MOTION_ABSOLUTE:
+    event->x = g_ascii_strtod (ARG (0), NULL);
+    event->y = g_ascii_strtod (ARG (1), NULL);
+    break;
+  case BENCH_TRACE_TOUCH_FRAME:
+  default:
+    break;
+  }
+#undef ARG
+
+  return TRUE;
+}
+
+
+static GArray *
+load_trace (const char *filename, GError **error)
+{
+  g_autoptr (GArray) events = g_array_new (FALSE, TRUE, sizeof (BenchTraceEvent));
+  g_autofree char *contents = NULL;
+  g_auto (GStrv) lines = NULL;
+
+  if (!g_file_get_contents (filename, &contents, NULL, error))
+    return NULL;
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (int i = 0; lines[i]; i++) {
+    BenchTraceEvent event = { 0 };
+    char *line = g_strstrip (lines[i]);
+
+    if (line[0] == '\0' || line[0] == '#')
+      continue;
+
+    if (!parse_trace_line (line, &event, error))
+      return NULL;
+
+    if (events->len &&
+        event.time_us < g_array_index (events, BenchTraceEvent, events->len - 1).time_us) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                   "Timestamps not monotonic at line %d", i + 1);
+      return NULL;
+    }
+
+    g_array_append_val (events, event);
+  }
+
+  return g_steal_pointer (&events);
+}
+
+
+static BenchInputClass
+bench_trace_event_get_class (BenchTraceEvent *event)
+{
+  switch (event->type) {
+  case BENCH_TRACE_TOUCH_DOWN:
+  case BENCH_TRACE_TOUCH_MOTION:
+  case BENCH_TRACE_TOUCH_UP:
+    return BENCH_INPUT_CLASS_TOUCH;
+  case BENCH_TRACE_KEYBOARD_KEY:
+    return BENCH_INPUT_CLASS_KEYBOARD;
+  case BENCH_TRACE_POINTER_MOTION_ABSOLUTE:
+  case BENCH_TRACE_POINTER_BUTTON:
+    return BENCH_INPUT_CLASS_POINTER;
+  case BENCH_TRACE_TOUCH_FRAME:
+  default:
+    return BENCH_INPUT_CLASS_NONE;
+  }
+}
+
+/* Compositor side */
+
+static void
+bench_replay_inject (BenchReplay *replay, BenchTraceEvent *event)
+{
+  BenchInputClass klass = bench_trace_event_get_class (event);
+  uint32_t time_msec = g_get_monotonic_time () / 1000;
+
+  /* Record before emitting as delivery happens from within the emission */
+  if (klass != BENCH_INPUT_CLASS_NONE) {
+    gint64 now_us = g_get_monotonic_time ();
+
+    g_mutex_lock (&replay->lock);
+    g_array_append_val (replay->injected_us[klass], now_us);
+    g_mutex_unlock (&replay->lock);
+  }
+
+  switch (event->type) {
+  case BENCH_TRACE_TOUCH_DOWN: {
+    struct wlr_touch_down_event ev = {
+      .touch = &replay->touch,
+      .time_msec = time_msec,
+      .touch_id = event->code,
+      .x = event->x,
+      .y = event->y,
+    };
+    wl_signal_emit_mutable (&replay->touch.events.down, &ev);
+    break;
+  }
+  case BENCH_TRACE_TOUCH_MOTION: {
+    struct wlr_touch_motion_event ev = {
+      .touch = &replay->touch,
+      .time_msec = time_msec,
+      .touch_id = event->code,
+      .x = event->x,
+      .y = event->y,
+    };
+    wl_signal_emit_mutable (&replay->touch.events.motion, &ev);
+    break;
+  }
+  case BENCH_TRACE_TOUCH_UP: {
+    struct wlr_touch_up_event ev = {
+      .touch = &replay->touch,
+      .time_msec = time_msec,
+      .touch_id = event->code,
+    };
+    wl_signal_emit_mutable (&replay->touch.events.up, &ev);
+    break;
+  }
+  case BENCH_TRACE_TOUCH_FRAME:
+    wl_signal_emit_mutable (&replay->touch.events.frame, NULL);
+    break;
+  case BENCH_TRACE_KEYBOARD_KEY: {
+    struct wlr_keyboard_key_event ev = {
+      .time_msec = time_msec,
+      .keycode = event->code,
+      .update_state = true,
+      .state = event->pressed ? WL_KEYBOARD_KEY_STATE_PRESSED : WL_KEYBOARD_KEY_STATE_RELEASED,
+    };
+    wlr_keyboard_notify_key (&replay->keyboard, &ev);
+    break;
+  }
+  case BENCH_TRACE_POINTER_MOTION_ABSOLUTE: {
+    struct wlr_pointer_motion_absolute_event ev = {
+      .pointer = &replay->pointer,
+      .time_msec = time_msec,
+      .x = event->x,
+      .y = event->y,
+    };
+    wl_signal_emit_mutable (&replay->pointer.events.motion_absolute, &ev);
+    wl_signal_emit_mutable (&replay->pointer.events.frame, &replay->pointer);
+    break;
+  }
+  case BENCH_TRACE_POINTER_BUTTON: {
+    struct wlr_pointer_button_event ev = {
+      .pointer = &replay->pointer,
+      .time_msec = time_msec,
+      .button = event->code,
+      .state = event->pressed ? WL_POINTER_BUTTON_STATE_PRESSED : WL_POINTER_BUTTON_STATE_RELEASED,
+    };
+    wl_signal_emit_mutable (&replay->pointer.events.button, &ev);
+    wl_signal_emit_mutable (&replay->pointer.events.frame, &replay->pointer);
+    break;
+  }
+  default:
+    g_assert_not_reached ();
+  }
+}
+
+
+static void bench_replay_schedule (BenchReplay *replay);
+
+
+static void
+on_replay_timeout (gpointer data)
+{
+  bench_replay_schedule (data);
+}
+
+/* Inject all due events and arm a timer for the next one */
+static void
+bench_replay_schedule (BenchReplay *replay)
+{
+  while (replay->next < replay->events->len) {
+    BenchTraceEvent *event = &g_array_index (replay->events, BenchTraceEvent, replay->next);
+    gint64 delay_us = replay->start_us + event->time_us - g_get_monotonic_time ();
+
+    if (delay_us > 0) {
+      g_timeout_add_once ((delay_us + 999) / 1000, on_replay_timeout, replay);
+      return;
+    }
+
+    bench_replay_inject (replay, event);
+    replay->next++;
+  }
+
+  g_atomic_int_set (&replay->done, TRUE);
+}
+
+
+static void
+on_replay_start (gpointer data)
+{
+  BenchReplay *replay = data;
+
+  replay->start_us = g_get_monotonic_time ();
+  bench_replay_schedule (replay);
+}
+
+
+static void
+on_replay_finish_devices (gpointer data)
+{
+  BenchReplay *replay = data;
+
+  wlr_touch_finish (&replay->touch);
+  wlr_keyboard_finish (&replay->keyboard);
+  wlr_pointer_finish (&replay->pointer);
+
+  g_mutex_lock (&replay->devices_lock);
+  replay->devices_finished = TRUE;
+  g_cond_signal (&replay->devices_cond);
+  g_mutex_unlock (&replay->devices_lock);
+}
+
+
+static gboolean
+bench_server_prepare (PhocServer *server, gpointer data)
+{
+  BenchReplay *replay = data;
+  PhocSeat *seat = phoc_input_get_seat (phoc_server_get_input (server),
+                                        PHOC_CONFIG_DEFAULT_SEAT_NAME);
+
+  g_assert (PHOC_IS_SEAT (seat));
+
+  /* Same path as devices created via the virtual keyboard and pointer protocols */
+  wlr_touch_init (&replay->touch, &bench_touch_impl, bench_touch_impl.name);
+  phoc_seat_add_device (seat, &replay->touch.base);
+
+  wlr_keyboard_init (&replay->keyboard, &bench_keyboard_impl, bench_keyboard_impl.name);
+  phoc_seat_add_device (seat, &replay->keyboard.base);
+
+  wlr_pointer_init (&replay->pointer, &bench_pointer_impl, bench_pointer_impl.name);
+  phoc_seat_add_device (seat, &replay->pointer.base);
+
+  return TRUE;
+}
+
+/* Client side */
+
+/* Match a received event with its injection time */
+static void
+bench_input_client_received (BenchInputClient *client, BenchInputClass klass)
+{
+  BenchReplay *replay = client->replay;
+  gint64 now_us = g_get_monotonic_time ();
+  gint64 injected_us = 0;
+
+  g_mutex_lock (&replay->lock);
+  if (replay->n_delivered[klass] < replay->injected_us[klass]->len) {
+    injected_us = g_array_index (replay->injected_us[klass], gint64, replay->n_delivered[klass]);
+    replay->n_delivered[klass]++;
+  }
+  g_mutex_unlock (&replay->lock);
+
+  /* E.g. pointer enter on map */
+  if (injected_us == 0)
+    return;
+
+  phoc_bench_samples_add (&replay->delivery_us[klass], now_us - injected_us);
+  g_array_append_val (client->pending_us[klass], injected_us);
+  client->last_event_us = now_us;
+}
+
+
+static void
+touch_handle_down (void *data, struct wl_touch *wl_touch, uint32_t serial, uint32_t time,
+                   struct wl_surface *surface, int32_t id, wl_fixed_t x, wl_fixed_t y)
+{
+  bench_input_client_received (data, BENCH_INPUT_CLASS_TOUCH);
+}
+
+
+static void
+touch_handle_up (void *data, struct wl_touch *wl_touch, uint32_t serial, uint32_t time, int32_t id)
+{
+  bench_input_client_received (data, BENCH_INPUT_CLASS_TOUCH);
+}
+
+
+static void
+touch_handle_motion (void *data, struct wl_touch *wl_touch, uint32_t time, int32_t id,
+                     wl_fixed_t x, wl_fixed_t y)
+{
+  bench_input_client_received (data, BENCH_INPUT_CLASS_TOUCH);
+}
+
+
+static void
+touch_handle_frame (void *data, struct wl_touch *wl_touch)
+{
+}
+
+
+static void
+touch_handle_cancel (void *data, struct wl_touch *wl_touch)
+{
+}
+
+
+static const struct wl_touch_listener touch_listener = {
+  .down = touch_handle_down,
+  .up = touch_handle_up,
+  .motion = touch_handle_motion,
+  .frame = touch_handle_frame,
+  .cancel = touch_handle_cancel,
+};
+
+
+static void
+keyboard_handle_keymap (void *data, struct wl_keyboard *wl_keyboard, uint32_t format,
+                        int32_t fd, uint32_t size)
+{
+  close (fd);
+}
+
+
+static void
+keyboard_handle_enter (void *data, struct wl_keyboard *wl_keyboard, uint32_t serial,
+                       struct wl_surface *surface, struct wl_array *keys)
+{
+}
+
+
+static void
+keyboard_handle_leave (void *data, struct wl_keyboard *wl_keyboard, uint32_t serial,
+                       struct wl_surface *surface)
+{
+}
+
+
+static void
+keyboard_handle_key (void *data, struct wl_keyboard *wl_keyboard, uint32_t serial,
+                     uint32_t time, uint32_t key, uint32_t state)
+{
+  bench_input_client_received (data, BENCH_INPUT_CLASS_KEYBOARD);
+}
+
+
+static void
+keyboard_handle_modifiers (void *data, struct wl_keyboard *wl_keyboard, uint32_t serial,
+                           uint32_t mods_depressed, uint32_t mods_latched,
+                           uint32_t mods_locked, uint32_t group)
+{
+}
+
+
+static void
+keyboard_handle_repeat_info (void *data, struct wl_keyboard *wl_keyboard,
+                             int32_t rate, int32_t delay)
+{
+}
+
+
+static const struct wl_keyboard_listener keyboard_listener = {
+  .keymap = keyboard_handle_keymap,
+  .enter = keyboard_handle_enter,
+  .leave = keyboard_handle_leave,
+  .key = keyboard_handle_key,
+  .modifiers = keyboard_handle_modifiers,
+  .repeat_info = keyboard_handle_repeat_info,
+};
+
+
+static void
+pointer_handle_enter (void *data, struct wl_pointer *wl_pointer, uint32_t serial,
+                      struct wl_surface *surface, wl_fixed_t x, wl_fixed_t y)
+{
+  /* Entering carries the position so it replaces a motion event */
+  bench_input_client_received (data, BENCH_INPUT_CLASS_POINTER);
+}
+
+
+static void
+pointer_handle_leave (void *data, struct wl_pointer *wl_pointer, uint32_t serial,
+                      struct wl_surface *surface)
+{
+}
+
+
+static void
+pointer_handle_motion (void *data, struct wl_pointer *wl_pointer, uint32_t time,
+                       wl_fixed_t x, wl_fixed_t y)
+{
+  bench_input_client_received (data, BENCH_INPUT_CLASS_POINTER);
+}
+
+
+static void
+pointer_handle_button (void *data, struct wl_pointer *wl_pointer, uint32_t serial,
+                       uint32_t time, uint32_t button, uint32_t state)
+{
+  bench_input_client_received (data, BENCH_INPUT_CLASS_POINTER);
+}
+
+
+static void
+pointer_handle_axis (void *data, struct wl_pointer *wl_pointer, uint32_t time,
+                     uint32_t axis, wl_fixed_t value)
+{
+}
+
+
+static const struct wl_pointer_listener pointer_listener = {
+  .enter = pointer_handle_enter,
+  .leave = pointer_handle_leave,
+  .motion = pointer_handle_motion,
+  .button = pointer_handle_button,
+  .axis = pointer_handle_axis,
+};
+
+
+static void
+seat_handle_capabilities (void *data, struct wl_seat *wl_seat, uint32_t caps)
+{
+  BenchInputClient *client = data;
+
+  if ((caps & WL_SEAT_CAPABILITY_TOUCH) && client->touch == NULL) {
+    client->touch = wl_seat_get_touch (wl_seat);
+    wl_touch_add_listener (client->touch, &touch_listener, client);
+  }
+
+  if ((caps & WL_SEAT_CAPABILITY_KEYBOARD) && client->keyboard == NULL) {
+    client->keyboard = wl_seat_get_keyboard (wl_seat);
+    wl_keyboard_add_listener (client->keyboard, &keyboard_listener, client);
+  }
+
+  if ((caps & WL_SEAT_CAPABILITY_POINTER) && client->pointer == NULL) {
+    client->pointer = wl_seat_get_pointer (wl_seat);
+    wl_pointer_add_listener (client->pointer, &pointer_listener, client);
+  }
+}
+
+
+static void
+seat_handle_name (void *data, struct wl_seat *wl_seat, const char *name)
+{
+}
+
+
+static const struct wl_seat_listener seat_listener = {
+  .capabilities = seat_handle_capabilities,
+  .name = seat_handle_name,
+};
+
+
+static void
+registry_handle_global (void               *data,
+                        struct wl_registry *registry,
+                        uint32_t            name,
+                        const char         *interface,
+                        uint32_t            version)
+{
+  BenchInputClient *client = data;
+
+  if (!g_strcmp0 (interface, wl_seat_interface.name) && client->seat == NULL) {
+    client->seat = wl_registry_bind (registry, name, &wl_seat_interface, MIN (version, 3));
+    wl_seat_add_listener (client->seat, &seat_listener, client);
+  }
+}
+
+
+static void
+registry_handle_global_remove (void               *data,
+                               struct wl_registry *registry,
+                               uint32_t            name)
+{
+}
+
+
+static const struct wl_registry_listener registry_listener = {
+  .global = registry_handle_global,
+  .global_remove = registry_handle_global_remove,
+};
+
+
+static gboolean
+bench_dispatch_timeout (struct wl_display *display, int timeout_ms)
+{
+  struct pollfd pfd = { .fd = wl_display_get_fd (display), .events = POLLIN };
+
+  while (wl_display_prepare_read (display) != 0)
+    wl_display_dispatch_pending (display);
+  wl_display_flush (display);
+
+  if (poll (&pfd, 1, timeout_ms) <= 0) {
+    wl_display_cancel_read (display);
+    return FALSE;
+  }
+
+  if (wl_display_read_events (display) < 0)
+    return FALSE;
+
+  return wl_display_dispatch_pending (display) >= 0;
+}
+
+
+static gboolean
+bench_input_client_has_pending (BenchInputClient *client, GArray **arrays)
+{
+  for (int i = 0; i < BENCH_INPUT_CLASS_LAST; i++) {
+    if (arrays[i]->len)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/* React to received events with a redraw, like a real client would */
+static void
+bench_input_client_update (BenchInputClient *client)
+{
+  BenchReplay *replay = client->replay;
+
+  if (client->surface->frame_done && bench_input_client_has_pending (client, client->in_flight_us)) {
+    gint64 now_us = g_get_monotonic_time ();
+
+    for (int i = 0; i < BENCH_INPUT_CLASS_LAST; i++) {
+      for (guint j = 0; j < client->in_flight_us[i]->len; j++) {
+        gint64 injected_us = g_array_index (client->in_flight_us[i], gint64, j);
+
+        phoc_bench_samples_add (&replay->commit_us[i], now_us - injected_us);
+      }
+      g_array_set_size (client->in_flight_us[i], 0);
+    }
+  }
+
+  if (client->surface->frame_done && bench_input_client_has_pending (client, client->pending_us)) {
+    for (int i = 0; i < BENCH_INPUT_CLASS_LAST; i++) {
+      g_array_append_vals (client->in_flight_us[i], client->pending_us[i]->data,
+                           client->pending_us[i]->len);
+      g_array_set_size (client->pending_us[i], 0);
+    }
+    client->redraws++;
+    phoc_bench_surface_commit (client->surface, 0xFF000000 | (client->redraws & 0xFF) << 8);
+  }
+}
+
+
+static gboolean
+bench_input_client_all_delivered (BenchInputClient *client)
+{
+  BenchReplay *replay = client->replay;
+  gboolean delivered = TRUE;
+
+  g_mutex_lock (&replay->lock);
+  for (int i = 0; i < BENCH_INPUT_CLASS_LAST; i++) {
+    if (replay->n_delivered[i] < replay->injected_us[i]->len)
+      delivered = FALSE;
+  }
+  g_mutex_unlock (&replay->lock);
+
+  return delivered;
+}
+
+
+static gboolean
+bench_client_run (PhocTestClientGlobals *globals, gpointer data)
+{
+  BenchReplay *replay = data;
+  BenchInputClient client = { .globals = globals, .replay = replay };
+  PhocTestXdgToplevelSurface *xs;
+  struct wl_registry *registry;
+
+  for (int i = 0; i < BENCH_INPUT_CLASS_LAST; i++) {
+    client.pending_us[i] = g_array_new (FALSE, FALSE, sizeof (gint64));
+    client.in_flight_us[i] = g_array_new (FALSE, FALSE, sizeof (gint64));
+  }
+
+  registry = wl_display_get_registry (globals->display);
+  wl_registry_add_listener (registry, &registry_listener, &client);
+  wl_display_roundtrip (globals->display);
+  wl_display_roundtrip (globals->display);
+  g_assert_nonnull (client.seat);
+  g_assert_nonnull (client.touch);
+  g_assert_nonnull (client.keyboard);
+  g_assert_nonnull (client.pointer);
+
+  /* A fullscreen toplevel so all normalized coordinates hit it */
+  xs = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, "input-replay", 0xFF000000);
+  xdg_toplevel_set_fullscreen (xs->xdg_toplevel, NULL);
+  wl_surface_commit (xs->wl_surface);
+  wl_display_roundtrip (globals->display);
+  wl_display_roundtrip (globals->display);
+  client.surface = phoc_bench_surface_new (globals, xs->wl_surface, xs->width, xs->height);
+  phoc_bench_surface_draw (globals, client.surface, 0xFF000000);
+
+  client.last_event_us = g_get_monotonic_time ();
+  g_idle_add_once (on_replay_start, replay);
+
+  while (TRUE) {
+    gboolean dispatched;
+
+    bench_input_client_update (&client);
+
+    dispatched = bench_dispatch_timeout (globals->display, 100);
+
+    if (!g_atomic_int_get (&replay->done))
+      continue;
+
+    if (bench_input_client_all_delivered (&client) &&
+        client.surface->frame_done &&
+        !bench_input_client_has_pending (&client, client.pending_us) &&
+        !bench_input_client_has_pending (&client, client.in_flight_us)) {
+      break;
+    }
+
+    /* Give up on events the compositor swallowed (e.g. gestures, keybindings) */
+    if (!dispatched && g_get_monotonic_time () - client.last_event_us > BENCH_SETTLE_TIMEOUT_US) {
+      g_test_message ("%s: Not all events got delivered", replay->name);
+      break;
+    }
+  }
+
+  /* Tear down the devices while the compositor is still up */
+  g_idle_add_once (on_replay_finish_devices, replay);
+  g_mutex_lock (&replay->devices_lock);
+  while (!replay->devices_finished)
+    g_cond_wait (&replay->devices_cond, &replay->devices_lock);
+  g_mutex_unlock (&replay->devices_lock);
+
+  g_clear_pointer (&client.surface, phoc_bench_surface_free);
+  phoc_test_xdg_toplevel_free (xs);
+  g_clear_pointer (&client.touch, wl_touch_destroy);
+  g_clear_pointer (&client.keyboard, wl_keyboard_destroy);
+  g_clear_pointer (&client.pointer, wl_pointer_destroy);
+  g_clear_pointer (&client.seat, wl_seat_destroy);
+  wl_registry_destroy (registry);
+  for (int i = 0; i < BENCH_INPUT_CLASS_LAST; i++) {
+    g_array_unref (client.pending_us[i]);
+    g_array_unref (client.in_flight_us[i]);
+  }
+
+  return TRUE;
+}
+
+
+static void
+bench_replay_free (BenchReplay *replay)
+{
+  for (int i = 0; i < BENCH_INPUT_CLASS_LAST; i++) {
+    g_clear_pointer (&replay->injected_us[i], g_array_unref);
+    phoc_bench_samples_clear (&replay->delivery_us[i]);
+    phoc_bench_samples_clear (&replay->commit_us[i]);
+  }
+  g_mutex_clear (&replay->lock);
+  g_mutex_clear (&replay->devices_lock);
+  g_cond_clear (&replay->devices_cond);
+  g_clear_pointer (&replay->events, g_array_unref);
+  g_free (replay->filename);
+  g_free (replay->name);
+  g_free (replay);
+}
+
+
+static void
+bench_run_replay (PhocTestFixture *fixture, gconstpointer data)
+{
+  BenchReplay *replay = g_new0 (BenchReplay, 1);
+  PhocTestClientIface iface = {
+    .server_prepare = bench_server_prepare,
+    .client_run     = bench_client_run,
+    .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+  g_autoptr (GError) err = NULL;
+
+  replay->filename = g_strdup (data);
+  replay->name = g_path_get_basename (replay->filename);
+  if (g_str_has_suffix (replay->name, ".trace"))
+    replay->name[strlen (replay->name) - strlen (".trace")] = '\0';
+
+  replay->events = load_trace (replay->filename, &err);
+  g_assert_no_error (err);
+
+  g_mutex_init (&replay->lock);
+  g_mutex_init (&replay->devices_lock);
+  g_cond_init (&replay->devices_cond);
+  for (int i = 0; i < BENCH_INPUT_CLASS_LAST; i++) {
+    replay->injected_us[i] = g_array_new (FALSE, FALSE, sizeof (gint64));
+    phoc_bench_samples_init (&replay->delivery_us[i]);
+    phoc_bench_samples_init (&replay->commit_us[i]);
+  }
+
+  phoc_test_client_run (BENCH_TIMEOUT_SECONDS, &iface, replay);
+
+  phoc_bench_report_begin_scenario (report, replay->name);
+  phoc_bench_report_add_uint (report, "events", replay->events->len);
+  for (int i = 0; i < BENCH_INPUT_CLASS_LAST; i++) {
+    g_autofree char *delivery_key = NULL;
+    g_autofree char *commit_key = NULL;
+
+    if (replay->injected_us[i]->len == 0)
+      continue;
+
+    delivery_key = g_strdup_printf ("%s_delivery_us", input_class_names[i]);
+    commit_key = g_strdup_printf ("%s_commit_us", input_class_names[i]);
+    phoc_bench_report_add_samples (report, delivery_key, &replay->delivery_us[i]);
+    phoc_bench_report_add_samples (report, commit_key, &replay->commit_us[i]);
+  }
+  phoc_bench_report_end_scenario (report);
+
+  bench_replay_free (replay);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_autoptr (GOptionContext) opt_context = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GPtrArray) traces = g_ptr_array_new_with_free_func (g_free);
+  int ret;
+  const GOptionEntry options [] = {
+    {"trace", 't', 0, G_OPTION_ARG_FILENAME_ARRAY, &trace_files,
+     "Trace to replay, can be given multiple times", NULL},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output_file,
+     "Write the JSON report to this file instead of stdout", NULL},
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+  };
+
+  g_test_init (&argc, &argv, NULL);
+
+  opt_context = g_option_context_new ("- phoc input latency benchmark");
+  g_option_context_add_main_entries (opt_context, options, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+
+  if (trace_files) {
+    for (int i = 0; trace_files[i]; i++)
+      g_ptr_array_add (traces, g_strdup (trace_files[i]));
+  } else {
+    const char *builtin[] = { "swipe.trace", "pinch.trace", "typing.trace" };
+
+    for (int i = 0; i < G_N_ELEMENTS (builtin); i++)
+      g_ptr_array_add (traces, g_test_build_filename (G_TEST_DIST, "traces", builtin[i], NULL));
+  }
+
+  report = phoc_bench_report_new ("input-replay");
+
+  for (guint i = 0; i < traces->len; i++) {
+    g_autofree char *name = g_path_get_basename (g_ptr_array_index (traces, i));
+    g_autofree char *path = g_strdup_printf ("/phoc/bench/input-replay/%s", name);
+
+    PHOC_BENCH_ADD (path, bench_run_replay, g_ptr_array_index (traces, i));
+  }
+
+  ret = g_test_run ();
+
+  if (!phoc_bench_report_write (report, output_file, &err)) {
+    g_printerr ("Failed to write report: %s\n", err->message);
+    ret = 1;
+  }
+  g_clear_pointer (&report, phoc_bench_report_free);
+  g_clear_pointer (&trace_files, g_strfreev);
+  g_free (output_file);
+
+  return ret;
+}
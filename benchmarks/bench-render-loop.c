@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ * Drive scripted client scenarios against phoc and measure how long
+ * the compositor spends per output frame and how many allocations it
+ * does while doing so.
+ */
+
+#include "benchlib.h"
+#include "testlib-layer-shell.h"
+
+#include "desktop.h"
+#include "output.h"
+
+#define BENCH_TIMEOUT_SECONDS       300
+#define BENCH_WARMUP_ITERATIONS     10
+#define BENCH_DEFAULT_ITERATIONS    300
+#define BENCH_DEFAULT_WINDOWS       8
+#define BENCH_PANEL_HEIGHT          32
+#define BENCH_OSK_HEIGHT            300
+
+static int  n_iterations = BENCH_DEFAULT_ITERATIONS;
+static int  n_windows = BENCH_DEFAULT_WINDOWS;
+static char *output_file;
+
+static PhocBenchReport *report;
+
+typedef struct _BenchClient {
+  PhocTestClientGlobals *globals;
+  GPtrArray             *toplevels;
+  PhocBenchSurface      *animated;
+  PhocTestLayerSurface  *panel;
+  PhocTestLayerSurface  *osk;
+} BenchClient;
+
+typedef struct _BenchScenario {
+  const char *name;
+  void      (*setup)   (BenchClient *client);
+  void      (*iterate) (BenchClient *client, guint iteration);
+
+  /* Written by the compositor while recording */
+  int               recording;
+  PhocBenchSamples  frame_time_us;
+  PhocBenchSamples  frame_allocs;
+  guint64           idle_frames;
+
+  /* Written by the client */
+  PhocBenchSamples  iteration_time_us;
+  guint64           allocs;
+} BenchScenario;
+
+typedef struct _BenchOutputProbe {
+  BenchScenario     *scenario;
+  gboolean           committed;
+
+  struct wl_listener frame;
+  struct wl_listener commit;
+  struct wl_listener destroy;
+} BenchOutputProbe;
+
+/* Compositor side */
+
+static GPollFunc default_poll_func;
+static gint64    wakeup_us;
+static guint64   wakeup_allocs;
+
+/*
+ * A frame gets handled within a single iteration of the compositor's
+ * main loop so measure from the main loop waking up to the end of the
+ * frame. This includes handling the client requests that led to the
+ * frame.
+ */
+static gint
+bench_poll (GPollFD *fds, guint nfds, gint timeout)
+{
+  gint ret = default_poll_func (fds, nfds, timeout);
+
+  wakeup_allocs = phoc_bench_alloc_get_count ();
+  wakeup_us = g_get_monotonic_time ();
+
+  return ret;
+}
+
+/* PhocOutput's frame handler was added first so it already ran */
+static void
+handle_frame (struct wl_listener *listener, void *data)
+{
+  BenchOutputProbe *probe = wl_container_of (listener, probe, frame);
+  BenchScenario *scenario = probe->scenario;
+  gboolean committed = probe->committed;
+
+  probe->committed = FALSE;
+  if (!g_atomic_int_get (&scenario->recording))
+    return;
+
+  if (!committed) {
+    scenario->idle_frames++;
+    return;
+  }
+
+  phoc_bench_samples_add (&scenario->frame_time_us, g_get_monotonic_time () - wakeup_us);
+  phoc_bench_samples_add (&scenario->frame_allocs, phoc_bench_alloc_get_count () - wakeup_allocs);
+}
+
+
+static void
+handle_commit (struct wl_listener *listener, void *data)
+{
+  BenchOutputProbe *probe = wl_container_of (listener, probe, commit);
+
+  probe->committed = TRUE;
+}
+
+
+static void
+handle_destroy (struct wl_listener *listener, void *data)
+{
+  BenchOutputProbe *probe = wl_container_of (listener, probe, destroy);
+
+  wl_list_remove (&probe->frame.link);
+  wl_list_remove (&probe->commit.link);
+  wl_list_remove (&probe->destroy.link);
+  g_free (probe);
+}
+
+
+static void
+bench_output_probe_new (BenchScenario *scenario, struct wlr_output *wlr_output)
+{
+  BenchOutputProbe *probe = g_new0 (BenchOutputProbe, 1);
+
+  probe->scenario = scenario;
+
+  probe->frame.notify = handle_frame;
+  wl_signal_add (&wlr_output->events.frame, &probe->frame);
+
+  probe->commit.notify = handle_commit;
+  wl_signal_add (&wlr_output->events.commit, &probe->commit);
+
+  probe->destroy.notify = handle_destroy;
+  wl_signal_add (&wlr_output->events.destroy, &probe->destroy);
+}
+
+
+static gboolean
+bench_server_prepare (PhocServer *server, gpointer data)
+{
+  BenchScenario *scenario = data;
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output;
+  GPollFunc poll_func;
+
+  phoc_bench_alloc_track_thread (TRUE);
+
+  poll_func = g_main_context_get_poll_func (NULL);
+  if (poll_func != bench_poll) {
+    default_poll_func = poll_func;
+    g_main_context_set_poll_func (NULL, bench_poll);
+  }
+
+  wl_list_for_each (output, &desktop->outputs, link)
+    bench_output_probe_new (scenario, output->wlr_output);
+
+  return TRUE;
+}
+
+/* Client side */
+
+static guint32
+bench_color (guint iteration)
+{
+  return 0xFF000000 | ((iteration * 0x010305) & 0x00FFFFFF);
+}
+
+
+static PhocTestXdgToplevelSurface *
+bench_client_add_toplevel (BenchClient *client)
+{
+  PhocTestXdgToplevelSurface *xs;
+  g_autofree char *title = g_strdup_printf ("bench-%u", client->toplevels->len);
+
+  xs = phoc_test_xdg_toplevel_new_with_buffer (client->globals, 0, 0, title,
+                                               bench_color (client->toplevels->len));
+  g_ptr_array_add (client->toplevels, xs);
+
+  return xs;
+}
+
+/* N stacked toplevels, the topmost one animates */
+static void
+setup_windows (BenchClient *client)
+{
+  PhocTestXdgToplevelSurface *xs = NULL;
+
+  for (int i = 0; i < n_windows; i++)
+    xs = bench_client_add_toplevel (client);
+
+  g_assert_nonnull (xs);
+  client->animated = phoc_bench_surface_new (client->globals, xs->wl_surface, xs->width, xs->height);
+}
+
+/* A static toplevel with an animated panel (e.g. a clock) on top */
+static void
+setup_panel (BenchClient *client)
+{
+  guint32 anchor = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+    ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+    ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+
+  bench_client_add_toplevel (client);
+  client->panel = phoc_test_layer_surface_new (client->globals, 0, BENCH_PANEL_HEIGHT,
+                                               0xFF000000, anchor, BENCH_PANEL_HEIGHT);
+  client->animated = phoc_bench_surface_new (client->globals, client->panel->wl_surface,
+                                             client->panel->width, client->panel->height);
+}
+
+
+static void
+iterate_animate (BenchClient *client, guint iteration)
+{
+  phoc_bench_surface_draw (client->globals, client->animated, bench_color (iteration));
+}
+
+/* An animated toplevel while the OSK folds in and out */
+static void
+setup_osk (BenchClient *client)
+{
+  PhocTestXdgToplevelSurface *xs = bench_client_add_toplevel (client);
+
+  client->animated = phoc_bench_surface_new (client->globals, xs->wl_surface, xs->width, xs->height);
+}
+
+
+static void
+iterate_osk (BenchClient *client, guint iteration)
+{
+  guint32 anchor = ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM |
+    ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+    ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+
+  if (client->osk) {
+    g_clear_pointer (&client->osk, phoc_test_layer_surface_free);
+  } else {
+    client->osk = phoc_test_layer_surface_new (client->globals, 0, BENCH_OSK_HEIGHT,
+                                               0xFF808080, anchor, BENCH_OSK_HEIGHT);
+  }
+
+  phoc_bench_surface_draw (client->globals, client->animated, bench_color (iteration));
+}
+
+/* Thumbnails of a static toplevel as used by the overview */
+static void
+setup_thumbnails (BenchClient *client)
+{
+  bench_client_add_toplevel (client);
+}
+
+
+static void
+iterate_thumbnails (BenchClient *client, guint iteration)
+{
+  PhocTestXdgToplevelSurface *xs = g_ptr_array_index (client->toplevels, 0);
+  PhocTestScreencopyFrame frame = { 0 };
+  struct zwlr_screencopy_frame_v1 *handle;
+
+  handle = phosh_private_get_thumbnail (client->globals->phosh,
+                                        xs->foreign_toplevel->handle,
+                                        xs->width / 2, xs->height / 2);
+  phoc_test_client_capture_frame (client->globals, &frame, handle);
+  zwlr_screencopy_frame_v1_destroy (handle);
+  phoc_test_buffer_free (&frame.buffer);
+}
+
+
+static gboolean
+bench_client_run (PhocTestClientGlobals *globals, gpointer data)
+{
+  BenchScenario *scenario = data;
+  BenchClient client = {
+    .globals = globals,
+    .toplevels = g_ptr_array_new_with_free_func ((GDestroyNotify)phoc_test_xdg_toplevel_free),
+  };
+  guint64 allocs;
+
+  scenario->setup (&client);
+
+  for (guint i = 0; i < BENCH_WARMUP_ITERATIONS; i++)
+    scenario->iterate (&client, i);
+
+  allocs = phoc_bench_alloc_get_count ();
+  g_atomic_int_set (&scenario->recording, TRUE);
+  for (guint i = 0; i < n_iterations; i++) {
+    gint64 start_us = g_get_monotonic_time ();
+
+    scenario->iterate (&client, BENCH_WARMUP_ITERATIONS + i);
+    phoc_bench_samples_add (&scenario->iteration_time_us, g_get_monotonic_time () - start_us);
+  }
+  g_atomic_int_set (&scenario->recording, FALSE);
+  scenario->allocs = phoc_bench_alloc_get_count () - allocs;
+
+  g_clear_pointer (&client.animated, phoc_bench_surface_free);
+  g_clear_pointer (&client.osk, phoc_test_layer_surface_free);
+  g_clear_pointer (&client.panel, phoc_test_layer_surface_free);
+  g_ptr_array_unref (client.toplevels);
+
+  return TRUE;
+}
+
+
+static void
+bench_run_scenario (PhocTestFixture *fixture, gconstpointer data)
+{
+  BenchScenario *scenario = (BenchScenario *)data;
+  PhocTestClientIface iface = {
+    .server_prepare = bench_server_prepare,
+    .client_run     = bench_client_run,
+    .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_bench_samples_init (&scenario->frame_time_us);
+  phoc_bench_samples_init (&scenario->frame_allocs);
+  phoc_bench_samples_init (&scenario->iteration_time_us);
+
+  phoc_test_client_run (BENCH_TIMEOUT_SECONDS, &iface, scenario);
+
+  phoc_bench_report_begin_scenario (report, scenario->name);
+  phoc_bench_report_add_uint (report, "iterations", n_iterations);
+  phoc_bench_report_add_uint (report, "frames", phoc_bench_samples_get_len (&scenario->frame_time_us));
+  phoc_bench_report_add_uint (report, "idle_frames", scenario->idle_frames);
+  phoc_bench_report_add_samples (report, "frame_time_us", &scenario->frame_time_us);
+  phoc_bench_report_add_samples (report, "allocs_per_frame", &scenario->frame_allocs);
+  phoc_bench_report_add_samples (report, "iteration_time_us", &scenario->iteration_time_us);
+  phoc_bench_report_add_uint (report, "allocs_per_iteration", scenario->allocs / n_iterations);
+  phoc_bench_report_end_scenario (report);
+
+  phoc_bench_samples_clear (&scenario->frame_time_us);
+  phoc_bench_samples_clear (&scenario->frame_allocs);
+  phoc_bench_samples_clear (&scenario->iteration_time_us);
+}
+
+
+static BenchScenario scenarios[] = {
+  { .name = "windows",    .setup = setup_windows,    .iterate = iterate_animate },
+  { .name = "panel",      .setup = setup_panel,      .iterate = iterate_animate },
+  { .name = "osk",        .setup = setup_osk,        .iterate = iterate_osk },
+  { .name = "thumbnails", .setup = setup_thumbnails, .iterate = iterate_thumbnails },
+};
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_autoptr (GOptionContext) opt_context = NULL;
+  g_autoptr (GError) err = NULL;
+  int ret;
+  const GOptionEntry options [] = {
+    {"iterations", 'i', 0, G_OPTION_ARG_INT, &n_iterations,
+     "Number of measured iterations per scenario", NULL},
+    {"windows", 'n', 0, G_OPTION_ARG_INT, &n_windows,
+     "Number of toplevels in the 'windows' scenario", NULL},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output_file,
+     "Write the JSON report to this file instead of stdout", NULL},
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+  };
+
+  g_test_init (&argc, &argv, NULL);
+
+  opt_context = g_option_context_new ("- phoc render loop benchmark");
+  g_option_context_add_main_entries (opt_context, options, NULL);
+  if (!g_option_context_parse (opt_context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    return 1;
+  }
+  n_iterations = MAX (n_iterations, 1);
+  n_windows = MAX (n_windows, 1);
+
+  report = phoc_bench_report_new ("render-loop");
+
+  for (int i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+    g_autofree char *path = g_strdup_printf ("/phoc/bench/render-loop/%s", scenarios[i].name);
+
+    PHOC_BENCH_ADD (path, bench_run_scenario, &scenarios[i]);
+  }
+
+  ret = g_test_run ();
+
+  if (!phoc_bench_report_write (report, output_file, &err)) {
+    g_printerr ("Failed to write report: %s\n", err->message);
+    ret = 1;
+  }
+  g_clear_pointer (&report, phoc_bench_report_free);
+  g_free (output_file);
+
+  return ret;
+}
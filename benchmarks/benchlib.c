@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "benchlib.h"
+
+#include <glib/gstdio.h>
+#include <math.h>
+
+struct _PhocBenchReport {
+  char      *benchmark;
+  GPtrArray *scenarios;
+  GString   *current;
+  guint      n_members;
+};
+
+static const double percentiles[] = { 50.0, 90.0, 99.0 };
+
+static const char bench_config[] =
+  "[core]\n"
+  "xwayland=false\n";
+
+
+void
+phoc_bench_samples_init (PhocBenchSamples *samples)
+{
+  samples->values = g_array_new (FALSE, FALSE, sizeof (double));
+}
+
+
+void
+phoc_bench_samples_clear (PhocBenchSamples *samples)
+{
+  g_clear_pointer (&samples->values, g_array_unref);
+}
+
+
+void
+phoc_bench_samples_add (PhocBenchSamples *samples, double value)
+{
+  g_array_append_val (samples->values, value);
+}
+
+
+guint
+phoc_bench_samples_get_len (PhocBenchSamples *samples)
+{
+  return samples->values->len;
+}
+
+
+static int
+compare_double (gconstpointer a, gconstpointer b)
+{
+  double da = *(const double *)a;
+  double db = *(const double *)b;
+
+  return (da > db) - (da < db);
+}
+
+/**
+ * phoc_bench_samples_percentile:
+ * @samples: The samples
+ * @percentile: The percentile in the range [0, 100]
+ *
+ * Get the given percentile using the nearest-rank method.
+ *
+ * Returns: The percentile or `0.0` if there are no samples.
+ */
+double
+phoc_bench_samples_percentile (PhocBenchSamples *samples, double percentile)
+{
+  g_autoptr (GArray) sorted = NULL;
+  guint rank;
+
+  g_assert (percentile >= 0.0 && percentile <= 100.0);
+
+  if (samples->values->len == 0)
+    return 0.0;
+
+  sorted = g_array_copy (samples->values);
+  g_array_sort (sorted, compare_double);
+
+  rank = (guint) ceil (percentile / 100.0 * sorted->len);
+  rank = CLAMP (rank, 1, sorted->len);
+
+  return g_array_index (sorted, double, rank - 1);
+}
+
+
+static double
+phoc_bench_samples_mean (PhocBenchSamples *samples)
+{
+  double sum = 0.0;
+
+  if (samples->values->len == 0)
+    return 0.0;
+
+  for (guint i = 0; i < samples->values->len; i++)
+    sum += g_array_index (samples->values, double, i);
+
+  return sum / samples->values->len;
+}
+
+
+static void
+json_append_string (GString *str, const char *value)
+{
+  g_autofree char *escaped = g_strescape (value ?: "", NULL);
+
+  g_string_append_printf (str, "\"%s\"", escaped);
+}
+
+
+static void
+phoc_bench_report_append_key (PhocBenchReport *report, const char *key)
+{
+  g_assert (report->current);
+
+  g_string_append (report->current, report->n_members ? ",\n      " : "\n      ");
+  json_append_string (report->current, key);
+  g_string_append (report->current, ": ");
+  report->n_members++;
+}
+
+
+PhocBenchReport *
+phoc_bench_report_new (const char *benchmark)
+{
+  PhocBenchReport *report = g_new0 (PhocBenchReport, 1);
+
+  report->benchmark = g_strdup (benchmark);
+  report->scenarios = g_ptr_array_new_with_free_func (g_free);
+
+  return report;
+}
+
+
+void
+phoc_bench_report_begin_scenario (PhocBenchReport *report, const char *name)
+{
+  g_assert (report->current == NULL);
+
+  report->current = g_string_new ("    {");
+  report->n_members = 0;
+
+  phoc_bench_report_append_key (report, "name");
+  json_append_string (report->current, name);
+}
+
+
+void
+phoc_bench_report_add_uint (PhocBenchReport *report, const char *key, guint64 value)
+{
+  phoc_bench_report_append_key (report, key);
+  g_string_append_printf (report->current, "%" G_GUINT64_FORMAT, value);
+}
+
+/**
+ * phoc_bench_report_add_samples:
+ * @report: The report
+ * @key: The key to store the samples under
+ * @samples: The samples to summarize
+ *
+ * Adds a summary of the samples (count, min, mean, percentiles and
+ * max) to the current scenario.
+ */
+void
+phoc_bench_report_add_samples (PhocBenchReport *report, const char *key, PhocBenchSamples *samples)
+{
+  GString *str = report->current;
+
+  phoc_bench_report_append_key (report, key);
+
+  g_string_append_printf (str, "{ \"count\": %u", phoc_bench_samples_get_len (samples));
+  g_string_append_printf (str, ", \"min\": %.3f", phoc_bench_samples_percentile (samples, 0.0));
+  g_string_append_printf (str, ", \"mean\": %.3f", phoc_bench_samples_mean (samples));
+  for (int i = 0; i < G_N_ELEMENTS (percentiles); i++) {
+    g_string_append_printf (str, ", \"p%d\": %.3f", (int)percentiles[i],
+                            phoc_bench_samples_percentile (samples, percentiles[i]));
+  }
+  g_string_append_printf (str, ", \"max\": %.3f }", phoc_bench_samples_percentile (samples, 100.0));
+}
+
+
+void
+phoc_bench_report_end_scenario (PhocBenchReport *report)
+{
+  g_assert (report->current);
+
+  g_string_append (report->current, "\n    }");
+  g_ptr_array_add (report->scenarios, g_string_free (report->current, FALSE));
+  report->current = NULL;
+}
+
+/**
+ * phoc_bench_report_write:
+ * @report: The report
+ * @filename:(nullable): The file to write to
+ * @error: The return location for an error
+ *
+ * Writes the report as JSON to `filename`. If `filename` is `NULL`
+ * the report is printed to stdout.
+ *
+ * Returns: %TRUE on success, otherwise %FALSE
+ */
+gboolean
+phoc_bench_report_write (PhocBenchReport *report, const char *filename, GError **error)
+{
+  g_autoptr (GString) str = g_string_new ("{\n");
+
+  g_assert (report->current == NULL);
+
+  g_string_append (str, "  \"benchmark\": ");
+  json_append_string (str, report->benchmark);
+  g_string_append (str, ",\n  \"backend\": ");
+  json_append_string (str, g_getenv ("WLR_BACKENDS"));
+  g_string_append (str, ",\n  \"renderer\": ");
+  json_append_string (str, g_getenv ("WLR_RENDERER"));
+  g_string_append (str, ",\n  \"scenarios\": [\n");
+  for (guint i = 0; i < report->scenarios->len; i++) {
+    g_string_append (str, g_ptr_array_index (report->scenarios, i));
+    g_string_append (str, i + 1 < report->scenarios->len ? ",\n" : "\n");
+  }
+  g_string_append (str, "  ]\n}\n");
+
+  if (filename == NULL) {
+    g_print ("%s", str->str);
+    return TRUE;
+  }
+
+  return g_file_set_contents (filename, str->str, str->len, error);
+}
+
+
+void
+phoc_bench_report_free (PhocBenchReport *report)
+{
+  if (report->current)
+    g_string_free (report->current, TRUE);
+  g_ptr_array_unref (report->scenarios);
+  g_free (report->benchmark);
+  g_free (report);
+}
+
+
+static void
+frame_handle_done (void *data, struct wl_callback *callback, uint32_t time)
+{
+  PhocBenchSurface *bs = data;
+
+  bs->frame_done = TRUE;
+  wl_callback_destroy (callback);
+}
+
+
+static const struct wl_callback_listener frame_listener = {
+  .done = frame_handle_done,
+};
+
+/**
+ * phoc_bench_surface_new:
+ * @globals: The wayland globals
+ * @wl_surface: The surface to draw to
+ * @width: The buffer width
+ * @height: The buffer height
+ *
+ * Wraps an existing surface so it can get new content with every
+ * iteration of a benchmark. The surface itself isn't owned.
+ *
+ * Returns: The bench surface. Free with `phoc_bench_surface_free`.
+ */
+PhocBenchSurface *
+phoc_bench_surface_new (PhocTestClientGlobals *globals,
+                        struct wl_surface     *wl_surface,
+                        guint32                width,
+                        guint32                height)
+{
+  PhocBenchSurface *bs = g_new0 (PhocBenchSurface, 1);
+
+  bs->wl_surface = wl_surface;
+  bs->frame_done = TRUE;
+  for (int i = 0; i < G_N_ELEMENTS (bs->buffers); i++) {
+    phoc_test_client_create_shm_buffer (globals, &bs->buffers[i], width, height,
+                                        WL_SHM_FORMAT_XRGB8888);
+  }
+
+  return bs;
+}
+
+
+void
+phoc_bench_surface_free (PhocBenchSurface *bs)
+{
+  for (int i = 0; i < G_N_ELEMENTS (bs->buffers); i++)
+    phoc_test_buffer_free (&bs->buffers[i]);
+  g_free (bs);
+}
+
+/**
+ * phoc_bench_surface_commit:
+ * @bs: The bench surface
+ * @color: The color to fill the next buffer with
+ *
+ * Fill the next buffer, commit it and request a frame callback.
+ * `frame_done` is set once the compositor presented the content.
+ */
+void
+phoc_bench_surface_commit (PhocBenchSurface *bs, guint32 color)
+{
+  PhocTestBuffer *buffer = &bs->buffers[bs->current];
+  struct wl_callback *callback;
+
+  for (int i = 0; i < buffer->width * buffer->height * 4; i += 4)
+    *(guint32*)(buffer->shm_data + i) = color;
+
+  bs->frame_done = FALSE;
+  callback = wl_surface_frame (bs->wl_surface);
+  wl_callback_add_listener (callback, &frame_listener, bs);
+
+  wl_surface_attach (bs->wl_surface, buffer->wl_buffer, 0, 0);
+  wl_surface_damage (bs->wl_surface, 0, 0, buffer->width, buffer->height);
+  wl_surface_commit (bs->wl_surface);
+
+  bs->current = (bs->current + 1) % G_N_ELEMENTS (bs->buffers);
+}
+
+/**
+ * phoc_bench_surface_draw:
+ * @globals: The wayland globals
+ * @bs: The bench surface
+ * @color: The color to fill the next buffer with
+ *
+ * Like `phoc_bench_surface_commit` but waits until the compositor
+ * presented the content. This is what an animating client does.
+ */
+void
+phoc_bench_surface_draw (PhocTestClientGlobals *globals, PhocBenchSurface *bs, guint32 color)
+{
+  phoc_bench_surface_commit (bs, color);
+
+  while (!bs->frame_done && wl_display_dispatch (globals->display) != -1) {
+  }
+  g_assert_true (bs->frame_done);
+}
+
+/**
+ * phoc_bench_setup:
+ * @fixture: Test fixture
+ * @data: Data for test setup
+ *
+ * Like `phoc_test_setup()` but keeps the backend and display
+ * configuration from the environment so benchmarks can run on the
+ * headless backend. A minimal `phoc.ini` is provided via
+ * `XDG_CONFIG_HOME`.
+ */
+void
+phoc_bench_setup (PhocTestFixture *fixture, gconstpointer data)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *config = NULL;
+
+  fixture->bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+  g_test_dbus_up (fixture->bus);
+
+  g_setenv ("NO_AT_BRIDGE", "1", TRUE);
+
+  fixture->tmpdir = g_dir_make_tmp ("phoc-bench-comp.XXXXXX", &err);
+  g_assert_no_error (err);
+
+  g_setenv ("XDG_RUNTIME_DIR", fixture->tmpdir, TRUE);
+
+  /* Don't pick up the user's or the source tree's configuration */
+  config = g_build_filename (fixture->tmpdir, "phoc.ini", NULL);
+  g_file_set_contents (config, bench_config, -1, &err);
+  g_assert_no_error (err);
+  g_setenv ("XDG_CONFIG_HOME", fixture->tmpdir, TRUE);
+  g_setenv ("XDG_CONFIG_DIRS", fixture->tmpdir, TRUE);
+}
+
+
+void
+phoc_bench_teardown (PhocTestFixture *fixture, gconstpointer unused)
+{
+  g_autoptr (GDir) dir = NULL;
+  const char *name;
+
+  g_test_dbus_down (fixture->bus);
+  g_clear_object (&fixture->bus);
+
+  /* Only phoc.ini, the Wayland socket and its lock file are expected here */
+  dir = g_dir_open (fixture->tmpdir, 0, NULL);
+  while (dir && (name = g_dir_read_name (dir))) {
+    g_autofree char *path = g_build_filename (fixture->tmpdir, name, NULL);
+
+    g_remove (path);
+  }
+  g_rmdir (fixture->tmpdir);
+  g_free (fixture->tmpdir);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib.h"
+
+#pragma once
+
+G_BEGIN_DECLS
+
+/**
+ * PhocBenchSamples:
+ *
+ * A growing list of measurements (e.g. frame times in µs or
+ * allocations per frame) that can be reduced to percentiles.
+ */
+typedef struct _PhocBenchSamples {
+  GArray *values;
+} PhocBenchSamples;
+
+void     phoc_bench_samples_init       (PhocBenchSamples *samples);
+void     phoc_bench_samples_clear      (PhocBenchSamples *samples);
+void     phoc_bench_samples_add        (PhocBenchSamples *samples, double value);
+guint    phoc_bench_samples_get_len    (PhocBenchSamples *samples);
+double   phoc_bench_samples_percentile (PhocBenchSamples *samples, double percentile);
+
+/* JSON report */
+typedef struct _PhocBenchReport PhocBenchReport;
+
+PhocBenchReport *phoc_bench_report_new            (const char       *benchmark);
+void             phoc_bench_report_begin_scenario (PhocBenchReport  *report,
+                                                   const char       *name);
+void             phoc_bench_report_add_uint       (PhocBenchReport  *report,
+                                                   const char       *key,
+                                                   guint64           value);
+void             phoc_bench_report_add_samples    (PhocBenchReport  *report,
+                                                   const char       *key,
+                                                   PhocBenchSamples *samples);
+void             phoc_bench_report_end_scenario   (PhocBenchReport  *report);
+gboolean         phoc_bench_report_write          (PhocBenchReport  *report,
+                                                   const char       *filename,
+                                                   GError          **error);
+void             phoc_bench_report_free           (PhocBenchReport  *report);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocBenchReport, phoc_bench_report_free)
+
+/* Client surfaces */
+typedef struct _PhocBenchSurface {
+  struct wl_surface *wl_surface;
+  PhocTestBuffer     buffers[2];
+  guint              current;
+  gboolean           frame_done;
+} PhocBenchSurface;
+
+PhocBenchSurface *phoc_bench_surface_new    (PhocTestClientGlobals *globals,
+                                             struct wl_surface     *wl_surface,
+                                             guint32                width,
+                                             guint32                height);
+void              phoc_bench_surface_free   (PhocBenchSurface      *surface);
+void              phoc_bench_surface_commit (PhocBenchSurface      *surface,
+                                             guint32                color);
+void              phoc_bench_surface_draw   (PhocTestClientGlobals *globals,
+                                             PhocBenchSurface      *surface,
+                                             guint32                color);
+
+/* Allocation counting, see bench-alloc.c */
+void     phoc_bench_alloc_track_thread (gboolean track);
+guint64  phoc_bench_alloc_get_count    (void);
+
+/* Fixtures */
+void phoc_bench_setup    (PhocTestFixture *fixture, gconstpointer data);
+void phoc_bench_teardown (PhocTestFixture *fixture, gconstpointer unused);
+#define PHOC_BENCH_ADD(name, func, data) g_test_add ((name), PhocTestFixture, (data), \
+                                                     phoc_bench_setup,                \
+                                                     (func),                          \
+                                                     phoc_bench_teardown)
+
+G_END_DECLS
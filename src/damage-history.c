@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-damage-history"
+
+#include "phoc-config.h"
+
+#include "damage-history.h"
+
+/**
+ * PhocDamageHistory:
+ *
+ * A ring of the most recent damage regions, each tagged with a
+ * monotonically increasing sequence number. This allows consumers
+ * that render a view outside of the output's render loop (thumbnails,
+ * screen capture, snapshots) to ask "what changed since sequence N"
+ * and only redraw that.
+ *
+ * Regions are stored as is, so all of them should use the same
+ * coordinate space (e.g. view local coordinates).
+ */
+struct _PhocDamageHistory {
+  pixman_region32_t regions[PHOC_DAMAGE_HISTORY_SIZE];
+  /* Sequence number of the most recent entry */
+  guint64           seq;
+  /* Oldest sequence number we can provide the damage for */
+  guint64           valid_since;
+};
+
+
+static pixman_region32_t *
+get_region (PhocDamageHistory *self, guint64 seq)
+{
+  return &self->regions[seq % PHOC_DAMAGE_HISTORY_SIZE];
+}
+
+
+PhocDamageHistory *
+phoc_damage_history_new (void)
+{
+  PhocDamageHistory *self = g_new0 (PhocDamageHistory, 1);
+
+  for (int i = 0; i < PHOC_DAMAGE_HISTORY_SIZE; i++)
+    pixman_region32_init (&self->regions[i]);
+
+  return self;
+}
+
+
+void
+phoc_damage_history_free (PhocDamageHistory *self)
+{
+  for (int i = 0; i < PHOC_DAMAGE_HISTORY_SIZE; i++)
+    pixman_region32_fini (&self->regions[i]);
+
+  g_free (self);
+}
+
+/**
+ * phoc_damage_history_add:
+ * @self: The damage history
+ * @damage: The damaged region
+ *
+ * Record a new damage region. This bumps the sequence number even if
+ * @damage is empty.
+ *
+ * Returns: The sequence number of the new entry
+ */
+guint64
+phoc_damage_history_add (PhocDamageHistory *self, const pixman_region32_t *damage)
+{
+  g_assert (self);
+
+  self->seq++;
+  pixman_region32_copy (get_region (self, self->seq), (pixman_region32_t *)damage);
+
+  return self->seq;
+}
+
+/**
+ * phoc_damage_history_invalidate:
+ * @self: The damage history
+ *
+ * Mark everything as damaged. Consumers asking for damage since a
+ * sequence number before this call need to redraw fully.
+ *
+ * Returns: The sequence number of the new entry
+ */
+guint64
+phoc_damage_history_invalidate (PhocDamageHistory *self)
+{
+  g_assert (self);
+
+  self->seq++;
+  pixman_region32_clear (get_region (self, self->seq));
+  self->valid_since = self->seq;
+
+  return self->seq;
+}
+
+/**
+ * phoc_damage_history_get_seq:
+ * @self: The damage history
+ *
+ * Get the sequence number of the most recent entry. Consumers store
+ * this after they rendered and pass it to
+ * `phoc_damage_history_get_since()` the next time.
+ *
+ * Returns: The current sequence number
+ */
+guint64
+phoc_damage_history_get_seq (PhocDamageHistory *self)
+{
+  g_assert (self);
+
+  return self->seq;
+}
+
+/**
+ * phoc_damage_history_get_since:
+ * @self: The damage history
+ * @seq: The sequence number the consumer last rendered
+ * @damage: (out): An initialized region to store the damage in
+ *
+ * Get the damage accumulated after sequence number @seq.
+ *
+ * Returns: %TRUE if @damage holds everything that changed since @seq,
+ *  %FALSE if the history doesn't go back that far (or got invalidated)
+ *  in which case the consumer must redraw fully.
+ */
+gboolean
+phoc_damage_history_get_since (PhocDamageHistory *self, guint64 seq, pixman_region32_t *damage)
+{
+  g_assert (self);
+
+  pixman_region32_clear (damage);
+
+  if (seq > self->seq) {
+    g_warning ("Sequence number %" G_GUINT64_FORMAT " is from the future", seq);
+    return FALSE;
+  }
+
+  if (seq < self->valid_since || self->seq - seq > PHOC_DAMAGE_HISTORY_SIZE)
+    return FALSE;
+
+  for (guint64 i = seq + 1; i <= self->seq; i++)
+    pixman_region32_union (damage, damage, get_region (self, i));
+
+  return TRUE;
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <pixman.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_DAMAGE_HISTORY_SIZE 16
+
+typedef struct _PhocDamageHistory PhocDamageHistory;
+
+PhocDamageHistory *phoc_damage_history_new        (void);
+void               phoc_damage_history_free       (PhocDamageHistory       *self);
+guint64            phoc_damage_history_add        (PhocDamageHistory       *self,
+                                                   const pixman_region32_t *damage);
+guint64            phoc_damage_history_invalidate (PhocDamageHistory       *self);
+guint64            phoc_damage_history_get_seq    (PhocDamageHistory       *self);
+gboolean           phoc_damage_history_get_since  (PhocDamageHistory       *self,
+                                                   guint64                  seq,
+                                                   pixman_region32_t       *damage);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocDamageHistory, phoc_damage_history_free)
+
+G_END_DECLS
@@ -11,7 +11,10 @@
 #include "phoc-config.h"
 #include "phoc-enums.h"
 #include "debug-control.h"
+#include "desktop-xwayland.h"
+#include "output.h"
 #include "server.h"
+#include "suspend-policy.h"
 
 #include <gio/gio.h>
 
@@ -46,9 +49,85 @@ G_DEFINE_TYPE_WITH_CODE (PhocDebugControl, phoc_debug_control,
                          G_IMPLEMENT_INTERFACE (PHOC_DBUS_TYPE_DEBUG_CONTROL,
                                                 phoc_dbus_debug_control_iface_init))
 
+static gboolean
+phoc_debug_control_handle_get_event_loop_stats (PhocDBusDebugControl  *object,
+                                                GDBusMethodInvocation *invocation,
+                                                gboolean               reset)
+{
+  PhocServer *server = phoc_server_get_default ();
+
+  phoc_dbus_debug_control_complete_get_event_loop_stats (object,
+                                                         invocation,
+                                                         phoc_server_get_event_loop_stats (server,
+                                                                                           reset));
+  return TRUE;
+}
+
+
+static gboolean
+phoc_debug_control_handle_get_xwayland_stats (PhocDBusDebugControl  *object,
+                                              GDBusMethodInvocation *invocation)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+
+  phoc_dbus_debug_control_complete_get_xwayland_stats (object,
+                                                       invocation,
+                                                       phoc_desktop_get_xwayland_stats (desktop));
+  return TRUE;
+}
+
+
+static gboolean
+phoc_debug_control_handle_get_refresh_stats (PhocDBusDebugControl  *object,
+                                             GDBusMethodInvocation *invocation)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  GVariantBuilder builder;
+  PhocOutput *output;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{ut}}"));
+  wl_list_for_each (output, &desktop->outputs, link) {
+    g_variant_builder_add (&builder, "{s@a{ut}}",
+                           phoc_output_get_name (output),
+                           phoc_output_get_refresh_stats (output));
+  }
+
+  phoc_dbus_debug_control_complete_get_refresh_stats (object,
+                                                      invocation,
+                                                      g_variant_builder_end (&builder));
+  return TRUE;
+}
+
+
+static gboolean
+phoc_debug_control_handle_get_frame_stats (PhocDBusDebugControl  *object,
+                                           GDBusMethodInvocation *invocation)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  GVariantBuilder builder;
+  PhocOutput *output;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{st}}"));
+  wl_list_for_each (output, &desktop->outputs, link) {
+    g_variant_builder_add (&builder, "{s@a{st}}",
+                           phoc_output_get_name (output),
+                           phoc_output_get_frame_stats (output));
+  }
+
+  phoc_dbus_debug_control_complete_get_frame_stats (object,
+                                                    invocation,
+                                                    g_variant_builder_end (&builder));
+  return TRUE;
+}
+
+
 static void
 phoc_dbus_debug_control_iface_init (PhocDBusDebugControlIface *iface)
 {
+  iface->handle_get_event_loop_stats = phoc_debug_control_handle_get_event_loop_stats;
+  iface->handle_get_xwayland_stats = phoc_debug_control_handle_get_xwayland_stats;
+  iface->handle_get_refresh_stats = phoc_debug_control_handle_get_refresh_stats;
+  iface->handle_get_frame_stats = phoc_debug_control_handle_get_frame_stats;
 }
 
 
@@ -141,6 +220,23 @@ phoc_debug_control_set_server (PhocDebugControl *self, PhocServer *server)
                           self,
                           "log-domains",
                           G_BINDING_SYNC_CREATE | G_BINDING_BIDIRECTIONAL);
+
+  g_object_bind_property (phoc_server_get_suspend_policy (server),
+                          "n-suspended",
+                          self,
+                          "suspended-views",
+                          G_BINDING_SYNC_CREATE);
+  g_object_bind_property (phoc_server_get_suspend_policy (server),
+                          "memory-pressure",
+                          self,
+                          "memory-pressure",
+                          G_BINDING_SYNC_CREATE);
+
+  g_object_bind_property (server,
+                          "startup-timeline",
+                          self,
+                          "startup-timeline",
+                          G_BINDING_SYNC_CREATE);
 }
 
 
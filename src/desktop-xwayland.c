@@ -6,6 +6,8 @@
  * Author: Guido Günther <agx@sigxcpu.org>
  */
 
+#define G_LOG_DOMAIN "phoc-desktop-xwayland"
+
 #include "cursor.h"
 #include "desktop.h"
 #include "desktop-xwayland.h"
@@ -14,11 +16,60 @@
 
 
 #ifdef PHOC_XWAYLAND
+
+/* wlroots only respawns Xwayland lazily if it ran for more than 5s */
+#define XWAYLAND_MIN_IDLE_TIMEOUT 10
+
 static const char *atom_map[XWAYLAND_ATOM_LAST] = {
   "_NET_WM_WINDOW_TYPE_NORMAL",
   "_NET_WM_WINDOW_TYPE_DIALOG"
 };
 
+/* Tracks the lifetime of X11 surfaces to detect when Xwayland is idle */
+typedef struct {
+  PhocDesktop       *desktop;
+  struct wl_listener destroy;
+} PhocXWaylandSurfaceTracker;
+
+
+static void
+on_xwayland_idle_timeout (gpointer data)
+{
+  PhocDesktop *self = PHOC_DESKTOP (data);
+  struct wlr_xwayland_server *server = self->xwayland->server;
+
+  self->xwayland_idle_id = 0;
+
+  if (self->xwayland_n_surfaces || server == NULL || server->client == NULL)
+    return;
+
+  g_debug ("Xwayland idle, shutting it down");
+  self->xwayland_stats.n_idle_stops++;
+  /* As Xwayland runs in lazy mode wlroots relaunches it on the next
+   * X11 connection */
+  wl_client_destroy (server->client);
+}
+
+
+static void
+update_xwayland_idle (PhocDesktop *self)
+{
+  PhocConfig *config = phoc_server_get_config (phoc_server_get_default ());
+  guint timeout;
+
+  g_clear_handle_id (&self->xwayland_idle_id, g_source_remove);
+
+  if (!config->xwayland_lazy || config->xwayland_idle_timeout == 0)
+    return;
+
+  if (self->xwayland_n_surfaces || self->xwayland_stats.start_time == 0)
+    return;
+
+  timeout = MAX (config->xwayland_idle_timeout, XWAYLAND_MIN_IDLE_TIMEOUT);
+  self->xwayland_idle_id = g_timeout_add_seconds_once (timeout, on_xwayland_idle_timeout, self);
+  g_source_set_name_by_id (self->xwayland_idle_id, "[phoc] xwayland idle");
+}
+
 static void
 handle_xwayland_ready (struct wl_listener *listener,
                        void               *data)
@@ -60,6 +111,75 @@ handle_xwayland_ready (struct wl_listener *listener,
     PhocSeat *xwayland_seat = phoc_input_get_seat (input, PHOC_CONFIG_DEFAULT_SEAT_NAME);
     wlr_xwayland_set_seat (desktop->xwayland, xwayland_seat->seat);
   }
+
+  if (desktop->xwayland_stats.start_time) {
+    desktop->xwayland_stats.last_start_latency =
+      g_get_monotonic_time () - desktop->xwayland_stats.start_time;
+    g_debug ("Xwayland ready after %" G_GINT64_FORMAT "us",
+             desktop->xwayland_stats.last_start_latency);
+  }
+
+  update_xwayland_idle (desktop);
+}
+
+
+static void
+handle_xwayland_client_destroy (struct wl_listener *listener, void *data)
+{
+  PhocDesktop *self = wl_container_of (listener, self, xwayland_client_destroy);
+  struct wl_client *client = data;
+
+  wl_list_remove (&self->xwayland_client_destroy.link);
+  wl_list_init (&self->xwayland_client_destroy.link);
+
+  /* A restarted server is accounted for already */
+  if (self->xwayland && self->xwayland->server && self->xwayland->server->client &&
+      self->xwayland->server->client != client) {
+    return;
+  }
+
+  self->xwayland_stats.time_alive += g_get_monotonic_time () - self->xwayland_stats.start_time;
+  self->xwayland_stats.start_time = 0;
+  g_clear_handle_id (&self->xwayland_idle_id, g_source_remove);
+}
+
+
+static void
+handle_xwayland_server_start (struct wl_listener *listener, void *data)
+{
+  PhocDesktop *self = wl_container_of (listener, self, xwayland_server_start);
+  struct wlr_xwayland_server *server = self->xwayland->server;
+
+  g_debug ("Xwayland starting");
+
+  /* wlroots restarts Xwayland from within the old client's destroy
+   * signal so we might not have seen that one yet */
+  wl_list_remove (&self->xwayland_client_destroy.link);
+  wl_list_init (&self->xwayland_client_destroy.link);
+  if (self->xwayland_stats.start_time) {
+    self->xwayland_stats.time_alive += g_get_monotonic_time () - self->xwayland_stats.start_time;
+    self->xwayland_stats.start_time = 0;
+  }
+
+  self->xwayland_stats.n_starts++;
+  self->xwayland_stats.start_time = g_get_monotonic_time ();
+
+  if (server->client) {
+    self->xwayland_client_destroy.notify = handle_xwayland_client_destroy;
+    wl_client_add_destroy_listener (server->client, &self->xwayland_client_destroy);
+  }
+}
+
+
+static void
+handle_xwayland_server_destroy (struct wl_listener *listener, void *data)
+{
+  PhocDesktop *self = wl_container_of (listener, self, xwayland_server_destroy);
+
+  wl_list_remove (&self->xwayland_server_start.link);
+  wl_list_init (&self->xwayland_server_start.link);
+  wl_list_remove (&self->xwayland_server_destroy.link);
+  wl_list_init (&self->xwayland_server_destroy.link);
 }
 
 
@@ -78,10 +198,35 @@ handle_xwayland_remove_startup_id (struct wl_listener *listener, void *data)
 }
 
 
+static void
+handle_xwayland_surface_destroy (struct wl_listener *listener, void *data)
+{
+  PhocXWaylandSurfaceTracker *tracker = wl_container_of (listener, tracker, destroy);
+  PhocDesktop *self = tracker->desktop;
+
+  wl_list_remove (&tracker->destroy.link);
+  g_free (tracker);
+
+  g_assert (self->xwayland_n_surfaces > 0);
+  self->xwayland_n_surfaces--;
+  if (self->xwayland_n_surfaces == 0)
+    update_xwayland_idle (self);
+}
+
+
 static void
 handle_xwayland_surface (struct wl_listener *listener, void *data)
 {
+  PhocDesktop *self = wl_container_of (listener, self, xwayland_surface);
   struct wlr_xwayland_surface *surface = data;
+  PhocXWaylandSurfaceTracker *tracker = g_new0 (PhocXWaylandSurfaceTracker, 1);
+
+  tracker->desktop = self;
+  tracker->destroy.notify = handle_xwayland_surface_destroy;
+  wl_signal_add (&surface->events.destroy, &tracker->destroy);
+  self->xwayland_n_surfaces++;
+  g_clear_handle_id (&self->xwayland_idle_id, g_source_remove);
+
   g_debug ("new xwayland surface: title=%s, class=%s, instance=%s",
            surface->title, surface->class, surface->instance);
   wlr_xwayland_surface_ping (surface);
@@ -121,6 +266,15 @@ phoc_desktop_setup_xwayland (PhocDesktop *self)
     wl_signal_add (&self->xwayland->events.remove_startup_info, &self->xwayland_remove_startup_id);
     self->xwayland_remove_startup_id.notify = handle_xwayland_remove_startup_id;
 
+    wl_list_init (&self->xwayland_client_destroy.link);
+    wl_signal_add (&self->xwayland->server->events.start, &self->xwayland_server_start);
+    self->xwayland_server_start.notify = handle_xwayland_server_start;
+    wl_signal_add (&self->xwayland->server->events.destroy, &self->xwayland_server_destroy);
+    self->xwayland_server_destroy.notify = handle_xwayland_server_destroy;
+    /* Not lazy, so already started */
+    if (self->xwayland->server->client)
+      handle_xwayland_server_start (&self->xwayland_server_start, NULL);
+
     g_setenv ("DISPLAY", self->xwayland->display_name, true);
 
     if (!wlr_xcursor_manager_load (self->xcursor_manager, 1))
@@ -147,12 +301,51 @@ phoc_desktop_destroy_xwayland (PhocDesktop *self)
     wl_list_remove (&self->xwayland_surface.link);
     wl_list_remove (&self->xwayland_ready.link);
     wl_list_remove (&self->xwayland_remove_startup_id.link);
+    wl_list_remove (&self->xwayland_server_start.link);
+    wl_list_remove (&self->xwayland_server_destroy.link);
+    wl_list_remove (&self->xwayland_client_destroy.link);
+    wl_list_init (&self->xwayland_client_destroy.link);
   }
+  /* Prevent surface destruction from arming the idle timer */
+  self->xwayland_stats.start_time = 0;
 
   g_clear_pointer (&self->xcursor_manager, wlr_xcursor_manager_destroy);
   /* We need to shutdown Xwayland before disconnecting all clients, otherwise
    * wlroots will restart it automatically. */
   g_clear_pointer (&self->xwayland, wlr_xwayland_destroy);
+  g_clear_handle_id (&self->xwayland_idle_id, g_source_remove);
+}
+
+/**
+ * phoc_desktop_get_xwayland_stats:
+ * @self: The desktop
+ *
+ * Get statistics about the Xwayland server like the number of starts,
+ * the latency of the last start and the accumulated time it was
+ * running. Times are in microseconds.
+ *
+ * Returns: (transfer floating): The statistics as `a{st}`
+ */
+GVariant *
+phoc_desktop_get_xwayland_stats (PhocDesktop *self)
+{
+  GVariantBuilder builder;
+  gint64 time_alive = self->xwayland_stats.time_alive;
+
+  if (self->xwayland_stats.start_time)
+    time_alive += g_get_monotonic_time () - self->xwayland_stats.start_time;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+  g_variant_builder_add (&builder, "{st}", "running", (guint64)!!self->xwayland_stats.start_time);
+  g_variant_builder_add (&builder, "{st}", "n-starts", (guint64)self->xwayland_stats.n_starts);
+  g_variant_builder_add (&builder, "{st}", "n-idle-stops",
+                         (guint64)self->xwayland_stats.n_idle_stops);
+  g_variant_builder_add (&builder, "{st}", "n-surfaces", (guint64)self->xwayland_n_surfaces);
+  g_variant_builder_add (&builder, "{st}", "last-start-latency",
+                         (guint64)self->xwayland_stats.last_start_latency);
+  g_variant_builder_add (&builder, "{st}", "time-alive", (guint64)time_alive);
+
+  return g_variant_builder_end (&builder);
 }
 
 #else /* PHOC_XWAYLAND */
@@ -168,4 +361,11 @@ phoc_desktop_destroy_xwayland (PhocDesktop *self)
 {
 }
 
+
+GVariant *
+phoc_desktop_get_xwayland_stats (PhocDesktop *self)
+{
+  return g_variant_new_array (G_VARIANT_TYPE ("{st}"), NULL, 0);
+}
+
 #endif /* !PHOC_XWAYLAND */
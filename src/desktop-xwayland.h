@@ -9,7 +9,8 @@
 
 G_BEGIN_DECLS
 
-void phoc_desktop_setup_xwayland   (PhocDesktop *self);
-void phoc_desktop_destroy_xwayland (PhocDesktop *self);
+void      phoc_desktop_setup_xwayland     (PhocDesktop *self);
+void      phoc_desktop_destroy_xwayland   (PhocDesktop *self);
+GVariant *phoc_desktop_get_xwayland_stats (PhocDesktop *self);
 
 G_END_DECLS
@@ -41,6 +41,7 @@
 #include "output.h"
 #include "seat.h"
 #include "server.h"
+#include "suspend-policy.h"
 #include "color-rect.h"
 #include "timed-animation.h"
 #include "utils.h"
@@ -85,10 +86,13 @@ typedef struct _PhocDesktopPrivate {
   PhocIdleInhibit       *idle_inhibit;
 
   gboolean               enable_animations;
+  guint                  color_temperature;
 
   GSettings             *settings;
   GSettings             *interface_settings;
 
+  guint                  deferred_globals_id;
+
   /* Protocols from wlroots */
   struct wlr_data_control_manager_v1 *data_control_manager_v1;
   struct wlr_idle_notifier_v1 *idle_notifier_v1;
@@ -204,12 +208,16 @@ layer_surface_at (PhocOutput                     *output,
                   double                         *sx,
                   double                         *sy)
 {
-  GQueue *layer_surfaces = phoc_output_get_layer_surfaces_for_layer (output, layer);
+  GSequence *layer_surfaces = phoc_output_get_layer_surfaces_for_layer (output, layer);
 
-  for (GList *l = layer_surfaces->tail; l; l = l->prev) {
-    PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (l->data);
+  for (GSequenceIter *iter = g_sequence_get_end_iter (layer_surfaces);
+       !g_sequence_iter_is_begin (iter);) {
+    PhocLayerSurface *layer_surface;
     struct wlr_surface *sub;
 
+    iter = g_sequence_iter_prev (iter);
+    layer_surface = PHOC_LAYER_SURFACE (g_sequence_get (iter));
+
     if (!phoc_layer_surface_get_mapped (layer_surface))
       continue;
 
@@ -322,7 +330,7 @@ phoc_desktop_view_check_visibility (PhocDesktop *self, PhocView *view)
   PhocDesktopPrivate *priv;
   PhocOutput *output;
   PhocView *top_view;
-  GQueue *layer_surfaces;
+  GSequence *layer_surfaces;
   gboolean visible = TRUE;
 
   g_assert (PHOC_IS_DESKTOP (self));
@@ -343,8 +351,10 @@ phoc_desktop_view_check_visibility (PhocDesktop *self, PhocView *view)
 
   output = wl_container_of (self->outputs.next, output, link);
   layer_surfaces = phoc_output_get_layer_surfaces_for_layer (output, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY);
-  for (GList *l = layer_surfaces->head; l; l = l->next) {
-    PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (l->data);
+  for (GSequenceIter *iter = g_sequence_get_begin_iter (layer_surfaces);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter)) {
+    PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (g_sequence_get (iter));
 
     if (phoc_layer_surface_covers_output (layer_surface)) {
       visible = FALSE;
@@ -377,6 +387,119 @@ phoc_desktop_view_check_visibility (PhocDesktop *self, PhocView *view)
   return visible;
 }
 
+/* Whether blitting one output's buffers onto the other is lossless */
+static gboolean
+outputs_match (PhocOutput *output, PhocOutput *source)
+{
+  return output->wlr_output->width == source->wlr_output->width &&
+    output->wlr_output->height == source->wlr_output->height &&
+    output->wlr_output->transform == source->wlr_output->transform;
+}
+
+
+static PhocOutput *
+find_mirror_source (PhocDesktop *self, PhocOutput *output)
+{
+  PhocConfig *config = phoc_server_get_config (phoc_server_get_default ());
+  PhocOutputConfig *output_config = phoc_config_get_output (config, output);
+  struct wlr_box box, source_box;
+  PhocOutput *source;
+
+  wlr_output_layout_get_box (self->layout, output->wlr_output, &box);
+
+  if (output_config && output_config->mirror) {
+    source = phoc_desktop_find_output_by_name (self, output_config->mirror);
+    if (source == NULL)
+      return NULL;
+
+    /* Output management placed the output somewhere else */
+    wlr_output_layout_get_box (self->layout, source->wlr_output, &source_box);
+    if (box.x != source_box.x || box.y != source_box.y)
+      return NULL;
+
+    return source;
+  }
+
+  /* Outputs showing the same part of the layout at the same resolution
+   * mirror the first one. Others keep rendering at their own resolution. */
+  wl_list_for_each (source, &self->outputs, link) {
+    if (source == output)
+      break;
+
+    if (!source->wlr_output->enabled)
+      continue;
+
+    wlr_output_layout_get_box (self->layout, source->wlr_output, &source_box);
+    if (wlr_box_equal (&box, &source_box) && outputs_match (output, source))
+      return source;
+  }
+
+  return NULL;
+}
+
+/*
+ * Let outputs that show another output's content blit that output's
+ * frames rather than rendering everything a second time.
+ */
+static void
+update_mirrors (PhocDesktop *self)
+{
+  PhocOutput *output;
+
+  wl_list_for_each (output, &self->outputs, link) {
+    PhocOutput *source = NULL;
+
+    if (output->wlr_output->enabled)
+      source = find_mirror_source (self, output);
+
+    /* Don't mirror disabled outputs or mirrors */
+    if (source == output ||
+        (source && (!source->wlr_output->enabled || phoc_output_get_mirror_source (source)))) {
+      source = NULL;
+    }
+
+    phoc_output_set_mirror_source (output, source);
+  }
+}
+
+/*
+ * Move outputs configured to mirror another output to that output's
+ * position. This only happens when one of them gets added so output
+ * management can place the output elsewhere later on.
+ */
+static void
+place_mirrors (PhocDesktop *self, PhocOutput *new_output)
+{
+  PhocConfig *config = phoc_server_get_config (phoc_server_get_default ());
+  PhocOutput *output;
+
+  wl_list_for_each (output, &self->outputs, link) {
+    PhocOutputConfig *output_config = phoc_config_get_output (config, output);
+    struct wlr_box source_box;
+    PhocOutput *source;
+
+    if (output_config == NULL || output_config->mirror == NULL)
+      continue;
+
+    source = phoc_desktop_find_output_by_name (self, output_config->mirror);
+    if (source == NULL || source == output)
+      continue;
+
+    if (output != new_output && source != new_output)
+      continue;
+
+    if (!output->wlr_output->enabled || !source->wlr_output->enabled)
+      continue;
+
+    wlr_output_layout_get_box (self->layout, source->wlr_output, &source_box);
+    /* Emits a layout change that updates the mirrors */
+    wlr_output_layout_add (self->layout, output->wlr_output, source_box.x, source_box.y);
+    output->lx = source_box.x;
+    output->ly = source_box.y;
+  }
+}
+
+
 static void
 handle_layout_change (struct wl_listener *listener, void *data)
 {
@@ -409,6 +532,8 @@ handle_layout_change (struct wl_listener *listener, void *data)
     phoc_view_move (view, center_x - box.width / 2, center_y - box.height / 2);
   }
 
+  update_mirrors (self);
+
   /* Damage all outputs since the move above damaged old layout space */
   wl_list_for_each(output, &self->outputs, link)
     phoc_output_damage_whole(output);
@@ -526,6 +651,35 @@ on_output_destroyed (PhocDesktop *self, PhocOutput *destroyed_output)
   g_object_unref (destroyed_output);
 }
 
+/* The runtime setting takes precedence over the one from phoc.ini */
+static void
+apply_color_temperature (PhocDesktop *self, PhocOutput *output)
+{
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+  PhocConfig *config = phoc_server_get_config (phoc_server_get_default ());
+  PhocOutputConfig *output_config = phoc_config_get_output (config, output);
+  guint temperature = priv->color_temperature;
+
+  if (temperature == 0 && output_config)
+    temperature = output_config->color_temperature;
+
+  phoc_output_set_color_temperature (output, temperature);
+}
+
+
+static void
+on_color_temperature_changed (PhocDesktop *self, const char *key, GSettings *settings)
+{
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+  PhocOutput *output;
+
+  priv->color_temperature = g_settings_get_uint (settings, key);
+
+  wl_list_for_each (output, &self->outputs, link)
+    apply_color_temperature (self, output);
+}
+
+
 static void
 handle_new_output (struct wl_listener *listener, void *data)
 {
@@ -542,6 +696,9 @@ handle_new_output (struct wl_listener *listener, void *data)
                            G_CALLBACK (on_output_destroyed),
                            self,
                            G_CONNECT_SWAPPED);
+
+  apply_color_temperature (self, output);
+  place_mirrors (self, output);
 }
 
 
@@ -555,12 +712,49 @@ handle_backend_destroy (struct wl_listener *listener, void *data)
 }
 
 
+/*
+ * Globals that aren't needed to bring up the shell. With lazy globals
+ * enabled these get created once startup is done.
+ */
+static void
+create_deferred_globals (PhocDesktop *self)
+{
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+  struct wl_display *wl_display = phoc_server_get_wl_display (phoc_server_get_default ());
+  struct wlr_xdg_foreign_registry *foreign_registry;
+
+  self->export_dmabuf_manager_v1 = wlr_export_dmabuf_manager_v1_create (wl_display);
+
+  foreign_registry = wlr_xdg_foreign_registry_create (wl_display);
+  wlr_xdg_foreign_v1_create (wl_display, foreign_registry);
+  wlr_xdg_foreign_v2_create (wl_display, foreign_registry);
+
+  priv->data_control_manager_v1 = wlr_data_control_manager_v1_create (wl_display);
+}
+
+
+static gboolean
+on_deferred_globals_idle (gpointer data)
+{
+  PhocDesktop *self = PHOC_DESKTOP (data);
+  PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
+
+  priv->deferred_globals_id = 0;
+
+  create_deferred_globals (self);
+  phoc_server_add_startup_step (phoc_server_get_default (), "lazy-globals");
+
+  return G_SOURCE_REMOVE;
+}
+
+
 static void
 phoc_desktop_constructed (GObject *object)
 {
   PhocDesktop *self = PHOC_DESKTOP (object);
   PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
   PhocServer *server = phoc_server_get_default ();
+  PhocConfig *config = phoc_server_get_config (server);
   struct wl_display *wl_display = phoc_server_get_wl_display (server);
   struct wlr_backend *wlr_backend = phoc_server_get_backend (server);
 
@@ -587,14 +781,18 @@ phoc_desktop_constructed (GObject *object)
   wl_signal_add(&self->layer_shell->events.new_surface, &self->layer_shell_surface);
   self->layer_shell_surface.notify = phoc_handle_layer_shell_surface;
   priv->layer_shell_effects = phoc_layer_shell_effects_new ();
+  phoc_server_add_startup_step (server, "desktop-shells");
 
-  self->tablet_v2 = wlr_tablet_v2_create (wl_display);
+  /* Otherwise created when the first tablet shows up */
+  if (!config->lazy_globals)
+    phoc_desktop_get_tablet_manager (self);
 
   char cursor_size_fmt[16];
   snprintf (cursor_size_fmt, sizeof (cursor_size_fmt), "%d", PHOC_XCURSOR_SIZE);
   g_setenv ("XCURSOR_SIZE", cursor_size_fmt, 1);
 
   phoc_desktop_setup_xwayland (self);
+  phoc_server_add_startup_step (server, "desktop-xwayland");
 
   self->security_context_manager_v1 = wlr_security_context_manager_v1_create (wl_display);
 
@@ -602,7 +800,6 @@ phoc_desktop_constructed (GObject *object)
   priv->gamma_control_set_gamma.notify = phoc_output_handle_gamma_control_set_gamma;
   wl_signal_add (&self->gamma_control_manager_v1->events.set_gamma, &priv->gamma_control_set_gamma);
 
-  self->export_dmabuf_manager_v1 = wlr_export_dmabuf_manager_v1_create (wl_display);
   self->server_decoration_manager = wlr_server_decoration_manager_create (wl_display);
   wlr_server_decoration_manager_set_default_mode (self->server_decoration_manager,
                                                   WLR_SERVER_DECORATION_MANAGER_MODE_CLIENT);
@@ -643,10 +840,6 @@ phoc_desktop_constructed (GObject *object)
   wlr_single_pixel_buffer_manager_v1_create (wl_display);
   wlr_fractional_scale_manager_v1_create (wl_display, PHOC_FRACTIONAL_SCALE_VERSION);
 
-  struct wlr_xdg_foreign_registry *foreign_registry = wlr_xdg_foreign_registry_create (wl_display);
-  wlr_xdg_foreign_v1_create (wl_display, foreign_registry);
-  wlr_xdg_foreign_v2_create (wl_display, foreign_registry);
-
   self->pointer_constraints = wlr_pointer_constraints_v1_create (wl_display);
   self->pointer_constraint.notify = handle_pointer_constraint;
   wl_signal_add (&self->pointer_constraints->events.new_constraint, &self->pointer_constraint);
@@ -669,7 +862,16 @@ phoc_desktop_constructed (GObject *object)
   wl_signal_add (&self->output_power_manager_v1->events.set_mode,
                  &self->output_power_manager_set_mode);
 
-  priv->data_control_manager_v1 = wlr_data_control_manager_v1_create (wl_display);
+  if (config->lazy_globals) {
+    priv->deferred_globals_id = g_idle_add_full (G_PRIORITY_LOW,
+                                                 on_deferred_globals_idle,
+                                                 self,
+                                                 NULL);
+    g_source_set_name_by_id (priv->deferred_globals_id, "[phoc] deferred globals");
+  } else {
+    create_deferred_globals (self);
+  }
+  phoc_server_add_startup_step (server, "desktop-globals");
 
   /* sm.puri.phoc settings */
   priv->settings = g_settings_new ("sm.puri.phoc");
@@ -677,6 +879,9 @@ phoc_desktop_constructed (GObject *object)
                             G_CALLBACK (auto_maximize_changed_cb), self);
   auto_maximize_changed_cb (self, "auto-maximize", priv->settings);
   g_settings_bind (priv->settings, "scale-to-fit", self, "scale-to-fit", G_SETTINGS_BIND_DEFAULT);
+  g_signal_connect_swapped (priv->settings, "changed::color-temperature",
+                            G_CALLBACK (on_color_temperature_changed), self);
+  on_color_temperature_changed (self, "color-temperature", priv->settings);
 
   /* org.gnome.desktop.interface settings */
   priv->interface_settings = g_settings_new ("org.gnome.desktop.interface");
@@ -697,6 +902,7 @@ phoc_desktop_finalize (GObject *object)
   PhocDesktopPrivate *priv = phoc_desktop_get_instance_private (self);
 
   g_clear_pointer (&priv->views, g_queue_free);
+  g_clear_handle_id (&priv->deferred_globals_id, g_source_remove);
 
   wl_list_remove (&priv->gamma_control_set_gamma.link);
   wl_list_remove (&self->layout_change.link);
@@ -1079,6 +1285,29 @@ phoc_desktop_get_gtk_shell (PhocDesktop *self)
   return priv->gtk_shell;
 }
 
+/**
+ * phoc_desktop_get_tablet_manager:
+ * @self: The `PhocDesktop`
+ *
+ * Gets the tablet manager creating it on first use.
+ *
+ * Returns: (transfer none): The tablet manager
+ */
+struct wlr_tablet_manager_v2 *
+phoc_desktop_get_tablet_manager (PhocDesktop *self)
+{
+  g_assert (PHOC_IS_DESKTOP (self));
+
+  if (self->tablet_v2 == NULL) {
+    struct wl_display *wl_display = phoc_server_get_wl_display (phoc_server_get_default ());
+
+    g_debug ("Creating tablet manager");
+    self->tablet_v2 = wlr_tablet_v2_create (wl_display);
+  }
+
+  return self->tablet_v2;
+}
+
 /**
  * phoc_desktop_get_phosh_private:
  * @self: The `PhocDesktop`
@@ -1103,11 +1332,15 @@ void
 phoc_desktop_notify_activity (PhocDesktop *self, PhocSeat *seat)
 {
   PhocDesktopPrivate *priv;
+  PhocOutput *output;
 
   g_assert (PHOC_IS_DESKTOP (self));
   priv = phoc_desktop_get_instance_private (self);
 
   wlr_idle_notifier_v1_notify_activity (priv->idle_notifier_v1, seat->seat);
+
+  wl_list_for_each (output, &self->outputs, link)
+    phoc_output_notify_activity (output);
 }
 
 gboolean
@@ -1122,10 +1355,10 @@ phoc_desktop_is_privileged_protocol (PhocDesktop *self, const struct wl_global *
   is_priv = (
     global == phoc_phosh_private_get_global (priv->phosh) ||
     global == phoc_layer_shell_effects_get_global (priv->layer_shell_effects) ||
-    global == priv->data_control_manager_v1->global ||
+    (priv->data_control_manager_v1 && global == priv->data_control_manager_v1->global) ||
     global == self->ext_foreign_toplevel_list_v1->global ||
     global == priv->screencopy_manager_v1->global ||
-    global == self->export_dmabuf_manager_v1->global ||
+    (self->export_dmabuf_manager_v1 && global == self->export_dmabuf_manager_v1->global) ||
     global == self->foreign_toplevel_manager_v1->global ||
     global == self->gamma_control_manager_v1->global ||
     global == self->input_method->global ||
@@ -1181,6 +1414,10 @@ phoc_desktop_move_view_to_top (PhocDesktop *self, PhocView *view)
   view_link = g_queue_find (priv->views, view);
   g_assert (view_link);
 
+  /* Resume the view before restacking so the client can draw its next frame in time */
+  phoc_suspend_policy_prepare_view (phoc_server_get_suspend_policy (phoc_server_get_default ()),
+                                    view);
+
   g_queue_unlink (priv->views, view_link);
 
   if (G_UNLIKELY (phoc_view_is_always_on_top (view))) {
@@ -1196,6 +1433,12 @@ phoc_desktop_move_view_to_top (PhocDesktop *self, PhocView *view)
     g_queue_insert_before_link (priv->views, l, view_link);
   }
 
+  /* The view might still be covered (e.g. by an overlay), let the
+   * policy suspend it again in that case */
+  phoc_desktop_view_check_visibility (self, view);
+  phoc_suspend_policy_update_view (phoc_server_get_suspend_policy (phoc_server_get_default ()),
+                                   view);
+
   phoc_view_damage_whole (view);
 }
 
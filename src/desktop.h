@@ -90,7 +90,19 @@ struct _PhocDesktop {
   struct wl_listener xwayland_surface;
   struct wl_listener xwayland_ready;
   struct wl_listener xwayland_remove_startup_id;
+  struct wl_listener xwayland_server_start;
+  struct wl_listener xwayland_server_destroy;
+  struct wl_listener xwayland_client_destroy;
   xcb_atom_t xwayland_atoms[XWAYLAND_ATOM_LAST];
+  guint xwayland_n_surfaces;
+  guint xwayland_idle_id;
+  struct {
+    guint  n_starts;
+    guint  n_idle_stops;
+    gint64 start_time;
+    gint64 last_start_latency;
+    gint64 time_alive;
+  } xwayland_stats;
 #endif
 
   gboolean maximize, scale_to_fit;
@@ -138,6 +150,8 @@ GSList              *phoc_desktop_get_layer_surface_stacks       (PhocDesktop *s
 
 PhocGtkShell        *phoc_desktop_get_gtk_shell                  (PhocDesktop *self);
 PhocPhoshPrivate    *phoc_desktop_get_phosh_private              (PhocDesktop *self);
+struct wlr_tablet_manager_v2 *
+                     phoc_desktop_get_tablet_manager             (PhocDesktop *self);
 
 void                 phoc_desktop_notify_activity                (PhocDesktop *self,
                                                                   PhocSeat    *seat);
@@ -21,9 +21,11 @@
 #include <wlr/types/wlr_pointer.h>
 #include <xkbcommon/xkbcommon.h>
 #include "keyboard.h"
+#include "keymap-cache.h"
 #include "phosh-private.h"
 #include "seat.h"
 
+#include <gio/gio.h>
 #include <glib.h>
 #include <glib/gprintf.h>
 #include <wlr/backend/libinput.h>
@@ -51,6 +53,12 @@ typedef enum {
  *
  * It's responsible for forwarding keys press and modifier changes
  * to the seat, it tracks keybindings and the keymap.
+ *
+ * Keymaps come from the server's [class@KeymapCache]. Compiling
+ * keymaps can take several milliseconds so it happens in a worker
+ * thread and the result gets applied from the main loop. Until then
+ * the fallback keymap is used. Wakeup keys are read right away as
+ * libinput's udev device already has the properties at hand.
  */
 
 enum {
@@ -74,6 +82,8 @@ struct _PhocKeyboard {
   gboolean           wakeup_key_default;
   GHashTable        *wakeup_keys;
 
+  GCancellable      *keymap_cancel;
+
   xkb_keysym_t       pressed_keysyms_translated[PHOC_KEYBOARD_PRESSED_KEYSYMS_CAP];
   xkb_keysym_t       pressed_keysyms_raw[PHOC_KEYBOARD_PRESSED_KEYSYMS_CAP];
 
@@ -469,65 +479,75 @@ phoc_keyboard_handle_modifiers (PhocKeyboard *self)
 
 
 static void
-set_fallback_keymap (PhocKeyboard *self)
+apply_keymap (PhocKeyboard *self, struct xkb_keymap *keymap)
 {
-  struct xkb_context *context;
   PhocInputDevice *input_device = PHOC_INPUT_DEVICE (self);
   struct wlr_input_device *device = phoc_input_device_get_device (input_device);
   struct wlr_keyboard *wlr_keyboard = wlr_keyboard_from_input_device (device);
 
-  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
-  if (context == NULL)
-    return;
+  g_assert (wlr_keyboard);
 
   xkb_keymap_unref (self->keymap);
-  self->keymap = xkb_keymap_new_from_names (context, NULL,
-                                            XKB_KEYMAP_COMPILE_NO_FLAGS);
-  xkb_context_unref (context);
-
+  self->keymap = keymap;
   wlr_keyboard_set_keymap (wlr_keyboard, self->keymap);
 }
 
 
 static void
-set_xkb_keymap (PhocKeyboard *self, const gchar *layout, const gchar *variant, const gchar *options)
+set_fallback_keymap (PhocKeyboard *self)
 {
-  struct xkb_rule_names rules = { 0 };
-  struct xkb_context *context = NULL;
-  struct xkb_keymap *keymap = NULL;
-  PhocInputDevice *input_device = PHOC_INPUT_DEVICE (self);
-  struct wlr_input_device *device = phoc_input_device_get_device (input_device);
-  struct wlr_keyboard *wlr_keyboard = wlr_keyboard_from_input_device (device);
+  PhocKeymapCache *cache = phoc_server_get_keymap_cache (phoc_server_get_default ());
+  struct xkb_keymap *keymap;
 
-  g_assert (wlr_keyboard);
+  keymap = phoc_keymap_cache_get_default_keymap (cache);
+  if (keymap == NULL)
+    return;
+
+  apply_keymap (self, xkb_keymap_ref (keymap));
+}
+
+
+static void
+on_keymap_loaded (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (GError) err = NULL;
+  struct xkb_keymap *keymap;
 
-  rules.layout = layout;
-  rules.variant = variant;
-  rules.options = options;
+  keymap = phoc_keymap_cache_load_finish (PHOC_KEYMAP_CACHE (source_object), res, &err);
+  if (keymap == NULL) {
+    /* Superseded by a newer keymap or keyboard got disposed */
+    if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      return;
 
-  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
-  if (context == NULL) {
-    g_warning ("Cannot create XKB context");
-    goto out;
+    /* Keep the current (or fallback) keymap */
+    g_warning ("%s", err->message);
+    return;
   }
 
-  keymap = xkb_map_new_from_names (context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
-  if (keymap == NULL)
-    g_warning ("Cannot create XKB keymap");
+  apply_keymap (PHOC_KEYBOARD (user_data), keymap);
+}
+
+
+static void
+set_xkb_keymap (PhocKeyboard *self, const gchar *layout, const gchar *variant, const gchar *options)
+{
+  PhocKeymapCache *cache = phoc_server_get_keymap_cache (phoc_server_get_default ());
+  struct xkb_keymap *keymap;
 
- out:
-  if (context)
-    xkb_context_unref (context);
+  /* Only the most recent request matters */
+  g_cancellable_cancel (self->keymap_cancel);
+  g_clear_object (&self->keymap_cancel);
 
+  keymap = phoc_keymap_cache_lookup (cache, layout, variant, options);
   if (keymap) {
-    xkb_keymap_unref (self->keymap);
-    self->keymap = keymap;
-  } else if (self->keymap == NULL) {
-    set_fallback_keymap (self);
+    apply_keymap (self, keymap);
     return;
   }
 
-  wlr_keyboard_set_keymap (wlr_keyboard, self->keymap);
+  /* The callback bails out when cancelled so it doesn't need a ref on the keyboard */
+  self->keymap_cancel = g_cancellable_new ();
+  phoc_keymap_cache_load_async (cache, layout, variant, options, self->keymap_cancel,
+                                on_keymap_loaded, self);
 }
 
 
@@ -654,6 +674,9 @@ phoc_keyboard_dispose (GObject *object)
 {
   PhocKeyboard *self = PHOC_KEYBOARD (object);
 
+  g_cancellable_cancel (self->keymap_cancel);
+  g_clear_object (&self->keymap_cancel);
+
   g_clear_object (&self->input_settings);
   g_clear_object (&self->keyboard_settings);
   g_clear_object (&self->xkbinfo);
@@ -681,23 +704,27 @@ phoc_keyboard_finalize (GObject *object)
 
 /**
  * parse_udev_wakeup_keys:
- * @keyboard: PhocKeyboard to update with wakeup keycode config
- * @input_device: device to check for wakeup keys udev properties
+ * @self: PhocKeyboard to update with wakeup keycode config
  *
- * If the provided input_device has an underlying udev device, the properties are checked for any
+ * The properties of the keyboard's udev device are checked for any
  * that are prefixed with WAKEUP_KEY_UDEV_PREFIX.
  *
  * All properties with this prefix must have a value of either "0" (ignored) or "1" (used).
  *
  * For each property with a valid (positive non-zero int) keycode suffix, the appropriate
- * PhocWakeupKey (based on value) is inserted into @keyboard->wakeup_keys for that keycode.
+ * PhocWakeupKey (based on value) is inserted into @self->wakeup_keys for that keycode.
  *
- * If the suffix is "DEFAULT", @keyboard->wakeup_key_default is set.
+ * If the suffix is "DEFAULT", @self->wakeup_key_default is set.
+ *
+ * This only reads the properties libinput's udev device already holds
+ * so it's cheap enough to do right away. This way key presses never
+ * see a partially loaded table.
  */
 static void
-parse_udev_wakeup_keys (PhocKeyboard *keyboard, PhocInputDevice *input_device)
+parse_udev_wakeup_keys (PhocKeyboard *self)
 {
-  struct wlr_input_device *device;
+  PhocInputDevice *input_device = PHOC_INPUT_DEVICE (self);
+  struct wlr_input_device *device = phoc_input_device_get_device (input_device);
   struct libinput_device *dev_handle;
   struct udev_device *udev_dev;
   struct udev_list_entry *props, *prop_list_entry;
@@ -706,14 +733,11 @@ parse_udev_wakeup_keys (PhocKeyboard *keyboard, PhocInputDevice *input_device)
   gint64 val;
   char *endptr;
 
-  device = phoc_input_device_get_device (input_device);
-
   if (!wlr_input_device_is_libinput (device))
     return;
 
   dev_handle = phoc_input_device_get_libinput_device_handle (input_device);
   udev_dev = libinput_device_get_udev_device (dev_handle);
-
   if (!udev_dev)
     return;
 
@@ -740,7 +764,7 @@ parse_udev_wakeup_keys (PhocKeyboard *keyboard, PhocInputDevice *input_device)
     }
 
     if (g_str_equal (wakeup_prop_name, "DEFAULT")) {
-      keyboard->wakeup_key_default = key_state == PHOC_WAKEUP_KEY_USE;
+      self->wakeup_key_default = key_state == PHOC_WAKEUP_KEY_USE;
       continue;
     }
 
@@ -751,7 +775,7 @@ parse_udev_wakeup_keys (PhocKeyboard *keyboard, PhocInputDevice *input_device)
       continue;
     }
 
-    g_hash_table_insert (keyboard->wakeup_keys, GUINT_TO_POINTER (val),
+    g_hash_table_insert (self->wakeup_keys, GUINT_TO_POINTER (val),
                          GUINT_TO_POINTER (key_state));
   }
 
@@ -772,7 +796,7 @@ phoc_keyboard_constructed (GObject *object)
    * property that explicitly prevents that. */
   self->wakeup_key_default = TRUE;
   self->wakeup_keys = g_hash_table_new (g_direct_hash, g_direct_equal);
-  parse_udev_wakeup_keys (self, input_device);
+  parse_udev_wakeup_keys (self);
 
   wlr_keyboard->data = self;
 
@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-keymap-cache"
+
+#include "phoc-config.h"
+
+#include "keymap-cache.h"
+
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <sys/stat.h>
+
+/**
+ * PhocKeymapCache:
+ *
+ * A process wide cache of compiled keymaps keyed by layout, variant
+ * and options. Keyboards with the same configuration share a keymap
+ * so adding devices and switching layouts back and forth only compiles
+ * each keymap once.
+ *
+ * Keymaps missing from the cache are compiled in a worker thread.
+ * Concurrent requests for the same keymap share a single compile.
+ *
+ * If a persist directory is set compiled keymaps are additionally
+ * stored there as serialized keymap strings so they can be loaded
+ * without resolving the xkb rules after a restart. The file names
+ * include the modification time of the xkb rules so updates to
+ * xkeyboard-config invalidate them.
+ */
+
+#define KEYMAP_CACHE_RULES "evdev"
+
+struct _PhocKeymapCache {
+  GObject            parent;
+
+  /* key -> struct xkb_keymap */
+  GHashTable        *keymaps;
+  /* key -> GPtrArray of GTask waiting for that keymap */
+  GHashTable        *pending;
+  struct xkb_keymap *default_keymap;
+
+  char              *persist_dir;
+  GCancellable      *cancel;
+};
+G_DEFINE_TYPE (PhocKeymapCache, phoc_keymap_cache, G_TYPE_OBJECT)
+
+/* Arguments for a keymap compile in a worker thread */
+typedef struct {
+  char *key;
+  char *layout;
+  char *variant;
+  char *options;
+  char *persist_dir;
+} PhocKeymapRequest;
+
+
+static void
+phoc_keymap_request_free (PhocKeymapRequest *request)
+{
+  g_free (request->key);
+  g_free (request->layout);
+  g_free (request->variant);
+  g_free (request->options);
+  g_free (request->persist_dir);
+  g_free (request);
+}
+
+
+static char *
+build_key (const char *layout, const char *variant, const char *options)
+{
+  return g_strdup_printf ("%s\x1f%s\x1f%s", layout ?: "", variant ?: "", options ?: "");
+}
+
+
+static gint64
+get_rules_mtime (struct xkb_context *context)
+{
+  for (unsigned int i = 0; i < xkb_context_num_include_paths (context); i++) {
+    g_autofree char *path = NULL;
+    GStatBuf st;
+
+    path = g_build_filename (xkb_context_include_path_get (context, i),
+                             "rules", KEYMAP_CACHE_RULES, NULL);
+    if (g_stat (path, &st) == 0)
+      return st.st_mtime;
+  }
+
+  return 0;
+}
+
+
+static char *
+build_persist_path (struct xkb_context *context, PhocKeymapRequest *request)
+{
+  g_autofree char *checksum = NULL;
+  g_autofree char *filename = NULL;
+
+  checksum = g_compute_checksum_for_string (G_CHECKSUM_SHA256, request->key, -1);
+  filename = g_strdup_printf ("%s-%" G_GINT64_FORMAT ".xkb", checksum, get_rules_mtime (context));
+
+  return g_build_filename (request->persist_dir, filename, NULL);
+}
+
+
+static struct xkb_keymap *
+load_persisted_keymap (struct xkb_context *context, const char *path)
+{
+  g_autofree char *contents = NULL;
+  struct xkb_keymap *keymap;
+
+  if (!g_file_get_contents (path, &contents, NULL, NULL))
+    return NULL;
+
+  keymap = xkb_keymap_new_from_string (context, contents, XKB_KEYMAP_FORMAT_TEXT_V1,
+                                       XKB_KEYMAP_COMPILE_NO_FLAGS);
+  if (keymap == NULL)
+    g_warning ("Failed to load persisted keymap %s", path);
+
+  return keymap;
+}
+
+
+static void
+persist_keymap (struct xkb_keymap *keymap, const char *path)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *dir = g_path_get_dirname (path);
+  g_autofree char *contents = NULL;
+
+  if (g_mkdir_with_parents (dir, 0700) < 0) {
+    g_warning ("Failed to create %s: %s", dir, g_strerror (errno));
+    return;
+  }
+
+  contents = xkb_keymap_get_as_string (keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+  if (contents == NULL)
+    return;
+
+  if (!g_file_set_contents (path, contents, -1, &err))
+    g_warning ("Failed to persist keymap: %s", err->message);
+}
+
+
+static void
+compile_keymap_in_thread (GTask        *task,
+                          gpointer      source_object,
+                          gpointer      task_data,
+                          GCancellable *cancellable)
+{
+  PhocKeymapRequest *request = task_data;
+  struct xkb_rule_names rules = { 0 };
+  g_autofree char *path = NULL;
+  struct xkb_context *context;
+  struct xkb_keymap *keymap = NULL;
+
+  rules.layout = request->layout;
+  rules.variant = request->variant;
+  rules.options = request->options;
+
+  /* xkb contexts aren't thread safe so use a private one */
+  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+  if (context == NULL) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "Cannot create XKB context");
+    return;
+  }
+
+  if (request->persist_dir) {
+    path = build_persist_path (context, request);
+    keymap = load_persisted_keymap (context, path);
+    if (keymap)
+      g_debug ("Loaded keymap %s %s from %s", request->layout, request->variant, path);
+  }
+
+  if (keymap == NULL) {
+    keymap = xkb_keymap_new_from_names (context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    if (keymap && path)
+      persist_keymap (keymap, path);
+  }
+
+  xkb_context_unref (context);
+
+  if (keymap == NULL) {
+    g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED, "Cannot create XKB keymap");
+    return;
+  }
+
+  g_task_return_pointer (task, keymap, (GDestroyNotify)xkb_keymap_unref);
+}
+
+
+static void
+on_keymap_compiled (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  PhocKeymapCache *self = PHOC_KEYMAP_CACHE (source_object);
+  PhocKeymapRequest *request = g_task_get_task_data (G_TASK (res));
+  g_autoptr (GPtrArray) waiters = NULL;
+  g_autoptr (GError) err = NULL;
+  struct xkb_keymap *keymap;
+
+  keymap = g_task_propagate_pointer (G_TASK (res), &err);
+
+  g_hash_table_steal_extended (self->pending, request->key, NULL, (gpointer *)&waiters);
+
+  if (keymap)
+    g_hash_table_insert (self->keymaps, g_strdup (request->key), keymap);
+
+  for (guint i = 0; waiters && i < waiters->len; i++) {
+    GTask *task = g_ptr_array_index (waiters, i);
+
+    if (keymap)
+      g_task_return_pointer (task, xkb_keymap_ref (keymap), (GDestroyNotify)xkb_keymap_unref);
+    else
+      g_task_return_error (task, g_error_copy (err));
+  }
+}
+
+
+static void
+phoc_keymap_cache_dispose (GObject *object)
+{
+  PhocKeymapCache *self = PHOC_KEYMAP_CACHE (object);
+
+  g_cancellable_cancel (self->cancel);
+  g_clear_object (&self->cancel);
+
+  G_OBJECT_CLASS (phoc_keymap_cache_parent_class)->dispose (object);
+}
+
+
+static void
+phoc_keymap_cache_finalize (GObject *object)
+{
+  PhocKeymapCache *self = PHOC_KEYMAP_CACHE (object);
+
+  g_clear_pointer (&self->keymaps, g_hash_table_destroy);
+  g_clear_pointer (&self->pending, g_hash_table_destroy);
+  g_clear_pointer (&self->default_keymap, xkb_keymap_unref);
+  g_clear_pointer (&self->persist_dir, g_free);
+
+  G_OBJECT_CLASS (phoc_keymap_cache_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_keymap_cache_class_init (PhocKeymapCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = phoc_keymap_cache_dispose;
+  object_class->finalize = phoc_keymap_cache_finalize;
+}
+
+
+static void
+phoc_keymap_cache_init (PhocKeymapCache *self)
+{
+  self->keymaps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify)xkb_keymap_unref);
+  self->pending = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify)g_ptr_array_unref);
+  self->cancel = g_cancellable_new ();
+}
+
+
+PhocKeymapCache *
+phoc_keymap_cache_new (void)
+{
+  return g_object_new (PHOC_TYPE_KEYMAP_CACHE, NULL);
+}
+
+/**
+ * phoc_keymap_cache_set_persist_dir:
+ * @self: The keymap cache
+ * @dir:(nullable): The directory to persist keymaps in
+ *
+ * Set the directory compiled keymaps are stored in and loaded
+ * from. %NULL disables persisting keymaps.
+ */
+void
+phoc_keymap_cache_set_persist_dir (PhocKeymapCache *self, const char *dir)
+{
+  g_assert (PHOC_IS_KEYMAP_CACHE (self));
+
+  g_free (self->persist_dir);
+  self->persist_dir = g_strdup (dir);
+}
+
+/**
+ * phoc_keymap_cache_get_default_keymap:
+ * @self: The keymap cache
+ *
+ * Get the keymap resulting from the default rules. This is used as
+ * fallback until a keyboard's configured keymap is available. It's
+ * compiled synchronously on first use.
+ *
+ * Returns: (transfer none)(nullable): The default keymap
+ */
+struct xkb_keymap *
+phoc_keymap_cache_get_default_keymap (PhocKeymapCache *self)
+{
+  struct xkb_context *context;
+
+  g_assert (PHOC_IS_KEYMAP_CACHE (self));
+
+  if (self->default_keymap)
+    return self->default_keymap;
+
+  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+  if (context == NULL)
+    return NULL;
+
+  self->default_keymap = xkb_keymap_new_from_names (context, NULL, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  xkb_context_unref (context);
+
+  return self->default_keymap;
+}
+
+/**
+ * phoc_keymap_cache_lookup:
+ * @self: The keymap cache
+ * @layout:(nullable): The xkb layout
+ * @variant:(nullable): The xkb variant
+ * @options:(nullable): The xkb options
+ *
+ * Look up an already compiled keymap.
+ *
+ * Returns: (transfer full)(nullable): The keymap or %NULL if it's not
+ *   in the cache.
+ */
+struct xkb_keymap *
+phoc_keymap_cache_lookup (PhocKeymapCache *self,
+                          const char      *layout,
+                          const char      *variant,
+                          const char      *options)
+{
+  g_autofree char *key = NULL;
+  struct xkb_keymap *keymap;
+
+  g_assert (PHOC_IS_KEYMAP_CACHE (self));
+
+  key = build_key (layout, variant, options);
+  keymap = g_hash_table_lookup (self->keymaps, key);
+
+  return keymap ? xkb_keymap_ref (keymap) : NULL;
+}
+
+/**
+ * phoc_keymap_cache_load_async:
+ * @self: The keymap cache
+ * @layout:(nullable): The xkb layout
+ * @variant:(nullable): The xkb variant
+ * @options:(nullable): The xkb options
+ * @cancellable:(nullable): A cancellable
+ * @callback: The callback to invoke once the keymap is available
+ * @user_data: The data passed to the callback
+ *
+ * Get a keymap from the cache, compiling it in a worker thread if
+ * needed.
+ */
+void
+phoc_keymap_cache_load_async (PhocKeymapCache     *self,
+                              const char          *layout,
+                              const char          *variant,
+                              const char          *options,
+                              GCancellable        *cancellable,
+                              GAsyncReadyCallback  callback,
+                              gpointer             user_data)
+{
+  g_autoptr (GTask) task = NULL;
+  g_autoptr (GTask) compile_task = NULL;
+  g_autofree char *key = NULL;
+  PhocKeymapRequest *request;
+  struct xkb_keymap *keymap;
+  GPtrArray *waiters;
+
+  g_assert (PHOC_IS_KEYMAP_CACHE (self));
+
+  task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (task, phoc_keymap_cache_load_async);
+
+  key = build_key (layout, variant, options);
+  keymap = g_hash_table_lookup (self->keymaps, key);
+  if (keymap) {
+    g_task_return_pointer (task, xkb_keymap_ref (keymap), (GDestroyNotify)xkb_keymap_unref);
+    return;
+  }
+
+  waiters = g_hash_table_lookup (self->pending, key);
+  if (waiters) {
+    g_ptr_array_add (waiters, g_steal_pointer (&task));
+    return;
+  }
+
+  waiters = g_ptr_array_new_with_free_func (g_object_unref);
+  g_ptr_array_add (waiters, g_steal_pointer (&task));
+  g_hash_table_insert (self->pending, g_strdup (key), waiters);
+
+  request = g_new0 (PhocKeymapRequest, 1);
+  request->key = g_steal_pointer (&key);
+  request->layout = g_strdup (layout);
+  request->variant = g_strdup (variant);
+  request->options = g_strdup (options);
+  request->persist_dir = g_strdup (self->persist_dir);
+
+  compile_task = g_task_new (self, self->cancel, on_keymap_compiled, NULL);
+  g_task_set_source_tag (compile_task, compile_keymap_in_thread);
+  g_task_set_task_data (compile_task, request, (GDestroyNotify)phoc_keymap_request_free);
+  g_task_run_in_thread (compile_task, compile_keymap_in_thread);
+}
+
+/**
+ * phoc_keymap_cache_load_finish:
+ * @self: The keymap cache
+ * @res: The async result
+ * @error: The return location for an error
+ *
+ * Finish an operation started by `phoc_keymap_cache_load_async()`.
+ *
+ * Returns: (transfer full)(nullable): The keymap
+ */
+struct xkb_keymap *
+phoc_keymap_cache_load_finish (PhocKeymapCache *self, GAsyncResult *res, GError **error)
+{
+  g_assert (PHOC_IS_KEYMAP_CACHE (self));
+  g_assert (g_task_is_valid (res, self));
+
+  return g_task_propagate_pointer (G_TASK (res), error);
+}
+
+
+guint
+phoc_keymap_cache_get_n_keymaps (PhocKeymapCache *self)
+{
+  g_assert (PHOC_IS_KEYMAP_CACHE (self));
+
+  return g_hash_table_size (self->keymaps);
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib-object.h>
+#include <xkbcommon/xkbcommon.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_KEYMAP_CACHE (phoc_keymap_cache_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocKeymapCache, phoc_keymap_cache, PHOC, KEYMAP_CACHE, GObject)
+
+PhocKeymapCache   *phoc_keymap_cache_new                 (void);
+void               phoc_keymap_cache_set_persist_dir     (PhocKeymapCache     *self,
+                                                          const char          *dir);
+struct xkb_keymap *phoc_keymap_cache_get_default_keymap  (PhocKeymapCache     *self);
+struct xkb_keymap *phoc_keymap_cache_lookup              (PhocKeymapCache     *self,
+                                                          const char          *layout,
+                                                          const char          *variant,
+                                                          const char          *options);
+void               phoc_keymap_cache_load_async          (PhocKeymapCache     *self,
+                                                          const char          *layout,
+                                                          const char          *variant,
+                                                          const char          *options,
+                                                          GCancellable        *cancellable,
+                                                          GAsyncReadyCallback  callback,
+                                                          gpointer             user_data);
+struct xkb_keymap *phoc_keymap_cache_load_finish         (PhocKeymapCache     *self,
+                                                          GAsyncResult        *res,
+                                                          GError             **error);
+guint              phoc_keymap_cache_get_n_keymaps       (PhocKeymapCache     *self);
+
+G_END_DECLS
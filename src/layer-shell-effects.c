@@ -507,18 +507,9 @@ phoc_stacked_layer_surface_destroy (PhocStackedLayerSurface *stacked_surface)
 
   layer_surface = stacked_surface->layer_surface;
   if (layer_surface) {
-      PhocOutput *output;
-
     /* wlr signals */
     wl_list_remove (&stacked_surface->surface_handle_commit.link);
     wl_list_remove (&stacked_surface->layer_surface_handle_destroy.link);
-
-    output = phoc_layer_surface_get_output (layer_surface);
-    if (output) {
-      enum zwlr_layer_shell_v1_layer layer = phoc_layer_surface_get_layer (layer_surface);
-
-      phoc_output_set_layer_dirty (output, layer);
-    }
   }
 
   if (stacked_surface->current.surface)
@@ -527,6 +518,14 @@ phoc_stacked_layer_surface_destroy (PhocStackedLayerSurface *stacked_surface)
   layer_shell_effects->stacked_surfaces = g_slist_remove (layer_shell_effects->stacked_surfaces,
                                                           stacked_surface);
 
+  /* Move the surface back to its regular position */
+  if (layer_surface) {
+    PhocOutput *output = phoc_layer_surface_get_output (layer_surface);
+
+    if (output)
+      phoc_output_update_layer_surface_stacking (output, layer_surface);
+  }
+
   stacked_surface->layer_surface = NULL;
   stacked_surface->current.surface = NULL;
 
@@ -739,8 +738,7 @@ stacked_surface_handle_commit (struct wl_listener *listener, void *data)
                  &stacked_surface->target_layer_surface_handle_destroy);
 
   output = phoc_layer_surface_get_output (stacked_surface->layer_surface);
-  phoc_output_set_layer_dirty (output,
-                               phoc_layer_surface_get_layer (stacked_surface->current.surface));
+  phoc_output_update_layer_surface_stacking (output, stacked_surface->layer_surface);
 }
 
 
@@ -1063,7 +1061,7 @@ apply_margin (PhocDraggableLayerSurface *drag_surface, double margin)
   if (wlr_layer_surface->current.exclusive_zone != exclusive &&
       (wlr_layer_surface->current.exclusive_zone <= 0 || exclusive <= 0)) {
     PhocOutput *output = phoc_layer_surface_get_output (drag_surface->layer_surface);
-    phoc_output_set_layer_dirty (output, phoc_layer_surface_get_layer (drag_surface->layer_surface));
+    phoc_output_update_layer_surface_stacking (output, drag_surface->layer_surface);
   }
 }
 
@@ -130,6 +130,143 @@ phoc_layer_shell_update_cursors (PhocLayerSurface *layer_surface, GSList *seats)
 }
 
 
+static void
+save_arranged_state (PhocLayerSurface *layer_surface)
+{
+  struct wlr_layer_surface_v1_state *state = &layer_surface->layer_surface->current;
+
+  layer_surface->arranged.anchor = state->anchor;
+  layer_surface->arranged.exclusive_zone = state->exclusive_zone;
+  layer_surface->arranged.desired_width = state->desired_width;
+  layer_surface->arranged.desired_height = state->desired_height;
+  layer_surface->arranged.margin_top = state->margin.top;
+  layer_surface->arranged.margin_right = state->margin.right;
+  layer_surface->arranged.margin_bottom = state->margin.bottom;
+  layer_surface->arranged.margin_left = state->margin.left;
+}
+
+
+static gboolean
+arranged_state_changed (PhocLayerSurface *layer_surface)
+{
+  struct wlr_layer_surface_v1_state *state = &layer_surface->layer_surface->current;
+
+  return layer_surface->arranged.anchor != state->anchor ||
+    layer_surface->arranged.exclusive_zone != state->exclusive_zone ||
+    layer_surface->arranged.desired_width != state->desired_width ||
+    layer_surface->arranged.desired_height != state->desired_height ||
+    layer_surface->arranged.margin_top != state->margin.top ||
+    layer_surface->arranged.margin_right != state->margin.right ||
+    layer_surface->arranged.margin_bottom != state->margin.bottom ||
+    layer_surface->arranged.margin_left != state->margin.left;
+}
+
+
+static gboolean
+arrange_surface (PhocOutput       *output,
+                 GSList           *seats, /* PhocSeat */
+                 PhocLayerSurface *layer_surface,
+                 struct wlr_box   *usable_area)
+{
+  struct wlr_layer_surface_v1 *wlr_layer_surface = layer_surface->layer_surface;
+  struct wlr_layer_surface_v1_state *state = &wlr_layer_surface->current;
+  struct wlr_box full_area = { 0 };
+  gboolean sent_configure = FALSE;
+  struct wlr_box bounds;
+
+  save_arranged_state (layer_surface);
+
+  wlr_output_effective_resolution (output->wlr_output, &full_area.width, &full_area.height);
+  if (state->exclusive_zone == -1)
+    bounds = full_area;
+  else
+    bounds = *usable_area;
+
+  struct wlr_box box = {
+    .width = state->desired_width,
+    .height = state->desired_height
+  };
+  /* Horizontal axis */
+  const uint32_t both_horiz = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT
+    | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+  if ((state->anchor & both_horiz) && box.width == 0) {
+    box.x = bounds.x;
+    box.width = bounds.width;
+  } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT)) {
+    box.x = bounds.x;
+  } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT)) {
+    box.x = bounds.x + (bounds.width - box.width);
+  } else {
+    box.x = bounds.x + ((bounds.width / 2) - (box.width / 2));
+  }
+  /* Vertical axis */
+  const uint32_t both_vert = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP
+    | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM;
+  if ((state->anchor & both_vert) && box.height == 0) {
+    box.y = bounds.y;
+    box.height = bounds.height;
+  } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP)) {
+    box.y = bounds.y;
+  } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM)) {
+    box.y = bounds.y + (bounds.height - box.height);
+  } else {
+    box.y = bounds.y + ((bounds.height / 2) - (box.height / 2));
+  }
+  /* Margin */
+  if ((state->anchor & both_horiz) == both_horiz) {
+    box.x += state->margin.left;
+    box.width -= state->margin.left + state->margin.right;
+  } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT)) {
+    box.x += state->margin.left;
+  } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT)) {
+    box.x -= state->margin.right;
+  }
+  if ((state->anchor & both_vert) == both_vert) {
+    box.y += state->margin.top;
+    box.height -= state->margin.top + state->margin.bottom;
+  } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP)) {
+    box.y += state->margin.top;
+  } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM)) {
+    box.y -= state->margin.bottom;
+  }
+  if (box.width < 0 || box.height < 0) {
+    g_warning_once ("Layer surface '%s' has negative bounds %dx%d - ignoring",
+                    layer_surface->layer_surface->namespace ?: "<unknown>",
+                    box.width, box.height);
+    /* The layer surface never gets configured, hence the client sees a protocol error */
+    return FALSE;
+  }
+
+  /* Apply */
+  struct wlr_box old_geo = layer_surface->geo;
+  /* Join the transaction before the geometry changes so the surface
+   * keeps being drawn where it was until it committed the new size */
+  if (box.width != old_geo.width || box.height != old_geo.height)
+    phoc_layout_transaction_add_layer_dirty (phoc_layout_transaction_get_default (), layer_surface);
+  layer_surface->geo = box;
+  if (wlr_layer_surface->surface->mapped) {
+    apply_exclusive (usable_area, state->anchor, state->exclusive_zone,
+                     state->margin.top, state->margin.right,
+                     state->margin.bottom, state->margin.left);
+  }
+
+  if (box.width != old_geo.width || box.height != old_geo.height) {
+    phoc_layer_surface_send_configure (layer_surface);
+    sent_configure = TRUE;
+  }
+
+  /* Having a cursor newly end up over the moved layer will not
+   * automatically send a motion event to the surface. The event needs to
+   * be synthesized.
+   * Only update layer surfaces which kept their size (and so buffers) the
+   * same, because those with resized buffers will be handled separately. */
+  if (layer_surface->geo.x != old_geo.x || layer_surface->geo.y != old_geo.y)
+    phoc_layer_shell_update_cursors (layer_surface, seats);
+
+  return sent_configure;
+}
+
+
 static gboolean
 arrange_layer (PhocOutput                     *output,
                GSList                         *seats, /* PhocSeat */
@@ -138,14 +275,11 @@ arrange_layer (PhocOutput                     *output,
                bool                            exclusive)
 {
   PhocLayerSurface *layer_surface;
-  struct wlr_box full_area = { 0 };
   gboolean sent_configure = FALSE;
 
   g_assert (PHOC_IS_OUTPUT (output));
-  wlr_output_effective_resolution (output->wlr_output, &full_area.width, &full_area.height);
   wl_list_for_each_reverse (layer_surface, &output->layer_surfaces, link) {
-    struct wlr_layer_surface_v1 *wlr_layer_surface = layer_surface->layer_surface;
-    struct wlr_layer_surface_v1_state *state = &wlr_layer_surface->current;
+    struct wlr_layer_surface_v1_state *state = &layer_surface->layer_surface->current;
 
     if (layer_surface->layer != layer)
       continue;
@@ -153,88 +287,7 @@ arrange_layer (PhocOutput                     *output,
     if (exclusive != (state->exclusive_zone > 0))
       continue;
 
-    struct wlr_box bounds;
-    if (state->exclusive_zone == -1)
-      bounds = full_area;
-    else
-      bounds = *usable_area;
-
-    struct wlr_box box = {
-      .width = state->desired_width,
-      .height = state->desired_height
-    };
-    /* Horizontal axis */
-    const uint32_t both_horiz = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT
-      | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
-    if ((state->anchor & both_horiz) && box.width == 0) {
-      box.x = bounds.x;
-      box.width = bounds.width;
-    } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT)) {
-      box.x = bounds.x;
-    } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT)) {
-      box.x = bounds.x + (bounds.width - box.width);
-    } else {
-      box.x = bounds.x + ((bounds.width / 2) - (box.width / 2));
-    }
-    /* Vertical axis */
-    const uint32_t both_vert = ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP
-      | ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM;
-    if ((state->anchor & both_vert) && box.height == 0) {
-      box.y = bounds.y;
-      box.height = bounds.height;
-    } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP)) {
-      box.y = bounds.y;
-    } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM)) {
-      box.y = bounds.y + (bounds.height - box.height);
-    } else {
-      box.y = bounds.y + ((bounds.height / 2) - (box.height / 2));
-    }
-    /* Margin */
-    if ((state->anchor & both_horiz) == both_horiz) {
-      box.x += state->margin.left;
-      box.width -= state->margin.left + state->margin.right;
-    } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT)) {
-      box.x += state->margin.left;
-    } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT)) {
-      box.x -= state->margin.right;
-    }
-    if ((state->anchor & both_vert) == both_vert) {
-      box.y += state->margin.top;
-      box.height -= state->margin.top + state->margin.bottom;
-    } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP)) {
-      box.y += state->margin.top;
-    } else if ((state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM)) {
-      box.y -= state->margin.bottom;
-    }
-    if (box.width < 0 || box.height < 0) {
-      g_warning_once ("Layer surface '%s' has negative bounds %dx%d - ignoring",
-                      layer_surface->layer_surface->namespace ?: "<unknown>",
-                      box.width, box.height);
-      /* The layer surface never gets configured, hence the client sees a protocol error */
-      continue;
-    }
-
-    /* Apply */
-    struct wlr_box old_geo = layer_surface->geo;
-    layer_surface->geo = box;
-    if (wlr_layer_surface->surface->mapped) {
-      apply_exclusive (usable_area, state->anchor, state->exclusive_zone,
-                       state->margin.top, state->margin.right,
-                       state->margin.bottom, state->margin.left);
-    }
-
-    if (box.width != old_geo.width || box.height != old_geo.height) {
-      phoc_layer_surface_send_configure (layer_surface);
-      sent_configure = TRUE;
-    }
-
-    /* Having a cursor newly end up over the moved layer will not
-     * automatically send a motion event to the surface. The event needs to
-     * be synthesized.
-     * Only update layer surfaces which kept their size (and so buffers) the
-     * same, because those with resized buffers will be handled separately. */
-    if (layer_surface->geo.x != old_geo.x || layer_surface->geo.y != old_geo.y)
-      phoc_layer_shell_update_cursors (layer_surface, seats);
+    sent_configure |= arrange_surface (output, seats, layer_surface, usable_area);
   }
 
   return sent_configure;
@@ -336,6 +389,49 @@ phoc_layer_shell_arrange (PhocOutput *output)
 }
 
 
+/**
+ * phoc_layer_shell_arrange_surface:
+ * @output: The output the layer surface is on
+ * @layer_surface: The layer surface that committed new state
+ *
+ * Arrange the layer surfaces affected by the committed state of the
+ * given layer surface. If nothing relevant for the layout changed
+ * nothing is done. Surfaces that neither had nor have an exclusive
+ * zone don't influence other surfaces or views so only the surface
+ * itself is rearranged. Otherwise all layers are arranged via
+ * [func@layer_shell_arrange].
+ *
+ * Returns: `TRUE` if configure events were sent to clients.
+ */
+gboolean
+phoc_layer_shell_arrange_surface (PhocOutput *output, PhocLayerSurface *layer_surface)
+{
+  PhocInput *input = phoc_server_get_input (phoc_server_get_default ());
+  struct wlr_box usable_area = output->usable_area;
+  gboolean sent_configure;
+
+  g_assert (PHOC_IS_OUTPUT (output));
+  g_assert (PHOC_IS_LAYER_SURFACE (layer_surface));
+
+  if (!arranged_state_changed (layer_surface))
+    return FALSE;
+
+  if (layer_surface->arranged.exclusive_zone > 0 ||
+      layer_surface->layer_surface->current.exclusive_zone > 0) {
+    return phoc_layer_shell_arrange (output);
+  }
+
+  g_debug ("Arranging layer surface %p (%s) only", layer_surface,
+           phoc_layer_surface_get_namespace (layer_surface));
+  phoc_layer_shell_update_osk (output, FALSE);
+  sent_configure = arrange_surface (output, phoc_input_get_seats (input), layer_surface,
+                                    &usable_area);
+  phoc_output_update_shell_reveal (output);
+
+  return sent_configure;
+}
+
+
 void
 phoc_layer_shell_update_focus (void)
 {
@@ -817,7 +913,7 @@ phoc_handle_layer_shell_surface (struct wl_listener *listener, void *data)
   wlr_layer_surface->current = wlr_layer_surface->pending;
 
   phoc_layer_shell_arrange (output);
-  phoc_output_set_layer_dirty (output, wlr_layer_surface->pending.layer);
+  phoc_output_update_layer_surface_stacking (output, self);
   phoc_layer_shell_update_focus ();
 
   wlr_layer_surface->current = old_state;
@@ -882,10 +978,8 @@ phoc_layer_shell_update_osk (PhocOutput *output, gboolean arrange)
   if (!force_overlay && osk->layer != osk->layer_surface->pending.layer)
     osk->layer = osk->layer_surface->pending.layer;
 
-  if (old_layer != osk->layer) {
-    phoc_output_set_layer_dirty (output, old_layer);
-    phoc_output_set_layer_dirty (output, osk->layer);
-  }
+  if (old_layer != osk->layer)
+    phoc_output_update_layer_surface_stacking (output, osk);
 
   if (force_overlay && arrange)
     phoc_layer_shell_arrange (output);
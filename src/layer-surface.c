@@ -38,6 +38,9 @@ enum {
 };
 static GParamSpec *props[PROP_LAST_PROP];
 
+/* Creation order of layer surfaces, determines their stacking */
+static guint64 stacking_serial;
+
 
 static void phoc_animatable_interface_init (PhocAnimatableInterface *iface);
 
@@ -111,12 +114,11 @@ handle_surface_commit (struct wl_listener *listener, void *data)
   if (wlr_layer_surface->current.committed != 0) {
     layer_changed = self->layer != wlr_layer_surface->current.layer;
 
-    /* Invalidate the layer the surface previously belonged to */
-    if (layer_changed)
-      phoc_output_set_layer_dirty (output, self->layer);
-
     self->layer = wlr_layer_surface->current.layer;
-    phoc_layer_shell_arrange (output);
+    if (layer_changed)
+      phoc_layer_shell_arrange (output);
+    else
+      phoc_layer_shell_arrange_surface (output, self);
     phoc_layer_shell_update_focus ();
   }
 
@@ -153,12 +155,12 @@ handle_surface_commit (struct wl_listener *listener, void *data)
   exclusive_zone_changed = !!(wlr_layer_surface->current.committed &
                               WLR_LAYER_SURFACE_V1_STATE_EXCLUSIVE_ZONE);
   if (layer_changed || exclusive_zone_changed)
-    phoc_output_set_layer_dirty (output, self->layer);
+    phoc_output_update_layer_surface_stacking (output, self);
 
   if (self->pending_serial &&
       self->layer_surface->current.configure_serial >= self->pending_serial) {
     g_debug ("layer-surface ack'ed serial %d", self->layer_surface->current.configure_serial);
-    phoc_layout_transaction_notify_layer_configured (phoc_layout_transaction_get_default ());
+    phoc_layout_transaction_notify_layer_configured (phoc_layout_transaction_get_default (), self);
     self->pending_serial = 0;
   }
 }
@@ -243,6 +245,8 @@ handle_unmap (struct wl_listener *listener, void *data)
   PhocOutput *output = phoc_layer_surface_get_output (self);
 
   self->mapped = false;
+  self->pending_serial = 0;
+  phoc_layout_transaction_remove_layer (phoc_layout_transaction_get_default (), self);
 
   PhocLayerSubsurface *subsurface, *tmp;
   wl_list_for_each_safe (subsurface, tmp, &self->subsurfaces, link)
@@ -255,7 +259,7 @@ handle_unmap (struct wl_listener *listener, void *data)
 
   if (output) {
     phoc_layer_shell_arrange (output);
-    phoc_output_set_layer_dirty (output, self->layer);
+    phoc_output_update_layer_surface_stacking (output, self);
   }
   phoc_layer_shell_update_focus ();
 }
@@ -349,6 +353,7 @@ phoc_layer_surface_constructed (GObject *object)
   /* Add to the list of layer surfaces on the output */
   output = PHOC_OUTPUT (self->layer_surface->output->data);
   wl_list_insert (&output->layer_surfaces, &self->link);
+  self->stacking.serial = ++stacking_serial;
 }
 
 
@@ -363,7 +368,12 @@ phoc_layer_surface_finalize (GObject *object)
 
   wl_list_remove (&self->link);
   if (output)
-    phoc_output_set_layer_dirty (output, self->layer);
+    phoc_output_remove_layer_surface_stacking (output, self);
+  else if (self->stacking.iter)
+    g_sequence_remove (self->stacking.iter);
+
+  /* Don't let the transaction wait for us until it times out */
+  phoc_layout_transaction_remove_layer (phoc_layout_transaction_get_default (), self);
 
   wl_list_remove (&self->destroy.link);
   wl_list_remove (&self->map.link);
@@ -586,9 +596,8 @@ phoc_layer_surface_send_configure (PhocLayerSurface *self)
   guint32 pending_serial;
   g_assert (PHOC_IS_LAYER_SURFACE (self));
 
-  /* We're not part of a transaction yet but need to */
-  if (!self->pending_serial)
-    phoc_layout_transaction_add_layer_dirty (phoc_layout_transaction_get_default ());
+  /* Join the transaction unless we're part of it already */
+  phoc_layout_transaction_add_layer_dirty (phoc_layout_transaction_get_default (), self);
 
   pending_serial = wlr_layer_surface_v1_configure (self->layer_surface,
                                                    self->geo.width,
@@ -41,6 +41,24 @@ struct _PhocLayerSurface {
 
   /* Last not yet ACKed serial */
   uint32_t           pending_serial;
+
+  /* Layout relevant state used in the last arrange */
+  struct {
+    uint32_t         anchor;
+    int32_t          exclusive_zone;
+    uint32_t         desired_width, desired_height;
+    uint32_t         margin_top, margin_right, margin_bottom, margin_left;
+  } arranged;
+
+  /* Position in the output's stacking order, see phoc_output_get_layer_surfaces_for_layer */
+  struct {
+    GSequenceIter   *iter;
+    guint64          serial;
+    gboolean         exclusive;
+    /* Surface we're stacked relative to, -1 means below, 1 above */
+    PhocLayerSurface *target;
+    int              offset;
+  } stacking;
 };
 
 PhocLayerSurface *phoc_layer_surface_new (struct wlr_layer_surface_v1 *layer_surface);
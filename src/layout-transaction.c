@@ -13,14 +13,26 @@
 #include "output.h"
 #include "server.h"
 #include "layer-surface.h"
+#include "view.h"
 
 #include "layout-transaction.h"
 
 /**
  * PhocLayoutTransaction:
  *
- * Track configures from layer surfaces and emit a signal when all of
- * them have committed new matching buffers.
+ * Track configures from layer surfaces and views and emit a signal
+ * when all of them have committed new matching buffers.
+ *
+ * When a layer surface or view joins a transaction the buffers it
+ * currently shows are locked and it's drawn from them until the
+ * transaction is done. Outputs keep repainting everything else as
+ * usual. Participants that acked their configure keep being drawn
+ * from their frozen buffers too. Once all configures got acked (or
+ * the timeout expired) the new state of all participants is presented
+ * at once.
+ *
+ * Participants are tracked individually so acks arriving after a
+ * transaction timed out don't count towards the next one.
  */
 
 #define TIMEOUT_LAYER_MS 3000
@@ -36,27 +48,127 @@ struct _PhocLayoutTransaction {
   GObject               parent;
 
   gint64                starttime;
-  guint                 pending_layer_configures;
+  /* Layer surfaces and views in the transaction mapped to their
+   * frozen surfaces */
+  GHashTable           *layer_participants;
+  GHashTable           *view_participants;
+  /* Participants that committed a buffer matching their configure */
+  GHashTable           *acked;
   guint                 layer_timer_id;
 };
 G_DEFINE_TYPE (PhocLayoutTransaction, phoc_layout_transaction, G_TYPE_OBJECT)
 
 
+static void
+frozen_surface_clear (gpointer data)
+{
+  PhocFrozenSurface *frozen = data;
+
+  wlr_buffer_unlock (&frozen->buffer->base);
+}
+
+
+static void
+freeze_surface_iterator (PhocOutput         *output,
+                         struct wlr_surface *surface,
+                         struct wlr_box     *box,
+                         float               scale,
+                         void               *data)
+{
+  GArray *frozen = data;
+  PhocFrozenSurface frozen_surface;
+
+  if (!surface->buffer || !surface->buffer->texture)
+    return;
+
+  frozen_surface = (PhocFrozenSurface) {
+    .output = output,
+    /* Locking keeps wlroots from uploading the next commit into the same texture */
+    .buffer = surface->buffer,
+    .box = *box,
+    .scale = scale,
+    .transform = surface->current.transform,
+  };
+  wlr_surface_get_buffer_source_box (surface, &frozen_surface.src_box);
+  wlr_buffer_lock (&surface->buffer->base);
+
+  g_array_append_val (frozen, frozen_surface);
+}
+
+
+static GArray *
+frozen_surfaces_new (void)
+{
+  GArray *frozen = g_array_new (FALSE, FALSE, sizeof (PhocFrozenSurface));
+
+  g_array_set_clear_func (frozen, frozen_surface_clear);
+  return frozen;
+}
+
+
+static GArray *
+freeze_layer_surface (PhocLayerSurface *layer_surface)
+{
+  PhocOutput *output = phoc_layer_surface_get_output (layer_surface);
+  GArray *frozen = frozen_surfaces_new ();
+
+  if (output && layer_surface->layer_surface->surface->mapped)
+    phoc_output_layer_surface_for_each_surface (output, layer_surface, freeze_surface_iterator,
+                                                frozen);
+  return frozen;
+}
+
+
+static GArray *
+freeze_view (PhocView *view)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  GArray *frozen = frozen_surfaces_new ();
+  PhocOutput *output;
+
+  if (!phoc_view_is_mapped (view))
+    return frozen;
+
+  wl_list_for_each (output, &desktop->outputs, link)
+    phoc_output_view_for_each_surface (output, view, freeze_surface_iterator, frozen);
+
+  return frozen;
+}
+
+
+static guint
+get_pending_configures (PhocLayoutTransaction *self)
+{
+  return g_hash_table_size (self->layer_participants) +
+    g_hash_table_size (self->view_participants) -
+    g_hash_table_size (self->acked);
+}
+
+
 static void
 apply_transaction (PhocLayoutTransaction *self)
 {
-  g_debug ("Would apply layout transaction");
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocOutput *output;
+
+  g_debug ("Applying layout transaction");
+
+  g_hash_table_remove_all (self->acked);
+  g_hash_table_remove_all (self->layer_participants);
+  g_hash_table_remove_all (self->view_participants);
+
+  /* Participants were drawn from their old buffers, render the new state in one go */
+  wl_list_for_each (output, &desktop->outputs, link)
+    phoc_output_damage_whole (output);
 }
 
 
 static void
 abort_transaction (PhocLayoutTransaction *self)
 {
-  g_return_if_fail (self->pending_layer_configures);
+  g_return_if_fail (get_pending_configures (self));
 
   apply_transaction (self);
-
-  self->pending_layer_configures = 0;
   g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ACTIVE]);
 }
 
@@ -67,12 +179,97 @@ on_timeout_expired (gpointer user_data)
   PhocLayoutTransaction *self = PHOC_LAYOUT_TRANSACTION (user_data);
 
   self->layer_timer_id = 0;
-  g_warning ("Timeout (%dms) expired with %u configures pending",
-             TIMEOUT_LAYER_MS, self->pending_layer_configures);
+  g_warning ("Timeout (%dms) expired with %u of %u configures pending",
+             TIMEOUT_LAYER_MS,
+             get_pending_configures (self),
+             g_hash_table_size (self->layer_participants) +
+             g_hash_table_size (self->view_participants));
   abort_transaction (self);
 }
 
 
+static void
+add_dirty (PhocLayoutTransaction *self)
+{
+  if (get_pending_configures (self) > 1) {
+    g_debug ("Layout transaction, adding %dth pending configure", get_pending_configures (self));
+    return;
+  }
+
+  /* Outstanding configures. Transaction started */
+  g_debug ("Starting new layout transaction");
+  self->starttime = g_get_monotonic_time ();
+  self->layer_timer_id = g_timeout_add_once (TIMEOUT_LAYER_MS, on_timeout_expired, self);
+  g_source_set_name_by_id (self->layer_timer_id, "[phoc] layout transaction timer");
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ACTIVE]);
+}
+
+
+static void
+damage_frozen (GArray *frozen)
+{
+  for (guint i = 0; i < frozen->len; i++)
+    phoc_output_damage_whole (g_array_index (frozen, PhocFrozenSurface, i).output);
+}
+
+
+static void
+notify_configured (PhocLayoutTransaction *self)
+{
+  gint64 now;
+
+  if (get_pending_configures (self)) {
+    g_debug ("Layout transaction has %u configures pending", get_pending_configures (self));
+    return;
+  }
+
+  /* All outstanding configures committed buffers */
+  now = g_get_monotonic_time ();
+  g_debug ("Layout transaction finished after %" G_GINT64_FORMAT "ms",
+           (now - self->starttime) / 1000);
+  g_clear_handle_id (&self->layer_timer_id, g_source_remove);
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ACTIVE]);
+
+  apply_transaction (self);
+}
+
+
+static void
+ack_participant (PhocLayoutTransaction *self, GHashTable *participants, gpointer participant)
+{
+  /* Transaction might have been aborted due to timeout */
+  if (!g_hash_table_contains (participants, participant))
+    return;
+
+  /* Keep the frozen buffers until all participants are done */
+  if (!g_hash_table_add (self->acked, participant))
+    return;
+
+  notify_configured (self);
+}
+
+
+static void
+remove_participant (PhocLayoutTransaction *self, GHashTable *participants, gpointer participant)
+{
+  GArray *frozen = g_hash_table_lookup (participants, participant);
+  gboolean acked;
+
+  if (!frozen)
+    return;
+
+  /* Its old state must not linger on screen */
+  damage_frozen (frozen);
+  acked = g_hash_table_remove (self->acked, participant);
+  g_hash_table_remove (participants, participant);
+
+  if (acked)
+    return;
+
+  notify_configured (self);
+}
+
+
 static void
 phoc_layout_transaction_get_property (GObject    *object,
                                       guint       property_id,
@@ -108,7 +305,9 @@ phoc_layout_transaction_finalize (GObject *object)
 {
   PhocLayoutTransaction *self = PHOC_LAYOUT_TRANSACTION (object);
 
-  apply_transaction (self);
+  g_clear_pointer (&self->acked, g_hash_table_destroy);
+  g_clear_pointer (&self->layer_participants, g_hash_table_destroy);
+  g_clear_pointer (&self->view_participants, g_hash_table_destroy);
 
   G_OBJECT_CLASS (phoc_layout_transaction_parent_class)->finalize (object);
 }
@@ -135,6 +334,11 @@ phoc_layout_transaction_class_init (PhocLayoutTransactionClass *klass)
 static void
 phoc_layout_transaction_init (PhocLayoutTransaction *self)
 {
+  self->layer_participants = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                    NULL, (GDestroyNotify) g_array_unref);
+  self->view_participants = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                                   NULL, (GDestroyNotify) g_array_unref);
+  self->acked = g_hash_table_new (g_direct_hash, g_direct_equal);
 }
 
 /**
@@ -163,65 +367,159 @@ phoc_layout_transaction_is_active (PhocLayoutTransaction *self)
 {
   g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
 
-  return self->pending_layer_configures > 0;
+  return get_pending_configures (self) > 0;
 }
 
 /**
  * phoc_layout_transaction_add_layer_dirty:
  * @self: The transaction
+ * @layer_surface: The layer surface
  *
  * Invoked by layer surfaces when they want to become part of
  * a layout transaction. If the number of outstanding configures isn't
- * 0 we consider the transaction dirty (in progress).
+ * 0 we consider the transaction dirty (in progress). Adding a layer
+ * surface that is already part of the transaction keeps its frozen
+ * surfaces but makes the transaction wait for it again.
  */
 void
-phoc_layout_transaction_add_layer_dirty (PhocLayoutTransaction *self)
+phoc_layout_transaction_add_layer_dirty (PhocLayoutTransaction *self, gpointer layer_surface)
 {
   g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
 
-  self->pending_layer_configures++;
-  if (self->pending_layer_configures > 1) {
-    g_debug ("Layout transaction, adding %dth pending configure", self->pending_layer_configures);
+  if (g_hash_table_contains (self->layer_participants, layer_surface)) {
+    g_hash_table_remove (self->acked, layer_surface);
     return;
   }
 
-  /* Outstanding configures. Transaction started */
-  g_debug ("Starting new layout transaction");
-  self->starttime = g_get_monotonic_time ();
-  self->layer_timer_id = g_timeout_add_once (TIMEOUT_LAYER_MS, on_timeout_expired, self);
-  g_source_set_name_by_id (self->layer_timer_id, "[phoc] layout transaction timer");
-  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ACTIVE]);
+  g_hash_table_insert (self->layer_participants, layer_surface,
+                       freeze_layer_surface (PHOC_LAYER_SURFACE (layer_surface)));
+
+  add_dirty (self);
 }
 
 /**
  * phoc_layout_transaction_notify_layer_configured:
  * @self: The transaction
+ * @layer_surface: The layer surface
  *
  * Invoked by layer surfaces when they handle a commit and
  * they were part of a transaction. If the number of outstanding
  * configures drops to 0 we apply the transaction.
  */
 void
-phoc_layout_transaction_notify_layer_configured (PhocLayoutTransaction *self)
+phoc_layout_transaction_notify_layer_configured (PhocLayoutTransaction *self,
+                                                 gpointer               layer_surface)
 {
-  gint64 now;
+  g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
+
+  ack_participant (self, self->layer_participants, layer_surface);
+}
 
+/**
+ * phoc_layout_transaction_remove_layer:
+ * @self: The transaction
+ * @layer_surface: The layer surface
+ *
+ * Invoked by layer surfaces when they get unmapped or destroyed so
+ * the transaction neither waits for them nor keeps drawing their old
+ * state.
+ */
+void
+phoc_layout_transaction_remove_layer (PhocLayoutTransaction *self, gpointer layer_surface)
+{
   g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
 
-  g_return_if_fail (self->pending_layer_configures > 0);
+  remove_participant (self, self->layer_participants, layer_surface);
+}
 
-  self->pending_layer_configures--;
-  if (self->pending_layer_configures) {
-    g_debug ("Layout transaction has %u configures pending", self->pending_layer_configures);
-    return;
+/**
+ * phoc_layout_transaction_add_view_dirty:
+ * @self: The transaction
+ * @view: The view
+ *
+ * Invoked by views when they get reconfigured while a transaction is
+ * active (e.g. as the usable area shrunk due to a layer surface
+ * changing its exclusive zone). The transaction then also waits for
+ * the view to commit a matching buffer.
+ *
+ * Returns: %TRUE if the view is part of the transaction
+ */
+gboolean
+phoc_layout_transaction_add_view_dirty (PhocLayoutTransaction *self, gpointer view)
+{
+  g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
+
+  if (g_hash_table_contains (self->view_participants, view)) {
+    g_hash_table_remove (self->acked, view);
+    return TRUE;
   }
 
-  /* All outstanding configures committed buffers */
-  now = g_get_monotonic_time ();
-  g_debug ("Layout transaction finished after %" G_GINT64_FORMAT "ms",
-           (now - self->starttime) / 1000);
-  g_clear_handle_id (&self->layer_timer_id, g_source_remove);
-  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_ACTIVE]);
+  /* Views don't start transactions on their own */
+  if (!phoc_layout_transaction_is_active (self))
+    return FALSE;
 
-  apply_transaction (self);
+  g_hash_table_insert (self->view_participants, view, freeze_view (PHOC_VIEW (view)));
+  add_dirty (self);
+  return TRUE;
+}
+
+/**
+ * phoc_layout_transaction_notify_view_configured:
+ * @self: The transaction
+ * @view: The view
+ *
+ * Invoked by views that were added via
+ * [method@LayoutTransaction.add_view_dirty] when they committed a
+ * buffer matching the configure.
+ */
+void
+phoc_layout_transaction_notify_view_configured (PhocLayoutTransaction *self, gpointer view)
+{
+  g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
+
+  ack_participant (self, self->view_participants, view);
+}
+
+/**
+ * phoc_layout_transaction_remove_view:
+ * @self: The transaction
+ * @view: The view
+ *
+ * Invoked by views when they get unmapped or destroyed so the
+ * transaction neither waits for them nor keeps drawing their old
+ * state.
+ */
+void
+phoc_layout_transaction_remove_view (PhocLayoutTransaction *self, gpointer view)
+{
+  g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
+
+  remove_participant (self, self->view_participants, view);
+}
+
+/**
+ * phoc_layout_transaction_get_frozen_surfaces:
+ * @self: The transaction
+ * @participant: A layer surface or view
+ *
+ * Get the surfaces of a participant as they were when it joined the
+ * transaction. The renderer draws these instead of the participant's
+ * current surfaces so the participant's old state stays on screen until
+ * the transaction is done.
+ *
+ * Returns:(transfer none)(nullable)(element-type PhocFrozenSurface): The
+ *   frozen surfaces or %NULL if @participant isn't part of the transaction
+ */
+GArray *
+phoc_layout_transaction_get_frozen_surfaces (PhocLayoutTransaction *self, gpointer participant)
+{
+  GArray *frozen;
+
+  g_assert (PHOC_IS_LAYOUT_TRANSACTION (self));
+
+  frozen = g_hash_table_lookup (self->layer_participants, participant);
+  if (frozen)
+    return frozen;
+
+  return g_hash_table_lookup (self->view_participants, participant);
 }
@@ -6,10 +6,34 @@
 
 #pragma once
 
+#include "output.h"
+
 #include <glib-object.h>
+#include <wlr/types/wlr_buffer.h>
 
 G_BEGIN_DECLS
 
+/**
+ * PhocFrozenSurface:
+ * @output: The output the surface was on
+ * @buffer: The locked buffer the surface showed when it joined
+ * @src_box: The source box within @buffer
+ * @box: The surface box in output coordinates
+ * @scale: The `scale-to-fit` scale
+ * @transform: The buffer transform
+ *
+ * A surface as it looked when its view or layer surface joined a
+ * layout transaction.
+ */
+typedef struct _PhocFrozenSurface {
+  PhocOutput               *output;
+  struct wlr_client_buffer *buffer;
+  struct wlr_fbox           src_box;
+  struct wlr_box            box;
+  float                     scale;
+  enum wl_output_transform  transform;
+} PhocFrozenSurface;
+
 #define PHOC_TYPE_LAYOUT_TRANSACTION (phoc_layout_transaction_get_type ())
 
 G_DECLARE_FINAL_TYPE (PhocLayoutTransaction, phoc_layout_transaction, PHOC, LAYOUT_TRANSACTION,
@@ -18,7 +42,19 @@ G_DECLARE_FINAL_TYPE (PhocLayoutTransaction, phoc_layout_transaction, PHOC, LAYO
 PhocLayoutTransaction *
                   phoc_layout_transaction_get_default (void);
 gboolean          phoc_layout_transaction_is_active (PhocLayoutTransaction *self);
-void              phoc_layout_transaction_notify_layer_configured (PhocLayoutTransaction *self);
-void              phoc_layout_transaction_add_layer_dirty (PhocLayoutTransaction *self);
+void              phoc_layout_transaction_notify_layer_configured (PhocLayoutTransaction *self,
+                                                                   gpointer               layer_surface);
+void              phoc_layout_transaction_add_layer_dirty (PhocLayoutTransaction *self,
+                                                           gpointer               layer_surface);
+void              phoc_layout_transaction_remove_layer (PhocLayoutTransaction *self,
+                                                        gpointer               layer_surface);
+gboolean          phoc_layout_transaction_add_view_dirty (PhocLayoutTransaction *self,
+                                                          gpointer               view);
+void              phoc_layout_transaction_notify_view_configured (PhocLayoutTransaction *self,
+                                                                  gpointer               view);
+void              phoc_layout_transaction_remove_view (PhocLayoutTransaction *self,
+                                                       gpointer               view);
+GArray           *phoc_layout_transaction_get_frozen_surfaces (PhocLayoutTransaction *self,
+                                                               gpointer               participant);
 
 G_END_DECLS
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-mode-cache"
+
+#include "phoc-config.h"
+
+#include "mode-cache.h"
+
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <stdio.h>
+
+/**
+ * PhocModeCache:
+ *
+ * Remembers the outcome of mode tests per monitor. Monitors are
+ * identified by connector and their EDID's make, model and serial so
+ * re-plugging a known monitor can use the last mode that worked
+ * right away instead of probing all modes again. Modes the backend
+ * rejected repeatedly are remembered too so they're skipped when
+ * probing. A single rejection is only noted as it might have been
+ * transient.
+ *
+ * If a filename is given the cache is loaded from and saved to that
+ * file so it persists across restarts.
+ */
+
+#define MODE_CACHE_KEY_MODE     "mode"
+#define MODE_CACHE_KEY_REJECTED "rejected"
+/* Modes rejected once, these get skipped when rejected again */
+#define MODE_CACHE_KEY_REJECTED_ONCE "rejected-once"
+
+struct _PhocModeCache {
+  GObject   parent;
+
+  GKeyFile *keyfile;
+  char     *filename;
+  gboolean  dirty;
+};
+G_DEFINE_TYPE (PhocModeCache, phoc_mode_cache, G_TYPE_OBJECT)
+
+
+static char *
+mode_to_string (int width, int height, int refresh)
+{
+  return g_strdup_printf ("%dx%d@%d", width, height, refresh);
+}
+
+
+static void
+phoc_mode_cache_finalize (GObject *object)
+{
+  PhocModeCache *self = PHOC_MODE_CACHE (object);
+  g_autoptr (GError) err = NULL;
+
+  if (!phoc_mode_cache_save (self, &err))
+    g_warning ("Failed to save mode cache: %s", err->message);
+
+  g_clear_pointer (&self->keyfile, g_key_file_unref);
+  g_clear_pointer (&self->filename, g_free);
+
+  G_OBJECT_CLASS (phoc_mode_cache_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_mode_cache_class_init (PhocModeCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_mode_cache_finalize;
+}
+
+
+static void
+phoc_mode_cache_init (PhocModeCache *self)
+{
+  self->keyfile = g_key_file_new ();
+}
+
+/**
+ * phoc_mode_cache_new:
+ * @filename: (nullable): The file to persist the cache in
+ *
+ * Returns: (transfer full): A new mode cache
+ */
+PhocModeCache *
+phoc_mode_cache_new (const char *filename)
+{
+  PhocModeCache *self = g_object_new (PHOC_TYPE_MODE_CACHE, NULL);
+  g_autoptr (GError) err = NULL;
+
+  if (filename == NULL)
+    return self;
+
+  self->filename = g_strdup (filename);
+  if (!g_key_file_load_from_file (self->keyfile, filename, G_KEY_FILE_NONE, &err)) {
+    if (!g_error_matches (err, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      g_warning ("Failed to load mode cache %s: %s", filename, err->message);
+  }
+
+  return self;
+}
+
+/**
+ * phoc_mode_cache_build_key:
+ * @connector: The output's connector name
+ * @make: (nullable): The monitor's make
+ * @model: (nullable): The monitor's model
+ * @serial: (nullable): The monitor's serial
+ *
+ * Build the key identifying a monitor on a connector.
+ *
+ * Returns: (transfer full): The key
+ */
+char *
+phoc_mode_cache_build_key (const char *connector,
+                           const char *make,
+                           const char *model,
+                           const char *serial)
+{
+  g_autofree char *edid = g_strdup_printf ("%s\n%s\n%s", make ?: "", model ?: "", serial ?: "");
+  g_autofree char *hash = g_compute_checksum_for_string (G_CHECKSUM_SHA256, edid, -1);
+
+  return g_strdup_printf ("%s %s", connector, hash);
+}
+
+/**
+ * phoc_mode_cache_lookup:
+ * @self: The mode cache
+ * @key: The monitor's key
+ * @width: (out): The mode's width
+ * @height: (out): The mode's height
+ * @refresh: (out): The mode's refresh rate in mHz
+ *
+ * Look up the last mode that worked for the monitor.
+ *
+ * Returns: %TRUE if a mode was found
+ */
+gboolean
+phoc_mode_cache_lookup (PhocModeCache *self, const char *key, int *width, int *height, int *refresh)
+{
+  g_autofree char *mode = NULL;
+
+  g_assert (PHOC_IS_MODE_CACHE (self));
+
+  mode = g_key_file_get_string (self->keyfile, key, MODE_CACHE_KEY_MODE, NULL);
+  if (mode == NULL)
+    return FALSE;
+
+  if (sscanf (mode, "%dx%d@%d", width, height, refresh) != 3) {
+    g_warning ("Invalid cached mode '%s' for %s", mode, key);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * phoc_mode_cache_set_mode:
+ * @self: The mode cache
+ * @key: The monitor's key
+ * @width: The mode's width
+ * @height: The mode's height
+ * @refresh: The mode's refresh rate in mHz
+ *
+ * Remember a mode that worked for the monitor.
+ */
+void
+phoc_mode_cache_set_mode (PhocModeCache *self, const char *key, int width, int height, int refresh)
+{
+  g_autofree char *mode = mode_to_string (width, height, refresh);
+  g_autofree char *old = NULL;
+
+  g_assert (PHOC_IS_MODE_CACHE (self));
+
+  old = g_key_file_get_string (self->keyfile, key, MODE_CACHE_KEY_MODE, NULL);
+  if (g_strcmp0 (old, mode) == 0)
+    return;
+
+  g_key_file_set_string (self->keyfile, key, MODE_CACHE_KEY_MODE, mode);
+  self->dirty = TRUE;
+}
+
+static gboolean
+list_contains (PhocModeCache *self, const char *key, const char *list, const char *mode)
+{
+  g_auto (GStrv) modes = NULL;
+
+  modes = g_key_file_get_string_list (self->keyfile, key, list, NULL, NULL);
+  if (modes == NULL)
+    return FALSE;
+
+  return g_strv_contains ((const char * const *)modes, mode);
+}
+
+
+static void
+list_add (PhocModeCache *self, const char *key, const char *list, const char *mode)
+{
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+  g_auto (GStrv) modes = NULL;
+  g_auto (GStrv) updated = NULL;
+
+  modes = g_key_file_get_string_list (self->keyfile, key, list, NULL, NULL);
+  if (modes && g_strv_contains ((const char * const *)modes, mode))
+    return;
+
+  if (modes)
+    g_strv_builder_addv (builder, (const char **)modes);
+  g_strv_builder_add (builder, mode);
+  updated = g_strv_builder_end (builder);
+
+  g_key_file_set_string_list (self->keyfile, key, list,
+                              (const char * const *)updated, g_strv_length (updated));
+  self->dirty = TRUE;
+}
+
+
+static void
+list_remove (PhocModeCache *self, const char *key, const char *list, const char *mode)
+{
+  g_autoptr (GStrvBuilder) builder = g_strv_builder_new ();
+  g_auto (GStrv) modes = NULL;
+  g_auto (GStrv) updated = NULL;
+
+  modes = g_key_file_get_string_list (self->keyfile, key, list, NULL, NULL);
+  if (modes == NULL || !g_strv_contains ((const char * const *)modes, mode))
+    return;
+
+  for (guint i = 0; modes[i]; i++) {
+    if (g_strcmp0 (modes[i], mode))
+      g_strv_builder_add (builder, modes[i]);
+  }
+  updated = g_strv_builder_end (builder);
+
+  if (updated[0]) {
+    g_key_file_set_string_list (self->keyfile, key, list,
+                                (const char * const *)updated, g_strv_length (updated));
+  } else {
+    g_key_file_remove_key (self->keyfile, key, list, NULL);
+  }
+  self->dirty = TRUE;
+}
+
+/**
+ * phoc_mode_cache_is_rejected:
+ * @self: The mode cache
+ * @key: The monitor's key
+ * @width: The mode's width
+ * @height: The mode's height
+ * @refresh: The mode's refresh rate in mHz
+ *
+ * Returns: %TRUE if the mode was rejected repeatedly for this monitor
+ */
+gboolean
+phoc_mode_cache_is_rejected (PhocModeCache *self, const char *key, int width, int height, int refresh)
+{
+  g_autofree char *mode = mode_to_string (width, height, refresh);
+
+  g_assert (PHOC_IS_MODE_CACHE (self));
+
+  return list_contains (self, key, MODE_CACHE_KEY_REJECTED, mode);
+}
+
+/**
+ * phoc_mode_cache_add_rejected:
+ * @self: The mode cache
+ * @key: The monitor's key
+ * @width: The mode's width
+ * @height: The mode's height
+ * @refresh: The mode's refresh rate in mHz
+ *
+ * Remember that the backend rejected the mode for the monitor. The
+ * mode only counts as rejected once this happened twice.
+ */
+void
+phoc_mode_cache_add_rejected (PhocModeCache *self, const char *key, int width, int height, int refresh)
+{
+  g_autofree char *mode = mode_to_string (width, height, refresh);
+
+  g_assert (PHOC_IS_MODE_CACHE (self));
+
+  if (list_contains (self, key, MODE_CACHE_KEY_REJECTED, mode))
+    return;
+
+  if (list_contains (self, key, MODE_CACHE_KEY_REJECTED_ONCE, mode)) {
+    list_remove (self, key, MODE_CACHE_KEY_REJECTED_ONCE, mode);
+    list_add (self, key, MODE_CACHE_KEY_REJECTED, mode);
+  } else {
+    list_add (self, key, MODE_CACHE_KEY_REJECTED_ONCE, mode);
+  }
+}
+
+/**
+ * phoc_mode_cache_remove_rejected:
+ * @self: The mode cache
+ * @key: The monitor's key
+ * @width: The mode's width
+ * @height: The mode's height
+ * @refresh: The mode's refresh rate in mHz
+ *
+ * Forget that the backend rejected the mode for the monitor, e.g. as
+ * it got accepted later on.
+ */
+void
+phoc_mode_cache_remove_rejected (PhocModeCache *self,
+                                 const char    *key,
+                                 int            width,
+                                 int            height,
+                                 int            refresh)
+{
+  g_autofree char *mode = mode_to_string (width, height, refresh);
+
+  g_assert (PHOC_IS_MODE_CACHE (self));
+
+  list_remove (self, key, MODE_CACHE_KEY_REJECTED_ONCE, mode);
+  list_remove (self, key, MODE_CACHE_KEY_REJECTED, mode);
+}
+
+/**
+ * phoc_mode_cache_save:
+ * @self: The mode cache
+ * @error: Return location for an error
+ *
+ * Write the cache to disk if it changed and has a filename.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+phoc_mode_cache_save (PhocModeCache *self, GError **error)
+{
+  g_autofree char *dir = NULL;
+
+  g_assert (PHOC_IS_MODE_CACHE (self));
+
+  if (!self->dirty || self->filename == NULL)
+    return TRUE;
+
+  dir = g_path_get_dirname (self->filename);
+  if (g_mkdir_with_parents (dir, 0700) < 0) {
+    int saved_errno = errno;
+
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+                 "Failed to create %s: %s", dir, g_strerror (saved_errno));
+    return FALSE;
+  }
+
+  if (!g_key_file_save_to_file (self->keyfile, self->filename, error))
+    return FALSE;
+
+  self->dirty = FALSE;
+  return TRUE;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_MODE_CACHE (phoc_mode_cache_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocModeCache, phoc_mode_cache, PHOC, MODE_CACHE, GObject)
+
+PhocModeCache *phoc_mode_cache_new              (const char    *filename);
+char          *phoc_mode_cache_build_key        (const char    *connector,
+                                                 const char    *make,
+                                                 const char    *model,
+                                                 const char    *serial);
+gboolean       phoc_mode_cache_lookup           (PhocModeCache *self,
+                                                 const char    *key,
+                                                 int           *width,
+                                                 int           *height,
+                                                 int           *refresh);
+void           phoc_mode_cache_set_mode         (PhocModeCache *self,
+                                                 const char    *key,
+                                                 int            width,
+                                                 int            height,
+                                                 int            refresh);
+gboolean       phoc_mode_cache_is_rejected      (PhocModeCache *self,
+                                                 const char    *key,
+                                                 int            width,
+                                                 int            height,
+                                                 int            refresh);
+void           phoc_mode_cache_add_rejected     (PhocModeCache *self,
+                                                 const char    *key,
+                                                 int            width,
+                                                 int            height,
+                                                 int            refresh);
+void           phoc_mode_cache_remove_rejected  (PhocModeCache *self,
+                                                 const char    *key,
+                                                 int            width,
+                                                 int            height,
+                                                 int            refresh);
+gboolean       phoc_mode_cache_save             (PhocModeCache *self,
+                                                 GError       **error);
+
+G_END_DECLS
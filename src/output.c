@@ -1,9 +1,11 @@
 #define G_LOG_DOMAIN "phoc-output"
 
 #include "phoc-config.h"
+#include "phoc-enums.h"
 #include "phoc-tracing.h"
 
 #define _POSIX_C_SOURCE 200809L
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <time.h>
@@ -14,6 +16,7 @@
 #include <wlr/types/wlr_gamma_control_v1.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_output_power_management_v1.h>
+#include <wlr/types/wlr_output_swapchain_manager.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/region.h>
 #include <wlr/util/transform.h>
@@ -26,6 +29,7 @@
 #include "layer-shell.h"
 #include "layer-shell-effects.h"
 #include "layout-transaction.h"
+#include "mode-cache.h"
 #include "output.h"
 #include "output-shield.h"
 #include "render.h"
@@ -70,18 +74,70 @@ typedef struct _PhocOutputPrivate {
   struct wl_listener     frame;
   struct wl_listener     needs_frame;
   struct wl_listener     request_state;
+  struct wl_listener     present;
 
   PhocOutputScaleFilter  scale_filter;
   gboolean               gamma_lut_changed;
+  guint                  color_temperature;
+  /* The last applied gamma table, %NULL for the identity */
+  guint16               *gamma_table;
+  gssize                 gamma_table_size;
+  /* The largest ramp size known to pass the test */
+  size_t                 gamma_tested_ramp_size;
 
-  GQueue                *layer_surfaces[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY + 1];
+  GSequence             *layer_surfaces[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY + 1];
 
   PhocLayoutTransaction *transaction;
   gboolean               modeset_shield;
 
   GSList                *debug_damage;
+
+  /* Refresh rate policy */
+  int                     idle_refresh;
+  GSource                *idle_refresh_source;
+  struct wlr_output_mode *pending_mode;
+  struct wlr_output_mode *restore_mode;
+  gboolean                restore_requested;
+  gint64                  busy_since_us;
+  gint64                  last_busy_us;
+  gboolean                refresh_switch;
+  /* mHz (0 for adaptive sync) -> time at that rate in µs */
+  GHashTable             *refresh_stats;
+  int                     stats_refresh;
+  gint64                  stats_since;
+
+  /* Frame accounting */
+  PhocOutputFrameReason   frame_reasons;
+  gboolean                parked;
+  guint64                 n_frames;
+  guint64                 n_empty_frames;
+  guint64                 n_parks;
+  guint64                 last_frame_time_us;
+  guint64                 n_reason_frames[8];
+
+  /* Mirroring */
+  PhocOutput             *mirror_source;
+  struct wlr_buffer      *mirror_buffer;
+  struct wlr_texture     *mirror_texture;
+  gboolean                mirror_dirty;
+  gboolean                mirror_unsupported;
+
+  /* Power saving */
+  struct wlr_buffer      *front_buffer;
+  gint64                  resume_start_us;
+  guint64                 n_resumes;
+  guint64                 n_fast_resumes;
+  guint64                 last_resume_us;
+  guint64                 max_resume_us;
 } PhocOutputPrivate;
 
+G_STATIC_ASSERT (PHOC_OUTPUT_FRAME_REASON_DEBUG < 1 << 8);
+
+/* Drop to the idle refresh rate after that long without new frames */
+#define IDLE_REFRESH_TIMEOUT_MS 2000
+/* Ramp up again when there were new frames at the idle rate for that long */
+#define IDLE_REFRESH_BUSY_MS 500
+
 static void phoc_output_initable_iface_init (GInitableIface *iface);
 
 static void phoc_output_animatable_interface_init (PhocAnimatableInterface *iface);
@@ -98,6 +154,7 @@ static void phoc_output_for_each_surface (PhocOutput          *self,
                                           PhocSurfaceIterator  iterator,
                                           void                *user_data,
                                           gboolean             visible_only);
+static void schedule_frame (PhocOutput *self, PhocOutputFrameReason reason);
 
 typedef struct {
   PhocAnimatable    *animatable;
@@ -301,6 +358,9 @@ phoc_output_init (PhocOutput *self)
   wl_list_init (&self->layer_surfaces);
 
   priv->scale_filter = PHOC_OUTPUT_SCALE_FILTER_AUTO;
+  priv->refresh_stats = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+  priv->gamma_table_size = -1;
+  priv->stats_refresh = -1;
 
   priv->renderer = g_object_ref (phoc_server_get_renderer (server));
 
@@ -380,33 +440,139 @@ phoc_output_handle_damage (struct wl_listener *listener, void *user_data)
   PhocOutput *self = PHOC_OUTPUT_SELF (priv);
   struct wlr_output_event_damage *event = user_data;
 
+  /* wlroots only emits damage for software cursors */
   if (wlr_damage_ring_add (&self->damage_ring, event->damage))
-    wlr_output_schedule_frame (self->wlr_output);
+    schedule_frame (self, PHOC_OUTPUT_FRAME_REASON_CURSOR);
 }
 
 
+/* Neutral color temperature, no need for a gamma table */
+#define COLOR_TEMPERATURE_NEUTRAL 6500
+#define COLOR_TEMPERATURE_MIN     1000
+
+/*
+ * Approximate the white point of a black body at the given color
+ * temperature and build a linear ramp per channel towards it.
+ */
+static guint16 *
+build_color_temperature_table (guint temperature, size_t ramp_size)
+{
+  double t = temperature / 100.0;
+  double r, g, b;
+  guint16 *table = g_new (guint16, ramp_size * 3);
+
+  if (t <= 66) {
+    r = 1.0;
+    g = (99.4708025861 * log (t) - 161.1195681661) / 255.0;
+    b = t <= 19 ? 0.0 : (138.5177312231 * log (t - 10) - 305.0447927307) / 255.0;
+  } else {
+    r = 329.698727446 * pow (t - 60, -0.1332047592) / 255.0;
+    g = 288.1221695283 * pow (t - 60, -0.0755148492) / 255.0;
+    b = 1.0;
+  }
+  r = CLAMP (r, 0.0, 1.0);
+  g = CLAMP (g, 0.0, 1.0);
+  b = CLAMP (b, 0.0, 1.0);
+
+  for (size_t i = 0; i < ramp_size; i++) {
+    double v = ramp_size > 1 ? (double)i / (ramp_size - 1) : 1.0;
+
+    table[i] = round (v * r * G_MAXUINT16);
+    table[ramp_size + i] = round (v * g * G_MAXUINT16);
+    table[2 * ramp_size + i] = round (v * b * G_MAXUINT16);
+  }
+
+  return table;
+}
+
+/*
+ * Forget about the applied gamma table and which ramp sizes passed the
+ * test, e.g. as the output got reenabled
+ */
+static void
+invalidate_gamma_lut (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  g_clear_pointer (&priv->gamma_table, g_free);
+  priv->gamma_table_size = -1;
+  priv->gamma_tested_ramp_size = 0;
+}
+
+/*
+ * Apply the gamma table of the output's gamma control or, if there's
+ * none, the one for the configured color temperature. Gamma changes
+ * are only picked up once per frame, tables identical to the current
+ * one are skipped and only tables with a ramp size that didn't pass
+ * the test yet get tested. The current table is only updated once
+ * the commit carrying it succeeded, see `update_gamma_lut()`.
+ */
 static void
 phoc_output_set_gamma_lut (PhocOutput *self, struct wlr_output_state *pending)
 {
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
   struct wlr_gamma_control_v1 *gamma_control;
+  g_autofree guint16 *temperature_table = NULL;
+  const guint16 *table = NULL;
+  size_t ramp_size = 0;
 
   gamma_control = wlr_gamma_control_manager_v1_get_control (desktop->gamma_control_manager_v1,
                                                             self->wlr_output);
   priv->gamma_lut_changed = FALSE;
 
-  if (!wlr_gamma_control_v1_apply (gamma_control, pending))
+  if (gamma_control) {
+    table = gamma_control->table;
+    ramp_size = gamma_control->ramp_size;
+  } else if (priv->color_temperature) {
+    ramp_size = wlr_output_get_gamma_size (self->wlr_output);
+    if (ramp_size) {
+      temperature_table = build_color_temperature_table (priv->color_temperature, ramp_size);
+      table = temperature_table;
+    }
+  }
+
+  if ((gssize)ramp_size * 3 == priv->gamma_table_size &&
+      (ramp_size == 0 || memcmp (table, priv->gamma_table, ramp_size * 3 * sizeof (guint16)) == 0)) {
     return;
+  }
 
-  if (!wlr_output_test_state (self->wlr_output, pending)) {
-    wlr_output_state_finish (pending);
-    wlr_gamma_control_v1_send_failed_and_destroy (gamma_control);
-    *pending = (struct wlr_output_state){0};
+  if (ramp_size)
+    wlr_output_state_set_gamma_lut (pending, ramp_size, table, table + ramp_size, table + 2 * ramp_size);
+  else
+    wlr_output_state_set_gamma_lut (pending, 0, NULL, NULL, NULL);
+
+  /* Only the size matters for the test, not the values */
+  if (ramp_size > priv->gamma_tested_ramp_size) {
+    if (!wlr_output_test_state (self->wlr_output, pending)) {
+      wlr_output_state_finish (pending);
+      *pending = (struct wlr_output_state){0};
+      if (gamma_control) {
+        wlr_gamma_control_v1_send_failed_and_destroy (gamma_control);
+      } else {
+        g_warning ("Failed to set color temperature on %s", phoc_output_get_name (self));
+        priv->color_temperature = 0;
+      }
+      return;
+    }
+    priv->gamma_tested_ramp_size = ramp_size;
   }
 }
 
 
+/* Remember the gamma table that made it to the output */
+static void
+update_gamma_lut (PhocOutput *self, const struct wlr_output_state *state)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  size_t size = state->gamma_lut_size * 3;
+
+  g_free (priv->gamma_table);
+  priv->gamma_table = size ? g_memdup2 (state->gamma_lut, size * sizeof (guint16)) : NULL;
+  priv->gamma_table_size = size;
+}
+
+
 static void
 surface_send_frame_done_iterator (PhocOutput         *output,
                                   struct wlr_surface *wlr_surface,
@@ -440,6 +606,7 @@ scan_out_fullscreen_view (PhocOutput *self, PhocView *view, struct wlr_output_st
   struct wlr_output *wlr_output = self->wlr_output;
   size_t n_surfaces = 0;
   struct wlr_surface *wlr_surface;
+  int width, height;
 
   g_assert (PHOC_IS_VIEW (view));
 
@@ -463,6 +630,10 @@ scan_out_fullscreen_view (PhocOutput *self, PhocView *view, struct wlr_output_st
   if (!phoc_view_is_mapped (view))
     return false;
 
+  /* The view is drawn from its old buffers until the transaction is done */
+  if (phoc_layout_transaction_get_frozen_surfaces (phoc_layout_transaction_get_default (), view))
+    return false;
+
   phoc_output_view_for_each_surface (self, view, count_surface_iterator, &n_surfaces);
   if (n_surfaces > 1)
     return false;
@@ -476,8 +647,24 @@ scan_out_fullscreen_view (PhocOutput *self, PhocView *view, struct wlr_output_st
   if (wlr_surface->buffer == NULL)
     return false;
 
-  if ((float)wlr_surface->current.scale != wlr_output->scale ||
-      wlr_surface->current.transform != wlr_output->transform) {
+  /* Without plane rotation the client needs to render with the output's
+   * transform applied, see the preferred buffer transform hint */
+  if (wlr_surface->current.transform != wlr_output->transform)
+    return false;
+
+  /* Fractionally scaled clients can be scanned out too as long as their
+   * buffer covers the output pixel by pixel */
+  if (wlr_surface->current.viewport.has_src ||
+      wlr_surface->current.buffer_width != wlr_output->width ||
+      wlr_surface->current.buffer_height != wlr_output->height) {
+    return false;
+  }
+
+  /* The surface also needs to cover the output when composited,
+   * e.g. no viewport destination or buffer scale that differs */
+  wlr_output_transformed_resolution (wlr_output, &width, &height);
+  if (round (wlr_surface->current.width * wlr_output->scale) != width ||
+      round (wlr_surface->current.height * wlr_output->scale) != height) {
     return false;
   }
 
@@ -562,12 +749,223 @@ build_debug_damage_tracking (PhocOutput *self)
 }
 
 
-PHOC_TRACE_NO_INLINE static void
+static int
+get_effective_refresh (PhocOutput *self)
+{
+  if (!self->wlr_output->enabled)
+    return -1;
+
+  if (self->wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED)
+    return 0;
+
+  return self->wlr_output->refresh;
+}
+
+
+static void
+update_refresh_stats (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gint64 now = g_get_monotonic_time ();
+
+  if (priv->stats_refresh >= 0) {
+    gint64 *usec = g_hash_table_lookup (priv->refresh_stats, GINT_TO_POINTER (priv->stats_refresh));
+
+    if (usec == NULL) {
+      usec = g_new0 (gint64, 1);
+      g_hash_table_insert (priv->refresh_stats, GINT_TO_POINTER (priv->stats_refresh), usec);
+    }
+    *usec += now - priv->stats_since;
+  }
+
+  priv->stats_refresh = get_effective_refresh (self);
+  priv->stats_since = now;
+}
+
+/*
+ * The mode with the same size as the current one and the lowest
+ * refresh rate that is still at or above the configured idle rate.
+ */
+static struct wlr_output_mode *
+find_idle_mode (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_output_mode *current = self->wlr_output->current_mode;
+  struct wlr_output_mode *mode, *best = NULL;
+
+  if (current == NULL)
+    return NULL;
+
+  wl_list_for_each (mode, &self->wlr_output->modes, link) {
+    if (mode->width != current->width || mode->height != current->height)
+      continue;
+
+    if (mode->refresh >= current->refresh || mode->refresh < priv->idle_refresh)
+      continue;
+
+    if (best == NULL || mode->refresh < best->refresh)
+      best = mode;
+  }
+
+  return best;
+}
+
+
+static gboolean
+on_idle_refresh (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_output_mode *mode;
+
+  g_source_set_ready_time (priv->idle_refresh_source, -1);
+
+  /* Already downclocked, animating or adaptive sync stretches frames anyway */
+  if (priv->restore_mode || priv->frame_callbacks || get_effective_refresh (self) <= 0)
+    return G_SOURCE_CONTINUE;
+
+  mode = find_idle_mode (self);
+  if (mode == NULL)
+    return G_SOURCE_CONTINUE;
+
+  g_debug ("%s idle, dropping to %d mHz", phoc_output_get_name (self), mode->refresh);
+  priv->restore_mode = self->wlr_output->current_mode;
+  priv->restore_requested = FALSE;
+  priv->busy_since_us = 0;
+  priv->pending_mode = mode;
+  phoc_output_damage_whole (self);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+/*
+ * @rejected: Whether the backend rejected the commit with the new mode.
+ *   Otherwise drawing the frame failed before it got committed.
+ */
+static void
+check_refresh_switch (PhocOutput *self, struct wlr_output_state *pending, gboolean rejected)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_output_mode *current = self->wlr_output->current_mode;
+
+  priv->refresh_switch = FALSE;
+
+  if (current == pending->mode)
+    return;
+
+  if (!rejected) {
+    /* Mode didn't make it to the backend, retry with the next frame */
+    if (current && pending->mode->refresh > current->refresh) {
+      priv->restore_mode = pending->mode;
+      priv->restore_requested = TRUE;
+    } else
+      priv->pending_mode = pending->mode;
+    return;
+  }
+
+  /* Retrying would fail every further frame, stay on the current mode */
+  g_debug ("Refresh rate switch to %d mHz failed on %s, disabling",
+           pending->mode->refresh, phoc_output_get_name (self));
+  priv->restore_mode = NULL;
+  priv->pending_mode = NULL;
+  priv->idle_refresh = 0;
+  g_source_destroy (priv->idle_refresh_source);
+  g_clear_pointer (&priv->idle_refresh_source, g_source_unref);
+
+  /* Redraw the rejected frame without the mode switch */
+  wlr_output_schedule_frame (self->wlr_output);
+}
+
+
+static gboolean
+idle_refresh_source_dispatch (GSource *source, GSourceFunc callback, gpointer user_data)
+{
+  return callback (user_data);
+}
+
+
+/* Only dispatches at its ready time which is moved forward on every frame */
+static GSourceFuncs idle_refresh_source_funcs = {
+  .dispatch = idle_refresh_source_dispatch,
+};
+
+
+/*
+ * While at the idle refresh rate only ramp up on user activity or
+ * when every frame at that rate had new content for a while. Periodic
+ * updates like a clock or a blinking cursor don't cause mode switches
+ * that way.
+ */
+static gboolean
+should_restore_refresh (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  gint64 now = g_get_monotonic_time ();
+  int refresh = self->wlr_output->refresh;
+  gint64 period_us = refresh > 0 ? G_USEC_PER_SEC * 1000 / refresh : 0;
+
+  if (priv->restore_requested)
+    return TRUE;
+
+  /* A frame was skipped so content isn't changing continuously */
+  if (priv->busy_since_us == 0 || now - priv->last_busy_us > 2 * period_us)
+    priv->busy_since_us = now;
+  priv->last_busy_us = now;
+
+  return now - priv->busy_since_us >= IDLE_REFRESH_BUSY_MS * 1000;
+}
+
+/*
+ * Blit the source's last frame scaled to fit, keeping the aspect
+ * ratio, instead of compositing the views again.
+ */
+static void
+render_mirror (PhocOutput *self, struct wlr_render_pass *render_pass)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_output *source = priv->mirror_source->wlr_output;
+  int width, height, src_width, src_height;
+  struct wlr_box dst_box;
+  double scale;
+
+  priv->mirror_dirty = FALSE;
+
+  wlr_render_pass_add_rect (render_pass, &(struct wlr_render_rect_options) {
+      .box = { .width = self->wlr_output->width, .height = self->wlr_output->height },
+      .color = { .a = 1.0 },
+    });
+
+  if (priv->mirror_texture == NULL)
+    return;
+
+  wlr_output_transformed_resolution (self->wlr_output, &width, &height);
+  wlr_output_transformed_resolution (source, &src_width, &src_height);
+  scale = MIN ((double)width / src_width, (double)height / src_height);
+
+  dst_box.width = round (src_width * scale);
+  dst_box.height = round (src_height * scale);
+  dst_box.x = (width - dst_box.width) / 2;
+  dst_box.y = (height - dst_box.height) / 2;
+  phoc_output_transform_box (self, &dst_box);
+
+  wlr_render_pass_add_texture (render_pass, &(struct wlr_render_texture_options) {
+      .texture = priv->mirror_texture,
+      .dst_box = dst_box,
+      .transform = wlr_output_transform_compose (wlr_output_transform_invert (source->transform),
+                                                 self->wlr_output->transform),
+      .filter_mode = scale == 1.0 ? WLR_SCALE_FILTER_NEAREST : WLR_SCALE_FILTER_BILINEAR,
+    });
+}
+
+
+/* Returns: %TRUE if a new frame was committed */
+PHOC_TRACE_NO_INLINE static gboolean
 phoc_output_draw (PhocOutput *self)
 {
   PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
   struct wlr_output *wlr_output = self->wlr_output;
-  bool needs_frame, scanned_out = false;
+  bool needs_frame, scanned_out = false, committed = false, rejected = false;
   pixman_region32_t buffer_damage, frame_damage;
   int buffer_age;
   PhocRenderContext render_context;
@@ -576,29 +974,52 @@ phoc_output_draw (PhocOutput *self)
   struct wlr_output_state pending = { 0 };
 
   if (!wlr_output->enabled)
-    return;
+    return FALSE;
 
   needs_frame = wlr_output->needs_frame;
-  needs_frame |= pixman_region32_not_empty (&self->damage_ring.current);
+  /* Mirrors only need to update when their source has a new frame */
+  if (G_UNLIKELY (priv->mirror_source))
+    needs_frame |= priv->mirror_dirty;
+  else
+    needs_frame |= pixman_region32_not_empty (&self->damage_ring.current);
   needs_frame |= priv->gamma_lut_changed;
   needs_frame |= (priv->debug_damage != NULL);
 
   if (!needs_frame)
-    return;
+    return FALSE;
 
   if (G_UNLIKELY (priv->gamma_lut_changed))
     phoc_output_set_gamma_lut (self, &pending);
 
+  if (priv->pending_mode) {
+    wlr_output_state_set_mode (&pending, priv->pending_mode);
+    priv->pending_mode = NULL;
+    priv->refresh_switch = TRUE;
+  } else if (priv->restore_mode && should_restore_refresh (self)) {
+    g_debug ("%s busy, restoring %d mHz", phoc_output_get_name (self), priv->restore_mode->refresh);
+    wlr_output_state_set_mode (&pending, priv->restore_mode);
+    priv->restore_mode = NULL;
+    priv->restore_requested = FALSE;
+    priv->refresh_switch = TRUE;
+  }
+
+  if (priv->idle_refresh_source && !priv->restore_mode) {
+    g_source_set_ready_time (priv->idle_refresh_source,
+                             g_get_monotonic_time () + IDLE_REFRESH_TIMEOUT_MS * 1000);
+  }
+
   get_frame_damage (self, &frame_damage);
   wlr_output_state_set_damage (&pending, &frame_damage);
   pixman_region32_fini (&frame_damage);
 
   /* Check if we can delegate the fullscreen surface to the output */
-  if (phoc_output_has_fullscreen_view (self))
+  if (!priv->mirror_source && phoc_output_has_fullscreen_view (self))
     scanned_out = scan_out_fullscreen_view (self, self->fullscreen_view, &pending);
 
-  if (scanned_out)
+  if (scanned_out) {
+    committed = true;
     goto out;
+  }
 
   if (!wlr_output_configure_primary_swapchain (wlr_output, &pending, &wlr_output->swapchain))
     goto out;
@@ -613,18 +1034,22 @@ phoc_output_draw (PhocOutput *self)
     goto out;
   }
 
-  pixman_region32_init (&buffer_damage);
-  wlr_damage_ring_get_buffer_damage (&self->damage_ring, buffer_age, &buffer_damage);
-
-  render_context = (PhocRenderContext){
-    .output = self,
-    .damage = &buffer_damage,
-    .alpha = 1.0,
-    .render_pass = render_pass,
-  };
-  phoc_renderer_render_output (priv->renderer, self, &render_context);
-
-  pixman_region32_fini (&buffer_damage);
+  if (G_UNLIKELY (priv->mirror_source)) {
+    render_mirror (self, render_pass);
+  } else {
+    pixman_region32_init (&buffer_damage);
+    wlr_damage_ring_get_buffer_damage (&self->damage_ring, buffer_age, &buffer_damage);
+
+    render_context = (PhocRenderContext){
+      .output = self,
+      .damage = &buffer_damage,
+      .alpha = 1.0,
+      .render_pass = render_pass,
+    };
+    phoc_renderer_render_output (priv->renderer, self, &render_context);
+
+    pixman_region32_fini (&buffer_damage);
+  }
 
   if (!wlr_render_pass_submit (render_pass)) {
     /* Rerender in case of failure */
@@ -636,13 +1061,82 @@ phoc_output_draw (PhocOutput *self)
   wlr_output_state_set_buffer (&pending, buffer);
   wlr_buffer_unlock (buffer);
 
-  if (!wlr_output_commit_state (wlr_output, &pending))
+  if (!wlr_output_commit_state (wlr_output, &pending)) {
+    rejected = true;
     goto out;
+  }
 
+  committed = true;
   wlr_damage_ring_rotate (&self->damage_ring);
 
  out:
+  if (G_UNLIKELY (priv->refresh_switch))
+    check_refresh_switch (self, &pending, rejected);
+
+  /* Gamma didn't make it to the output, retry with the next frame */
+  if (G_UNLIKELY (!committed && pending.committed & WLR_OUTPUT_STATE_GAMMA_LUT))
+    priv->gamma_lut_changed = TRUE;
+
   wlr_output_state_finish (&pending);
+
+  return committed;
+}
+
+
+static void
+schedule_frame (PhocOutput *self, PhocOutputFrameReason reason)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  priv->frame_reasons |= reason;
+  wlr_output_schedule_frame (self->wlr_output);
+}
+
+/*
+ * Damage, gamma changes, etc. are already tracked so derive the
+ * reasons from that and only keep track of the ones we can't tell
+ * apart afterwards.
+ */
+static PhocOutputFrameReason
+collect_frame_reasons (PhocOutput *self, gboolean animating)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  PhocOutputFrameReason reasons = priv->frame_reasons;
+
+  if (pixman_region32_not_empty (&self->damage_ring.current))
+    reasons |= PHOC_OUTPUT_FRAME_REASON_DAMAGE;
+  if (animating)
+    reasons |= PHOC_OUTPUT_FRAME_REASON_ANIMATION;
+  if (priv->gamma_lut_changed)
+    reasons |= PHOC_OUTPUT_FRAME_REASON_GAMMA;
+  if (self->wlr_output->needs_frame)
+    reasons |= PHOC_OUTPUT_FRAME_REASON_BACKEND;
+  if (priv->debug_damage)
+    reasons |= PHOC_OUTPUT_FRAME_REASON_DEBUG;
+
+  priv->frame_reasons = 0;
+  return reasons;
+}
+
+
+static void
+account_frame (PhocOutput            *self,
+               PhocOutputFrameReason  reasons,
+               gboolean               committed,
+               gint64                 start_us)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  if (committed) {
+    priv->n_frames++;
+    priv->last_frame_time_us = g_get_monotonic_time () - start_us;
+  } else if (reasons & ~PHOC_OUTPUT_FRAME_REASON_CLIENT)
+    priv->n_empty_frames++;
+
+  for (guint i = 0; i < G_N_ELEMENTS (priv->n_reason_frames); i++) {
+    if (reasons & (1 << i))
+      priv->n_reason_frames[i]++;
+  }
 }
 
 
@@ -651,8 +1145,14 @@ phoc_output_handle_frame (struct wl_listener *listener, void *data)
 {
   PhocOutputPrivate *priv = wl_container_of (listener, priv, frame);
   PhocOutput *self = PHOC_OUTPUT_SELF (priv);
+  PhocOutputFrameReason reasons;
+  gboolean animating, committed;
+  gint64 start_us = g_get_monotonic_time ();
   struct timespec now;
 
+  priv->parked = FALSE;
+  animating = !!priv->frame_callbacks;
+
   /* Process all registered frame callbacks */
   GSList *l = priv->frame_callbacks;
   while (l != NULL) {
@@ -669,17 +1169,20 @@ phoc_output_handle_frame (struct wl_listener *listener, void *data)
   }
   priv->last_frame_us = g_get_monotonic_time ();
 
-  /* Ensure the cutouts are drawn */
-  if (G_UNLIKELY (priv->cutouts_texture)) {
+  /* Ensure the cutouts are drawn on top of whatever gets repainted but
+   * don't keep the frame clock ticking just for them */
+  if (G_UNLIKELY (priv->cutouts_texture) && pixman_region32_not_empty (&self->damage_ring.current)) {
     struct wlr_box box = { 0, 0, priv->cutouts_texture->width, priv->cutouts_texture->height };
-    if (wlr_damage_ring_add_box (&self->damage_ring, &box))
-      wlr_output_schedule_frame (self->wlr_output);
+    wlr_damage_ring_add_box (&self->damage_ring, &box);
   }
 
   build_debug_damage_tracking (self);
 
+  reasons = collect_frame_reasons (self, animating);
+
   /* Repaint the output */
-  phoc_output_draw (self);
+  committed = phoc_output_draw (self);
+  account_frame (self, reasons, committed, start_us);
 
   /* Send frame done events to all visible surfaces */
   clock_gettime (CLOCK_MONOTONIC, &now);
@@ -687,11 +1190,19 @@ phoc_output_handle_frame (struct wl_listener *listener, void *data)
 
   /* Want frame clock ticking as long as we have frame callbacks */
   if (priv->frame_callbacks)
-    wlr_output_schedule_frame (self->wlr_output);
+    schedule_frame (self, PHOC_OUTPUT_FRAME_REASON_ANIMATION);
 
   /* Need to redraw until all debug damage faded out */
   if (priv->debug_damage)
-    wlr_output_schedule_frame (self->wlr_output);
+    schedule_frame (self, PHOC_OUTPUT_FRAME_REASON_DEBUG);
+
+  /* Without a commit there's no further frame event unless someone
+   * schedules one so the frame clock parks */
+  if (!committed && !priv->frame_callbacks && !priv->debug_damage && !priv->frame_reasons &&
+      !priv->gamma_lut_changed && !pixman_region32_not_empty (&self->damage_ring.current)) {
+    priv->parked = TRUE;
+    priv->n_parks++;
+  }
 }
 
 
@@ -701,7 +1212,7 @@ phoc_output_handle_needs_frame (struct wl_listener *listener, void *user_data)
   PhocOutputPrivate *priv = wl_container_of (listener, priv, needs_frame);
   PhocOutput *self = PHOC_OUTPUT_SELF (priv);
 
-  wlr_output_schedule_frame (self->wlr_output);
+  schedule_frame (self, PHOC_OUTPUT_FRAME_REASON_BACKEND);
 }
 
 
@@ -718,6 +1229,66 @@ update_output_scale_iterator (PhocOutput         *self,
 }
 
 
+static void
+set_mirror_buffer (PhocOutput *self, struct wlr_buffer *buffer)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+
+  g_clear_pointer (&priv->mirror_texture, wlr_texture_destroy);
+  g_clear_pointer (&priv->mirror_buffer, wlr_buffer_unlock);
+
+  if (buffer == NULL)
+    return;
+
+  priv->mirror_texture = wlr_texture_from_buffer (self->wlr_output->renderer, buffer);
+  if (priv->mirror_texture == NULL) {
+    g_warning ("Can't use %s's buffers on %s, rendering it separately",
+               phoc_output_get_name (priv->mirror_source), phoc_output_get_name (self));
+    priv->mirror_unsupported = TRUE;
+    phoc_output_set_mirror_source (self, NULL);
+    return;
+  }
+
+  priv->mirror_buffer = wlr_buffer_lock (buffer);
+  priv->mirror_dirty = TRUE;
+  phoc_output_damage_whole (self);
+}
+
+
+static void
+update_mirrors (PhocOutput *self, struct wlr_buffer *buffer)
+{
+  PhocOutput *output;
+
+  wl_list_for_each (output, &self->desktop->outputs, link) {
+    PhocOutputPrivate *output_priv = phoc_output_get_instance_private (output);
+
+    if (output_priv->mirror_source == self)
+      set_mirror_buffer (output, buffer);
+  }
+}
+
+
+/*
+ * Keep the last composited buffer around so it can be shown right
+ * away when the output resumes from power saving. Client buffers
+ * used for direct scanout aren't kept as this would keep clients from
+ * reusing them.
+ */
+static void
+set_front_buffer (PhocOutput *self, struct wlr_buffer *buffer)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_buffer *old = priv->front_buffer;
+
+  priv->front_buffer = NULL;
+  if (buffer && wlr_client_buffer_get (buffer) == NULL)
+    priv->front_buffer = wlr_buffer_lock (buffer);
+
+  g_clear_pointer (&old, wlr_buffer_unlock);
+}
+
+
 static void
 phoc_output_handle_commit (struct wl_listener *listener, void *data)
 {
@@ -725,7 +1296,34 @@ phoc_output_handle_commit (struct wl_listener *listener, void *data)
   PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
   struct wlr_output_event_commit *event = data;
 
-  if (event->state->committed & (WLR_OUTPUT_STATE_MODE |
+  if (event->state->committed & WLR_OUTPUT_STATE_BUFFER) {
+    update_mirrors (self, event->state->buffer);
+    set_front_buffer (self, event->state->buffer);
+  }
+
+  /* The old content doesn't fit anymore */
+  if (event->state->committed & WLR_OUTPUT_STATE_MODE &&
+      !(event->state->committed & WLR_OUTPUT_STATE_BUFFER)) {
+    set_front_buffer (self, NULL);
+  }
+
+  if (event->state->committed & (WLR_OUTPUT_STATE_ENABLED |
+                                 WLR_OUTPUT_STATE_MODE |
+                                 WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED)) {
+    update_refresh_stats (self);
+  }
+
+  /* Someone else picked a mode, don't switch back to the old one */
+  if ((event->state->committed & (WLR_OUTPUT_STATE_ENABLED | WLR_OUTPUT_STATE_MODE)) &&
+      !priv->refresh_switch) {
+    priv->restore_mode = NULL;
+    priv->restore_requested = FALSE;
+    priv->pending_mode = NULL;
+  }
+
+  /* Refresh rate switches keep the size so there's nothing to rearrange */
+  if (!priv->refresh_switch &&
+      event->state->committed & (WLR_OUTPUT_STATE_MODE |
                                  WLR_OUTPUT_STATE_SCALE |
                                  WLR_OUTPUT_STATE_TRANSFORM)) {
     gboolean configure_sent;
@@ -748,7 +1346,8 @@ phoc_output_handle_commit (struct wl_listener *listener, void *data)
     update_output_manager_config (self->desktop);
   }
 
-  if (event->state->committed & (WLR_OUTPUT_STATE_MODE |
+  if (!priv->refresh_switch &&
+      event->state->committed & (WLR_OUTPUT_STATE_MODE |
                                  WLR_OUTPUT_STATE_TRANSFORM)) {
     int width, height;
     wlr_output_transformed_resolution (self->wlr_output, &width, &height);
@@ -757,15 +1356,38 @@ phoc_output_handle_commit (struct wl_listener *listener, void *data)
   }
 
   if (event->state->committed & WLR_OUTPUT_STATE_ENABLED && self->wlr_output->enabled) {
+    invalidate_gamma_lut (self);
     priv->gamma_lut_changed = TRUE;
     wlr_output_schedule_frame (self->wlr_output);
   }
 
-  if (event->state->committed & WLR_OUTPUT_STATE_SCALE)
+  if (event->state->committed & WLR_OUTPUT_STATE_GAMMA_LUT)
+    update_gamma_lut (self, event->state);
+
+  if (event->state->committed & (WLR_OUTPUT_STATE_SCALE | WLR_OUTPUT_STATE_TRANSFORM))
     phoc_output_for_each_surface (self, update_output_scale_iterator, NULL, FALSE);
 }
 
 
+static void
+handle_present (struct wl_listener *listener, void *data)
+{
+  PhocOutputPrivate *priv = wl_container_of (listener, priv, present);
+  PhocOutput *self = PHOC_OUTPUT_SELF (priv);
+  const struct wlr_output_event_present *event = data;
+  guint64 latency;
+
+  if (!priv->resume_start_us || !event->presented)
+    return;
+
+  latency = g_get_monotonic_time () - priv->resume_start_us;
+  priv->resume_start_us = 0;
+  priv->last_resume_us = latency;
+  priv->max_resume_us = MAX (priv->max_resume_us, latency);
+  g_debug ("%s visible %" G_GUINT64_FORMAT "µs after resume", phoc_output_get_name (self), latency);
+}
+
+
 static void
 handle_request_state (struct wl_listener *listener, void *data)
 {
@@ -873,6 +1495,117 @@ adjust_frac_scale (double scale)
 }
 
 
+static struct wlr_output_mode *
+find_mode (PhocOutput *self, int width, int height, int refresh)
+{
+  struct wlr_output_mode *mode;
+
+  wl_list_for_each (mode, &self->wlr_output->modes, link) {
+    if (mode->width == width && mode->height == height && mode->refresh == refresh)
+      return mode;
+  }
+
+  return NULL;
+}
+
+
+static gboolean
+test_mode (PhocOutput              *self,
+           struct wlr_output_state *pending,
+           struct wlr_output_mode  *mode,
+           PhocModeCache           *cache,
+           const char              *key)
+{
+  gboolean success;
+
+  wlr_output_state_set_mode (pending, mode);
+  success = wlr_output_test_state (self->wlr_output, pending);
+
+  if (cache == NULL)
+    return success;
+
+  if (success) {
+    phoc_mode_cache_set_mode (cache, key, mode->width, mode->height, mode->refresh);
+    phoc_mode_cache_remove_rejected (cache, key, mode->width, mode->height, mode->refresh);
+  } else
+    phoc_mode_cache_add_rejected (cache, key, mode->width, mode->height, mode->refresh);
+
+  return success;
+}
+
+/*
+ * Find a mode the backend accepts. For DRM outputs the outcome is
+ * cached per monitor so if the preferred mode doesn't work a known
+ * monitor gets its last working mode with a single test and modes
+ * that failed repeatedly before are only tried as a last resort.
+ */
+static void
+probe_mode (PhocOutput *self, struct wlr_output_state *pending)
+{
+  struct wlr_output *wlr_output = self->wlr_output;
+  struct wlr_output_mode *preferred_mode = wlr_output_preferred_mode (wlr_output);
+  struct wlr_output_mode *cached_mode = NULL;
+  struct wlr_output_mode *mode;
+  PhocModeCache *cache = NULL;
+  g_autofree char *key = NULL;
+  g_autoptr (GError) err = NULL;
+  g_autoptr (GPtrArray) skipped = g_ptr_array_new ();
+  gboolean has_mode = FALSE;
+  int width, height, refresh;
+
+  if (wlr_output_is_drm (wlr_output))
+    cache = phoc_server_get_mode_cache (phoc_server_get_default ());
+
+  if (cache) {
+    key = phoc_mode_cache_build_key (wlr_output->name, wlr_output->make, wlr_output->model,
+                                     wlr_output->serial);
+  }
+
+  /* Always give the preferred mode a chance, a rejection might have been transient */
+  if (preferred_mode != NULL) {
+    g_debug ("Using preferred mode for %s", wlr_output->name);
+    has_mode = test_mode (self, pending, preferred_mode, cache, key);
+  }
+
+  if (!has_mode)
+    g_debug ("Preferred mode rejected for %s falling back to another mode", wlr_output->name);
+
+  if (!has_mode && cache && phoc_mode_cache_lookup (cache, key, &width, &height, &refresh)) {
+    cached_mode = find_mode (self, width, height, refresh);
+    if (cached_mode && cached_mode != preferred_mode) {
+      g_debug ("Using cached mode %dx%d@%d for %s", width, height, refresh, wlr_output->name);
+      has_mode = test_mode (self, pending, cached_mode, cache, key);
+    }
+  }
+
+  /* Skip modes that failed before */
+  if (!has_mode) {
+    wl_list_for_each (mode, &wlr_output->modes, link) {
+      g_assert (mode);
+      if (mode == preferred_mode || mode == cached_mode)
+        continue;
+
+      if (cache && phoc_mode_cache_is_rejected (cache, key, mode->width, mode->height,
+                                                mode->refresh)) {
+        g_ptr_array_add (skipped, mode);
+        continue;
+      }
+
+      has_mode = test_mode (self, pending, mode, cache, key);
+      if (has_mode)
+        break;
+    }
+  }
+
+  /* Only retry the skipped ones if nothing else works */
+  for (guint i = 0; i < skipped->len && !has_mode; i++)
+    has_mode = test_mode (self, pending, g_ptr_array_index (skipped, i), cache, key);
+
+  if (cache && !phoc_mode_cache_save (cache, &err))
+    g_warning ("Failed to save mode cache: %s", err->message);
+}
+
+
 static void
 phoc_output_fill_state (PhocOutput              *self,
                         PhocOutputConfig        *output_config,
@@ -925,31 +1658,13 @@ phoc_output_fill_state (PhocOutput              *self,
 
     wlr_output_state_set_transform (pending, transform);
     priv->scale_filter = output_config->scale_filter;
+
+    if (output_config->adaptive_sync)
+      wlr_output_state_set_adaptive_sync_enabled (pending, true);
   } else if (enable) {
     enum wl_output_transform transform = WL_OUTPUT_TRANSFORM_NORMAL;
-    gboolean has_mode = FALSE;
-
-    if (preferred_mode != NULL) {
-      g_debug ("Using preferred mode for %s", self->wlr_output->name);
-      wlr_output_state_set_mode (pending, preferred_mode);
-      has_mode = wlr_output_test_state (self->wlr_output, pending);
-    }
 
-    if (!has_mode) {
-      g_debug ("Preferred mode rejected for %s falling back to another mode",
-               self->wlr_output->name);
-      struct wlr_output_mode *mode;
-      wl_list_for_each (mode, &self->wlr_output->modes, link) {
-        g_assert (mode);
-        if (mode == preferred_mode)
-          continue;
-
-        wlr_output_state_set_mode (pending, mode);
-        has_mode = wlr_output_test_state (self->wlr_output, pending);
-        if (has_mode)
-          break;
-      }
-    }
+    probe_mode (self, pending);
 
     if (wlr_output_is_drm (self->wlr_output))
       transform = wlr_drm_connector_get_panel_orientation (self->wlr_output);
@@ -1014,10 +1729,21 @@ phoc_output_initable_init (GInitable    *initable,
   priv->request_state.notify = handle_request_state;
   wl_signal_add (&self->wlr_output->events.request_state, &priv->request_state);
 
+  priv->present.notify = handle_present;
+  wl_signal_add (&self->wlr_output->events.present, &priv->present);
+
   PhocOutputConfig *output_config = phoc_config_get_output (config, self);
   struct wlr_output_state pending;
   phoc_output_fill_state (self, output_config, &pending);
 
+  if (output_config && output_config->idle_refresh_rate > 0) {
+    priv->idle_refresh = (int)(output_config->idle_refresh_rate * 1000);
+    priv->idle_refresh_source = g_source_new (&idle_refresh_source_funcs, sizeof (GSource));
+    g_source_set_callback (priv->idle_refresh_source, on_idle_refresh, self, NULL);
+    g_source_set_name (priv->idle_refresh_source, "[phoc] output idle refresh");
+    g_source_attach (priv->idle_refresh_source, NULL);
+  }
+
   wlr_output_commit_state (self->wlr_output, &pending);
   wlr_output_layout_get_box (self->desktop->layout, self->wlr_output, &output_box);
   self->lx = output_box.x;
@@ -1084,6 +1810,7 @@ phoc_output_finalize (GObject *object)
   wl_list_remove (&self->output_destroy.link);
 
   wl_list_remove (&priv->request_state.link);
+  wl_list_remove (&priv->present.link);
   wl_list_remove (&priv->damage.link);
   wl_list_remove (&priv->frame.link);
   wl_list_remove (&priv->needs_frame.link);
@@ -1093,14 +1820,24 @@ phoc_output_finalize (GObject *object)
   g_clear_slist (&priv->frame_callbacks,
                  (GDestroyNotify)phoc_output_frame_callback_info_free);
 
-  wl_list_init (&self->layer_surfaces);
   for (int i = 0; i < G_N_ELEMENTS (priv->layer_surfaces); i++)
-    g_clear_pointer (&priv->layer_surfaces[i], g_queue_free);
+    phoc_output_set_layer_dirty (self, i);
+  wl_list_init (&self->layer_surfaces);
 
   g_clear_signal_handler (&priv->render_cutouts_id, priv->renderer);
   g_clear_object (&priv->renderer);
   g_clear_object (&priv->cutouts);
   g_clear_pointer (&priv->cutouts_texture, wlr_texture_destroy);
+  if (priv->idle_refresh_source) {
+    g_source_destroy (priv->idle_refresh_source);
+    g_clear_pointer (&priv->idle_refresh_source, g_source_unref);
+  }
+  g_clear_pointer (&priv->refresh_stats, g_hash_table_destroy);
+  g_clear_pointer (&priv->gamma_table, g_free);
+  g_clear_pointer (&priv->mirror_texture, wlr_texture_destroy);
+  g_clear_pointer (&priv->mirror_buffer, wlr_buffer_unlock);
+  g_clear_pointer (&priv->front_buffer, wlr_buffer_unlock);
+  g_clear_weak_pointer (&priv->mirror_source);
   g_clear_object (&priv->shield);
   g_clear_object (&self->desktop);
 
@@ -1264,39 +2001,55 @@ phoc_output_view_for_each_surface (PhocOutput          *self,
 }
 
 #ifdef PHOC_XWAYLAND
+static void
+xwayland_children_for_each_surface (PhocOutput          *self,
+                                    PhocXWaylandSurface *surface,
+                                    struct wlr_box      *output_box,
+                                    PhocSurfaceIterator  iterator,
+                                    void                *user_data)
+{
+  for (GList *l = phoc_xwayland_surface_get_children (surface); l; l = l->next) {
+    PhocXWaylandSurface *child = PHOC_XWAYLAND_SURFACE (l->data);
+    struct wlr_xwayland_surface *xchild = phoc_xwayland_surface_get_wlr_surface (child);
+
+    if (phoc_xwayland_surface_is_mapped (child)) {
+      double ox = xchild->x - output_box->x;
+      double oy = xchild->y - output_box->y;
+      phoc_output_surface_for_each_surface (self, xchild->surface, ox, oy, iterator,
+                                            user_data);
+    }
+
+    /* Skip subtrees without anything to draw */
+    if (phoc_xwayland_surface_has_children (child))
+      xwayland_children_for_each_surface (self, child, output_box, iterator, user_data);
+  }
+}
+
 /**
  * phoc_output_xwayland_children_for_each_surface:
  * @self: the output
- * @surface: The wlr_xwayland_surface
+ * @surface: The XWayland surface
  * @iterator: (scope call): The callback invoked on each iteration
  * @user_data: Callback user data
  *
- * Iterate over children of a `wlr_xwayland_surface`.
+ * Iterate over the mapped children of a [type@XWaylandSurface].
  */
 void
-phoc_output_xwayland_children_for_each_surface (PhocOutput                  *self,
-                                                struct wlr_xwayland_surface *surface,
-                                                PhocSurfaceIterator          iterator,
-                                                void                        *user_data)
+phoc_output_xwayland_children_for_each_surface (PhocOutput          *self,
+                                                PhocXWaylandSurface *surface,
+                                                PhocSurfaceIterator  iterator,
+                                                void                *user_data)
 {
   struct wlr_box output_box;
-  wlr_output_layout_get_box (self->desktop->layout, self->wlr_output, &output_box);
 
-  if (wlr_box_empty (&output_box))
+  if (!phoc_xwayland_surface_has_children (surface))
     return;
 
-  struct wlr_xwayland_surface *child;
+  wlr_output_layout_get_box (self->desktop->layout, self->wlr_output, &output_box);
+  if (wlr_box_empty (&output_box))
+    return;
 
-  wl_list_for_each (child, &surface->children, parent_link) {
-    if (child->surface && child->surface->mapped) {
-      double ox = child->x - output_box.x;
-      double oy = child->y - output_box.y;
-      phoc_output_surface_for_each_surface (self, child->surface, ox, oy, iterator,
-                                            user_data);
-    }
-    phoc_output_xwayland_children_for_each_surface (self, child,
-                                                    iterator, user_data);
-  }
+  xwayland_children_for_each_surface (self, surface, &output_box, iterator, user_data);
 }
 #endif
 
@@ -1356,16 +2109,290 @@ phoc_output_layer_for_each_surface (PhocOutput          *self,
                                     PhocSurfaceIterator  iterator,
                                     void                *user_data)
 {
-  GQueue *layer_surfaces = phoc_output_get_layer_surfaces_for_layer (self, layer);
+  GSequence *layer_surfaces = phoc_output_get_layer_surfaces_for_layer (self, layer);
 
-  for (GList *l = layer_surfaces->tail; l; l = l->prev) {
-    PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (l->data);
+  for (GSequenceIter *iter = g_sequence_get_end_iter (layer_surfaces);
+       !g_sequence_iter_is_begin (iter);) {
+    PhocLayerSurface *layer_surface;
+
+    iter = g_sequence_iter_prev (iter);
+    layer_surface = PHOC_LAYER_SURFACE (g_sequence_get (iter));
 
     phoc_output_layer_surface_for_each_surface (self, layer_surface, iterator, user_data);
   }
 }
 
 
+/* Maximum number of surfaces in a chain of stacking relations */
+#define MAX_STACKING_DEPTH 8
+
+/*
+ * Fill @path with the surfaces from the root of @layer_surface's
+ * stacking chain down to @layer_surface and return its length.
+ */
+static guint
+get_stacking_path (PhocLayerSurface *layer_surface, PhocLayerSurface **path)
+{
+  guint depth = 0;
+
+  /* get_stacking_target() keeps chains shorter than that */
+  for (PhocLayerSurface *s = layer_surface; s && depth < MAX_STACKING_DEPTH; s = s->stacking.target)
+    depth++;
+
+  for (guint i = depth; i > 0; layer_surface = layer_surface->stacking.target)
+    path[--i] = layer_surface;
+
+  return depth;
+}
+
+/*
+ * Non exclusive surfaces go below exclusive ones. Newer non exclusive
+ * surfaces go above older ones, for exclusive surfaces it's the other
+ * way around.
+ */
+static int
+compare_stacking_roots (PhocLayerSurface *root_a, PhocLayerSurface *root_b)
+{
+  int cmp;
+
+  if (root_a->stacking.exclusive != root_b->stacking.exclusive)
+    return root_a->stacking.exclusive ? 1 : -1;
+
+  cmp = root_a->stacking.serial < root_b->stacking.serial ? -1 : 1;
+  return root_a->stacking.exclusive ? -cmp : cmp;
+}
+
+/*
+ * Order layer surfaces bottom to top. Surfaces stacked relative to
+ * another surface are placed directly below or above it together with
+ * everything stacked relative to them. Surfaces stacked on the same
+ * side of the same target are ordered by age.
+ */
+static int
+compare_stacking (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  PhocLayerSurface *path_a[MAX_STACKING_DEPTH], *path_b[MAX_STACKING_DEPTH];
+  PhocLayerSurface *layer_surface_a, *layer_surface_b;
+  guint depth_a, depth_b, i;
+
+  depth_a = get_stacking_path ((PhocLayerSurface *)a, path_a);
+  depth_b = get_stacking_path ((PhocLayerSurface *)b, path_b);
+
+  if (path_a[0] != path_b[0])
+    return compare_stacking_roots (path_a[0], path_b[0]);
+
+  for (i = 1; i < depth_a && i < depth_b && path_a[i] == path_b[i]; i++)
+    ;
+
+  if (i == depth_a && i == depth_b)
+    return 0;
+
+  /* One surface is stacked (indirectly) relative to the other */
+  if (i == depth_a)
+    return path_b[i]->stacking.offset < 0 ? 1 : -1;
+  if (i == depth_b)
+    return path_a[i]->stacking.offset < 0 ? -1 : 1;
+
+  /* Stacked relative to the same surface */
+  layer_surface_a = path_a[i];
+  layer_surface_b = path_b[i];
+  if (layer_surface_a->stacking.offset != layer_surface_b->stacking.offset)
+    return layer_surface_a->stacking.offset - layer_surface_b->stacking.offset;
+
+  return layer_surface_a->stacking.serial < layer_surface_b->stacking.serial ? -1 : 1;
+}
+
+
+static PhocLayerSurface *
+find_stacking_target (PhocOutput       *self,
+                      PhocLayerSurface *layer_surface,
+                      PhocLayerSurface *exclude,
+                      int              *offset)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  PhocLayerSurface *found = NULL;
+
+  for (GSList *s = phoc_desktop_get_layer_surface_stacks (desktop); s; s = s->next) {
+    PhocStackedLayerSurface *stack = s->data;
+    PhocLayerSurface *target;
+
+    if (phoc_stacked_layer_surface_get_layer_surface (stack) != layer_surface)
+      continue;
+
+    target = phoc_stacked_layer_surface_get_target_layer_surface (stack);
+    if (!target || target == exclude || target == layer_surface)
+      continue;
+
+    if (phoc_layer_surface_get_output (target) != self)
+      continue;
+
+    if (phoc_layer_surface_get_layer (target) != phoc_layer_surface_get_layer (layer_surface)) {
+      g_critical ("Stacked surface %s and target %s surface not in same layer",
+                  phoc_layer_surface_get_namespace (layer_surface),
+                  phoc_layer_surface_get_namespace (target));
+      continue;
+    }
+
+    switch (phoc_stacked_layer_surface_get_position (stack)) {
+    case PHOC_STACKED_SURFACE_STACK_BELOW:
+      *offset = -1;
+      break;
+    case PHOC_STACKED_SURFACE_STACK_ABOVE:
+      *offset = 1;
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+    found = target;
+  }
+
+  return found;
+}
+
+/*
+ * Like find_stacking_target() but only accept relations that reach a
+ * surface that isn't stacked itself within MAX_STACKING_DEPTH
+ * steps. This drops cycles and chains leading into them no matter in
+ * which order surfaces get (re)stacked.
+ */
+static PhocLayerSurface *
+get_stacking_target (PhocOutput       *self,
+                     PhocLayerSurface *layer_surface,
+                     PhocLayerSurface *exclude,
+                     int              *offset)
+{
+  PhocLayerSurface *target, *s;
+  int unused;
+
+  target = find_stacking_target (self, layer_surface, exclude, offset);
+
+  s = target;
+  for (guint depth = 1; s; depth++) {
+    if (s == layer_surface || depth >= MAX_STACKING_DEPTH) {
+      g_debug ("Not stacking '%s', it's part of a cycle or too deep",
+               phoc_layer_surface_get_namespace (layer_surface));
+      return NULL;
+    }
+    s = find_stacking_target (self, s, exclude, &unused);
+  }
+
+  return target;
+}
+
+
+static void
+unstack_layer_surface (PhocLayerSurface *layer_surface)
+{
+  g_clear_pointer (&layer_surface->stacking.iter, g_sequence_remove);
+  layer_surface->stacking.target = NULL;
+}
+
+/*
+ * Update the sort keys of a layer surface. Keys of all surfaces that
+ * get inserted must be up to date before the first insert as the
+ * position of stacked surfaces depends on their targets.
+ */
+static void
+prepare_layer_surface (PhocOutput       *self,
+                       PhocLayerSurface *layer_surface,
+                       PhocLayerSurface *exclude)
+{
+  PhocLayerSurface *target;
+
+  layer_surface->stacking.exclusive = layer_surface->layer_surface->current.exclusive_zone > 0;
+
+  target = get_stacking_target (self, layer_surface, exclude, &layer_surface->stacking.offset);
+  layer_surface->stacking.target = target;
+  if (target) {
+    g_debug ("Stacking '%s' %s '%s'",
+             phoc_layer_surface_get_namespace (layer_surface),
+             layer_surface->stacking.offset < 0 ? "below" : "above",
+             phoc_layer_surface_get_namespace (target));
+  }
+}
+
+
+static void
+stack_layer_surface (PhocOutput *self, PhocLayerSurface *layer_surface)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  GSequence *seq = priv->layer_surfaces[layer_surface->layer];
+
+  g_assert (layer_surface->stacking.iter == NULL);
+
+  /* Layer not built yet, will be sorted on first access */
+  if (!seq) {
+    layer_surface->stacking.target = NULL;
+    return;
+  }
+
+  layer_surface->stacking.iter = g_sequence_insert_sorted (seq, layer_surface, compare_stacking, NULL);
+}
+
+/*
+ * (Re)insert @layer_surface and all surfaces with stacking relations
+ * as any of these might now be stacked relative to @layer_surface or
+ * not anymore. There's only a handful of those so this stays cheap.
+ */
+static void
+restack_layer_surface (PhocOutput       *self,
+                       PhocLayerSurface *layer_surface,
+                       gboolean          remove)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  g_autoptr (GPtrArray) restack = g_ptr_array_new ();
+
+  if (!remove)
+    g_ptr_array_add (restack, layer_surface);
+
+  for (GSList *s = phoc_desktop_get_layer_surface_stacks (desktop); s; s = s->next) {
+    PhocLayerSurface *stacked = phoc_stacked_layer_surface_get_layer_surface (s->data);
+
+    if (!stacked || stacked == layer_surface)
+      continue;
+
+    if (phoc_layer_surface_get_output (stacked) != self)
+      continue;
+
+    if (g_ptr_array_find (restack, stacked, NULL))
+      continue;
+
+    g_ptr_array_add (restack, stacked);
+  }
+
+  unstack_layer_surface (layer_surface);
+  for (guint i = 0; i < restack->len; i++)
+    unstack_layer_surface (g_ptr_array_index (restack, i));
+
+  for (guint i = 0; i < restack->len; i++)
+    prepare_layer_surface (self, g_ptr_array_index (restack, i), remove ? layer_surface : NULL);
+
+  for (guint i = 0; i < restack->len; i++)
+    stack_layer_surface (self, g_ptr_array_index (restack, i));
+}
+
+
+static void
+clear_layer (PhocOutput *self, enum zwlr_layer_shell_v1_layer layer)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  GSequence *seq = priv->layer_surfaces[layer];
+
+  if (!seq)
+    return;
+
+  for (GSequenceIter *iter = g_sequence_get_begin_iter (seq);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter)) {
+    PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (g_sequence_get (iter));
+
+    layer_surface->stacking.iter = NULL;
+    layer_surface->stacking.target = NULL;
+  }
+
+  g_clear_pointer (&priv->layer_surfaces[layer], g_sequence_free);
+}
+
 /**
  * phoc_output_get_layer_surfaces_for_layer:
  * @self: the output
@@ -1374,15 +2401,16 @@ phoc_output_layer_for_each_surface (PhocOutput          *self,
  * Get a list of [type@PhocLayerSurface]s on this output in the given
  * `layer` in rendering order.
  *
+ * The order is built on first access and then kept up to date by
+ * `phoc_output_update_layer_surface_stacking()`.
+ *
  * Returns:(transfer none): The layer surfaces of that layer
  */
-GQueue *
+GSequence *
 phoc_output_get_layer_surfaces_for_layer (PhocOutput *self, enum zwlr_layer_shell_v1_layer layer)
 {
-  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   PhocLayerSurface *layer_surface;
   PhocOutputPrivate *priv;
-  g_autoptr (GQueue) queue = NULL;
 
   g_assert (PHOC_IS_OUTPUT (self));
   priv = phoc_output_get_instance_private (self);
@@ -1390,82 +2418,82 @@ phoc_output_get_layer_surfaces_for_layer (PhocOutput *self, enum zwlr_layer_shel
   if (priv->layer_surfaces[layer])
     return priv->layer_surfaces[layer];
 
-  queue = g_queue_new ();
+  priv->layer_surfaces[layer] = g_sequence_new (NULL);
 
-  wl_list_for_each_reverse (layer_surface, &self->layer_surfaces, link) {
+  wl_list_for_each (layer_surface, &self->layer_surfaces, link) {
     if (layer_surface->layer != layer)
       continue;
 
-    if (layer_surface->layer_surface->current.exclusive_zone > 0)
-      g_queue_push_head (queue, layer_surface);
+    prepare_layer_surface (self, layer_surface, NULL);
   }
 
   wl_list_for_each (layer_surface, &self->layer_surfaces, link) {
     if (layer_surface->layer != layer)
       continue;
 
-    if (layer_surface->layer_surface->current.exclusive_zone <= 0)
-      g_queue_push_head (queue, layer_surface);
+    stack_layer_surface (self, layer_surface);
   }
 
-  GSList *stacks = phoc_desktop_get_layer_surface_stacks (desktop);
-  for (GSList *s = stacks; s; s = s->next) {
-    PhocStackedLayerSurface *stack = s->data;
-    PhocLayerSurface *stacked, *target;
-    GList *stacked_link, *target_link;
-
-    if (phoc_stacked_layer_surface_get_layer (stack) != layer)
-      continue;
-
-    stacked = phoc_stacked_layer_surface_get_layer_surface (stack);
-    if (!stacked)
-      continue;
+  return priv->layer_surfaces[layer];
+}
 
-    if (phoc_layer_surface_get_output (stacked) != self)
-      continue;
+/**
+ * phoc_output_update_layer_surface_stacking:
+ * @self: the output
+ * @layer_surface: The layer surface that changed
+ *
+ * Moving a layer surface between layers, changing the exclusive zone
+ * or its stacking relation might affect a layer surface's position in
+ * the stack. Calling this function moves the layer surface (and the
+ * ones stacked relative to it) to their new positions. If nothing
+ * relevant changed this is a no-op.
+ */
+void
+phoc_output_update_layer_surface_stacking (PhocOutput *self, PhocLayerSurface *layer_surface)
+{
+  PhocOutputPrivate *priv;
+  GSequence *seq;
 
-    target = phoc_stacked_layer_surface_get_target_layer_surface (stack);
-    if (!target)
-      continue;
+  g_assert (PHOC_IS_OUTPUT (self));
+  g_assert (PHOC_IS_LAYER_SURFACE (layer_surface));
+  priv = phoc_output_get_instance_private (self);
 
-    if (phoc_layer_surface_get_output (target) != self)
-      continue;
+  seq = priv->layer_surfaces[layer_surface->layer];
+  if (layer_surface->stacking.iter == NULL && seq == NULL) {
+    /* Neither in a built layer nor going to be */
+    return;
+  }
 
-    if (phoc_layer_surface_get_layer (target) != phoc_layer_surface_get_layer (stacked)) {
-      g_critical ("Stacked surface %s and target %s surface not in same layer",
-                  phoc_layer_surface_get_namespace (stacked),
-                  phoc_layer_surface_get_namespace (target));
-      continue;
-    }
+  if (layer_surface->stacking.iter && g_sequence_iter_get_sequence (layer_surface->stacking.iter) == seq) {
+    gboolean exclusive = layer_surface->layer_surface->current.exclusive_zone > 0;
+    PhocLayerSurface *target;
+    int offset = 0;
 
-    stacked_link = g_queue_find (queue, stacked);
-    g_assert (stacked_link);
-    g_queue_unlink (queue, stacked_link);
+    target = get_stacking_target (self, layer_surface, NULL, &offset);
+    if (exclusive == layer_surface->stacking.exclusive &&
+        target == layer_surface->stacking.target &&
+        (!target || offset == layer_surface->stacking.offset))
+      return;
+  }
 
-    target_link = g_queue_find (queue, target);
-    g_assert (target_link);
+  restack_layer_surface (self, layer_surface, FALSE);
+}
 
-    switch (phoc_stacked_layer_surface_get_position (stack)) {
-    case PHOC_STACKED_SURFACE_STACK_BELOW:
-      g_debug ("Stacking '%s' below '%s'",
-               PHOC_LAYER_SURFACE (stacked_link->data)->layer_surface->namespace,
-               PHOC_LAYER_SURFACE (target_link->data)->layer_surface->namespace);
-      g_queue_insert_before_link (queue, target_link, stacked_link);
-      break;
-    case PHOC_STACKED_SURFACE_STACK_ABOVE:
-      g_debug ("Stacking '%s' above '%s'",
-               PHOC_LAYER_SURFACE (stacked_link->data)->layer_surface->namespace,
-               PHOC_LAYER_SURFACE (target_link->data)->layer_surface->namespace);
-      g_queue_insert_after_link (queue, target_link, stacked_link);
-      break;
-    default:
-      g_assert_not_reached ();
-    }
-  }
+/**
+ * phoc_output_remove_layer_surface_stacking:
+ * @self: the output
+ * @layer_surface: The layer surface to remove
+ *
+ * Remove a layer surface that is going away from the stacking order.
+ * Surfaces stacked relative to it go back to their regular position.
+ */
+void
+phoc_output_remove_layer_surface_stacking (PhocOutput *self, PhocLayerSurface *layer_surface)
+{
+  g_assert (PHOC_IS_OUTPUT (self));
+  g_assert (PHOC_IS_LAYER_SURFACE (layer_surface));
 
-  g_clear_pointer (&priv->layer_surfaces[layer], g_queue_free);
-  priv->layer_surfaces[layer] = g_steal_pointer (&queue);
-  return priv->layer_surfaces[layer];
+  restack_layer_surface (self, layer_surface, TRUE);
 }
 
 /**
@@ -1473,22 +2501,17 @@ phoc_output_get_layer_surfaces_for_layer (PhocOutput *self, enum zwlr_layer_shel
  * @self: the output
  * @layer: The layer to marks as dirty
  *
- * Invalidate the ordering of layer surfaces.
- *
- * Moving a layer surface between layers or changing the exclusive zone
- * might affect a layer surfaces position in the stack. Calling this function
- * invalidates the current ordering and makes sure the ordering is recalculated
- * on next access.
+ * Invalidate the ordering of layer surfaces and makes sure the
+ * ordering is recalculated on next access. Prefer
+ * `phoc_output_update_layer_surface_stacking()` which only moves the
+ * affected surfaces.
  */
 void
 phoc_output_set_layer_dirty (PhocOutput *self, enum zwlr_layer_shell_v1_layer layer)
-{
-  PhocOutputPrivate *priv;
-
+{
   g_assert (PHOC_IS_OUTPUT (self));
-  priv = phoc_output_get_instance_private (self);
 
-  g_clear_pointer (&priv->layer_surfaces[layer], g_queue_free);
+  clear_layer (self, layer);
 }
 
 /**
@@ -1552,9 +2575,8 @@ phoc_output_for_each_surface (PhocOutput          *self,
 
 #ifdef PHOC_XWAYLAND
     if (PHOC_IS_XWAYLAND_SURFACE (view)) {
-      struct wlr_xwayland_surface *xsurface =
-        phoc_xwayland_surface_get_wlr_surface (PHOC_XWAYLAND_SURFACE (view));
-      phoc_output_xwayland_children_for_each_surface (self, xsurface, iterator, user_data);
+      phoc_output_xwayland_children_for_each_surface (self, PHOC_XWAYLAND_SURFACE (view),
+                                                      iterator, user_data);
     }
 #endif
   } else {
@@ -1602,8 +2624,8 @@ phoc_view_accept_damage (PhocOutput *self, PhocView  *view)
 
   /* Special case: accept damage from children */
   if (PHOC_IS_XWAYLAND_SURFACE (self->fullscreen_view) && PHOC_IS_XWAYLAND_SURFACE (view)) {
-    if (phoc_xwayland_surface_is_child (PHOC_XWAYLAND_SURFACE (view),
-                                        PHOC_XWAYLAND_SURFACE (self->fullscreen_view))) {
+    if (phoc_xwayland_surface_is_child (PHOC_XWAYLAND_SURFACE (self->fullscreen_view),
+                                        PHOC_XWAYLAND_SURFACE (view))) {
       return true;
     }
   }
@@ -1617,26 +2639,20 @@ damage_surface_iterator (PhocOutput *self, struct wlr_surface *wlr_surface, stru
 {
   bool *whole = data;
   PhocSurface *surface = wlr_surface->data;
+  float output_scale = scale * self->wlr_output->scale;
 
   struct wlr_box box = *_box;
 
-  phoc_utils_scale_box (&box, scale);
-  phoc_utils_scale_box (&box, self->wlr_output->scale);
+  /* Scale once so edges snap to output pixels only once */
+  phoc_utils_scale_box (&box, output_scale);
 
   pixman_region32_t damage;
   pixman_region32_init (&damage);
   wlr_surface_get_effective_damage (wlr_surface, &damage);
   pixman_region32_union (&damage, &damage, phoc_surface_get_damage (surface));
+  phoc_utils_scale_surface_damage (&damage, wlr_surface, &box, output_scale);
   phoc_surface_clear_damage (surface);
 
-  wlr_region_scale (&damage, &damage, scale);
-  wlr_region_scale (&damage, &damage, self->wlr_output->scale);
-  if (ceil (self->wlr_output->scale) > wlr_surface->current.scale) {
-    /* When scaling up a surface, it'll become blurry so we need to
-     * expand the damage region */
-    wlr_region_expand (&damage, &damage, ceil (self->wlr_output->scale) - wlr_surface->current.scale);
-  }
-
   pixman_region32_translate (&damage, box.x, box.y);
   if (wlr_damage_ring_add (&self->damage_ring, &damage))
     wlr_output_schedule_frame (self->wlr_output);
@@ -1648,7 +2664,7 @@ damage_surface_iterator (PhocOutput *self, struct wlr_surface *wlr_surface, stru
   }
 
   if (!wl_list_empty (&wlr_surface->current.frame_callback_list))
-    wlr_output_schedule_frame (self->wlr_output);
+    schedule_frame (self, PHOC_OUTPUT_FRAME_REASON_CLIENT);
 }
 
 
@@ -1742,78 +2758,259 @@ phoc_output_damage_from_surface (PhocOutput         *self,
 }
 
 
+/*
+ * Drop the parts of the state that match the output's current state so
+ * outputs that don't change don't get a modeset.
+ */
+static void
+strip_unchanged_state (struct wlr_output *wlr_output, struct wlr_output_state *state)
+{
+  if (!wlr_output->enabled || !(state->committed & WLR_OUTPUT_STATE_ENABLED) || !state->enabled)
+    return;
+
+  if (state->committed & WLR_OUTPUT_STATE_MODE) {
+    if (state->mode_type == WLR_OUTPUT_STATE_MODE_FIXED && state->mode == wlr_output->current_mode)
+      state->committed &= ~WLR_OUTPUT_STATE_MODE;
+    else if (state->mode_type == WLR_OUTPUT_STATE_MODE_CUSTOM &&
+             wlr_output->current_mode == NULL &&
+             state->custom_mode.width == wlr_output->width &&
+             state->custom_mode.height == wlr_output->height &&
+             state->custom_mode.refresh == wlr_output->refresh)
+      state->committed &= ~WLR_OUTPUT_STATE_MODE;
+  }
+
+  if ((state->committed & WLR_OUTPUT_STATE_TRANSFORM) &&
+      state->transform == wlr_output->transform)
+    state->committed &= ~WLR_OUTPUT_STATE_TRANSFORM;
+
+  if ((state->committed & WLR_OUTPUT_STATE_SCALE) && state->scale == wlr_output->scale)
+    state->committed &= ~WLR_OUTPUT_STATE_SCALE;
+
+  if ((state->committed & WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED) &&
+      state->adaptive_sync_enabled ==
+      (wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED))
+    state->committed &= ~WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED;
+
+  if (!(state->committed & WLR_OUTPUT_STATE_MODE))
+    state->committed &= ~WLR_OUTPUT_STATE_ENABLED;
+}
+
+/*
+ * Capture the current state of an output so it can be restored
+ */
+static void
+snapshot_state (struct wlr_output *wlr_output, struct wlr_output_state *state)
+{
+  wlr_output_state_init (state);
+  wlr_output_state_set_enabled (state, wlr_output->enabled);
+  if (!wlr_output->enabled)
+    return;
+
+  if (wlr_output->current_mode) {
+    wlr_output_state_set_mode (state, wlr_output->current_mode);
+  } else {
+    wlr_output_state_set_custom_mode (state, wlr_output->width, wlr_output->height,
+                                      wlr_output->refresh);
+  }
+  wlr_output_state_set_transform (state, wlr_output->transform);
+  wlr_output_state_set_scale (state, wlr_output->scale);
+  wlr_output_state_set_adaptive_sync_enabled (state,
+                                              wlr_output->adaptive_sync_status ==
+                                              WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED);
+}
+
+
+static void
+free_backend_states (struct wlr_backend_output_state *states, size_t states_len)
+{
+  for (size_t i = 0; i < states_len; i++)
+    wlr_output_state_finish (&states[i].base);
+  free (states);
+}
+
+
+static gboolean
+state_needs_buffer (const struct wlr_output_state *state)
+{
+  if ((state->committed & WLR_OUTPUT_STATE_ENABLED) && !state->enabled)
+    return FALSE;
+
+  return !!(state->committed & (WLR_OUTPUT_STATE_ENABLED | WLR_OUTPUT_STATE_MODE));
+}
+
+/*
+ * Backends like DRM need a buffer to enable an output or to switch
+ * its mode. Attach a blank one from the swapchains matching the new
+ * modes. The next frame replaces it with the actual content.
+ */
+static gboolean
+attach_blank_buffers (struct wlr_output_swapchain_manager *swapchain_manager,
+                      struct wlr_backend_output_state     *states,
+                      size_t                               states_len)
+{
+  if (!wlr_output_swapchain_manager_prepare (swapchain_manager, states, states_len))
+    return FALSE;
+
+  for (size_t i = 0; i < states_len; i++) {
+    struct wlr_output *wlr_output = states[i].output;
+    struct wlr_output_state *state = &states[i].base;
+    struct wlr_render_pass *render_pass;
+    struct wlr_swapchain *swapchain;
+    struct wlr_buffer *buffer;
+
+    if (!state_needs_buffer (state))
+      continue;
+
+    swapchain = wlr_output_swapchain_manager_get_swapchain (swapchain_manager, wlr_output);
+    buffer = swapchain ? wlr_swapchain_acquire (swapchain, NULL) : NULL;
+    if (!buffer)
+      return FALSE;
+
+    render_pass = wlr_renderer_begin_buffer_pass (wlr_output->renderer, buffer, NULL);
+    if (!render_pass) {
+      wlr_buffer_unlock (buffer);
+      return FALSE;
+    }
+
+    wlr_render_pass_add_rect (render_pass, &(struct wlr_render_rect_options) {
+        .box = { .width = buffer->width, .height = buffer->height },
+        .color = { .a = 1.0 },
+      });
+
+    if (!wlr_render_pass_submit (render_pass)) {
+      wlr_buffer_unlock (buffer);
+      return FALSE;
+    }
+
+    wlr_output_state_set_buffer (state, buffer);
+    wlr_buffer_unlock (buffer);
+  }
+
+  return TRUE;
+}
+
+
+static void
+restore_backend_states (struct wlr_backend_output_state *old_states, size_t states_len)
+{
+  struct wlr_backend *backend = phoc_server_get_backend (phoc_server_get_default ());
+  struct wlr_output_swapchain_manager swapchain_manager;
+
+  wlr_output_swapchain_manager_init (&swapchain_manager, backend);
+
+  if (attach_blank_buffers (&swapchain_manager, old_states, states_len) &&
+      wlr_backend_commit (backend, old_states, states_len)) {
+    wlr_output_swapchain_manager_apply (&swapchain_manager);
+  } else {
+    g_warning ("Failed to restore previous output configuration");
+  }
+
+  wlr_output_swapchain_manager_finish (&swapchain_manager);
+
+  /* Replace the blank buffers */
+  for (size_t i = 0; i < states_len; i++) {
+    if (old_states[i].output->enabled)
+      phoc_output_damage_whole (PHOC_OUTPUT (old_states[i].output->data));
+  }
+}
+
+/*
+ * Build the state for all heads of the configuration, test it and
+ * commit it with a single backend commit so the outputs are
+ * reconfigured at once (atomically where the backend supports
+ * it). If the commit fails midway (e.g. on multi GPU setups) the
+ * previous state is restored.
+ */
 static void
 output_manager_apply_config (PhocDesktop                        *desktop,
                              struct wlr_output_configuration_v1 *config,
                              gboolean                            test_only)
 
 {
+  struct wlr_backend *backend = phoc_server_get_backend (phoc_server_get_default ());
   struct wlr_output_configuration_head_v1 *config_head;
-  gboolean ok = TRUE;
+  struct wlr_backend_output_state *states, *old_states = NULL;
+  struct wlr_output_swapchain_manager swapchain_manager;
+  size_t states_len;
+  gboolean ok = FALSE;
 
-  /* First disable outputs we need to disable */
-  wl_list_for_each (config_head, &config->heads, link) {
-    struct wlr_output *wlr_output = config_head->state.output;
-    struct wlr_output_state pending;
+  wlr_output_swapchain_manager_init (&swapchain_manager, backend);
 
-    wlr_output_state_init (&pending);
-    if (config_head->state.enabled)
-      continue;
+  states = wlr_output_configuration_v1_build_state (config, &states_len);
+  if (states == NULL)
+    goto out;
 
-    if (!wlr_output->enabled)
-      continue;
+  for (size_t i = 0; i < states_len; i++) {
+    struct wlr_output_state *state = &states[i].base;
 
-    wlr_output_state_set_enabled (&pending, false);
-    if (test_only) {
-      ok &= wlr_output_test_state (wlr_output, &pending);
-    } else {
-      wlr_output_layout_remove (desktop->layout, wlr_output);
-      ok &= wlr_output_commit_state (wlr_output, &pending);
-    }
-    wlr_output_state_finish (&pending);
+    if (state->committed & WLR_OUTPUT_STATE_SCALE)
+      wlr_output_state_set_scale (state, adjust_frac_scale (state->scale));
+
+    strip_unchanged_state (states[i].output, state);
+  }
+
+  if (!attach_blank_buffers (&swapchain_manager, states, states_len) ||
+      !wlr_backend_test (backend, states, states_len)) {
+    g_debug ("Output configuration failed test");
+    goto out;
+  }
+
+  if (test_only) {
+    ok = TRUE;
+    goto out;
   }
 
-  /* Then enable outputs that need to */
+  old_states = g_new0 (struct wlr_backend_output_state, states_len);
+  for (size_t i = 0; i < states_len; i++) {
+    struct wlr_output *wlr_output = states[i].output;
+
+    old_states[i].output = wlr_output;
+    snapshot_state (wlr_output, &old_states[i].base);
+  }
+
+  ok = wlr_backend_commit (backend, states, states_len);
+  if (!ok) {
+    g_warning ("Failed to commit output configuration, restoring previous state");
+    restore_backend_states (old_states, states_len);
+    goto out;
+  }
+  wlr_output_swapchain_manager_apply (&swapchain_manager);
+
+  /* Configuration got applied, update the layout */
   wl_list_for_each (config_head, &config->heads, link) {
     struct wlr_output *wlr_output = config_head->state.output;
     PhocOutput *output = PHOC_OUTPUT (wlr_output->data);
-    struct wlr_output_state pending;
     struct wlr_box output_box;
 
-    if (!config_head->state.enabled)
+    if (!config_head->state.enabled) {
+      wlr_output_layout_remove (desktop->layout, wlr_output);
       continue;
-
-    wlr_output_state_init (&pending);
-    wlr_output_state_set_enabled (&pending, true);
-    if (config_head->state.mode != NULL) {
-      wlr_output_state_set_mode (&pending, config_head->state.mode);
-    } else {
-      wlr_output_state_set_custom_mode (&pending,
-                                        config_head->state.custom_mode.width,
-                                        config_head->state.custom_mode.height,
-                                        config_head->state.custom_mode.refresh);
     }
-    wlr_output_state_set_transform (&pending, config_head->state.transform);
-    wlr_output_state_set_scale (&pending, adjust_frac_scale (config_head->state.scale));
 
-    if (test_only) {
-      ok &= wlr_output_test_state (wlr_output, &pending);
-    } else {
-      wlr_output_layout_add (desktop->layout,
-                             wlr_output,
-                             config_head->state.x,
-                             config_head->state.y);
-      ok &= wlr_output_commit_state (wlr_output, &pending);
-
-      if (output->fullscreen_view)
-        phoc_view_set_fullscreen (output->fullscreen_view, true, output);
-
-      wlr_output_layout_get_box (output->desktop->layout, output->wlr_output, &output_box);
-      output->lx = output_box.x;
-      output->ly = output_box.y;
-    }
+    wlr_output_layout_add (desktop->layout,
+                           wlr_output,
+                           config_head->state.x,
+                           config_head->state.y);
 
-    wlr_output_state_finish (&pending);
+    if (output->fullscreen_view)
+      phoc_view_set_fullscreen (output->fullscreen_view, true, output);
+
+    wlr_output_layout_get_box (output->desktop->layout, output->wlr_output, &output_box);
+    output->lx = output_box.x;
+    output->ly = output_box.y;
+
+    /* Replace the blank buffer */
+    phoc_output_damage_whole (output);
+  }
+
+ out:
+  wlr_output_swapchain_manager_finish (&swapchain_manager);
+  if (states)
+    free_backend_states (states, states_len);
+  if (old_states) {
+    for (size_t i = 0; i < states_len; i++)
+      wlr_output_state_finish (&old_states[i].base);
+    g_free (old_states);
   }
 
   if (ok)
@@ -1841,18 +3038,57 @@ phoc_handle_output_manager_apply (struct wl_listener *listener, void *data)
 void
 phoc_handle_output_manager_test (struct wl_listener *listener, void *data)
 {
-  PhocDesktop *desktop = wl_container_of (listener, desktop, output_manager_apply);
+  PhocDesktop *desktop = wl_container_of (listener, desktop, output_manager_test);
   struct wlr_output_configuration_v1 *config = data;
 
   output_manager_apply_config (desktop, config, TRUE);
 }
 
 
+/*
+ * Resume the output showing the last composited frame so it's visible
+ * with the enabling commit rather than only after a redraw. Returns
+ * %FALSE if that's not possible.
+ *
+ * Anything that got damaged while the output was off (e.g. a lock
+ * screen showing up) makes the last frame stale so it must not be
+ * shown again.
+ */
+static gboolean
+resume_with_front_buffer (PhocOutput *self)
+{
+  PhocOutputPrivate *priv = phoc_output_get_instance_private (self);
+  struct wlr_buffer *buffer = priv->front_buffer;
+  struct wlr_output_state pending;
+  gboolean success = FALSE;
+
+  if (buffer == NULL)
+    return FALSE;
+
+  if (pixman_region32_not_empty (&self->damage_ring.current) ||
+      buffer->width != self->wlr_output->width || buffer->height != self->wlr_output->height) {
+    set_front_buffer (self, NULL);
+    return FALSE;
+  }
+
+  wlr_output_state_init (&pending);
+  wlr_output_state_set_enabled (&pending, true);
+  wlr_output_state_set_buffer (&pending, buffer);
+
+  if (wlr_output_test_state (self->wlr_output, &pending))
+    success = wlr_output_commit_state (self->wlr_output, &pending);
+
+  wlr_output_state_finish (&pending);
+  return success;
+}
+
+
 void
 phoc_output_handle_output_power_manager_set_mode (struct wl_listener *listener, void *data)
 {
   struct wlr_output_power_v1_set_mode_event *event = data;
   struct wlr_output_state pending;
+  PhocOutputPrivate *priv;
   PhocOutput *self;
   bool enable = true;
   bool current;
@@ -1860,6 +3096,7 @@ phoc_output_handle_output_power_manager_set_mode (struct wl_listener *listener,
   g_return_if_fail (event && event->output && event->output->data);
 
   self = event->output->data;
+  priv = phoc_output_get_instance_private (self);
   g_debug ("Request to set output power mode of %p to %d", self->wlr_output->name, event->mode);
   switch (event->mode) {
   case ZWLR_OUTPUT_POWER_V1_MODE_OFF:
@@ -1877,12 +3114,24 @@ phoc_output_handle_output_power_manager_set_mode (struct wl_listener *listener,
   if (enable == current)
     return;
 
+  if (enable) {
+    priv->resume_start_us = g_get_monotonic_time ();
+    priv->n_resumes++;
+
+    /* Nothing got damaged while off so there's nothing to redraw */
+    if (resume_with_front_buffer (self)) {
+      priv->n_fast_resumes++;
+      return;
+    }
+  }
+
   wlr_output_state_init (&pending);
   wlr_output_state_set_enabled (&pending, enable);
 
   if (!wlr_output_commit_state (self->wlr_output, &pending)) {
     g_warning ("Failed to commit power mode change to %d for %p", enable, self);
     wlr_output_state_finish (&pending);
+    priv->resume_start_us = 0;
     return;
   }
 
@@ -2276,7 +3525,7 @@ phoc_output_handle_gamma_control_set_gamma (struct wl_listener *listener, void *
     return;
 
   priv->gamma_lut_changed = TRUE;
-  wlr_output_schedule_frame (self->wlr_output);
+  schedule_frame (self, PHOC_OUTPUT_FRAME_REASON_GAMMA);
 }
 
 
@@ -2373,3 +3622,234 @@ phoc_output_get_debug_damage (PhocOutput *self)
 
   return priv->debug_damage;
 }
+
+/**
+ * phoc_output_notify_activity:
+ * @self: The output
+ *
+ * Notify the output about user activity (e.g. input) so it can switch
+ * back from a lowered refresh rate right away.
+ */
+void
+phoc_output_notify_activity (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  if (priv->pending_mode) {
+    /* Didn't switch yet */
+    priv->pending_mode = NULL;
+    priv->restore_mode = NULL;
+    return;
+  }
+
+  if (priv->restore_mode) {
+    priv->restore_requested = TRUE;
+    phoc_output_damage_whole (self);
+  }
+}
+
+/**
+ * phoc_output_get_refresh_stats:
+ * @self: The output
+ *
+ * Get the time the output spent at each refresh rate. The keys are
+ * the refresh rates in mHz, `0` is used for the time adaptive sync
+ * was enabled.
+ *
+ * Returns: (transfer floating): The time in µs per refresh rate as `a{ut}`
+ */
+GVariant *
+phoc_output_get_refresh_stats (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+  GVariantBuilder builder;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  /* Account the current period */
+  update_refresh_stats (self);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{ut}"));
+  g_hash_table_iter_init (&iter, priv->refresh_stats);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    g_variant_builder_add (&builder, "{ut}",
+                           (guint32)GPOINTER_TO_INT (key),
+                           (guint64)*(gint64 *)value);
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * phoc_output_get_frame_stats:
+ * @self: The output
+ *
+ * Get frame statistics of the output: The number of committed
+ * (`frames`) and empty frames (`empty-frames`) that were scheduled
+ * but had nothing to redraw, the time it took to build the last
+ * committed frame (`frame-time`) in microseconds, how often the frame
+ * clock stopped (`parks`), whether it's stopped right now (`parked`), the
+ * number of frames each [enum@OutputFrameReason] contributed to,
+ * keyed by the reason's nick, how often the output resumed from power
+ * saving (`resumes`), how often it could show the last frame right
+ * away (`fast-resumes`) and the time from the resume request until
+ * the first frame was visible (`resume-latency`,
+ * `max-resume-latency`) in microseconds.
+ *
+ * Returns: (transfer floating): The statistics as `a{st}`
+ */
+GVariant *
+phoc_output_get_frame_stats (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+  GVariantBuilder builder;
+  g_autoptr (GFlagsClass) flags_class = NULL;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  flags_class = G_FLAGS_CLASS (g_type_class_ref (phoc_output_frame_reason_get_type ()));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+  g_variant_builder_add (&builder, "{st}", "frames", priv->n_frames);
+  g_variant_builder_add (&builder, "{st}", "empty-frames", priv->n_empty_frames);
+  g_variant_builder_add (&builder, "{st}", "frame-time", priv->last_frame_time_us);
+  g_variant_builder_add (&builder, "{st}", "parks", priv->n_parks);
+  g_variant_builder_add (&builder, "{st}", "parked", (guint64)priv->parked);
+  g_variant_builder_add (&builder, "{st}", "resumes", priv->n_resumes);
+  g_variant_builder_add (&builder, "{st}", "fast-resumes", priv->n_fast_resumes);
+  g_variant_builder_add (&builder, "{st}", "resume-latency", priv->last_resume_us);
+  g_variant_builder_add (&builder, "{st}", "max-resume-latency", priv->max_resume_us);
+
+  for (guint i = 0; i < flags_class->n_values; i++) {
+    GFlagsValue *value = &flags_class->values[i];
+
+    g_variant_builder_add (&builder, "{st}", value->value_nick,
+                           priv->n_reason_frames[g_bit_nth_lsf (value->value, -1)]);
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * phoc_output_set_mirror_source:
+ * @self: The output
+ * @source: (nullable): The output to mirror
+ *
+ * Show the contents of `source` on this output by scaling the
+ * source's frames instead of rendering the views a second time.
+ */
+void
+phoc_output_set_mirror_source (PhocOutput *self, PhocOutput *source)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  g_assert (source == NULL || PHOC_IS_OUTPUT (source));
+  priv = phoc_output_get_instance_private (self);
+
+  if (source && priv->mirror_unsupported)
+    source = NULL;
+
+  if (priv->mirror_source == source)
+    return;
+
+  g_debug ("%s mirrors %s", phoc_output_get_name (self),
+           source ? phoc_output_get_name (source) : "nothing");
+  set_mirror_buffer (self, NULL);
+  g_set_weak_pointer (&priv->mirror_source, source);
+  priv->mirror_dirty = FALSE;
+
+  /* Get a fresh frame from the source */
+  if (source)
+    phoc_output_damage_whole (source);
+  phoc_output_damage_whole (self);
+}
+
+/**
+ * phoc_output_get_mirror_source:
+ * @self: The output
+ *
+ * Returns: (transfer none) (nullable): The output that is mirrored on this output
+ */
+PhocOutput *
+phoc_output_get_mirror_source (PhocOutput *self)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  return priv->mirror_source;
+}
+
+/**
+ * phoc_output_get_texture_filter_mode_for_scale:
+ * @self: The output
+ * @scale_x: The horizontal scale from texture to buffer pixels
+ * @scale_y: The vertical scale from texture to buffer pixels
+ *
+ * Get the filter to use for a texture drawn at the given scale. Unless
+ * a filter is configured for the output textures that are drawn pixel
+ * by pixel or scaled up by an integer factor don't need any filtering
+ * while anything that is scaled down does.
+ *
+ * Returns: The filter mode
+ */
+enum wlr_scale_filter_mode
+phoc_output_get_texture_filter_mode_for_scale (PhocOutput *self, double scale_x, double scale_y)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  if (priv->scale_filter != PHOC_OUTPUT_SCALE_FILTER_AUTO)
+    return phoc_output_get_texture_filter_mode (self);
+
+  if (scale_x < 1.0 || scale_y < 1.0)
+    return WLR_SCALE_FILTER_BILINEAR;
+
+  if (ceil (scale_x) == scale_x && ceil (scale_y) == scale_y)
+    return WLR_SCALE_FILTER_NEAREST;
+
+  return WLR_SCALE_FILTER_BILINEAR;
+}
+
+/**
+ * phoc_output_set_color_temperature:
+ * @self: The output
+ * @temperature: The color temperature in Kelvin
+ *
+ * Tint the output towards the given color temperature e.g. for a
+ * night light. Temperatures at or above 6500K disable the tint.
+ * Clients using the gamma control protocol take precedence. Changes
+ * are applied with the next frame so transitions can update the
+ * temperature as often as they like.
+ */
+void
+phoc_output_set_color_temperature (PhocOutput *self, guint temperature)
+{
+  PhocOutputPrivate *priv;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  priv = phoc_output_get_instance_private (self);
+
+  if (temperature >= COLOR_TEMPERATURE_NEUTRAL)
+    temperature = 0;
+  else
+    temperature = MAX (temperature, COLOR_TEMPERATURE_MIN);
+
+  if (priv->color_temperature == temperature)
+    return;
+
+  priv->color_temperature = temperature;
+  priv->gamma_lut_changed = TRUE;
+  schedule_frame (self, PHOC_OUTPUT_FRAME_REASON_GAMMA);
+}
@@ -33,6 +33,28 @@ typedef enum _PhocOutputScaleFilter {
   PHOC_OUTPUT_SCALE_FILTER_NEAREST,
 } PhocOutputScaleFilter;
 
+/**
+ * PhocOutputFrameReason:
+ * @PHOC_OUTPUT_FRAME_REASON_DAMAGE: The output got damaged
+ * @PHOC_OUTPUT_FRAME_REASON_ANIMATION: An animation is running
+ * @PHOC_OUTPUT_FRAME_REASON_CLIENT: A client waits for a frame callback
+ * @PHOC_OUTPUT_FRAME_REASON_CURSOR: A software cursor changed
+ * @PHOC_OUTPUT_FRAME_REASON_GAMMA: The gamma table changed
+ * @PHOC_OUTPUT_FRAME_REASON_BACKEND: The backend asked for a frame
+ * @PHOC_OUTPUT_FRAME_REASON_DEBUG: Debug damage is being faded out
+ *
+ * Why a frame was scheduled on an output.
+ */
+typedef enum _PhocOutputFrameReason {
+  PHOC_OUTPUT_FRAME_REASON_DAMAGE    = 1 << 0,
+  PHOC_OUTPUT_FRAME_REASON_ANIMATION = 1 << 1,
+  PHOC_OUTPUT_FRAME_REASON_CLIENT    = 1 << 2,
+  PHOC_OUTPUT_FRAME_REASON_CURSOR    = 1 << 3,
+  PHOC_OUTPUT_FRAME_REASON_GAMMA     = 1 << 4,
+  PHOC_OUTPUT_FRAME_REASON_BACKEND   = 1 << 5,
+  PHOC_OUTPUT_FRAME_REASON_DEBUG     = 1 << 6,
+} PhocOutputFrameReason;
+
 
 typedef struct {
   gint64            when;
@@ -117,14 +139,18 @@ void        phoc_output_layer_surface_for_each_surface (PhocOutput          *sel
                                                         void                *user_data);
 
 #ifdef PHOC_XWAYLAND
-struct wlr_xwayland_surface;
+typedef struct _PhocXWaylandSurface PhocXWaylandSurface;
 void        phoc_output_xwayland_children_for_each_surface (PhocOutput *self,
-                                                            struct wlr_xwayland_surface *surface,
+                                                            PhocXWaylandSurface *surface,
                                                             PhocSurfaceIterator iterator,
                                                             void *user_data);
 #endif
-GQueue     *phoc_output_get_layer_surfaces_for_layer (PhocOutput                     *self,
+GSequence  *phoc_output_get_layer_surfaces_for_layer (PhocOutput                     *self,
                                                       enum zwlr_layer_shell_v1_layer  layer);
+void        phoc_output_update_layer_surface_stacking (PhocOutput       *self,
+                                                       PhocLayerSurface *layer_surface);
+void        phoc_output_remove_layer_surface_stacking (PhocOutput       *self,
+                                                       PhocLayerSurface *layer_surface);
 void        phoc_output_set_layer_dirty (PhocOutput *self, enum zwlr_layer_shell_v1_layer  layer);
 
 /* signal handlers */
@@ -172,11 +198,21 @@ void       phoc_output_lower_shield          (PhocOutput *self, PhocEasing easin
 void       phoc_output_raise_shield          (PhocOutput *self);
 float      phoc_output_get_scale             (PhocOutput *self);
 const char *phoc_output_get_name             (PhocOutput *self);
+void        phoc_output_notify_activity      (PhocOutput *self);
+GVariant   *phoc_output_get_refresh_stats    (PhocOutput *self);
+GVariant   *phoc_output_get_frame_stats      (PhocOutput *self);
+void        phoc_output_set_mirror_source    (PhocOutput *self, PhocOutput *source);
+PhocOutput *phoc_output_get_mirror_source    (PhocOutput *self);
+void        phoc_output_set_color_temperature (PhocOutput *self, guint temperature);
 void       phoc_output_transform_damage      (PhocOutput *self, pixman_region32_t *damage);
 void       phoc_output_transform_box         (PhocOutput *self, struct wlr_box *box);
 GSList    *phoc_output_get_debug_damage      (PhocOutput *self);
 
 enum wlr_scale_filter_mode
            phoc_output_get_texture_filter_mode (PhocOutput *self);
+enum wlr_scale_filter_mode
+           phoc_output_get_texture_filter_mode_for_scale (PhocOutput *self,
+                                                          double      scale_x,
+                                                          double      scale_y);
 
 G_END_DECLS
@@ -16,6 +16,7 @@
 #include "cursor.h"
 #include "input.h"
 #include "layer-shell.h"
+#include "layout-transaction.h"
 #include "seat.h"
 #include "server.h"
 #include "render.h"
@@ -39,6 +40,7 @@
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_linux_dmabuf_v1.h>
+#include <wlr/util/box.h>
 #include <wlr/util/region.h>
 #include <wlr/util/transform.h>
 #include <wlr/render/allocator.h>
@@ -48,6 +50,11 @@
 #define COLOR_BLACK                ((struct wlr_render_color){0.0f, 0.0f, 0.0f, 1.0f})
 #define COLOR_MAGENTA_ALPHA(x)     ((struct wlr_render_color){0.5f, 0.0f, 0.5f, (x)})
 
+/* Number of frames a view needs to be unchanged before we snapshot it */
+#define VIEW_SNAPSHOT_IDLE_FRAMES  3
+/* Snapshot single surface views too when scaled down at least that much */
+#define VIEW_SNAPSHOT_DOWNSCALE    0.5
+
 /**
  * PhocRenderer:
  *
@@ -73,6 +80,9 @@ struct _PhocRenderer {
   struct wlr_backend   *wlr_backend;
   struct wlr_renderer  *wlr_renderer;
   struct wlr_allocator *wlr_allocator;
+
+  GHashTable           *view_snapshots;
+  guint                 view_snapshots_idle_id;
 };
 
 static void phoc_renderer_initable_iface_init (GInitableIface *iface);
@@ -88,6 +98,41 @@ struct render_view_data {
   struct wlr_render_pass *render_pass;
 };
 
+/*
+ * A flattened texture of all surfaces of a view at the size it's
+ * drawn on the output. It's only rendered once the view's damage
+ * history was idle for a couple of frames. New damage only drops the
+ * texture, the buffer is kept so only the parts damaged in the
+ * meantime need to be redrawn once the view is idle again.
+ */
+typedef struct _PhocViewSnapshot {
+  PhocRenderer       *renderer;
+  PhocView           *view;
+  /* The view's damage sequence number the snapshot is based on */
+  guint64             seq;
+  /* The view's damage sequence number the buffer's content is from */
+  guint64             buffer_seq;
+  /* Whether the buffer was halved down from a larger one */
+  gboolean            downscaled;
+  guint               idle_frames;
+  gboolean            pending;
+  /* View scale times output scale */
+  float               scale;
+  /* Extents of all surfaces in view local coordinates */
+  struct wlr_box      extents;
+  struct wlr_buffer  *buffer;
+  struct wlr_texture *texture;
+} PhocViewSnapshot;
+
+struct view_snapshot_data {
+  PhocViewSnapshot       *snapshot;
+  guint                   n_surfaces;
+  float                   scale;
+  struct wlr_render_pass *render_pass;
+  /* Buffer local area to redraw, %NULL for everything */
+  const pixman_region32_t *clip;
+};
+
 
 static void
 phoc_renderer_set_property (GObject      *object,
@@ -127,6 +172,34 @@ phoc_renderer_get_property (GObject    *object,
 }
 
 
+/* Pick the filter based on how much this texture gets scaled */
+static enum wlr_scale_filter_mode
+get_filter_mode (PhocOutput               *output,
+                 struct wlr_texture       *texture,
+                 const struct wlr_fbox    *src_box,
+                 const struct wlr_box     *dst_box,
+                 enum wl_output_transform  transform)
+{
+  double src_width = texture->width, src_height = texture->height;
+
+  if (!wlr_fbox_empty (src_box)) {
+    src_width = src_box->width;
+    src_height = src_box->height;
+  }
+
+  if (transform & WL_OUTPUT_TRANSFORM_90) {
+    double tmp = src_width;
+
+    src_width = src_height;
+    src_height = tmp;
+  }
+
+  return phoc_output_get_texture_filter_mode_for_scale (output,
+                                                        dst_box->width / src_width,
+                                                        dst_box->height / src_height);
+}
+
+
 static void
 render_texture (PhocOutput               *output,
                 struct wlr_texture       *texture,
@@ -159,7 +232,7 @@ render_texture (PhocOutput               *output,
       .transform = transform,
       .alpha = &alpha,
       .clip = &damage,
-      .filter_mode = phoc_output_get_texture_filter_mode (ctx->output),
+      .filter_mode = get_filter_mode (output, texture, &src_box, &proj_box, transform),
     });
 
  buffer_damage_finish:
@@ -188,10 +261,9 @@ render_surface_iterator (PhocOutput         *output,
   struct wlr_box dst_box = *box;
   struct wlr_box clip_box = *box;
 
-  phoc_utils_scale_box (&dst_box, scale);
-  phoc_utils_scale_box (&dst_box, wlr_output->scale);
-  phoc_utils_scale_box (&clip_box, scale);
-  phoc_utils_scale_box (&clip_box, wlr_output->scale);
+  /* Scale once so edges snap to output pixels only once */
+  phoc_utils_scale_box (&dst_box, scale * wlr_output->scale);
+  phoc_utils_scale_box (&clip_box, scale * wlr_output->scale);
 
   render_texture (output, texture, &src_box, &dst_box, &clip_box, surface->current.transform, alpha, ctx);
 
@@ -220,8 +292,435 @@ render_blings (PhocOutput *output, PhocView *view, PhocRenderContext *ctx)
 
 
 static void
-render_view (PhocOutput *output, PhocView *view, PhocRenderContext *ctx)
+view_snapshot_clear (PhocViewSnapshot *snapshot)
+{
+  g_clear_pointer (&snapshot->texture, wlr_texture_destroy);
+  g_clear_pointer (&snapshot->buffer, wlr_buffer_drop);
+  snapshot->pending = FALSE;
+}
+
+
+static void
+on_view_finalized (gpointer data, GObject *where_the_object_was)
+{
+  PhocViewSnapshot *snapshot = data;
+
+  /* The view is gone already, don't drop the weak ref again */
+  snapshot->view = NULL;
+  g_hash_table_remove (snapshot->renderer->view_snapshots, where_the_object_was);
+}
+
+
+static void
+view_snapshot_free (PhocViewSnapshot *snapshot)
+{
+  view_snapshot_clear (snapshot);
+  if (snapshot->view)
+    g_object_weak_unref (G_OBJECT (snapshot->view), on_view_finalized, snapshot);
+  g_free (snapshot);
+}
+
+
+static PhocViewSnapshot *
+view_snapshot_lookup (PhocRenderer *self, PhocView *view)
+{
+  PhocViewSnapshot *snapshot = g_hash_table_lookup (self->view_snapshots, view);
+
+  if (snapshot)
+    return snapshot;
+
+  snapshot = g_new0 (PhocViewSnapshot, 1);
+  snapshot->renderer = self;
+  snapshot->view = view;
+  snapshot->seq = phoc_view_get_damage_seq (view);
+  g_object_weak_ref (G_OBJECT (view), on_view_finalized, snapshot);
+  g_hash_table_insert (self->view_snapshots, view, snapshot);
+
+  return snapshot;
+}
+
+
+static void
+view_snapshot_extents_iterator (struct wlr_surface *surface, int sx, int sy, void *_data)
+{
+  struct view_snapshot_data *data = _data;
+  struct wlr_box box = { sx, sy, surface->current.width, surface->current.height };
+
+  if (!wlr_surface_has_buffer (surface))
+    return;
+
+  if (data->n_surfaces++) {
+    struct wlr_box *extents = &data->snapshot->extents;
+    int x2 = MAX (extents->x + extents->width, box.x + box.width);
+    int y2 = MAX (extents->y + extents->height, box.y + box.height);
+
+    extents->x = MIN (extents->x, box.x);
+    extents->y = MIN (extents->y, box.y);
+    extents->width = x2 - extents->x;
+    extents->height = y2 - extents->y;
+  } else {
+    data->snapshot->extents = box;
+  }
+}
+
+
+static void
+view_snapshot_render_iterator (struct wlr_surface *surface, int sx, int sy, void *_data)
 {
+  struct view_snapshot_data *data = _data;
+  PhocViewSnapshot *snapshot = data->snapshot;
+  struct wlr_texture *texture = wlr_surface_get_texture (surface);
+  struct wlr_fbox src_box;
+  struct wlr_box dst_box = {
+    .x = sx - snapshot->extents.x,
+    .y = sy - snapshot->extents.y,
+    .width = surface->current.width,
+    .height = surface->current.height,
+  };
+
+  if (!texture)
+    return;
+
+  wlr_surface_get_buffer_source_box (surface, &src_box);
+  phoc_utils_scale_box (&dst_box, data->scale);
+
+  wlr_render_pass_add_texture (data->render_pass, &(struct wlr_render_texture_options) {
+      .texture = texture,
+      .src_box = src_box,
+      .dst_box = dst_box,
+      .transform = surface->current.transform,
+      .filter_mode = WLR_SCALE_FILTER_BILINEAR,
+      .clip = data->clip,
+    });
+}
+
+
+static struct wlr_buffer *
+create_snapshot_buffer (PhocRenderer *self, int width, int height)
+{
+  const struct wlr_drm_format *fmt;
+  struct wlr_drm_format_set fmt_set = {};
+  struct wlr_buffer *buffer;
+
+  wlr_drm_format_set_add (&fmt_set, DRM_FORMAT_ARGB8888, DRM_FORMAT_MOD_INVALID);
+  fmt = wlr_drm_format_set_get (&fmt_set, DRM_FORMAT_ARGB8888);
+  buffer = wlr_allocator_create_buffer (self->wlr_allocator, width, height, fmt);
+  wlr_drm_format_set_finish (&fmt_set);
+  if (!buffer)
+    g_warning ("Failed to allocate %dx%d snapshot buffer", width, height);
+
+  return buffer;
+}
+
+/*
+ * Scale the buffer down to the given size. Used with halved sizes so
+ * bilinear filtering averages 2x2 blocks like a mipmap level would.
+ * Takes ownership of the passed in buffer.
+ */
+static struct wlr_buffer *
+downscale_snapshot_buffer (PhocRenderer *self, struct wlr_buffer *buffer, int width, int height)
+{
+  struct wlr_render_pass *render_pass;
+  struct wlr_texture *texture;
+  struct wlr_buffer *scaled = NULL;
+
+  texture = wlr_texture_from_buffer (self->wlr_renderer, buffer);
+  if (!texture)
+    goto out;
+
+  scaled = create_snapshot_buffer (self, width, height);
+  if (!scaled)
+    goto out;
+
+  render_pass = wlr_renderer_begin_buffer_pass (self->wlr_renderer, scaled, NULL);
+  if (!render_pass) {
+    g_clear_pointer (&scaled, wlr_buffer_drop);
+    goto out;
+  }
+
+  wlr_render_pass_add_texture (render_pass, &(struct wlr_render_texture_options) {
+      .texture = texture,
+      .dst_box = { .width = width, .height = height },
+      .blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+      .filter_mode = WLR_SCALE_FILTER_BILINEAR,
+    });
+  if (!wlr_render_pass_submit (render_pass))
+    g_clear_pointer (&scaled, wlr_buffer_drop);
+
+ out:
+  g_clear_pointer (&texture, wlr_texture_destroy);
+  wlr_buffer_drop (buffer);
+  return scaled;
+}
+
+
+/*
+ * Redraw only the parts of the snapshot's buffer the view damaged
+ * since it was rendered. Returns %FALSE if the buffer can't be
+ * updated and the snapshot needs to be rendered from scratch.
+ */
+static gboolean
+view_snapshot_update (PhocViewSnapshot *snapshot)
+{
+  PhocRenderer *self = snapshot->renderer;
+  struct view_snapshot_data data = { .snapshot = snapshot, .scale = snapshot->scale };
+  struct wlr_box extents = snapshot->extents;
+  pixman_region32_t damage;
+  gboolean ret = FALSE;
+
+  /* Halved buffers would need every level redone */
+  if (snapshot->downscaled)
+    return FALSE;
+
+  phoc_view_for_each_surface (snapshot->view, view_snapshot_extents_iterator, &data);
+  if (data.n_surfaces < 2 || !wlr_box_equal (&extents, &snapshot->extents))
+    return FALSE;
+
+  pixman_region32_init (&damage);
+  if (!phoc_view_get_damage_since (snapshot->view, snapshot->buffer_seq, &damage))
+    goto out;
+
+  pixman_region32_translate (&damage, -extents.x, -extents.y);
+  wlr_region_scale (&damage, &damage, data.scale);
+  /* Bilinear filtering samples neighbouring pixels too */
+  wlr_region_expand (&damage, &damage, 1);
+  pixman_region32_intersect_rect (&damage, &damage, 0, 0,
+                                  snapshot->buffer->width, snapshot->buffer->height);
+
+  if (pixman_region32_not_empty (&damage)) {
+    data.render_pass = wlr_renderer_begin_buffer_pass (self->wlr_renderer, snapshot->buffer, NULL);
+    if (!data.render_pass)
+      goto out;
+
+    data.clip = &damage;
+    wlr_render_pass_add_rect (data.render_pass, &(struct wlr_render_rect_options){
+        .color = { 0, 0, 0, 0 },
+        .blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+        .clip = &damage,
+      });
+    phoc_view_for_each_surface (snapshot->view, view_snapshot_render_iterator, &data);
+    if (!wlr_render_pass_submit (data.render_pass))
+      goto out;
+  }
+
+  snapshot->texture = wlr_texture_from_buffer (self->wlr_renderer, snapshot->buffer);
+  ret = !!snapshot->texture;
+
+ out:
+  pixman_region32_fini (&damage);
+  return ret;
+}
+
+
+static void
+view_snapshot_render (PhocViewSnapshot *snapshot)
+{
+  PhocRenderer *self = snapshot->renderer;
+  struct view_snapshot_data data = { .snapshot = snapshot, .scale = snapshot->scale };
+  guint n_halvings = 0;
+  int width, height;
+
+  if (snapshot->buffer) {
+    if (view_snapshot_update (snapshot)) {
+      snapshot->buffer_seq = snapshot->seq;
+      return;
+    }
+    g_clear_pointer (&snapshot->buffer, wlr_buffer_drop);
+  }
+
+  phoc_view_for_each_surface (snapshot->view, view_snapshot_extents_iterator, &data);
+
+  /* A single surface can be drawn directly unless it's scaled down a lot */
+  if (data.n_surfaces == 0 || (data.n_surfaces == 1 && snapshot->scale > VIEW_SNAPSHOT_DOWNSCALE))
+    return;
+
+  /* Render at the surfaces' own size or up to half below it (which is
+   * up to about 1/scale times the final size) and halve from there */
+  while (data.scale * 2 <= 1.0) {
+    data.scale *= 2;
+    n_halvings++;
+  }
+
+  snapshot->downscaled = n_halvings > 0;
+  width = ceil (snapshot->extents.width * data.scale);
+  height = ceil (snapshot->extents.height * data.scale);
+  if (width <= 0 || height <= 0)
+    return;
+
+  snapshot->buffer = create_snapshot_buffer (self, width, height);
+  if (!snapshot->buffer)
+    return;
+
+  data.render_pass = wlr_renderer_begin_buffer_pass (self->wlr_renderer, snapshot->buffer, NULL);
+  if (!data.render_pass) {
+    g_clear_pointer (&snapshot->buffer, wlr_buffer_drop);
+    return;
+  }
+
+  wlr_render_pass_add_rect (data.render_pass, &(struct wlr_render_rect_options){
+      .color = { 0, 0, 0, 0 },
+      .blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+    });
+  phoc_view_for_each_surface (snapshot->view, view_snapshot_render_iterator, &data);
+  if (!wlr_render_pass_submit (data.render_pass)) {
+    g_clear_pointer (&snapshot->buffer, wlr_buffer_drop);
+    return;
+  }
+
+  for (; n_halvings > 0 && snapshot->buffer; n_halvings--) {
+    data.scale /= 2;
+    width = MAX (ceil (snapshot->extents.width * data.scale), 1);
+    height = MAX (ceil (snapshot->extents.height * data.scale), 1);
+    snapshot->buffer = downscale_snapshot_buffer (self, snapshot->buffer, width, height);
+  }
+  if (!snapshot->buffer)
+    return;
+
+  snapshot->texture = wlr_texture_from_buffer (self->wlr_renderer, snapshot->buffer);
+  if (!snapshot->texture)
+    g_clear_pointer (&snapshot->buffer, wlr_buffer_drop);
+  snapshot->buffer_seq = snapshot->seq;
+}
+
+
+static gboolean
+on_view_snapshots_idle (gpointer data)
+{
+  PhocRenderer *self = PHOC_RENDERER (data);
+  GHashTableIter iter;
+  PhocViewSnapshot *snapshot;
+
+  /* Snapshots are rendered outside of the output's render pass */
+  g_hash_table_iter_init (&iter, self->view_snapshots);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&snapshot)) {
+    if (!snapshot->pending)
+      continue;
+
+    snapshot->pending = FALSE;
+    if (!phoc_view_is_mapped (snapshot->view) ||
+        snapshot->seq != phoc_view_get_damage_seq (snapshot->view))
+      continue;
+
+    view_snapshot_render (snapshot);
+  }
+
+  self->view_snapshots_idle_id = 0;
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+render_view_snapshot_iterator (PhocOutput         *output,
+                               struct wlr_surface *surface,
+                               struct wlr_box     *box,
+                               float               scale,
+                               void               *data)
+{
+  wlr_presentation_surface_scanned_out_on_output (surface, output->wlr_output);
+}
+
+/*
+ * Render the view from its snapshot. Returns %FALSE if there is no
+ * up to date snapshot and the view needs to be rendered surface by
+ * surface instead.
+ */
+static gboolean
+render_view_snapshot (PhocRenderer *self, PhocOutput *output, PhocView *view, PhocRenderContext *ctx)
+{
+  PhocViewSnapshot *snapshot;
+  guint64 seq = phoc_view_get_damage_seq (view);
+  float scale = phoc_view_get_scale (view) * output->wlr_output->scale;
+  struct wlr_box output_box, dst_box;
+
+  /* Only snapshot views on their primary output so different output scales don't thrash the cache */
+  if (phoc_view_get_output (view) != output)
+    return FALSE;
+
+  snapshot = view_snapshot_lookup (self, view);
+  if (!G_APPROX_VALUE (snapshot->scale, scale, FLT_EPSILON)) {
+    view_snapshot_clear (snapshot);
+    snapshot->seq = seq;
+    snapshot->scale = scale;
+    snapshot->idle_frames = 0;
+    return FALSE;
+  }
+
+  if (snapshot->seq != seq) {
+    /* Keep the buffer around so it can be updated from the view's damage */
+    g_clear_pointer (&snapshot->texture, wlr_texture_destroy);
+    snapshot->pending = FALSE;
+    snapshot->seq = seq;
+    snapshot->idle_frames = 0;
+    return FALSE;
+  }
+
+  if (!snapshot->texture) {
+    if (snapshot->idle_frames < VIEW_SNAPSHOT_IDLE_FRAMES &&
+        ++snapshot->idle_frames == VIEW_SNAPSHOT_IDLE_FRAMES) {
+      snapshot->pending = TRUE;
+      if (!self->view_snapshots_idle_id) {
+        self->view_snapshots_idle_id = g_idle_add (on_view_snapshots_idle, self);
+        g_source_set_name_by_id (self->view_snapshots_idle_id, "[phoc] view snapshots");
+      }
+    }
+    return FALSE;
+  }
+
+  wlr_output_layout_get_box (output->desktop->layout, output->wlr_output, &output_box);
+  dst_box = (struct wlr_box) {
+    .x = view->box.x - output_box.x + snapshot->extents.x,
+    .y = view->box.y - output_box.y + snapshot->extents.y,
+    .width = snapshot->extents.width,
+    .height = snapshot->extents.height,
+  };
+  /* Scale once so edges snap to output pixels only once */
+  phoc_utils_scale_box (&dst_box, scale);
+
+  render_texture (output, snapshot->texture, NULL, &dst_box, &dst_box,
+                  WL_OUTPUT_TRANSFORM_NORMAL, ctx->alpha, ctx);
+  phoc_output_view_for_each_surface (output, view, render_view_snapshot_iterator, NULL);
+
+  return TRUE;
+}
+
+
+/*
+ * Render a participant of the layout transaction from the buffers it
+ * showed when it joined. Returns %FALSE if it isn't part of the
+ * transaction.
+ */
+static gboolean
+render_frozen (PhocOutput *output, gpointer participant, PhocRenderContext *ctx)
+{
+  GArray *frozen;
+
+  frozen = phoc_layout_transaction_get_frozen_surfaces (phoc_layout_transaction_get_default (),
+                                                        participant);
+  if (!frozen)
+    return FALSE;
+
+  for (guint i = 0; i < frozen->len; i++) {
+    PhocFrozenSurface *frozen_surface = &g_array_index (frozen, PhocFrozenSurface, i);
+    struct wlr_box dst_box = frozen_surface->box;
+
+    if (frozen_surface->output != output)
+      continue;
+
+    /* Scale once so edges snap to output pixels only once */
+    phoc_utils_scale_box (&dst_box, frozen_surface->scale * output->wlr_output->scale);
+    render_texture (output, frozen_surface->buffer->texture, &frozen_surface->src_box,
+                    &dst_box, &dst_box, frozen_surface->transform, ctx->alpha, ctx);
+  }
+
+  return TRUE;
+}
+
+
+static void
+render_view (PhocRenderer *self, PhocOutput *output, PhocView *view, PhocRenderContext *ctx)
+{
+  PhocConfig *config = phoc_server_get_config (phoc_server_get_default ());
+
   /*  Do not render views fullscreened on other outputs */
   if (phoc_view_is_fullscreen (view) && phoc_view_get_fullscreen_output (view) != output)
     return;
@@ -231,6 +730,12 @@ render_view (PhocOutput *output, PhocView *view, PhocRenderContext *ctx)
   if (!phoc_view_is_fullscreen (view))
     render_blings (output, view, ctx);
 
+  if (render_frozen (output, view, ctx))
+    return;
+
+  if (config->view_snapshots && render_view_snapshot (self, output, view, ctx))
+    return;
+
   phoc_output_view_for_each_surface (output, view, render_surface_iterator, ctx);
 }
 
@@ -238,12 +743,17 @@ render_view (PhocOutput *output, PhocView *view, PhocRenderContext *ctx)
 static void
 render_layer (enum zwlr_layer_shell_v1_layer layer, PhocRenderContext *ctx)
 {
-  GQueue *layer_surfaces = phoc_output_get_layer_surfaces_for_layer (ctx->output, layer);
+  GSequence *layer_surfaces = phoc_output_get_layer_surfaces_for_layer (ctx->output, layer);
 
-  for (GList *l = layer_surfaces->head; l; l = l->next) {
-    PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (l->data);
+  for (GSequenceIter *iter = g_sequence_get_begin_iter (layer_surfaces);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter)) {
+    PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (g_sequence_get (iter));
 
     ctx->alpha = phoc_layer_surface_get_alpha (layer_surface);
+    if (render_frozen (ctx->output, layer_surface, ctx))
+      continue;
+
     phoc_output_layer_surface_for_each_surface (ctx->output,
                                                 layer_surface,
                                                 render_surface_iterator,
@@ -478,17 +988,15 @@ phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output, PhocRenderC
   if (output->fullscreen_view != NULL) {
     PhocView *view = output->fullscreen_view;
 
-    render_view (output, view, ctx);
+    render_view (self, output, view, ctx);
 
     /* During normal rendering the xwayland window tree isn't traversed
      * because all windows are rendered. Here we only want to render
      * the fullscreen window's children so we have to traverse the tree. */
 #ifdef PHOC_XWAYLAND
     if (PHOC_IS_XWAYLAND_SURFACE (view)) {
-      struct wlr_xwayland_surface *xsurface =
-        phoc_xwayland_surface_get_wlr_surface (PHOC_XWAYLAND_SURFACE (view));
       phoc_output_xwayland_children_for_each_surface (output,
-                                                      xsurface,
+                                                      PHOC_XWAYLAND_SURFACE (view),
                                                       render_surface_iterator,
                                                       ctx);
     }
@@ -508,7 +1016,7 @@ phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output, PhocRenderC
       PhocView *view = PHOC_VIEW (l->data);
 
       if (phoc_desktop_view_check_visibility (desktop, view))
-        render_view (output, view, ctx);
+        render_view (self, output, view, ctx);
     }
     /* Render top layer above views */
     render_layer (ZWLR_LAYER_SHELL_V1_LAYER_TOP, ctx);
@@ -563,6 +1071,8 @@ phoc_renderer_finalize (GObject *object)
 {
   PhocRenderer *self = PHOC_RENDERER (object);
 
+  g_clear_handle_id (&self->view_snapshots_idle_id, g_source_remove);
+  g_clear_pointer (&self->view_snapshots, g_hash_table_destroy);
   g_clear_pointer (&self->wlr_allocator, wlr_allocator_destroy);
   g_clear_pointer (&self->wlr_renderer, wlr_renderer_destroy);
 
@@ -619,6 +1129,10 @@ phoc_renderer_class_init (PhocRendererClass *klass)
 static void
 phoc_renderer_init (PhocRenderer *self)
 {
+  self->view_snapshots = g_hash_table_new_full (g_direct_hash,
+                                                g_direct_equal,
+                                                NULL,
+                                                (GDestroyNotify)view_snapshot_free);
 }
 
 
@@ -647,3 +1161,19 @@ phoc_renderer_get_wlr_allocator (PhocRenderer *self)
 
   return self->wlr_allocator;
 }
+
+/**
+ * phoc_renderer_drop_view_snapshot:
+ * @self: The renderer
+ * @view: The view
+ *
+ * Drop the snapshot of @view (if any) so its buffers don't stay around
+ * while the view is unmapped.
+ */
+void
+phoc_renderer_drop_view_snapshot (PhocRenderer *self, PhocView *view)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  g_hash_table_remove (self->view_snapshots, view);
+}
@@ -36,5 +36,6 @@ void          phoc_renderer_render_output (PhocRenderer      *self,
 gboolean      phoc_renderer_render_view_to_buffer (PhocRenderer           *self,
                                                    PhocView               *view,
                                                    struct wlr_buffer      *data);
+void          phoc_renderer_drop_view_snapshot (PhocRenderer *self, PhocView *view);
 
 G_END_DECLS
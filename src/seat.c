@@ -451,7 +451,7 @@ handle_tool_proximity (struct wl_listener *listener, void *data)
 
     phoc_tool->seat = cursor->seat;
     tool->data = phoc_tool;
-    phoc_tool->tablet_v2_tool = wlr_tablet_tool_create (desktop->tablet_v2,
+    phoc_tool->tablet_v2_tool = wlr_tablet_tool_create (phoc_desktop_get_tablet_manager (desktop),
                                                         cursor->seat->seat,
                                                         tool);
 
@@ -1115,7 +1115,9 @@ seat_add_tablet_pad (PhocSeat *seat, struct wlr_input_device *device)
 
   wl_list_init (&tablet_pad->tablet_destroy.link);
 
-  tablet_pad->tablet_v2_pad = wlr_tablet_pad_create (desktop->tablet_v2, seat->seat, device);
+  tablet_pad->tablet_v2_pad = wlr_tablet_pad_create (phoc_desktop_get_tablet_manager (desktop),
+                                                     seat->seat,
+                                                     device);
 
   /* Search for a sibling tablet */
   if (!wlr_input_device_is_libinput (device)) {
@@ -1177,7 +1179,9 @@ seat_add_tablet_tool (PhocSeat                *seat,
   wlr_cursor_attach_input_device (seat->cursor->cursor, device);
   phoc_seat_add_input_mapping_settings (seat, PHOC_INPUT_DEVICE (tablet));
 
-  tablet->tablet_v2 = wlr_tablet_create (desktop->tablet_v2, seat->seat, device);
+  tablet->tablet_v2 = wlr_tablet_create (phoc_desktop_get_tablet_manager (desktop),
+                                         seat->seat,
+                                         device);
 
   struct libinput_device_group *group =
     libinput_device_get_device_group (wlr_libinput_get_device_handle (device));
@@ -15,6 +15,9 @@
 #include "seat.h"
 #include "server.h"
 #include "surface.h"
+#include "keymap-cache.h"
+#include "mode-cache.h"
+#include "suspend-policy.h"
 #include "utils.h"
 
 #include <gmobile.h>
@@ -26,19 +29,33 @@
 #include <wlr/xwayland/shell.h>
 
 #include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+/* Log when Wayland events wait longer than that for being dispatched */
+#define PHOC_WAKEUP_LATENCY_WARN_USEC (8 * 1000)
 
 /* Maximum protocol versions we support */
 #define PHOC_WL_DISPLAY_VERSION 6
 #define PHOC_LINUX_DMABUF_VERSION 5
+/* How long the session gets to exit after SIGTERM before it's killed */
+#define SESSION_TERM_TIMEOUT_MS   2000
+#define SESSION_POLL_INTERVAL_MS  10
 
 enum {
   PROP_0,
   PROP_DEBUG_FLAGS,
   PROP_LOG_DOMAINS,
+  PROP_STARTUP_TIMELINE,
   PROP_LAST_PROP
 };
 static GParamSpec *props[PROP_LAST_PROP];
 
+typedef struct {
+  const char *step;
+  gint64      usec;
+} PhocStartupStep;
+
 /**
  * PhocServer:
  *
@@ -60,8 +77,16 @@ typedef struct _PhocServer {
 
   PhocRenderer        *renderer;
   PhocDesktop         *desktop;
+  PhocSuspendPolicy   *suspend_policy;
+  PhocKeymapCache     *keymap_cache;
+  PhocModeCache       *mode_cache;
+
+  gint64               startup_time;
+  GArray              *startup_steps;
 
   gchar               *session_exec;
+  GPid                 session_pid;
+  guint                session_watch_id;
   gint                 exit_status;
   GMainLoop           *mainloop;
 
@@ -86,17 +111,84 @@ static void phoc_server_initable_iface_init (GInitableIface *iface);
 G_DEFINE_TYPE_WITH_CODE (PhocServer, phoc_server, G_TYPE_OBJECT,
                          G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, phoc_server_initable_iface_init));
 
+/*
+ * Main loop statistics, all times in microseconds:
+ *
+ * - dispatch: time spent dispatching Wayland and backend events
+ * - wakeup latency: time from poll() reporting the event loop's fd
+ *   ready until it got dispatched (i.e. time spent in other sources)
+ * - busy: time of a main loop iteration not spent in poll()
+ * - other: time of a main loop iteration spent in sources other than
+ *   the Wayland one (GSettings, DBus, timers, idles, ...)
+ */
+typedef struct {
+  guint64 n_iterations;
+  guint64 n_dispatches;
+  gint64  dispatch_time;
+  gint64  max_dispatch_time;
+  gint64  wakeup_latency;
+  gint64  max_wakeup_latency;
+  gint64  busy_time;
+  gint64  max_busy_time;
+  gint64  other_time;
+  gint64  max_other_time;
+  gint64  poll_time;
+} PhocEventLoopStats;
+
 typedef struct {
-  GSource source;
+  GSource            source;
   struct wl_display *display;
+  gpointer           fd_tag;
+
+  PhocEventLoopStats stats;
+  gint64             iteration_start;
+  gint64             iteration_dispatch_time;
+  gint64             ready_time;
 } WaylandEventSource;
 
+/* poll() bookkeeping. The poll func doesn't take any user data */
+static gint64 poll_end_time;
+static gint64 poll_duration;
+
+
+static gint
+phoc_poll (GPollFD *fds, guint nfds, gint timeout)
+{
+  gint64 start = g_get_monotonic_time ();
+  gint ret;
+
+  ret = g_poll (fds, nfds, timeout);
+
+  poll_end_time = g_get_monotonic_time ();
+  poll_duration = poll_end_time - start;
+
+  return ret;
+}
+
 
 static gboolean
 wayland_event_source_prepare (GSource *base,
                               int     *timeout)
 {
   WaylandEventSource *source = (WaylandEventSource *)base;
+  PhocEventLoopStats *stats = &source->stats;
+  gint64 now = g_get_monotonic_time ();
+
+  /* Account the previous iteration */
+  if (source->iteration_start) {
+    gint64 busy = now - source->iteration_start - poll_duration;
+    gint64 other = busy - source->iteration_dispatch_time;
+
+    stats->n_iterations++;
+    stats->poll_time += poll_duration;
+    stats->busy_time += busy;
+    stats->max_busy_time = MAX (stats->max_busy_time, busy);
+    stats->other_time += other;
+    stats->max_other_time = MAX (stats->max_other_time, other);
+  }
+  source->iteration_start = now;
+  source->iteration_dispatch_time = 0;
+  poll_duration = 0;
 
   *timeout = -1;
 
@@ -105,21 +197,57 @@ wayland_event_source_prepare (GSource *base,
   return FALSE;
 }
 
+
+static gboolean
+wayland_event_source_check (GSource *base)
+{
+  WaylandEventSource *source = (WaylandEventSource *)base;
+  GIOCondition revents = g_source_query_unix_fd (base, source->fd_tag);
+
+  if (!revents)
+    return FALSE;
+
+  source->ready_time = poll_end_time ? poll_end_time : g_get_monotonic_time ();
+  return TRUE;
+}
+
+
 static gboolean
 wayland_event_source_dispatch (GSource     *base,
                                GSourceFunc callback,
                                void        *data)
 {
   WaylandEventSource *source = (WaylandEventSource *)base;
+  PhocEventLoopStats *stats = &source->stats;
   struct wl_event_loop *loop = wl_display_get_event_loop (source->display);
+  gint64 start, duration, latency = 0;
+
+  start = g_get_monotonic_time ();
+  if (source->ready_time) {
+    latency = start - source->ready_time;
+    source->ready_time = 0;
+  }
 
   wl_event_loop_dispatch (loop, 0);
 
+  duration = g_get_monotonic_time () - start;
+  source->iteration_dispatch_time += duration;
+
+  stats->n_dispatches++;
+  stats->dispatch_time += duration;
+  stats->max_dispatch_time = MAX (stats->max_dispatch_time, duration);
+  stats->wakeup_latency += latency;
+  stats->max_wakeup_latency = MAX (stats->max_wakeup_latency, latency);
+
+  if (G_UNLIKELY (latency > PHOC_WAKEUP_LATENCY_WARN_USEC))
+    g_debug ("Wayland events waited %.3f ms for dispatch", latency / 1000.0);
+
   return TRUE;
 }
 
 static GSourceFuncs wayland_event_source_funcs = {
   .prepare = wayland_event_source_prepare,
+  .check = wayland_event_source_check,
   .dispatch = wayland_event_source_dispatch
 };
 
@@ -133,9 +261,9 @@ wayland_event_source_new (struct wl_display *display)
                                                 sizeof (WaylandEventSource));
   g_source_set_name (&source->source, "[phoc] wayland source");
   source->display = display;
-  g_source_add_unix_fd (&source->source,
-                        wl_event_loop_get_fd (loop),
-                        G_IO_IN | G_IO_ERR);
+  source->fd_tag = g_source_add_unix_fd (&source->source,
+                                         wl_event_loop_get_fd (loop),
+                                         G_IO_IN | G_IO_ERR);
 
   return &source->source;
 }
@@ -146,7 +274,10 @@ phoc_wayland_init (PhocServer *self)
   GSource *wayland_event_source;
 
   wayland_event_source = wayland_event_source_new (self->wl_display);
+  g_source_set_priority (wayland_event_source, self->config->wayland_priority);
   self->wl_source = g_source_attach (wayland_event_source, NULL);
+
+  g_main_context_set_poll_func (NULL, phoc_poll);
 }
 
 
@@ -156,6 +287,8 @@ on_session_exit (GPid pid, gint status, PhocServer *self)
   g_autoptr(GError) err = NULL;
 
   g_return_if_fail (PHOC_IS_SERVER (self));
+  self->session_watch_id = 0;
+  self->session_pid = 0;
   g_spawn_close_pid (pid);
   if (g_spawn_check_wait_status (status, &err)) {
     self->exit_status = 0;
@@ -165,7 +298,7 @@ on_session_exit (GPid pid, gint status, PhocServer *self)
     else
       g_warning ("Session terminated: %s (%d)", err->message, self->exit_status);
   }
-  if (!(self->debug_flags & PHOC_SERVER_DEBUG_FLAG_NO_QUIT))
+  if (self->mainloop && !(self->debug_flags & PHOC_SERVER_DEBUG_FLAG_NO_QUIT))
     g_main_loop_quit (self->mainloop);
 }
 
@@ -183,39 +316,65 @@ on_child_setup (gpointer unused)
 }
 
 
+/*
+ * Spawn the session right away. It can connect to the socket but
+ * only gets served once the main loop runs so it won't see a
+ * half initialized compositor.
+ */
 static gboolean
-phoc_startup_session_in_idle (PhocServer *self)
+phoc_startup_session (PhocServer *self)
 {
   GPid pid;
-  g_auto (GStrv) argv;
+  g_auto (GStrv) argv = NULL;
   g_autoptr (GError) err = NULL;
-  gboolean success;
 
-  success = g_shell_parse_argv (self->session_exec, NULL, &argv, &err);
-  if (!success) {
+  if (!g_shell_parse_argv (self->session_exec, NULL, &argv, &err)) {
     g_critical ("Failed to parse session command: %s", err->message);
-    g_main_loop_quit (self->mainloop);
+    return FALSE;
   }
 
-  if (g_spawn_async (NULL, argv, NULL,
-                     G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH,
-                     on_child_setup, self, &pid, &err)) {
-    g_child_watch_add (pid, (GChildWatchFunc)on_session_exit, self);
-  } else {
+  if (!g_spawn_async (NULL, argv, NULL,
+                      G_SPAWN_DO_NOT_REAP_CHILD | G_SPAWN_SEARCH_PATH,
+                      on_child_setup, self, &pid, &err)) {
     g_critical ("Failed to launch session: %s", err->message);
-    g_main_loop_quit (self->mainloop);
+    return FALSE;
   }
-  return FALSE;
+
+  self->session_pid = pid;
+  self->session_watch_id = g_child_watch_add (pid, (GChildWatchFunc)on_session_exit, self);
+  return TRUE;
 }
 
 
+/* Setup failed after the session got spawned, don't leave it behind */
 static void
-phoc_startup_session (PhocServer *server)
+phoc_stop_session (PhocServer *self)
 {
-  gint id;
+  if (!self->session_pid)
+    return;
 
-  id = g_idle_add ((GSourceFunc) phoc_startup_session_in_idle, server);
-  g_source_set_name_by_id (id, "[phoc] phoc_startup_session");
+  g_clear_handle_id (&self->session_watch_id, g_source_remove);
+  if (kill (self->session_pid, SIGTERM) < 0) {
+    g_warning ("Failed to terminate session: %s", g_strerror (errno));
+  } else {
+    gint64 deadline = g_get_monotonic_time () + SESSION_TERM_TIMEOUT_MS * 1000;
+    pid_t ret;
+
+    /* The child watch is gone so reap it ourselves */
+    while ((ret = waitpid (self->session_pid, NULL, WNOHANG)) == 0 ||
+           (ret < 0 && errno == EINTR)) {
+      if (g_get_monotonic_time () > deadline) {
+        g_warning ("Session didn't exit after SIGTERM, killing it");
+        kill (self->session_pid, SIGKILL);
+        while (waitpid (self->session_pid, NULL, 0) < 0 && errno == EINTR) {
+        }
+        break;
+      }
+      g_usleep (SESSION_POLL_INTERVAL_MS * 1000);
+    }
+  }
+  g_spawn_close_pid (self->session_pid);
+  self->session_pid = 0;
 }
 
 
@@ -300,6 +459,8 @@ phoc_server_initable_init (GInitable    *initable,
   PhocServer *self = PHOC_SERVER (initable);
   struct wlr_renderer *wlr_renderer;
 
+  self->startup_time = g_get_monotonic_time ();
+
   self->wl_display = wl_display_create ();
   if (self->wl_display == NULL) {
     g_set_error (error,
@@ -308,6 +469,7 @@ phoc_server_initable_init (GInitable    *initable,
     return FALSE;
   }
   wl_display_set_global_filter (self->wl_display, phoc_server_filter_globals, self);
+  phoc_server_add_startup_step (self, "display");
 
   self->backend = wlr_backend_autocreate (wl_display_get_event_loop (self->wl_display),
                                           &self->session);
@@ -317,6 +479,7 @@ phoc_server_initable_init (GInitable    *initable,
                  "Could not create backend");
     return FALSE;
   }
+  phoc_server_add_startup_step (self, "backend");
 
   self->renderer = phoc_renderer_new (self->backend, error);
   if (self->renderer == NULL) {
@@ -324,6 +487,7 @@ phoc_server_initable_init (GInitable    *initable,
   }
   wlr_renderer = phoc_renderer_get_wlr_renderer (self->renderer);
   wlr_renderer_init_wl_shm (wlr_renderer, self->wl_display);
+  phoc_server_add_startup_step (self, "renderer");
 
   if (wlr_renderer_get_texture_formats (wlr_renderer, WLR_BUFFER_CAP_DMABUF)) {
     wlr_drm_create (self->wl_display, wlr_renderer);
@@ -333,6 +497,7 @@ phoc_server_initable_init (GInitable    *initable,
   } else {
     g_message ("Linux dmabuf support unavailable");
   }
+  phoc_server_add_startup_step (self, "dmabuf");
 
   self->data_device_manager = wlr_data_device_manager_create (self->wl_display);
 
@@ -341,7 +506,10 @@ phoc_server_initable_init (GInitable    *initable,
   self->new_surface.notify = handle_new_surface;
 
   self->subcompositor = wlr_subcompositor_create (self->wl_display);
+  phoc_server_add_startup_step (self, "compositor");
 
+  self->suspend_policy = phoc_suspend_policy_new ();
+  self->keymap_cache = phoc_keymap_cache_new ();
   self->debug_control = phoc_debug_control_new (self);
   phoc_debug_control_set_exported (self->debug_control, TRUE);
 
@@ -393,6 +561,9 @@ phoc_server_get_property (GObject    *object,
   case PROP_LOG_DOMAINS:
     g_value_set_boxed (value, phoc_server_get_log_domains (self));
     break;
+  case PROP_STARTUP_TIMELINE:
+    g_value_set_variant (value, phoc_server_get_startup_timeline (self));
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -427,8 +598,14 @@ phoc_server_finalize (GObject *object)
   wl_list_remove (&self->new_surface.link);
 
   g_clear_pointer (&self->dt_compatibles, g_strfreev);
-  g_clear_handle_id (&self->wl_source, g_source_remove);
+  if (self->wl_source) {
+    g_main_context_set_poll_func (NULL, NULL);
+    g_clear_handle_id (&self->wl_source, g_source_remove);
+  }
   g_clear_object (&self->desktop);
+  g_clear_object (&self->suspend_policy);
+  g_clear_object (&self->keymap_cache);
+  g_clear_object (&self->mode_cache);
   g_clear_pointer (&self->session_exec, g_free);
 
   if (self->inited) {
@@ -442,6 +619,7 @@ phoc_server_finalize (GObject *object)
   g_clear_pointer (&self->wl_display, wl_display_destroy);
 
   g_clear_pointer (&self->log_domains, g_strfreev);
+  g_clear_pointer (&self->startup_steps, g_array_unref);
 
   G_OBJECT_CLASS (phoc_server_parent_class)->finalize (object);
 }
@@ -476,6 +654,17 @@ phoc_server_class_init (PhocServerClass *klass)
     g_param_spec_boxed ("log-domains", "", "",
                         G_TYPE_STRV,
                         G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  /**
+   * PhocServer:startup-timeline
+   *
+   * The steps of compositor startup as `a(st)` with each step's name
+   * and its end time in microseconds since startup began.
+   */
+  props[PROP_STARTUP_TIMELINE] =
+    g_param_spec_variant ("startup-timeline", "", "",
+                          G_VARIANT_TYPE ("a(st)"),
+                          NULL,
+                          G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
 
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 }
@@ -488,6 +677,7 @@ phoc_server_init (PhocServer *self)
   g_autoptr (GError) err = NULL;
 
   self->dt_compatibles = gm_device_tree_get_compatibles (NULL, &err);
+  self->startup_steps = g_array_new (FALSE, FALSE, sizeof (PhocStartupStep));
 
   messages_debug = g_getenv ("G_MESSAGES_DEBUG");
   if (messages_debug)
@@ -532,6 +722,10 @@ phoc_server_get_default (void)
  * Perform wayland server initialization: parse command line and config,
  * create the wayland socket, setup env vars.
  *
+ * The socket is opened and the session spawned before the backend
+ * starts so the session's startup overlaps with ours. Clients get
+ * served once @mainloop runs.
+ *
  * Returns: %TRUE on success, %FALSE otherwise
  */
 gboolean
@@ -541,32 +735,64 @@ phoc_server_setup (PhocServer      *self,
                    GMainLoop       *mainloop,
                    PhocServerFlags  flags)
 {
+  const char *socket;
+
   g_assert (!self->inited);
 
   self->config = config;
   self->flags = flags;
   self->mainloop = mainloop;
-  self->desktop = phoc_desktop_new ();
-  self->input = phoc_input_new ();
   self->session_exec = g_strdup (exec);
 
-  const char *socket = wl_display_add_socket_auto (self->wl_display);
+  socket = wl_display_add_socket_auto (self->wl_display);
   if (!socket) {
     g_warning("Unable to open wayland socket: %s", strerror(errno));
-    wlr_backend_destroy (self->backend);
-    return FALSE;
+    goto err;
   }
 
   g_print ("Running compositor on wayland display '%s'\n", socket);
+  g_setenv("WAYLAND_DISPLAY", socket, true);
+  phoc_server_add_startup_step (self, "socket");
+
+  if (config->persist_modes) {
+    g_autofree char *filename = g_build_filename (g_get_user_cache_dir (), "phoc", "modes.ini", NULL);
+
+    self->mode_cache = phoc_mode_cache_new (filename);
+  } else {
+    self->mode_cache = phoc_mode_cache_new (NULL);
+  }
 
+  self->desktop = phoc_desktop_new ();
+  phoc_suspend_policy_set_memory_pressure_enabled (self->suspend_policy,
+                                                   config->suspend_on_memory_pressure);
+  if (config->persist_keymaps) {
+    g_autofree char *dir = g_build_filename (g_get_user_cache_dir (), "phoc", "keymaps", NULL);
+
+    phoc_keymap_cache_set_persist_dir (self->keymap_cache, dir);
+  }
+  phoc_server_add_startup_step (self, "desktop");
+
+  /* The desktop set up XWayland's DISPLAY so the session's env is complete */
+  if (self->session_exec) {
+    if (!phoc_startup_session (self))
+      goto err;
+    phoc_server_add_startup_step (self, "session");
+  }
+
+  self->input = phoc_input_new ();
+  phoc_server_add_startup_step (self, "input");
+
+  /*
+   * No separate splash frame gets committed here: The outputs' first
+   * real frame is drawn in the first main loop iteration after we
+   * return and a splash commit in between would only make that frame
+   * wait for another page flip.
+   */
   if (!wlr_backend_start (self->backend)) {
     g_warning("Failed to start backend");
-    wlr_backend_destroy (self->backend);
-    wl_display_destroy (self->wl_display);
-    return FALSE;
+    goto err;
   }
-
-  g_setenv("WAYLAND_DISPLAY", socket, true);
+  phoc_server_add_startup_step (self, "backend-start");
 
   if (self->flags & PHOC_SERVER_FLAG_SHELL_MODE) {
     g_message ("Enabling shell mode");
@@ -578,11 +804,17 @@ phoc_server_setup (PhocServer      *self,
   }
 
   phoc_wayland_init (self);
-  if (self->session_exec)
-    phoc_startup_session (self);
 
+  phoc_server_add_startup_step (self, "ready");
   self->inited = TRUE;
   return TRUE;
+
+ err:
+  /* The rest gets torn down with the server */
+  phoc_stop_session (self);
+  if (socket)
+    g_unsetenv ("WAYLAND_DISPLAY");
+  return FALSE;
 }
 
 /**
@@ -650,6 +882,55 @@ phoc_server_get_desktop (PhocServer *self)
   return self->desktop;
 }
 
+/**
+ * phoc_server_get_suspend_policy:
+ * @self: The server
+ *
+ * Get the policy that decides when views are suspended
+ *
+ * Returns: (transfer none): The suspend policy
+ */
+PhocSuspendPolicy *
+phoc_server_get_suspend_policy (PhocServer *self)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  return self->suspend_policy;
+}
+
+/**
+ * phoc_server_get_keymap_cache:
+ * @self: The server
+ *
+ * Get the cache of compiled keymaps shared by all keyboards
+ *
+ * Returns: (transfer none): The keymap cache
+ */
+PhocKeymapCache *
+phoc_server_get_keymap_cache (PhocServer *self)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  return self->keymap_cache;
+}
+
+/**
+ * phoc_server_get_mode_cache:
+ * @self: The server
+ *
+ * Get the cache of mode test results used when probing modes of
+ * hotplugged monitors
+ *
+ * Returns: (transfer none): The mode cache
+ */
+PhocModeCache *
+phoc_server_get_mode_cache (PhocServer *self)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  return self->mode_cache;
+}
+
 /**
  * phoc_server_get_input:
  * @self: The server
@@ -774,6 +1055,108 @@ phoc_server_get_log_domains (PhocServer *self)
   return (const char *const *)self->log_domains;
 }
 
+/**
+ * phoc_server_add_startup_step:
+ * @self: The server
+ * @step: (not nullable): The name of the step that just finished
+ *
+ * Record that a step of compositor startup finished. The step's
+ * duration is logged and the step is added to the startup timeline.
+ * @step must be a static string.
+ */
+void
+phoc_server_add_startup_step (PhocServer *self, const char *step)
+{
+  PhocStartupStep entry;
+  gint64 prev = 0;
+
+  g_assert (PHOC_IS_SERVER (self));
+  g_assert (step);
+
+  if (self->startup_steps->len)
+    prev = g_array_index (self->startup_steps, PhocStartupStep, self->startup_steps->len - 1).usec;
+
+  entry.step = step;
+  entry.usec = g_get_monotonic_time () - self->startup_time;
+  g_array_append_val (self->startup_steps, entry);
+
+  g_debug ("Startup step '%s' took %.3f ms (%.3f ms total)",
+           step, (entry.usec - prev) / 1000.0, entry.usec / 1000.0);
+
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_STARTUP_TIMELINE]);
+}
+
+/**
+ * phoc_server_get_startup_timeline:
+ * @self: The server
+ *
+ * Get the steps of compositor startup so far.
+ *
+ * Returns: (transfer floating): The steps as `a(st)`
+ */
+GVariant *
+phoc_server_get_startup_timeline (PhocServer *self)
+{
+  GVariantBuilder builder;
+
+  g_assert (PHOC_IS_SERVER (self));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(st)"));
+  for (guint i = 0; i < self->startup_steps->len; i++) {
+    PhocStartupStep *entry = &g_array_index (self->startup_steps, PhocStartupStep, i);
+
+    g_variant_builder_add (&builder, "(st)", entry->step, (guint64)entry->usec);
+  }
+
+  return g_variant_builder_end (&builder);
+}
+
+/**
+ * phoc_server_get_event_loop_stats:
+ * @self: The server
+ * @reset: Whether to reset the statistics
+ *
+ * Get statistics about the main loop: how long dispatching Wayland
+ * and backend events takes, how long these events wait for other
+ * sources and how long other sources block the main loop. Times are
+ * in microseconds.
+ *
+ * Returns: (transfer floating): The statistics as `a{st}`
+ */
+GVariant *
+phoc_server_get_event_loop_stats (PhocServer *self, gboolean reset)
+{
+  WaylandEventSource *source;
+  PhocEventLoopStats *stats;
+  GVariantBuilder builder;
+
+  g_assert (PHOC_IS_SERVER (self));
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{st}"));
+  if (!self->wl_source)
+    return g_variant_builder_end (&builder);
+
+  source = (WaylandEventSource *)g_main_context_find_source_by_id (NULL, self->wl_source);
+  stats = &source->stats;
+
+  g_variant_builder_add (&builder, "{st}", "iterations", stats->n_iterations);
+  g_variant_builder_add (&builder, "{st}", "dispatches", stats->n_dispatches);
+  g_variant_builder_add (&builder, "{st}", "dispatch-time", (guint64)stats->dispatch_time);
+  g_variant_builder_add (&builder, "{st}", "max-dispatch-time", (guint64)stats->max_dispatch_time);
+  g_variant_builder_add (&builder, "{st}", "wakeup-latency", (guint64)stats->wakeup_latency);
+  g_variant_builder_add (&builder, "{st}", "max-wakeup-latency", (guint64)stats->max_wakeup_latency);
+  g_variant_builder_add (&builder, "{st}", "busy-time", (guint64)stats->busy_time);
+  g_variant_builder_add (&builder, "{st}", "max-busy-time", (guint64)stats->max_busy_time);
+  g_variant_builder_add (&builder, "{st}", "other-time", (guint64)stats->other_time);
+  g_variant_builder_add (&builder, "{st}", "max-other-time", (guint64)stats->max_other_time);
+  g_variant_builder_add (&builder, "{st}", "poll-time", (guint64)stats->poll_time);
+
+  if (reset)
+    *stats = (PhocEventLoopStats){ 0 };
+
+  return g_variant_builder_end (&builder);
+}
+
 /**
  * phoc_server_get_last_active_seat:
  * @self: The server
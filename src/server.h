@@ -27,6 +27,10 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (PhocServer, phoc_server, PHOC, SERVER, GObject);
 
+typedef struct _PhocSuspendPolicy PhocSuspendPolicy;
+typedef struct _PhocKeymapCache PhocKeymapCache;
+typedef struct _PhocModeCache PhocModeCache;
+
 /**
  * PhocServerFlags:
  *
@@ -65,10 +69,18 @@ gboolean               phoc_server_check_debug_flags       (PhocServer *self,
 void                   phoc_server_set_log_domains         (PhocServer *self,
                                                             const char * const *log_domains);
 const char *const *    phoc_server_get_log_domains         (PhocServer *self);
+void                   phoc_server_add_startup_step        (PhocServer *self,
+                                                            const char *step);
+GVariant              *phoc_server_get_startup_timeline    (PhocServer *self);
+GVariant              *phoc_server_get_event_loop_stats    (PhocServer *self,
+                                                            gboolean    reset);
 const char            *phoc_server_get_session_exec        (PhocServer *self);
 gint                   phoc_server_get_session_exit_status (PhocServer *self);
 PhocRenderer          *phoc_server_get_renderer            (PhocServer *self);
 PhocDesktop           *phoc_server_get_desktop             (PhocServer *self);
+PhocSuspendPolicy     *phoc_server_get_suspend_policy      (PhocServer *self);
+PhocKeymapCache       *phoc_server_get_keymap_cache        (PhocServer *self);
+PhocModeCache         *phoc_server_get_mode_cache          (PhocServer *self);
 PhocInput             *phoc_server_get_input               (PhocServer *self);
 PhocConfig            *phoc_server_get_config              (PhocServer *self);
 const char *const     *phoc_server_get_compatibles         (PhocServer *self);
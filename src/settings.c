@@ -109,6 +109,8 @@ phoc_output_config_new (const char *name)
   oc->y = -1;
   oc->scale_filter = PHOC_OUTPUT_SCALE_FILTER_AUTO;
   oc->drm_panel_orientation = false;
+  oc->adaptive_sync = false;
+  oc->idle_refresh_rate = 0;
 
   return oc;
 }
@@ -118,6 +120,7 @@ static void
 phoc_output_config_destroy (PhocOutputConfig *oc)
 {
   g_slist_free_full (oc->modes, g_free);
+  g_free (oc->mirror);
   g_free (oc->name);
   g_free (oc);
 }
@@ -138,6 +141,25 @@ config_ini_handler (PhocConfig *config, const char *section, const char *name, c
       } else {
         g_critical ("got unknown xwayland value: %s", value);
       }
+    } else if (strcmp (name, "xwayland-idle-timeout") == 0) {
+      config->xwayland_idle_timeout = strtoul (value, NULL, 10);
+    } else if (strcmp (name, "view-snapshots") == 0) {
+      config->view_snapshots = parse_boolean (value, false);
+    } else if (strcmp (name, "suspend-on-memory-pressure") == 0) {
+      config->suspend_on_memory_pressure = parse_boolean (value, false);
+    } else if (strcmp (name, "lazy-globals") == 0) {
+      config->lazy_globals = parse_boolean (value, false);
+    } else if (strcmp (name, "persist-keymaps") == 0) {
+      config->persist_keymaps = parse_boolean (value, false);
+    } else if (strcmp (name, "persist-modes") == 0) {
+      config->persist_modes = parse_boolean (value, false);
+    } else if (strcmp (name, "wayland-priority") == 0) {
+      if (strcasecmp (value, "default") == 0)
+        config->wayland_priority = G_PRIORITY_DEFAULT;
+      else if (strcasecmp (value, "high") == 0)
+        config->wayland_priority = G_PRIORITY_HIGH;
+      else
+        g_critical ("got unknown wayland-priority value: %s", value);
     } else {
       g_critical ("got unknown core config: %s", name);
     }
@@ -220,6 +242,15 @@ config_ini_handler (PhocConfig *config, const char *section, const char *name, c
       oc->scale_filter = parse_scale_filter (value);
     } else if (strcmp (name, "drm-panel-orientation") == 0) {
       oc->drm_panel_orientation = parse_boolean (value, true);
+    } else if (strcmp (name, "adaptive-sync") == 0) {
+      oc->adaptive_sync = parse_boolean (value, false);
+    } else if (strcmp (name, "idle-refresh-rate") == 0) {
+      oc->idle_refresh_rate = strtof (value, NULL);
+    } else if (strcmp (name, "color-temperature") == 0) {
+      oc->color_temperature = strtoul (value, NULL, 10);
+    } else if (strcmp (name, "mirror") == 0) {
+      g_free (oc->mirror);
+      oc->mirror = g_strdup (value);
     } else if (g_str_equal (name, "phys_width")) {
       oc->phys_width = strtol (value, NULL, 10);
     } else if (g_str_equal (name, "phys_height")) {
@@ -243,6 +274,7 @@ phoc_config_new_from_keyfile (GKeyFile *keyfile)
 
   config->xwayland = true;
   config->xwayland_lazy = true;
+  config->wayland_priority = G_PRIORITY_DEFAULT;
   config->keybindings = phoc_keybindings_new ();
 
   sections = g_key_file_get_groups (keyfile, NULL);
@@ -23,6 +23,10 @@ typedef struct _PhocOutputConfig {
   float                    scale;
   PhocOutputScaleFilter    scale_filter;
   bool                     drm_panel_orientation;
+  bool                     adaptive_sync;
+  float                    idle_refresh_rate;
+  char                    *mirror;
+  guint                    color_temperature;
 
   struct PhocMode {
     int   width, height;
@@ -36,6 +40,13 @@ typedef struct _PhocOutputConfig {
 typedef struct _PhocConfig {
   bool             xwayland;
   bool             xwayland_lazy;
+  guint            xwayland_idle_timeout;
+  bool             view_snapshots;
+  bool             suspend_on_memory_pressure;
+  bool             lazy_globals;
+  bool             persist_keymaps;
+  bool             persist_modes;
+  int              wayland_priority;
 
   PhocKeybindings *keybindings;
 
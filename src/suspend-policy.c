@@ -0,0 +1,413 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-suspend-policy"
+
+#include "phoc-config.h"
+
+#include "server.h"
+#include "suspend-policy.h"
+
+#include <glib-unix.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PSI_MEMORY_PATH "/proc/pressure/memory"
+/* Trigger when tasks stalled for 150ms within a 2s window. Unprivileged
+ * processes can only use multiples of 2s as window */
+#define PSI_MEMORY_TRIGGER "some 150000 2000000"
+/* Release escalated views when there was no pressure for that long */
+#define PSI_RELAX_TIMEOUT_SECONDS 10
+
+/**
+ * PhocSuspendPolicy:
+ *
+ * Decides when views get told that they're suspended. Views that are
+ * occluded are suspended right away and resumed as soon as they're
+ * about to become visible again.
+ *
+ * Optionally the policy listens for memory pressure stall information
+ * and keeps the least recently focused views suspended one by one
+ * while the system is under memory pressure, even when they get
+ * uncovered.
+ */
+
+enum {
+  PROP_0,
+  PROP_MEMORY_PRESSURE,
+  PROP_N_SUSPENDED,
+  PROP_LAST_PROP
+};
+static GParamSpec *props[PROP_LAST_PROP];
+
+struct _PhocSuspendPolicy {
+  GObject     parent;
+
+  guint       n_suspended;
+
+  /* Views suspended due to memory pressure */
+  GHashTable *escalated;
+  gboolean    memory_pressure;
+  int         psi_fd;
+  guint       psi_id;
+  guint       relax_id;
+};
+
+G_DEFINE_TYPE (PhocSuspendPolicy, phoc_suspend_policy, G_TYPE_OBJECT)
+
+
+static void
+phoc_suspend_policy_get_property (GObject    *object,
+                                  guint       property_id,
+                                  GValue     *value,
+                                  GParamSpec *pspec)
+{
+  PhocSuspendPolicy *self = PHOC_SUSPEND_POLICY (object);
+
+  switch (property_id) {
+  case PROP_MEMORY_PRESSURE:
+    g_value_set_boolean (value, self->memory_pressure);
+    break;
+  case PROP_N_SUSPENDED:
+    g_value_set_uint (value, self->n_suspended);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+update_n_suspended (PhocSuspendPolicy *self)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  guint n_suspended = 0;
+
+  for (GList *l = phoc_desktop_get_views (desktop)->head; l; l = l->next) {
+    if (phoc_view_is_suspended (PHOC_VIEW (l->data)))
+      n_suspended++;
+  }
+
+  if (self->n_suspended == n_suspended)
+    return;
+
+  self->n_suspended = n_suspended;
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_N_SUSPENDED]);
+}
+
+
+static void
+set_memory_pressure (PhocSuspendPolicy *self, gboolean memory_pressure)
+{
+  if (self->memory_pressure == memory_pressure)
+    return;
+
+  self->memory_pressure = memory_pressure;
+  g_object_notify_by_pspec (G_OBJECT (self), props[PROP_MEMORY_PRESSURE]);
+}
+
+
+static void
+on_escalated_view_finalized (gpointer data, GObject *where_the_object_was)
+{
+  PhocSuspendPolicy *self = PHOC_SUSPEND_POLICY (data);
+
+  g_hash_table_remove (self->escalated, where_the_object_was);
+}
+
+
+static gboolean
+release_view (PhocSuspendPolicy *self, PhocView *view)
+{
+  if (!g_hash_table_remove (self->escalated, view))
+    return FALSE;
+
+  g_object_weak_unref (G_OBJECT (view), on_escalated_view_finalized, self);
+  return TRUE;
+}
+
+
+static void
+release_all_views (PhocSuspendPolicy *self)
+{
+  g_autoptr (GList) views = g_hash_table_get_keys (self->escalated);
+
+  for (GList *l = views; l; l = l->next) {
+    PhocView *view = PHOC_VIEW (l->data);
+
+    release_view (self, view);
+    phoc_suspend_policy_update_view (self, view);
+  }
+}
+
+/*
+ * Keep the least recently focused view that isn't escalated yet
+ * suspended, even once it's uncovered again, until it gets
+ * activated. New and focused views are moved to the front of the
+ * desktop's view stack so we walk it from the back. The topmost view
+ * and views that are on screen are never suspended.
+ */
+static gboolean
+escalate (PhocSuspendPolicy *self)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
+  GQueue *views = phoc_desktop_get_views (desktop);
+
+  for (GList *l = views->tail; l && l != views->head; l = l->prev) {
+    PhocView *view = PHOC_VIEW (l->data);
+
+    if (!phoc_view_is_mapped (view) || g_hash_table_contains (self->escalated, view))
+      continue;
+
+    /* Same check as phoc_suspend_policy_update_view() so we don't suspend what's on screen */
+    if (phoc_view_get_visibility (view))
+      continue;
+
+    g_debug ("Suspending %s (%p) due to memory pressure", phoc_view_get_app_id (view), view);
+    g_hash_table_add (self->escalated, view);
+    g_object_weak_ref (G_OBJECT (view), on_escalated_view_finalized, self);
+    phoc_suspend_policy_update_view (self, view);
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+
+static void
+on_relax_timeout (gpointer data)
+{
+  PhocSuspendPolicy *self = PHOC_SUSPEND_POLICY (data);
+
+  self->relax_id = 0;
+
+  g_debug ("Memory pressure relaxed, releasing %u views", g_hash_table_size (self->escalated));
+  set_memory_pressure (self, FALSE);
+  release_all_views (self);
+}
+
+
+static gboolean
+on_memory_pressure (int fd, GIOCondition condition, gpointer user_data)
+{
+  PhocSuspendPolicy *self = PHOC_SUSPEND_POLICY (user_data);
+
+  if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+    g_warning ("Memory pressure monitoring failed, disabling");
+    self->psi_id = 0;
+    phoc_suspend_policy_set_memory_pressure_enabled (self, FALSE);
+    return G_SOURCE_REMOVE;
+  }
+
+  phoc_suspend_policy_notify_memory_pressure (self);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+phoc_suspend_policy_finalize (GObject *object)
+{
+  PhocSuspendPolicy *self = PHOC_SUSPEND_POLICY (object);
+  GHashTableIter iter;
+  PhocView *view;
+
+  g_hash_table_iter_init (&iter, self->escalated);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&view, NULL))
+    g_object_weak_unref (G_OBJECT (view), on_escalated_view_finalized, self);
+  g_hash_table_remove_all (self->escalated);
+
+  phoc_suspend_policy_set_memory_pressure_enabled (self, FALSE);
+  g_clear_handle_id (&self->relax_id, g_source_remove);
+  g_clear_pointer (&self->escalated, g_hash_table_destroy);
+
+  G_OBJECT_CLASS (phoc_suspend_policy_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_suspend_policy_class_init (PhocSuspendPolicyClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->get_property = phoc_suspend_policy_get_property;
+  object_class->finalize = phoc_suspend_policy_finalize;
+
+  /**
+   * PhocSuspendPolicy:memory-pressure:
+   *
+   * %TRUE while views are suspended due to memory pressure
+   */
+  props[PROP_MEMORY_PRESSURE] =
+    g_param_spec_boolean ("memory-pressure", "", "",
+                          FALSE,
+                          G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  /**
+   * PhocSuspendPolicy:n-suspended:
+   *
+   * The number of currently suspended views
+   */
+  props[PROP_N_SUSPENDED] =
+    g_param_spec_uint ("n-suspended", "", "",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+}
+
+
+static void
+phoc_suspend_policy_init (PhocSuspendPolicy *self)
+{
+  self->psi_fd = -1;
+  self->escalated = g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+
+PhocSuspendPolicy *
+phoc_suspend_policy_new (void)
+{
+  return g_object_new (PHOC_TYPE_SUSPEND_POLICY, NULL);
+}
+
+/**
+ * phoc_suspend_policy_update_view:
+ * @self: The suspend policy
+ * @view: The view
+ *
+ * Reevaluate whether the given view should be suspended. This is
+ * invoked whenever the view's visibility changes.
+ */
+void
+phoc_suspend_policy_update_view (PhocSuspendPolicy *self, PhocView *view)
+{
+  gboolean suspend;
+
+  g_assert (PHOC_IS_SUSPEND_POLICY (self));
+  g_assert (PHOC_IS_VIEW (view));
+
+  if (!phoc_view_is_mapped (view))
+    release_view (self, view);
+
+  suspend = !phoc_view_get_visibility (view) || g_hash_table_contains (self->escalated, view);
+  phoc_view_set_suspended (view, suspend);
+
+  update_n_suspended (self);
+}
+
+/**
+ * phoc_suspend_policy_prepare_view:
+ * @self: The suspend policy
+ * @view: The view
+ *
+ * Notify the policy that the view is about to become visible (e.g. as
+ * it's getting activated). This resumes the view right away so the
+ * client can render its next frame while the stack gets rearranged
+ * rather than after.
+ */
+void
+phoc_suspend_policy_prepare_view (PhocSuspendPolicy *self, PhocView *view)
+{
+  g_assert (PHOC_IS_SUSPEND_POLICY (self));
+  g_assert (PHOC_IS_VIEW (view));
+
+  release_view (self, view);
+
+  if (!phoc_view_is_suspended (view))
+    return;
+
+  g_debug ("Resuming %s (%p) ahead of time", phoc_view_get_app_id (view), view);
+  phoc_view_set_suspended (view, FALSE);
+  update_n_suspended (self);
+}
+
+/**
+ * phoc_suspend_policy_notify_memory_pressure:
+ * @self: The suspend policy
+ *
+ * Notify the policy that the system is under memory pressure. This
+ * keeps the least recently focused view that isn't on screen
+ * suspended even when it gets uncovered. Views get released again
+ * once there was no pressure for a while.
+ */
+void
+phoc_suspend_policy_notify_memory_pressure (PhocSuspendPolicy *self)
+{
+  g_assert (PHOC_IS_SUSPEND_POLICY (self));
+
+  set_memory_pressure (self, TRUE);
+  if (!escalate (self))
+    g_debug ("Memory pressure but no more views to suspend");
+
+  g_clear_handle_id (&self->relax_id, g_source_remove);
+  self->relax_id = g_timeout_add_seconds_once (PSI_RELAX_TIMEOUT_SECONDS, on_relax_timeout, self);
+  g_source_set_name_by_id (self->relax_id, "[phoc] memory pressure relax timer");
+}
+
+/**
+ * phoc_suspend_policy_set_memory_pressure_enabled:
+ * @self: The suspend policy
+ * @enable: Whether to monitor memory pressure
+ *
+ * Whether to suspend views when the system is under memory pressure.
+ */
+void
+phoc_suspend_policy_set_memory_pressure_enabled (PhocSuspendPolicy *self, gboolean enable)
+{
+  g_assert (PHOC_IS_SUSPEND_POLICY (self));
+
+  if (enable == (self->psi_fd >= 0))
+    return;
+
+  if (!enable) {
+    g_clear_handle_id (&self->psi_id, g_source_remove);
+    g_clear_handle_id (&self->relax_id, g_source_remove);
+    close (self->psi_fd);
+    self->psi_fd = -1;
+    set_memory_pressure (self, FALSE);
+    release_all_views (self);
+    return;
+  }
+
+  self->psi_fd = open (PSI_MEMORY_PATH, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (self->psi_fd < 0) {
+    g_warning ("Failed to open %s: %s", PSI_MEMORY_PATH, g_strerror (errno));
+    return;
+  }
+
+  if (write (self->psi_fd, PSI_MEMORY_TRIGGER, strlen (PSI_MEMORY_TRIGGER) + 1) < 0) {
+    g_warning ("Failed to set memory pressure trigger: %s", g_strerror (errno));
+    close (self->psi_fd);
+    self->psi_fd = -1;
+    return;
+  }
+
+  self->psi_id = g_unix_fd_add (self->psi_fd, G_IO_PRI, on_memory_pressure, self);
+  g_source_set_name_by_id (self->psi_id, "[phoc] memory pressure");
+  g_debug ("Monitoring memory pressure");
+}
+
+
+gboolean
+phoc_suspend_policy_get_memory_pressure (PhocSuspendPolicy *self)
+{
+  g_assert (PHOC_IS_SUSPEND_POLICY (self));
+
+  return self->memory_pressure;
+}
+
+
+guint
+phoc_suspend_policy_get_n_suspended (PhocSuspendPolicy *self)
+{
+  g_assert (PHOC_IS_SUSPEND_POLICY (self));
+
+  return self->n_suspended;
+}
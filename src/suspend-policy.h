@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "view.h"
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_SUSPEND_POLICY (phoc_suspend_policy_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocSuspendPolicy, phoc_suspend_policy, PHOC, SUSPEND_POLICY, GObject)
+
+PhocSuspendPolicy *phoc_suspend_policy_new                    (void);
+void               phoc_suspend_policy_update_view            (PhocSuspendPolicy *self,
+                                                               PhocView          *view);
+void               phoc_suspend_policy_prepare_view           (PhocSuspendPolicy *self,
+                                                               PhocView          *view);
+void               phoc_suspend_policy_notify_memory_pressure (PhocSuspendPolicy *self);
+void               phoc_suspend_policy_set_memory_pressure_enabled (PhocSuspendPolicy *self,
+                                                                    gboolean           enable);
+gboolean           phoc_suspend_policy_get_memory_pressure    (PhocSuspendPolicy *self);
+guint              phoc_suspend_policy_get_n_suspended        (PhocSuspendPolicy *self);
+
+G_END_DECLS
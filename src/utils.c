@@ -18,7 +18,9 @@
 
 #include <inttypes.h>
 #include <math.h>
+#include <wlr/types/wlr_compositor.h>
 #include <wlr/util/box.h>
+#include <wlr/util/region.h>
 
 
 void
@@ -139,6 +141,77 @@ phoc_utils_scale_box (struct wlr_box *box, float scale)
   box->y = round (box->y * scale);
 }
 
+/**
+ * phoc_utils_scale_damage:
+ * @damage: (inout): The damage in surface local coordinates
+ * @scale: The scale to apply
+ * @buffer_scale: The surface's buffer scale
+ *
+ * Scales surface damage to output buffer coordinates. When the surface
+ * gets scaled up beyond its buffer scale the filtering affects
+ * neighbouring pixels too so the damage is expanded accordingly.
+ */
+void
+phoc_utils_scale_damage (pixman_region32_t *damage, float scale, int buffer_scale)
+{
+  wlr_region_scale (damage, damage, scale);
+
+  if (ceil (scale) > buffer_scale)
+    wlr_region_expand (damage, damage, ceil (scale) - buffer_scale);
+}
+
+/**
+ * phoc_utils_is_surface_pixel_aligned:
+ * @surface: The surface
+ * @box: The surface's box in output buffer coordinates
+ *
+ * Checks whether the surface's buffer maps one to one onto output
+ * pixels. This is e.g. the case for clients using fractional-scale-v1
+ * and viewporter at the output's scale. Such surfaces need neither
+ * filtering nor damage expansion and their buffer damage can be used
+ * as is.
+ *
+ * Returns: %TRUE if buffer pixels map to output pixels
+ */
+gboolean
+phoc_utils_is_surface_pixel_aligned (struct wlr_surface *surface, const struct wlr_box *box)
+{
+  if (surface->current.transform != WL_OUTPUT_TRANSFORM_NORMAL)
+    return FALSE;
+
+  if (surface->current.viewport.has_src)
+    return FALSE;
+
+  return surface->current.buffer_width == box->width &&
+    surface->current.buffer_height == box->height;
+}
+
+/**
+ * phoc_utils_scale_surface_damage:
+ * @damage: (inout): The surface's damage in surface local coordinates
+ * @surface: The surface
+ * @box: The surface's box in output buffer coordinates
+ * @scale: The scale to apply
+ *
+ * Scales surface damage to output buffer coordinates like
+ * [func@utils_scale_damage]. The damage of pixel aligned surfaces at
+ * fractional scales isn't expanded as they aren't filtered.
+ */
+void
+phoc_utils_scale_surface_damage (pixman_region32_t    *damage,
+                                 struct wlr_surface   *surface,
+                                 const struct wlr_box *box,
+                                 float                 scale)
+{
+  if (scale != floorf (scale) && phoc_utils_is_surface_pixel_aligned (surface, box)) {
+    /* Buffer pixels are output pixels, no filtering so no need to expand */
+    wlr_region_scale (damage, damage, scale);
+    return;
+  }
+
+  phoc_utils_scale_damage (damage, scale, surface->current.scale);
+}
+
 /**
  * phoc_util_is_box_damaged:
  * @box: The box to check
@@ -175,19 +248,34 @@ phoc_utils_is_damaged (const struct wlr_box    *box,
 }
 
 
+/**
+ * phoc_utils_wlr_surface_update_scales:
+ * @surface: The surface
+ *
+ * Let the surface know the preferred scale and buffer transform. Both
+ * are picked from the output with the highest scale the surface is
+ * on. Clients that render with the output's transform already applied
+ * can be scanned out directly on rotated outputs.
+ */
 void
 phoc_utils_wlr_surface_update_scales (struct wlr_surface *surface)
 {
+  enum wl_output_transform transform = WL_OUTPUT_TRANSFORM_NORMAL;
   float scale = 1.0;
+  gboolean found = FALSE;
 
   struct wlr_surface_output *surface_output;
   wl_list_for_each (surface_output, &surface->current_outputs, link) {
-    if (surface_output->output->scale > scale)
-      scale = surface_output->output->scale;
+    if (!found || surface_output->output->scale > scale) {
+      scale = MAX (surface_output->output->scale, 1.0);
+      transform = surface_output->output->transform;
+      found = TRUE;
+    }
   }
 
   wlr_fractional_scale_v1_notify_scale (surface, scale);
   wlr_surface_set_preferred_buffer_scale (surface, ceil (scale));
+  wlr_surface_set_preferred_buffer_transform (surface, transform);
 }
 
 
@@ -39,6 +39,15 @@ void       phoc_utils_fix_transform         (enum wl_output_transform *transform
 float      phoc_utils_compute_scale         (int32_t phys_width, int32_t phys_height,
                                              int32_t width, int32_t height);
 void       phoc_utils_scale_box             (struct wlr_box *box, float scale);
+void       phoc_utils_scale_damage          (pixman_region32_t *damage,
+                                             float              scale,
+                                             int                buffer_scale);
+gboolean   phoc_utils_is_surface_pixel_aligned (struct wlr_surface   *surface,
+                                                const struct wlr_box *box);
+void       phoc_utils_scale_surface_damage  (pixman_region32_t    *damage,
+                                             struct wlr_surface   *surface,
+                                             const struct wlr_box *box,
+                                             float                 scale);
 gboolean   phoc_utils_is_damaged            (const struct wlr_box    *box,
                                              const pixman_region32_t *damage,
                                              const struct wlr_box    *clip_box,
@@ -14,12 +14,15 @@
 
 #include "bling.h"
 #include "cursor.h"
+#include "damage-history.h"
 #include "view-deco.h"
 #include "desktop.h"
 #include "input.h"
 #include "seat.h"
 #include "server.h"
 #include "subsurface.h"
+#include "surface.h"
+#include "suspend-policy.h"
 #include "utils.h"
 #include "timed-animation.h"
 #include "view-child-private.h"
@@ -27,8 +30,6 @@
 
 #define PHOC_ANIM_DURATION_WINDOW_FADE 150
 #define PHOC_MOVE_TO_CORNER_MARGIN 12
-/* How long should a surface be invisible/occluded before we notify it about it */
-#define PHOC_SUSPEND_TIMEOUT_SECONDS 3
 
 
 enum {
@@ -63,7 +64,7 @@ typedef struct _PhocViewPrivate {
   PhocViewTileDirection tile_direction;
   gboolean       always_on_top;
   gboolean       visibility;
-  guint          suspend_timer_id;
+  gboolean       suspended;
 
   PhocOutput    *fullscreen_output;
 
@@ -72,6 +73,7 @@ typedef struct _PhocViewPrivate {
   char          *activation_token;
   int            activation_token_type;
   GSList        *blings; /* PhocBlings */
+  PhocDamageHistory *damage_history;
 
   /* wlr-toplevel-management handling */
   struct wlr_foreign_toplevel_handle_v1 *toplevel_handle;
@@ -422,39 +424,39 @@ phoc_view_move_default (PhocView *view, double x, double y)
 }
 
 
-static void
-on_suspend_timer_expired (gpointer user_data)
+/**
+ * phoc_view_set_suspended:
+ * @self: a view
+ * @suspended: Whether the view is suspended
+ *
+ * Tell the view's client whether it's suspended. This is usually
+ * invoked by [type@SuspendPolicy].
+ */
+void
+phoc_view_set_suspended (PhocView *self, gboolean suspended)
 {
-  PhocView *self = user_data;
   PhocViewPrivate *priv;
 
   g_assert (PHOC_IS_VIEW (self));
   priv = phoc_view_get_instance_private (self);
 
-  priv->suspend_timer_id = 0;
+  if (priv->suspended == suspended)
+    return;
 
-  PHOC_VIEW_GET_CLASS (self)->set_suspended (self, TRUE);
+  priv->suspended = suspended;
+  PHOC_VIEW_GET_CLASS (self)->set_suspended (self, suspended);
 }
 
 
-static void
-phoc_view_set_suspended (PhocView *self, bool suspended)
+gboolean
+phoc_view_is_suspended (PhocView *self)
 {
-  PhocViewPrivate *priv = phoc_view_get_instance_private (self);
+  PhocViewPrivate *priv;
 
   g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
 
-  if (suspended) {
-    if (!priv->suspend_timer_id) {
-      priv->suspend_timer_id = g_timeout_add_seconds_once (PHOC_SUSPEND_TIMEOUT_SECONDS,
-                                                           on_suspend_timer_expired,
-                                                           self);
-      g_source_set_name_by_id (priv->suspend_timer_id, "[phoc] surface suspend timer");
-    }
-  } else {
-    g_clear_handle_id (&priv->suspend_timer_id, g_source_remove);
-    PHOC_VIEW_GET_CLASS (self)->set_suspended (self, FALSE);
-  }
+  return priv->suspended;
 }
 
 
@@ -1224,6 +1226,7 @@ phoc_view_unmap (PhocView *view)
   bool was_visible = phoc_desktop_view_check_visibility (desktop, view);
 
   phoc_view_damage_whole (view);
+  phoc_renderer_drop_view_snapshot (phoc_server_get_renderer (phoc_server_get_default ()), view);
 
   wl_list_remove (&priv->surface_new_subsurface.link);
   phoc_view_drop_child_surfaces (view);
@@ -1298,6 +1301,22 @@ phoc_view_setup (PhocView *view)
   wlr_foreign_toplevel_handle_v1_set_parent (priv->toplevel_handle, toplevel_handle);
 }
 
+
+static void
+collect_damage_iterator (struct wlr_surface *wlr_surface, int sx, int sy, void *data)
+{
+  pixman_region32_t *view_damage = data;
+  PhocSurface *surface = wlr_surface->data;
+  pixman_region32_t damage;
+
+  pixman_region32_init (&damage);
+  wlr_surface_get_effective_damage (wlr_surface, &damage);
+  pixman_region32_union (&damage, &damage, phoc_surface_get_damage (surface));
+  pixman_region32_translate (&damage, sx, sy);
+  pixman_region32_union (view_damage, view_damage, &damage);
+  pixman_region32_fini (&damage);
+}
+
 /**
  * phoc_view_apply_damage:
  * @view: A view
@@ -1308,8 +1327,16 @@ phoc_view_setup (PhocView *view)
 void
 phoc_view_apply_damage (PhocView *view)
 {
+  PhocViewPrivate *priv = phoc_view_get_instance_private (view);
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   PhocOutput *output;
+  pixman_region32_t damage;
+
+  /* Record before the outputs consume the surface damage */
+  pixman_region32_init (&damage);
+  phoc_view_for_each_surface (view, collect_damage_iterator, &damage);
+  phoc_damage_history_add (priv->damage_history, &damage);
+  pixman_region32_fini (&damage);
 
   wl_list_for_each (output, &desktop->outputs, link)
     phoc_output_damage_from_view (output, view, false);
@@ -1327,9 +1354,12 @@ phoc_view_apply_damage (PhocView *view)
 void
 phoc_view_damage_whole (PhocView *view)
 {
+  PhocViewPrivate *priv = phoc_view_get_instance_private (view);
   PhocDesktop *desktop = phoc_server_get_desktop (phoc_server_get_default ());
   PhocOutput *output;
 
+  phoc_damage_history_invalidate (priv->damage_history);
+
   wl_list_for_each (output, &desktop->outputs, link)
     phoc_output_damage_from_view (output, view, true);
 }
@@ -1557,8 +1587,6 @@ phoc_view_finalize (GObject *object)
   PhocView *self = PHOC_VIEW (object);
   PhocViewPrivate *priv = phoc_view_get_instance_private (self);
 
-  g_clear_handle_id (&priv->suspend_timer_id, g_source_remove);
-
   /* Unlink from our parent */
   if (self->parent) {
     wl_list_remove (&self->parent_link);
@@ -1583,6 +1611,7 @@ phoc_view_finalize (GObject *object)
     priv->fullscreen_output->fullscreen_view = NULL;
 
   g_clear_slist (&priv->blings, g_object_unref);
+  g_clear_pointer (&priv->damage_history, phoc_damage_history_free);
   g_clear_pointer (&priv->title, g_free);
   g_clear_pointer (&priv->app_id, g_free);
   g_clear_pointer (&priv->activation_token, g_free);
@@ -1806,6 +1835,7 @@ phoc_view_init (PhocView *self)
   priv->scale = 1.0f;
   priv->state = PHOC_VIEW_STATE_FLOATING;
   priv->visibility = TRUE;
+  priv->damage_history = phoc_damage_history_new ();
 
   wl_list_init (&self->stack);
 
@@ -2022,6 +2052,50 @@ phoc_view_get_alpha (PhocView *self)
   return priv->alpha;
 }
 
+/**
+ * phoc_view_get_damage_seq:
+ * @self: The view
+ *
+ * Get the sequence number of the view's most recent damage. Consumers
+ * that render the view on their own (e.g. thumbnails) can store it
+ * and use [method@View.get_damage_since] to only redraw what changed.
+ *
+ * Returns: The damage sequence number
+ */
+guint64
+phoc_view_get_damage_seq (PhocView *self)
+{
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  return phoc_damage_history_get_seq (priv->damage_history);
+}
+
+/**
+ * phoc_view_get_damage_since:
+ * @self: The view
+ * @seq: A sequence number obtained via [method@View.get_damage_seq]
+ * @damage: (out): An initialized region to store the damage in
+ *
+ * Get the damage in view local (unscaled) coordinates accumulated
+ * after @seq.
+ *
+ * Returns: %TRUE if @damage is valid, %FALSE if the whole view needs
+ *   to be redrawn.
+ */
+gboolean
+phoc_view_get_damage_since (PhocView *self, guint64 seq, pixman_region32_t *damage)
+{
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  return phoc_damage_history_get_since (priv->damage_history, seq, damage);
+}
+
 /**
  * phoc_view_get_scale:
  * @self: The view
@@ -2358,7 +2432,20 @@ phoc_view_set_visibility (PhocView *self, gboolean visibility)
 
   priv->visibility = visibility;
 
-  phoc_view_set_suspended (self, !visibility);
+  phoc_suspend_policy_update_view (phoc_server_get_suspend_policy (phoc_server_get_default ()),
+                                   self);
+}
+
+
+gboolean
+phoc_view_get_visibility (PhocView *self)
+{
+  PhocViewPrivate *priv;
+
+  g_assert (PHOC_IS_VIEW (self));
+  priv = phoc_view_get_instance_private (self);
+
+  return priv->visibility;
 }
 
 /**
@@ -197,6 +197,10 @@ const char           *phoc_view_get_activation_token (PhocView *self);
 void                  phoc_view_flush_activation_token (PhocView *self);
 float                 phoc_view_get_alpha (PhocView *self);
 float                 phoc_view_get_scale (PhocView *self);
+guint64               phoc_view_get_damage_seq (PhocView *self);
+gboolean              phoc_view_get_damage_since (PhocView          *self,
+                                                  guint64            seq,
+                                                  pixman_region32_t *damage);
 gboolean              phoc_view_is_decorated (PhocView *self);
 void                  phoc_view_set_always_on_top (PhocView *self, gboolean on_top);
 bool                  phoc_view_is_always_on_top (PhocView *self);
@@ -208,6 +212,9 @@ gboolean              phoc_view_get_maximized_box (PhocView       *self,
                                                    PhocOutput     *output,
                                                    struct wlr_box *box);
 void                  phoc_view_set_visibility (PhocView *self, gboolean visibility);
+gboolean              phoc_view_get_visibility (PhocView *self);
+void                  phoc_view_set_suspended (PhocView *self, gboolean suspended);
+gboolean              phoc_view_is_suspended (PhocView *self);
 gboolean              phoc_view_get_tiled_box (PhocView             *self,
                                                PhocViewTileDirection dir,
                                                PhocOutput           *output,
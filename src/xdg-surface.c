@@ -11,6 +11,7 @@
 #include "phoc-config.h"
 
 #include "cursor.h"
+#include "layout-transaction.h"
 #include "server.h"
 #include "view-private.h"
 #include "xdg-popup.h"
@@ -65,6 +66,8 @@ typedef struct _PhocXdgSurface {
   struct wl_event_source *frame_done_idle;
 
   uint32_t pending_move_resize_configure_serial;
+  /* Serial we need to see acked to finish our part of a layout transaction */
+  uint32_t layout_transaction_serial;
 
   PhocXdgToplevelDecoration *decoration;
 } PhocXdgSurface;
@@ -222,6 +225,9 @@ move_resize (PhocView *view, double x, double y, uint32_t width, uint32_t height
   } else {
     self->pending_move_resize_configure_serial =
       wlr_xdg_toplevel_set_size (wlr_xdg_surface->toplevel, constrained_width, constrained_height);
+
+    if (phoc_layout_transaction_add_view_dirty (phoc_layout_transaction_get_default (), self))
+      self->layout_transaction_serial = self->pending_move_resize_configure_serial;
   }
 
   send_frame_done_if_not_visible (self);
@@ -458,6 +464,12 @@ handle_surface_commit (struct wl_listener *listener, void *data)
       self->pending_move_resize_configure_serial = 0;
   }
 
+  if (self->layout_transaction_serial &&
+      surface->current.configure_serial >= self->layout_transaction_serial) {
+    self->layout_transaction_serial = 0;
+    phoc_layout_transaction_notify_view_configured (phoc_layout_transaction_get_default (), self);
+  }
+
   struct wlr_box geometry;
   phoc_xdg_surface_get_geometry (self, &geometry);
   if (self->saved_geometry.x != geometry.x || self->saved_geometry.y != geometry.y) {
@@ -502,6 +514,10 @@ static void
 handle_unmap (struct wl_listener *listener, void *data)
 {
   PhocXdgSurface *self = wl_container_of (listener, self, unmap);
+
+  self->layout_transaction_serial = 0;
+  phoc_layout_transaction_remove_view (phoc_layout_transaction_get_default (), self);
+
   phoc_view_unmap (PHOC_VIEW (self));
 }
 
@@ -681,6 +697,7 @@ phoc_xdg_surface_finalize (GObject *object)
   PhocXdgSurface *self = PHOC_XDG_SURFACE(object);
 
   g_clear_pointer (&self->frame_done_idle, wl_event_source_remove);
+  phoc_layout_transaction_remove_view (phoc_layout_transaction_get_default (), self);
 
   wl_list_remove(&self->surface_commit.link);
   wl_list_remove(&self->destroy.link);
@@ -30,6 +30,10 @@ static GParamSpec *props[PROP_LAST_PROP];
  * An XWayland Surface.
  *
  * For how to setup such an object see handle_xwayland_surface.
+ *
+ * XWayland surfaces keep an index of their transient-for tree that is
+ * updated on set_parent, map and unmap so that checking for (mapped)
+ * children doesn't need to walk the X11 window tree.
  */
 typedef struct _PhocXWaylandSurface {
   PhocView view;
@@ -49,8 +53,16 @@ typedef struct _PhocXWaylandSurface {
   struct wl_listener set_title;
   struct wl_listener set_class;
   struct wl_listener set_startup_id;
+  struct wl_listener set_parent;
 
   struct wl_listener surface_commit;
+
+  /* Parent/child index */
+  PhocXWaylandSurface         *parent;
+  PhocXWaylandSurface         *root;
+  GList                       *children;
+  gboolean                     mapped;
+  guint                        n_mapped_descendants;
 } PhocXWaylandSurface;
 
 G_DEFINE_TYPE (PhocXWaylandSurface, phoc_xwayland_surface, PHOC_TYPE_VIEW)
@@ -274,6 +286,65 @@ phoc_xwayland_surface_set_property (GObject      *object,
 }
 
 
+static void
+add_mapped_descendants (PhocXWaylandSurface *self, int delta)
+{
+  for (PhocXWaylandSurface *ancestor = self->parent; ancestor; ancestor = ancestor->parent) {
+    g_assert ((int)ancestor->n_mapped_descendants + delta >= 0);
+    ancestor->n_mapped_descendants += delta;
+  }
+}
+
+
+static void
+update_root (PhocXWaylandSurface *self, PhocXWaylandSurface *root)
+{
+  self->root = root;
+
+  for (GList *l = self->children; l; l = l->next)
+    update_root (l->data, root);
+}
+
+
+static void
+set_parent (PhocXWaylandSurface *self, PhocXWaylandSurface *parent)
+{
+  int n_mapped = self->n_mapped_descendants + (self->mapped ? 1 : 0);
+
+  if (self->parent == parent)
+    return;
+
+  if (parent && phoc_xwayland_surface_is_child (self, parent)) {
+    g_debug ("Ignoring transient-for loop for %p", self);
+    return;
+  }
+
+  if (self->parent) {
+    add_mapped_descendants (self, -n_mapped);
+    self->parent->children = g_list_remove (self->parent->children, self);
+  }
+
+  self->parent = parent;
+
+  if (self->parent) {
+    self->parent->children = g_list_prepend (self->parent->children, self);
+    add_mapped_descendants (self, n_mapped);
+  }
+
+  update_root (self, parent ? parent->root : self);
+}
+
+
+static void
+set_mapped (PhocXWaylandSurface *self, gboolean mapped)
+{
+  if (self->mapped == mapped)
+    return;
+
+  self->mapped = mapped;
+  add_mapped_descendants (self, mapped ? 1 : -1);
+}
+
 /* {{{ wlr_xwayland_surface signal handlers */
 
 static void
@@ -281,6 +352,11 @@ handle_destroy (struct wl_listener *listener, void *data)
 {
   PhocXWaylandSurface *self = wl_container_of (listener, self, destroy);
 
+  /* wlroots doesn't emit set_parent for the children of destroyed surfaces */
+  while (self->children)
+    set_parent (self->children->data, NULL);
+  set_parent (self, NULL);
+
   g_signal_emit_by_name (self, "surface-destroy");
   g_object_unref (self);
 }
@@ -444,6 +520,16 @@ handle_surface_commit (struct wl_listener *listener, void *data)
   view_update_position (view, x, y);
 }
 
+static void
+handle_set_parent (struct wl_listener *listener, void *data)
+{
+  PhocXWaylandSurface *self = wl_container_of (listener, self, set_parent);
+  struct wlr_xwayland_surface *parent = self->xwayland_surface->parent;
+
+  set_parent (self, parent ? parent->data : NULL);
+}
+
+
 static void
 handle_map (struct wl_listener *listener, void *data)
 {
@@ -459,6 +545,7 @@ handle_map (struct wl_listener *listener, void *data)
   self->surface_commit.notify = handle_surface_commit;
   wl_signal_add (&surface->surface->events.commit, &self->surface_commit);
 
+  set_mapped (self, TRUE);
   phoc_view_map (view, surface->surface);
 
   if (surface->override_redirect)
@@ -483,6 +570,7 @@ handle_unmap (struct wl_listener *listener, void *data)
   PhocView *view = PHOC_VIEW (self);
 
   wl_list_remove (&self->surface_commit.link);
+  set_mapped (self, FALSE);
   phoc_view_unmap (view);
 }
 
@@ -565,6 +653,13 @@ phoc_xwayland_surface_constructed (GObject *object)
   self->set_startup_id.notify = handle_set_startup_id;
   wl_signal_add(&surface->events.set_startup_id, &self->set_startup_id);
 
+  self->set_parent.notify = handle_set_parent;
+  wl_signal_add (&surface->events.set_parent, &self->set_parent);
+
+  self->root = self;
+  if (surface->parent)
+    set_parent (self, surface->parent->data);
+
   wl_list_init (&self->map.link);
   wl_list_init (&self->unmap.link);
 }
@@ -586,7 +681,9 @@ phoc_xwayland_surface_finalize (GObject *object)
   wl_list_remove(&self->set_title.link);
   wl_list_remove(&self->set_class.link);
   wl_list_remove(&self->set_startup_id.link);
+  wl_list_remove (&self->set_parent.link);
 
+  g_assert (self->parent == NULL && self->children == NULL);
   self->xwayland_surface->data = NULL;
 
   G_OBJECT_CLASS (phoc_xwayland_surface_parent_class)->finalize (object);
@@ -672,18 +769,19 @@ phoc_xwayland_surface_get_wlr_surface (PhocXWaylandSurface *self)
 gboolean
 phoc_xwayland_surface_is_child (PhocXWaylandSurface *self, PhocXWaylandSurface *maybe_child)
 {
-  struct wlr_xwayland_surface *parent, *xsurface;
-
   g_assert (PHOC_IS_XWAYLAND_SURFACE (self));
   g_assert (PHOC_IS_XWAYLAND_SURFACE (maybe_child));
-  xsurface = phoc_xwayland_surface_get_wlr_surface (maybe_child);
-  parent = phoc_xwayland_surface_get_wlr_surface (self);
 
-  while (xsurface != NULL) {
-    if (parent == xsurface)
-      return TRUE;
+  if (self->root != maybe_child->root)
+    return FALSE;
 
-    xsurface = xsurface->parent;
+  /* Everything in the tree is a child of its root */
+  if (self == self->root)
+    return TRUE;
+
+  for (PhocXWaylandSurface *surface = maybe_child; surface; surface = surface->parent) {
+    if (surface == self)
+      return TRUE;
   }
 
   return FALSE;
@@ -693,17 +791,39 @@ phoc_xwayland_surface_is_child (PhocXWaylandSurface *self, PhocXWaylandSurface *
  * phoc_xwayland_surface_has_children:
  * @self: The XWayland surface
  *
- * Checks whether the given XWayland surface has any children
+ * Checks whether the given XWayland surface has any mapped children
  *
- * Returns: `TRUE` if the surface has any children
+ * Returns: `TRUE` if the surface has any mapped children
  */
 gboolean
 phoc_xwayland_surface_has_children (PhocXWaylandSurface *self)
 {
-  struct wlr_xwayland_surface *xsurface;
+  g_assert (PHOC_IS_XWAYLAND_SURFACE (self));
+
+  return self->n_mapped_descendants > 0;
+}
+
+/**
+ * phoc_xwayland_surface_get_children:
+ * @self: The XWayland surface
+ *
+ * Get the direct children of the given XWayland surface
+ *
+ * Returns: (transfer none)(element-type PhocXWaylandSurface): The children
+ */
+GList *
+phoc_xwayland_surface_get_children (PhocXWaylandSurface *self)
+{
+  g_assert (PHOC_IS_XWAYLAND_SURFACE (self));
+
+  return self->children;
+}
+
 
+gboolean
+phoc_xwayland_surface_is_mapped (PhocXWaylandSurface *self)
+{
   g_assert (PHOC_IS_XWAYLAND_SURFACE (self));
-  xsurface = phoc_xwayland_surface_get_wlr_surface (self);
 
-  return !wl_list_empty (&xsurface->children);
+  return self->mapped;
 }
@@ -32,6 +32,8 @@ struct wlr_xwayland_surface *phoc_xwayland_surface_get_wlr_surface (PhocXWayland
 gboolean             phoc_xwayland_surface_is_child (PhocXWaylandSurface *self,
                                                      PhocXWaylandSurface *maybe_child);
 gboolean             phoc_xwayland_surface_has_children (PhocXWaylandSurface *self);
+GList               *phoc_xwayland_surface_get_children (PhocXWaylandSurface *self);
+gboolean             phoc_xwayland_surface_is_mapped (PhocXWaylandSurface *self);
 
 G_END_DECLS
 
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "damage-history.h"
+
+
+static void
+assert_region_equal_box (pixman_region32_t *region, int x1, int y1, int x2, int y2)
+{
+  pixman_box32_t *extents = pixman_region32_extents (region);
+
+  g_assert_cmpint (pixman_region32_n_rects (region), ==, 1);
+  g_assert_cmpint (extents->x1, ==, x1);
+  g_assert_cmpint (extents->y1, ==, y1);
+  g_assert_cmpint (extents->x2, ==, x2);
+  g_assert_cmpint (extents->y2, ==, y2);
+}
+
+
+static void
+test_phoc_damage_history_since (void)
+{
+  g_autoptr (PhocDamageHistory) history = phoc_damage_history_new ();
+  pixman_region32_t damage, result;
+  guint64 seq, start;
+
+  pixman_region32_init (&result);
+
+  start = phoc_damage_history_get_seq (history);
+  g_assert_true (phoc_damage_history_get_since (history, start, &result));
+  g_assert_false (pixman_region32_not_empty (&result));
+
+  pixman_region32_init_rect (&damage, 0, 0, 10, 10);
+  seq = phoc_damage_history_add (history, &damage);
+  g_assert_cmpint (seq, ==, start + 1);
+  pixman_region32_fini (&damage);
+
+  pixman_region32_init_rect (&damage, 10, 0, 10, 10);
+  phoc_damage_history_add (history, &damage);
+  pixman_region32_fini (&damage);
+
+  g_assert_true (phoc_damage_history_get_since (history, start, &result));
+  assert_region_equal_box (&result, 0, 0, 20, 10);
+
+  g_assert_true (phoc_damage_history_get_since (history, seq, &result));
+  assert_region_equal_box (&result, 10, 0, 20, 10);
+
+  seq = phoc_damage_history_get_seq (history);
+  g_assert_true (phoc_damage_history_get_since (history, seq, &result));
+  g_assert_false (pixman_region32_not_empty (&result));
+
+  pixman_region32_fini (&result);
+}
+
+
+static void
+test_phoc_damage_history_overflow (void)
+{
+  g_autoptr (PhocDamageHistory) history = phoc_damage_history_new ();
+  pixman_region32_t damage, result;
+  guint64 start;
+
+  pixman_region32_init (&result);
+  pixman_region32_init_rect (&damage, 0, 0, 1, 1);
+
+  start = phoc_damage_history_get_seq (history);
+  for (int i = 0; i < PHOC_DAMAGE_HISTORY_SIZE; i++)
+    phoc_damage_history_add (history, &damage);
+
+  /* Still in the ring */
+  g_assert_true (phoc_damage_history_get_since (history, start, &result));
+
+  /* Too old */
+  phoc_damage_history_add (history, &damage);
+  g_assert_false (phoc_damage_history_get_since (history, start, &result));
+  g_assert_true (phoc_damage_history_get_since (history, start + 1, &result));
+
+  pixman_region32_fini (&damage);
+  pixman_region32_fini (&result);
+}
+
+
+static void
+test_phoc_damage_history_invalidate (void)
+{
+  g_autoptr (PhocDamageHistory) history = phoc_damage_history_new ();
+  pixman_region32_t damage, result;
+  guint64 start, seq;
+
+  pixman_region32_init (&result);
+  pixman_region32_init_rect (&damage, 0, 0, 1, 1);
+
+  start = phoc_damage_history_add (history, &damage);
+  seq = phoc_damage_history_invalidate (history);
+  g_assert_cmpint (seq, ==, start + 1);
+
+  g_assert_false (phoc_damage_history_get_since (history, start, &result));
+  g_assert_true (phoc_damage_history_get_since (history, seq, &result));
+  g_assert_false (pixman_region32_not_empty (&result));
+
+  phoc_damage_history_add (history, &damage);
+  g_assert_true (phoc_damage_history_get_since (history, seq, &result));
+  assert_region_equal_box (&result, 0, 0, 1, 1);
+
+  pixman_region32_fini (&damage);
+  pixman_region32_fini (&result);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/damage-history/since", test_phoc_damage_history_since);
+  g_test_add_func ("/phoc/damage-history/overflow", test_phoc_damage_history_overflow);
+  g_test_add_func ("/phoc/damage-history/invalidate", test_phoc_damage_history_invalidate);
+
+  return g_test_run ();
+}
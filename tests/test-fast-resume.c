@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Test that outputs resuming from power saving show their last frame
+ * right away unless something got damaged while they were off
+ */
+
+#include "desktop.h"
+#include "output.h"
+#include "server.h"
+
+#include <wlr/types/wlr_output_power_management_v1.h>
+
+#define TIMEOUT_S 5
+
+
+static PhocServer *
+setup_server (void)
+{
+  PhocConfig *config = phoc_config_new_from_data ("[core]\nxwayland=false\n");
+  PhocServer *server = phoc_server_get_default ();
+
+  g_assert_true (config);
+  g_assert_true (phoc_server_setup (server, config, NULL, NULL, PHOC_SERVER_FLAG_NONE));
+
+  return server;
+}
+
+
+static guint64
+get_stat (PhocOutput *output, const char *key)
+{
+  g_autoptr (GVariant) stats = g_variant_ref_sink (phoc_output_get_frame_stats (output));
+  guint64 value;
+
+  g_assert_true (g_variant_lookup (stats, key, "t", &value));
+  return value;
+}
+
+
+/* Wait until the first frame got drawn and there's nothing left to draw */
+static PhocOutput *
+wait_for_parked_output (PhocServer *server)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output = phoc_desktop_find_output_by_name (desktop, "HEADLESS-1");
+  gint64 deadline = g_get_monotonic_time () + TIMEOUT_S * G_USEC_PER_SEC;
+
+  g_assert_true (PHOC_IS_OUTPUT (output));
+
+  while (!get_stat (output, "frames") || !get_stat (output, "parked")) {
+    g_assert_cmpint (g_get_monotonic_time (), <, deadline);
+    g_main_context_iteration (NULL, FALSE);
+  }
+
+  return output;
+}
+
+
+static void
+set_power_mode (PhocOutput *output, enum zwlr_output_power_v1_mode mode)
+{
+  struct wlr_output_power_v1_set_mode_event event = {
+    .output = output->wlr_output,
+    .mode = mode,
+  };
+
+  phoc_output_handle_output_power_manager_set_mode (NULL, &event);
+}
+
+
+static void
+test_phoc_fast_resume_undamaged (void)
+{
+  g_autoptr (PhocServer) server = setup_server ();
+  PhocOutput *output = wait_for_parked_output (server);
+
+  set_power_mode (output, ZWLR_OUTPUT_POWER_V1_MODE_OFF);
+  g_assert_false (output->wlr_output->enabled);
+
+  set_power_mode (output, ZWLR_OUTPUT_POWER_V1_MODE_ON);
+  g_assert_true (output->wlr_output->enabled);
+
+  /* The last frame is still valid */
+  g_assert_cmpuint (get_stat (output, "resumes"), ==, 1);
+  g_assert_cmpuint (get_stat (output, "fast-resumes"), ==, 1);
+}
+
+
+static void
+test_phoc_fast_resume_damaged (void)
+{
+  g_autoptr (PhocServer) server = setup_server ();
+  PhocOutput *output = wait_for_parked_output (server);
+
+  set_power_mode (output, ZWLR_OUTPUT_POWER_V1_MODE_OFF);
+  g_assert_false (output->wlr_output->enabled);
+
+  /* E.g. a lock screen showing up while the output is off */
+  phoc_output_damage_whole (output);
+
+  set_power_mode (output, ZWLR_OUTPUT_POWER_V1_MODE_ON);
+  g_assert_true (output->wlr_output->enabled);
+
+  /* The last frame is stale, the output got enabled without it */
+  g_assert_cmpuint (get_stat (output, "resumes"), ==, 1);
+  g_assert_cmpuint (get_stat (output, "fast-resumes"), ==, 0);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", TRUE);
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/fast-resume/undamaged", test_phoc_fast_resume_undamaged);
+  g_test_add_func ("/phoc/fast-resume/damaged", test_phoc_fast_resume_damaged);
+
+  return g_test_run ();
+}
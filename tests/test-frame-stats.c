@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/* Test that the frame clock parks once there's nothing left to draw */
+
+#include "testlib.h"
+
+#include "desktop.h"
+#include "output.h"
+
+typedef struct {
+  PhocOutput *output;
+  guint64     frames;
+  guint64     parks;
+  guint64     empty_frames;
+} FrameStatsTestData;
+
+
+static void
+get_frame_stats (PhocOutput *output,
+                 guint64    *frames,
+                 guint64    *parks,
+                 guint64    *empty_frames,
+                 guint64    *parked)
+{
+  g_autoptr (GVariant) stats = g_variant_ref_sink (phoc_output_get_frame_stats (output));
+  guint64 frame_time;
+
+  g_assert_true (g_variant_lookup (stats, "frames", "t", frames));
+  g_assert_true (g_variant_lookup (stats, "parks", "t", parks));
+  g_assert_true (g_variant_lookup (stats, "empty-frames", "t", empty_frames));
+  g_assert_true (g_variant_lookup (stats, "parked", "t", parked));
+  g_assert_true (g_variant_lookup (stats, "frame-time", "t", &frame_time));
+}
+
+
+static gboolean
+server_is_parked (PhocServer *server, gpointer user_data)
+{
+  FrameStatsTestData *data = user_data;
+  guint64 frames, parks, empty_frames, parked;
+
+  get_frame_stats (data->output, &frames, &parks, &empty_frames, &parked);
+
+  return parked && parks > data->parks;
+}
+
+
+static gboolean
+server_damage (PhocServer *server, gpointer user_data)
+{
+  FrameStatsTestData *data = user_data;
+  guint64 parked;
+
+  get_frame_stats (data->output, &data->frames, &data->parks, &data->empty_frames, &parked);
+  g_assert_true (parked);
+
+  phoc_output_damage_whole (data->output);
+  return TRUE;
+}
+
+
+static gboolean
+server_check_parked_again (PhocServer *server, gpointer user_data)
+{
+  FrameStatsTestData *data = user_data;
+  guint64 frames, parks, empty_frames, parked;
+
+  get_frame_stats (data->output, &frames, &parks, &empty_frames, &parked);
+
+  /* The damage got drawn and no empty frames were needed to park again */
+  g_assert_cmpuint (frames, >, data->frames);
+  g_assert_cmpuint (empty_frames, ==, data->empty_frames);
+
+  return TRUE;
+}
+
+
+static gboolean
+server_prepare_park (PhocServer *server, gpointer user_data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  FrameStatsTestData *data = user_data;
+
+  g_assert_false (wl_list_empty (&desktop->outputs));
+  data->output = wl_container_of (desktop->outputs.next, data->output, link);
+
+  return TRUE;
+}
+
+
+static gboolean
+client_run_park (PhocTestClientGlobals *globals, gpointer user_data)
+{
+  FrameStatsTestData *data = user_data;
+
+  /* Nothing to draw after startup */
+  phoc_test_client_wait_for_server (server_is_parked, data);
+
+  g_assert_true (phoc_test_client_run_in_server (server_damage, data));
+  phoc_test_client_wait_for_server (server_is_parked, data);
+  g_assert_true (phoc_test_client_run_in_server (server_check_parked_again, data));
+
+  return TRUE;
+}
+
+
+static void
+test_phoc_frame_stats_park (void)
+{
+  FrameStatsTestData data = { 0 };
+  PhocTestClientIface iface = {
+    .server_prepare = server_prepare_park,
+    .client_run     = client_run_park,
+    .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, &data);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  PHOC_TEST_ADD ("/phoc/frame-stats/park", test_phoc_frame_stats_park);
+
+  return g_test_run ();
+}
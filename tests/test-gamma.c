@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Test that gamma changes are picked up once per frame, that tables
+ * identical to the applied one are skipped and that re-enabling an
+ * output tests the table again
+ */
+
+#include "testlib.h"
+
+#include "desktop.h"
+#include "output.h"
+
+#define GAMMA_RAMP_SIZE 256
+
+typedef struct {
+  PhocOutput *output;
+  guint       n_commits;
+  guint       n_gamma_commits;
+  guint       n_gamma_tests;
+  guint16     last_blue;
+  guint       baseline;
+} GammaTestData;
+
+
+static size_t
+on_get_gamma_size (struct wlr_output *wlr_output, gpointer user_data)
+{
+  return GAMMA_RAMP_SIZE;
+}
+
+
+/* The backends used for testing don't support gamma tables */
+static bool
+on_test (struct wlr_output *wlr_output, const struct wlr_output_state *state, gpointer user_data)
+{
+  GammaTestData *data = user_data;
+  struct wlr_output_state stripped = *state;
+
+  if (state->committed & WLR_OUTPUT_STATE_GAMMA_LUT) {
+    data->n_gamma_tests++;
+    stripped.committed &= ~WLR_OUTPUT_STATE_GAMMA_LUT;
+  }
+
+  return phoc_test_output_impl_test (wlr_output, &stripped);
+}
+
+
+static bool
+on_commit (struct wlr_output *wlr_output, const struct wlr_output_state *state, gpointer user_data)
+{
+  GammaTestData *data = user_data;
+  struct wlr_output_state stripped = *state;
+
+  data->n_commits++;
+  if (state->committed & WLR_OUTPUT_STATE_GAMMA_LUT) {
+    data->n_gamma_commits++;
+    if (state->gamma_lut_size)
+      data->last_blue = state->gamma_lut[3 * state->gamma_lut_size - 1];
+    stripped.committed &= ~WLR_OUTPUT_STATE_GAMMA_LUT;
+  }
+
+  return phoc_test_output_impl_commit (wlr_output, &stripped);
+}
+
+
+static const PhocTestOutputHooks hooks = {
+  .test           = on_test,
+  .commit         = on_commit,
+  .get_gamma_size = on_get_gamma_size,
+};
+
+
+static gboolean
+server_prepare (PhocServer *server, gpointer user_data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  GammaTestData *data = user_data;
+
+  g_assert_false (wl_list_empty (&desktop->outputs));
+  data->output = wl_container_of (desktop->outputs.next, data->output, link);
+  phoc_test_output_override_impl (data->output->wlr_output, &hooks, data);
+
+  return TRUE;
+}
+
+
+static gboolean
+server_frame_committed (PhocServer *server, gpointer user_data)
+{
+  GammaTestData *data = user_data;
+
+  return data->n_commits > data->baseline;
+}
+
+
+static gboolean
+server_set_temperatures (PhocServer *server, gpointer user_data)
+{
+  GammaTestData *data = user_data;
+
+  data->n_gamma_commits = 0;
+  data->n_gamma_tests = 0;
+  data->baseline = data->n_commits;
+
+  /* Like a transition updating the temperature several times per frame */
+  phoc_output_set_color_temperature (data->output, 3000);
+  phoc_output_set_color_temperature (data->output, 4000);
+  phoc_output_set_color_temperature (data->output, 5000);
+
+  return TRUE;
+}
+
+
+static gboolean
+server_check_coalesced (PhocServer *server, gpointer user_data)
+{
+  GammaTestData *data = user_data;
+
+  /* Only the last temperature made it to the output */
+  g_assert_cmpuint (data->n_gamma_commits, ==, 1);
+  g_assert_cmpuint (data->n_gamma_tests, ==, 1);
+  g_assert_cmpuint (data->last_blue, >, 0.75 * G_MAXUINT16);
+  g_assert_cmpuint (data->last_blue, <, G_MAXUINT16);
+
+  return TRUE;
+}
+
+
+static gboolean
+server_set_same_temperature (PhocServer *server, gpointer user_data)
+{
+  GammaTestData *data = user_data;
+
+  data->n_gamma_commits = 0;
+  data->baseline = data->n_commits;
+
+  /* Ends up with the table that's already applied */
+  phoc_output_set_color_temperature (data->output, 3000);
+  phoc_output_set_color_temperature (data->output, 5000);
+
+  return TRUE;
+}
+
+
+static gboolean
+server_check_skipped (PhocServer *server, gpointer user_data)
+{
+  GammaTestData *data = user_data;
+
+  g_assert_cmpuint (data->n_gamma_commits, ==, 0);
+
+  return TRUE;
+}
+
+
+static gboolean
+server_reenable (PhocServer *server, gpointer user_data)
+{
+  GammaTestData *data = user_data;
+  struct wlr_output_state state;
+
+  wlr_output_state_init (&state);
+  wlr_output_state_set_enabled (&state, false);
+  g_assert_true (wlr_output_commit_state (data->output->wlr_output, &state));
+  wlr_output_state_finish (&state);
+
+  data->n_gamma_commits = 0;
+  data->n_gamma_tests = 0;
+
+  wlr_output_state_init (&state);
+  wlr_output_state_set_enabled (&state, true);
+  g_assert_true (wlr_output_commit_state (data->output->wlr_output, &state));
+  wlr_output_state_finish (&state);
+
+  data->baseline = data->n_commits;
+
+  return TRUE;
+}
+
+
+static gboolean
+server_check_reapplied (PhocServer *server, gpointer user_data)
+{
+  GammaTestData *data = user_data;
+
+  /* The output might have lost its table so it's applied and tested again */
+  g_assert_cmpuint (data->n_gamma_commits, ==, 1);
+  g_assert_cmpuint (data->n_gamma_tests, ==, 1);
+
+  phoc_test_output_restore_impl (data->output->wlr_output);
+  return TRUE;
+}
+
+
+static gboolean
+client_run (PhocTestClientGlobals *globals, gpointer user_data)
+{
+  GammaTestData *data = user_data;
+
+  phoc_test_client_wait_for_server (server_frame_committed, data);
+
+  g_assert_true (phoc_test_client_run_in_server (server_set_temperatures, data));
+  phoc_test_client_wait_for_server (server_frame_committed, data);
+  g_assert_true (phoc_test_client_run_in_server (server_check_coalesced, data));
+
+  g_assert_true (phoc_test_client_run_in_server (server_set_same_temperature, data));
+  phoc_test_client_wait_for_server (server_frame_committed, data);
+  g_assert_true (phoc_test_client_run_in_server (server_check_skipped, data));
+
+  g_assert_true (phoc_test_client_run_in_server (server_reenable, data));
+  phoc_test_client_wait_for_server (server_frame_committed, data);
+  g_assert_true (phoc_test_client_run_in_server (server_check_reapplied, data));
+
+  return TRUE;
+}
+
+
+static void
+test_phoc_gamma (void)
+{
+  GammaTestData data = { 0 };
+  PhocTestClientIface iface = {
+    .server_prepare = server_prepare,
+    .client_run     = client_run,
+    .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, &data);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  PHOC_TEST_ADD ("/phoc/gamma", test_phoc_gamma);
+
+  return g_test_run ();
+}
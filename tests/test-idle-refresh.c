@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Test lowering the refresh rate of idle outputs and that a backend
+ * rejecting the idle refresh rate doesn't make us retry forever
+ */
+
+#include "testlib.h"
+
+#include "desktop.h"
+#include "output.h"
+
+/* Longer than the output's idle timeout */
+#define IDLE_WAIT_MS 3500
+
+typedef struct {
+  PhocOutput *output;
+  gboolean    reject;
+  guint       n_mode_commits;
+  guint       n_commits;
+  gint64      deadline;
+} IdleRefreshTestData;
+
+
+static gboolean
+is_mode_switch (const struct wlr_output_state *state)
+{
+  return (state->committed & WLR_OUTPUT_STATE_MODE) &&
+    state->mode_type == WLR_OUTPUT_STATE_MODE_FIXED;
+}
+
+
+/* The headless backend only supports custom modes */
+static void
+to_custom_mode (const struct wlr_output_state *state, struct wlr_output_state *custom)
+{
+  *custom = *state;
+  custom->mode_type = WLR_OUTPUT_STATE_MODE_CUSTOM;
+  custom->custom_mode.width = state->mode->width;
+  custom->custom_mode.height = state->mode->height;
+  custom->custom_mode.refresh = state->mode->refresh;
+}
+
+
+static bool
+on_test (struct wlr_output *wlr_output, const struct wlr_output_state *state, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+  struct wlr_output_state custom;
+
+  if (is_mode_switch (state)) {
+    if (data->reject)
+      return false;
+
+    to_custom_mode (state, &custom);
+    state = &custom;
+  }
+
+  return phoc_test_output_impl_test (wlr_output, state);
+}
+
+
+static bool
+on_commit (struct wlr_output *wlr_output, const struct wlr_output_state *state, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+  struct wlr_output_state custom;
+
+  if (is_mode_switch (state)) {
+    data->n_mode_commits++;
+    if (data->reject)
+      return false;
+
+    to_custom_mode (state, &custom);
+    state = &custom;
+  } else {
+    data->n_commits++;
+  }
+
+  return phoc_test_output_impl_commit (wlr_output, state);
+}
+
+
+static const PhocTestOutputHooks hooks = {
+  .test   = on_test,
+  .commit = on_commit,
+};
+
+
+static struct wlr_output_mode *
+add_mode (struct wlr_output *wlr_output, int refresh)
+{
+  /* Freed by wlroots together with the output */
+  struct wlr_output_mode *mode = calloc (1, sizeof (*mode));
+
+  mode->width = wlr_output->width;
+  mode->height = wlr_output->height;
+  mode->refresh = refresh;
+  wl_list_insert (wlr_output->modes.prev, &mode->link);
+
+  return mode;
+}
+
+
+static gboolean
+server_mode_rejected (PhocServer *server, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  return data->n_mode_commits > 0;
+}
+
+
+static gboolean
+server_damage (PhocServer *server, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  /* The switch to the idle refresh rate got rejected once */
+  g_assert_cmpuint (data->n_mode_commits, ==, 1);
+
+  data->n_commits = 0;
+  data->deadline = g_get_monotonic_time () + IDLE_WAIT_MS * 1000;
+  phoc_output_damage_whole (data->output);
+
+  return TRUE;
+}
+
+
+static gboolean
+server_idle_again (PhocServer *server, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  return g_get_monotonic_time () > data->deadline && data->n_commits > 0;
+}
+
+
+static gboolean
+server_check_rejected (PhocServer *server, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  /* No further attempts even after another idle period */
+  g_assert_cmpuint (data->n_mode_commits, ==, 1);
+
+  phoc_test_output_restore_impl (data->output->wlr_output);
+  return TRUE;
+}
+
+
+static gboolean
+server_prepare (PhocServer *server, gpointer user_data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  IdleRefreshTestData *data = user_data;
+  struct wlr_output *wlr_output;
+
+  g_assert_false (wl_list_empty (&desktop->outputs));
+  data->output = wl_container_of (desktop->outputs.next, data->output, link);
+  wlr_output = data->output->wlr_output;
+
+  /* Pretend to be a panel with a fixed 60Hz and 30Hz mode */
+  wlr_output->current_mode = add_mode (wlr_output, 60000);
+  wlr_output->refresh = 60000;
+  add_mode (wlr_output, 30000);
+
+  phoc_test_output_override_impl (wlr_output, &hooks, data);
+
+  return TRUE;
+}
+
+
+static gboolean
+client_run_reject (PhocTestClientGlobals *globals, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  phoc_test_client_wait_for_server (server_mode_rejected, data);
+  g_assert_true (phoc_test_client_run_in_server (server_damage, data));
+  /* Frames at the current mode still make it to the backend */
+  phoc_test_client_wait_for_server (server_idle_again, data);
+  g_assert_true (phoc_test_client_run_in_server (server_check_rejected, data));
+
+  return TRUE;
+}
+
+
+static gboolean
+server_is_downclocked (PhocServer *server, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  return data->output->wlr_output->refresh == 30000;
+}
+
+
+static gboolean
+server_is_restored (PhocServer *server, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  return data->output->wlr_output->refresh == 60000;
+}
+
+
+static gboolean
+server_update (PhocServer *server, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  data->n_commits = 0;
+  phoc_output_damage_whole (data->output);
+
+  return TRUE;
+}
+
+
+static gboolean
+server_frame_committed (PhocServer *server, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  return data->n_commits > 0;
+}
+
+
+static gboolean
+server_check_downclocked (PhocServer *server, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  /* A single update doesn't ramp up again */
+  g_assert_cmpint (data->output->wlr_output->refresh, ==, 30000);
+  g_assert_cmpuint (data->n_mode_commits, ==, 1);
+
+  return TRUE;
+}
+
+
+static gboolean
+server_notify_activity (PhocServer *server, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  phoc_output_notify_activity (data->output);
+
+  return TRUE;
+}
+
+
+static guint64
+get_refresh_time (GVariant *stats, guint32 refresh)
+{
+  GVariantIter iter;
+  guint32 key;
+  guint64 usec;
+
+  g_variant_iter_init (&iter, stats);
+  while (g_variant_iter_next (&iter, "{ut}", &key, &usec)) {
+    if (key == refresh)
+      return usec;
+  }
+
+  return 0;
+}
+
+
+static gboolean
+server_check_stats (PhocServer *server, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+  g_autoptr (GVariant) stats = g_variant_ref_sink (phoc_output_get_refresh_stats (data->output));
+
+  /* Dropped once and restored once */
+  g_assert_cmpuint (data->n_mode_commits, ==, 2);
+
+  g_assert_cmpuint (get_refresh_time (stats, 30000), >, 0);
+  g_assert_cmpuint (get_refresh_time (stats, 60000), >, 0);
+
+  phoc_test_output_restore_impl (data->output->wlr_output);
+  return TRUE;
+}
+
+
+static gboolean
+client_run_activity (PhocTestClientGlobals *globals, gpointer user_data)
+{
+  IdleRefreshTestData *data = user_data;
+
+  phoc_test_client_wait_for_server (server_is_downclocked, data);
+
+  g_assert_true (phoc_test_client_run_in_server (server_update, data));
+  phoc_test_client_wait_for_server (server_frame_committed, data);
+  g_assert_true (phoc_test_client_run_in_server (server_check_downclocked, data));
+
+  g_assert_true (phoc_test_client_run_in_server (server_notify_activity, data));
+  phoc_test_client_wait_for_server (server_is_restored, data);
+  g_assert_true (phoc_test_client_run_in_server (server_check_stats, data));
+
+  return TRUE;
+}
+
+
+static void
+test_phoc_idle_refresh_activity (void)
+{
+  IdleRefreshTestData data = { 0 };
+  PhocTestClientIface iface = {
+    .server_prepare = server_prepare,
+    .client_run     = client_run_activity,
+    .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+    .output_config  = { .idle_refresh_rate = 30.0 },
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, &data);
+}
+
+
+static void
+test_phoc_idle_refresh_reject (void)
+{
+  IdleRefreshTestData data = { .reject = TRUE };
+  PhocTestClientIface iface = {
+    .server_prepare = server_prepare,
+    .client_run     = client_run_reject,
+    .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+    .output_config  = { .idle_refresh_rate = 30.0 },
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, &data);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  PHOC_TEST_ADD ("/phoc/idle-refresh/activity", test_phoc_idle_refresh_activity);
+  PHOC_TEST_ADD ("/phoc/idle-refresh/reject", test_phoc_idle_refresh_reject);
+
+  return g_test_run ();
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "keymap-cache.h"
+
+#include <glib/gstdio.h>
+
+typedef struct {
+  GMainLoop         *loop;
+  struct xkb_keymap *keymap;
+} LoadData;
+
+
+static void
+on_keymap_loaded (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr (GError) err = NULL;
+  LoadData *data = user_data;
+
+  data->keymap = phoc_keymap_cache_load_finish (PHOC_KEYMAP_CACHE (source_object), res, &err);
+  g_assert_no_error (err);
+  g_assert_nonnull (data->keymap);
+
+  g_main_loop_quit (data->loop);
+}
+
+
+static struct xkb_keymap *
+load_keymap (PhocKeymapCache *cache, const char *layout, const char *variant)
+{
+  g_autoptr (GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+  LoadData data = { .loop = loop };
+
+  phoc_keymap_cache_load_async (cache, layout, variant, NULL, NULL, on_keymap_loaded, &data);
+  g_main_loop_run (loop);
+
+  return data.keymap;
+}
+
+
+static void
+test_phoc_keymap_cache_shared (void)
+{
+  g_autoptr (PhocKeymapCache) cache = phoc_keymap_cache_new ();
+  struct xkb_keymap *us, *us2, *de, *lookup;
+
+  g_assert_null (phoc_keymap_cache_lookup (cache, "us", NULL, NULL));
+
+  us = load_keymap (cache, "us", NULL);
+  g_assert_cmpint (phoc_keymap_cache_get_n_keymaps (cache), ==, 1);
+
+  lookup = phoc_keymap_cache_lookup (cache, "us", NULL, NULL);
+  g_assert_true (lookup == us);
+
+  us2 = load_keymap (cache, "us", NULL);
+  g_assert_true (us2 == us);
+  g_assert_cmpint (phoc_keymap_cache_get_n_keymaps (cache), ==, 1);
+
+  de = load_keymap (cache, "de", "nodeadkeys");
+  g_assert_true (de != us);
+  g_assert_cmpint (phoc_keymap_cache_get_n_keymaps (cache), ==, 2);
+
+  g_assert_nonnull (phoc_keymap_cache_get_default_keymap (cache));
+
+  xkb_keymap_unref (us);
+  xkb_keymap_unref (us2);
+  xkb_keymap_unref (de);
+  xkb_keymap_unref (lookup);
+}
+
+
+static void
+test_phoc_keymap_cache_persist (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *dir = g_dir_make_tmp ("phoc-keymap-cache-XXXXXX", &err);
+  struct xkb_keymap *keymap;
+  g_autofree char *first = NULL;
+  g_autofree char *second = NULL;
+  g_autofree char *replaced = NULL;
+  g_autofree char *path = NULL;
+  g_autoptr (GDir) gdir = NULL;
+  g_autofree char *name = NULL;
+
+  g_assert_no_error (err);
+
+  {
+    g_autoptr (PhocKeymapCache) cache = phoc_keymap_cache_new ();
+
+    phoc_keymap_cache_set_persist_dir (cache, dir);
+    keymap = load_keymap (cache, "de", NULL);
+    first = xkb_keymap_get_as_string (keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    xkb_keymap_unref (keymap);
+  }
+
+  gdir = g_dir_open (dir, 0, &err);
+  g_assert_no_error (err);
+  name = g_strdup (g_dir_read_name (gdir));
+  g_assert_nonnull (name);
+  g_assert_null (g_dir_read_name (gdir));
+  path = g_build_filename (dir, name, NULL);
+
+  {
+    struct xkb_context *context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+    struct xkb_rule_names names = { .layout = "us" };
+
+    /* Replace the persisted keymap so loading it can't be mistaken for a recompile */
+    keymap = xkb_keymap_new_from_names (context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    g_assert_nonnull (keymap);
+    replaced = xkb_keymap_get_as_string (keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    xkb_keymap_unref (keymap);
+    xkb_context_unref (context);
+
+    g_assert_cmpstr (replaced, !=, first);
+    g_file_set_contents (path, replaced, -1, &err);
+    g_assert_no_error (err);
+  }
+
+  {
+    g_autoptr (PhocKeymapCache) cache = phoc_keymap_cache_new ();
+
+    /* A new cache picks up the persisted keymap */
+    phoc_keymap_cache_set_persist_dir (cache, dir);
+    keymap = load_keymap (cache, "de", NULL);
+    second = xkb_keymap_get_as_string (keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    xkb_keymap_unref (keymap);
+  }
+
+  g_assert_cmpstr (second, ==, replaced);
+
+  g_assert_cmpint (g_remove (path), ==, 0);
+  g_assert_cmpint (g_rmdir (dir), ==, 0);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/keymap-cache/shared", test_phoc_keymap_cache_shared);
+  g_test_add_func ("/phoc/keymap-cache/persist", test_phoc_keymap_cache_persist);
+
+  return g_test_run ();
+}
@@ -6,6 +6,10 @@
 
 #include "testlib-layer-shell.h"
 
+#include "desktop.h"
+#include "layer-surface.h"
+#include "output.h"
+
 #include <wayland-client-protocol.h>
 
 #define HEIGHT 350
@@ -165,6 +169,172 @@ test_client_layer_shell_effects_stack_surface_simple (PhocTestClientGlobals *glo
 }
 
 
+typedef struct {
+  enum zwlr_layer_shell_v1_layer layer;
+  const guint32                 *widths;
+  guint                          n_widths;
+} StackingTestData;
+
+
+static gboolean
+server_check_stacking (PhocServer *server, gpointer user_data)
+{
+  StackingTestData *data = user_data;
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output = wl_container_of (desktop->outputs.next, output, link);
+  GSequence *layer_surfaces = phoc_output_get_layer_surfaces_for_layer (output, data->layer);
+  guint i = 0;
+
+  g_assert_cmpint (g_sequence_get_length (layer_surfaces), ==, data->n_widths);
+  /* Surfaces are told apart by their width */
+  for (GSequenceIter *iter = g_sequence_get_begin_iter (layer_surfaces);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter)) {
+    PhocLayerSurface *layer_surface = PHOC_LAYER_SURFACE (g_sequence_get (iter));
+
+    g_assert_cmpuint (layer_surface->layer_surface->current.desired_width, ==, data->widths[i++]);
+  }
+
+  return TRUE;
+}
+
+
+static void
+check_stacking (StackingTestData               *data,
+                enum zwlr_layer_shell_v1_layer  layer,
+                const guint32                  *widths,
+                guint                           n_widths)
+{
+  data->layer = layer;
+  data->widths = widths;
+  data->n_widths = n_widths;
+
+  g_assert_true (phoc_test_client_run_in_server (server_check_stacking, data));
+}
+
+
+static struct zphoc_stacked_layer_surface_v1 *
+stack_surface (PhocTestClientGlobals *globals,
+               PhocTestLayerSurface  *ls,
+               PhocTestLayerSurface  *target,
+               gboolean               above)
+{
+  struct zphoc_stacked_layer_surface_v1 *stacked_surf;
+
+  stacked_surf = zphoc_layer_shell_effects_v1_get_stacked_layer_surface (
+    globals->layer_shell_effects, ls->layer_surface);
+  g_assert_nonnull (stacked_surf);
+
+  if (above)
+    zphoc_stacked_layer_surface_v1_stack_above (stacked_surf, target->layer_surface);
+  else
+    zphoc_stacked_layer_surface_v1_stack_below (stacked_surf, target->layer_surface);
+  wl_surface_commit (ls->wl_surface);
+  wl_display_roundtrip (globals->display);
+
+  return stacked_surf;
+}
+
+
+static void
+set_layer (PhocTestClientGlobals *globals, PhocTestLayerSurface *ls, enum zwlr_layer_shell_v1_layer layer)
+{
+  zwlr_layer_surface_v1_set_layer (ls->layer_surface, layer);
+  wl_surface_commit (ls->wl_surface);
+  wl_display_roundtrip (globals->display);
+}
+
+
+static gboolean
+test_client_layer_shell_effects_stacking_order (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestLayerSurface *ls[7];
+  struct zphoc_stacked_layer_surface_v1 *stacked_surfs[3];
+  const guint32 initial[] = { 10, 50, 20, 40, 30 };
+  const guint32 moved_overlay[] = { 10, 50, 40, 30 };
+  const guint32 moved_top[] = { 20 };
+  const guint32 cycle[] = { 10, 50, 20, 60, 70, 40, 30 };
+
+  /* Non exclusive surfaces: newer ones go on top */
+  ls[0] = phoc_test_layer_surface_new (globals, 10, 10, 0xFFFF0000,
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM, 0);
+  ls[1] = phoc_test_layer_surface_new (globals, 20, 10, 0xFF00FF00,
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM, 0);
+  /* Exclusive surfaces: above non exclusive ones, older ones go on top */
+  ls[2] = phoc_test_layer_surface_new (globals, 30, 10, 0xFF0000FF,
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP, 10);
+  ls[3] = phoc_test_layer_surface_new (globals, 40, 10, 0xFFFFFF00,
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP, 10);
+  /* Stacked surfaces go directly above (or below) their target */
+  ls[4] = phoc_test_layer_surface_new (globals, 50, 10, 0xFF00FFFF,
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM, 0);
+  stacked_surfs[0] = stack_surface (globals, ls[4], ls[0], TRUE);
+  check_stacking (data, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, initial, G_N_ELEMENTS (initial));
+
+  /* Moving to another layer and back restores the position */
+  set_layer (globals, ls[1], ZWLR_LAYER_SHELL_V1_LAYER_TOP);
+  check_stacking (data, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, moved_overlay, G_N_ELEMENTS (moved_overlay));
+  check_stacking (data, ZWLR_LAYER_SHELL_V1_LAYER_TOP, moved_top, G_N_ELEMENTS (moved_top));
+  set_layer (globals, ls[1], ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY);
+  check_stacking (data, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, initial, G_N_ELEMENTS (initial));
+  check_stacking (data, ZWLR_LAYER_SHELL_V1_LAYER_TOP, NULL, 0);
+
+  /*
+   * Surfaces stacked relative to each other form a cycle. Those
+   * relations are ignored so they're sorted like unrelated surfaces.
+   */
+  ls[5] = phoc_test_layer_surface_new (globals, 60, 10, 0xFFFF00FF,
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM, 0);
+  ls[6] = phoc_test_layer_surface_new (globals, 70, 10, 0xFFFFFFFF,
+                                       ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM, 0);
+  stacked_surfs[1] = stack_surface (globals, ls[5], ls[6], FALSE);
+  stacked_surfs[2] = stack_surface (globals, ls[6], ls[5], FALSE);
+  check_stacking (data, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, cycle, G_N_ELEMENTS (cycle));
+
+  for (guint i = 0; i < G_N_ELEMENTS (stacked_surfs); i++)
+    zphoc_stacked_layer_surface_v1_destroy (stacked_surfs[i]);
+  for (guint i = 0; i < G_N_ELEMENTS (ls); i++)
+    phoc_test_layer_surface_free (ls[i]);
+
+  phoc_assert_screenshot (globals, "empty.png");
+
+  return TRUE;
+}
+
+
+static gboolean
+test_client_layer_shell_effects_stacking_chain (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestLayerSurface *ls[4];
+  struct zphoc_stacked_layer_surface_v1 *stacked_surfs[3];
+  const guint32 above[] = { 10, 20, 30, 40 };
+  const guint32 below[] = { 40, 10, 20, 30 };
+
+  for (guint i = 0; i < G_N_ELEMENTS (ls); i++) {
+    ls[i] = phoc_test_layer_surface_new (globals, 10 * (i + 1), 10, 0xFFFF0000,
+                                         ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM, 0);
+  }
+
+  /* 30 above 20 above 10: The older surface 30 still goes on top */
+  stacked_surfs[0] = stack_surface (globals, ls[1], ls[0], TRUE);
+  stacked_surfs[1] = stack_surface (globals, ls[2], ls[1], TRUE);
+  check_stacking (data, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, above, G_N_ELEMENTS (above));
+
+  /* The chain stays together when its root isn't on top */
+  stacked_surfs[2] = stack_surface (globals, ls[3], ls[0], FALSE);
+  check_stacking (data, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, below, G_N_ELEMENTS (below));
+
+  for (guint i = 0; i < G_N_ELEMENTS (stacked_surfs); i++)
+    zphoc_stacked_layer_surface_v1_destroy (stacked_surfs[i]);
+  for (guint i = 0; i < G_N_ELEMENTS (ls); i++)
+    phoc_test_layer_surface_free (ls[i]);
+
+  phoc_assert_screenshot (globals, "empty.png");
+
+  return TRUE;
+}
+
+
 static void
 test_layer_shell_effects_drag_surface_simple (void)
 {
@@ -192,6 +362,26 @@ test_layer_shell_effects_stack_surface_simple (void)
 }
 
 
+static void
+test_layer_shell_effects_stacking_order (void)
+{
+  StackingTestData data = { 0 };
+  PhocTestClientIface iface = { .client_run =  test_client_layer_shell_effects_stacking_order };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, &data);
+}
+
+
+static void
+test_layer_shell_effects_stacking_chain (void)
+{
+  StackingTestData data = { 0 };
+  PhocTestClientIface iface = { .client_run =  test_client_layer_shell_effects_stacking_chain };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, &data);
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -203,5 +393,9 @@ main (gint argc, gchar *argv[])
                  test_layer_shell_effects_alpha_surface_simple);
   PHOC_TEST_ADD ("/phoc/layer-shell-effects/bind-surface/simple",
                  test_layer_shell_effects_stack_surface_simple);
+  PHOC_TEST_ADD ("/phoc/layer-shell-effects/stacking-order",
+                 test_layer_shell_effects_stacking_order);
+  PHOC_TEST_ADD ("/phoc/layer-shell-effects/stacking-chain",
+                 test_layer_shell_effects_stacking_chain);
   return g_test_run ();
 }
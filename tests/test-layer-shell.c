@@ -5,6 +5,11 @@
  */
 
 #include "testlib.h"
+#include "desktop.h"
+#include "layer-shell.h"
+#include "layer-surface.h"
+#include "layout-transaction.h"
+#include "output.h"
 
 #include <wayland-client-protocol.h>
 
@@ -214,6 +219,252 @@ test_layer_shell_set_layer (void)
 }
 
 
+static gint transactions_done;
+
+
+static void
+on_transaction_active_changed (PhocLayoutTransaction *transaction,
+                               GParamSpec            *pspec,
+                               gpointer               unused)
+{
+  if (!phoc_layout_transaction_is_active (transaction))
+    g_atomic_int_inc (&transactions_done);
+}
+
+
+static gboolean
+server_layer_shell_transaction (PhocServer *server, gpointer data)
+{
+  g_atomic_int_set (&transactions_done, 0);
+  g_signal_connect_object (phoc_layout_transaction_get_default (),
+                           "notify::active",
+                           G_CALLBACK (on_transaction_active_changed),
+                           server,
+                           0);
+  return TRUE;
+}
+
+
+static void
+layer_surface_set_color (PhocTestClientGlobals *globals, PhocTestLayerSurface *ls, guint32 color)
+{
+  phoc_test_buffer_free (&ls->buffer);
+  phoc_test_client_create_shm_buffer (globals, &ls->buffer, ls->width, ls->height,
+                                      WL_SHM_FORMAT_XRGB8888);
+
+  for (int i = 0; i < ls->width * ls->height * 4; i += 4)
+    *(guint32*)(ls->buffer.shm_data + i) = color;
+
+  wl_surface_attach (ls->wl_surface, ls->buffer.wl_buffer, 0, 0);
+  wl_surface_damage (ls->wl_surface, 0, 0, ls->width, ls->height);
+  wl_surface_commit (ls->wl_surface);
+  wl_display_roundtrip (globals->display);
+}
+
+
+static guint32
+get_pixel (PhocTestBuffer *buffer, guint x, guint y)
+{
+  return *(guint32 *)(buffer->shm_data + y * buffer->stride + x * 4) & 0x00FFFFFF;
+}
+
+
+static gboolean
+test_client_layer_shell_transaction (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestLayerSurface *ls_green, *ls_red;
+  PhocTestBuffer *screenshot;
+  guint x = globals->output.width / 2;
+  guint y = globals->output.height - HEIGHT / 2;
+
+  ls_green = phoc_test_layer_surface_new (globals, WIDTH, HEIGHT, 0xFF00FF00,
+                                          ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP, 0);
+  ls_red = phoc_test_layer_surface_new (globals, WIDTH, HEIGHT, 0xFFFF0000,
+                                        ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM, 0);
+
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, x, y), ==, 0x00FF0000);
+
+  /* Resize the green surface but don't commit a buffer for the new size
+   * so the layout transaction stays pending */
+  ls_green->configured = FALSE;
+  zwlr_layer_surface_v1_set_size (ls_green->layer_surface, WIDTH, HEIGHT * 2);
+  wl_surface_commit (ls_green->wl_surface);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (ls_green->configured);
+
+  /* The unrelated red surface still gets updated on screen */
+  layer_surface_set_color (globals, ls_red, 0xFF0000FF);
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, x, y), ==, 0x000000FF);
+  g_assert_cmpint (g_atomic_int_get (&transactions_done), ==, 0);
+
+  phoc_test_layer_surface_free (ls_red);
+  phoc_test_layer_surface_free (ls_green);
+
+  phoc_assert_screenshot (globals, "empty.png");
+  return TRUE;
+}
+
+
+static void
+test_layer_shell_transaction (void)
+{
+  PhocTestClientIface iface = {
+    .server_prepare = server_layer_shell_transaction,
+    .client_run = test_client_layer_shell_transaction,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+static void
+layer_surface_resize (PhocTestClientGlobals *globals, PhocTestLayerSurface *ls,
+                      guint32 width, guint32 height)
+{
+  ls->configured = FALSE;
+  zwlr_layer_surface_v1_set_size (ls->layer_surface, width, height);
+  wl_surface_commit (ls->wl_surface);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (ls->configured);
+}
+
+
+static gboolean
+test_client_layer_shell_transaction_acked (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestLayerSurface *ls_green, *ls_red;
+  PhocTestBuffer *screenshot;
+  guint x = globals->output.width / 2;
+  guint y = globals->output.height - HEIGHT / 2;
+
+  ls_green = phoc_test_layer_surface_new (globals, WIDTH, HEIGHT, 0xFF00FF00,
+                                          ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP, 0);
+  ls_red = phoc_test_layer_surface_new (globals, WIDTH, HEIGHT, 0xFFFF0000,
+                                        ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM, 0);
+
+  /* Both surfaces join the same transaction */
+  layer_surface_resize (globals, ls_green, WIDTH, HEIGHT * 2);
+  layer_surface_resize (globals, ls_red, WIDTH, HEIGHT * 2);
+
+  /* The red surface acks first but is still drawn from its old buffer */
+  layer_surface_set_color (globals, ls_red, 0xFF0000FF);
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, x, y), ==, 0x00FF0000);
+  g_assert_cmpint (g_atomic_int_get (&transactions_done), ==, 0);
+
+  /* Once the green surface acked too both show their new state */
+  layer_surface_set_color (globals, ls_green, 0xFF00FF00);
+  g_assert_cmpint (g_atomic_int_get (&transactions_done), ==, 1);
+  screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  g_assert_cmphex (get_pixel (screenshot, x, y), ==, 0x000000FF);
+
+  phoc_test_layer_surface_free (ls_red);
+  phoc_test_layer_surface_free (ls_green);
+
+  phoc_assert_screenshot (globals, "empty.png");
+  return TRUE;
+}
+
+
+static void
+test_layer_shell_transaction_acked (void)
+{
+  PhocTestClientIface iface = {
+    .server_prepare = server_layer_shell_transaction,
+    .client_run = test_client_layer_shell_transaction_acked,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+static gboolean
+server_check_full_arrange (PhocServer *server, gpointer user_data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output = wl_container_of (desktop->outputs.next, output, link);
+  g_autoptr (GArray) geos = g_array_new (FALSE, FALSE, sizeof (struct wlr_box));
+  struct wlr_box usable_area = output->usable_area;
+  PhocLayerSurface *layer_surface;
+  guint i = 0;
+
+  wl_list_for_each (layer_surface, &output->layer_surfaces, link)
+    g_array_append_val (geos, layer_surface->geo);
+
+  /* A full arrange must end up with the same layout */
+  phoc_layer_shell_arrange (output);
+
+  g_assert_cmpmem (&output->usable_area, sizeof (struct wlr_box), &usable_area, sizeof (struct wlr_box));
+  wl_list_for_each (layer_surface, &output->layer_surfaces, link) {
+    struct wlr_box *geo = &g_array_index (geos, struct wlr_box, i++);
+
+    g_assert_cmpmem (&layer_surface->geo, sizeof (struct wlr_box), geo, sizeof (struct wlr_box));
+  }
+
+  return TRUE;
+}
+
+
+static void
+check_full_arrange (void)
+{
+  g_assert_true (phoc_test_client_run_in_server (server_check_full_arrange, NULL));
+}
+
+
+static gboolean
+test_client_layer_shell_arrange_surface (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestLayerSurface *ls_panel, *ls_red, *ls_blue;
+
+  ls_panel = phoc_test_layer_surface_new (globals, 0, HEIGHT / 4, 0xFF00FF00,
+                                          ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP
+                                          | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT
+                                          | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT,
+                                          HEIGHT / 4);
+  ls_red = phoc_test_layer_surface_new (globals, WIDTH, HEIGHT, 0xFFFF0000,
+                                        ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM, 0);
+  ls_blue = phoc_test_layer_surface_new (globals, WIDTH, HEIGHT, 0xFF0000FF,
+                                         ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP, 0);
+  check_full_arrange ();
+
+  /* Anchor change only arranges the red surface */
+  zwlr_layer_surface_v1_set_anchor (ls_red->layer_surface,
+                                    ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP
+                                    | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT);
+  wl_surface_commit (ls_red->wl_surface);
+  wl_display_roundtrip (globals->display);
+  check_full_arrange ();
+
+  /* Size change only arranges the red surface */
+  ls_red->configured = FALSE;
+  zwlr_layer_surface_v1_set_size (ls_red->layer_surface, WIDTH * 2, HEIGHT / 2);
+  wl_surface_commit (ls_red->wl_surface);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (ls_red->configured);
+  layer_surface_set_color (globals, ls_red, 0xFFFF0000);
+  check_full_arrange ();
+
+  phoc_test_layer_surface_free (ls_blue);
+  phoc_test_layer_surface_free (ls_red);
+  phoc_test_layer_surface_free (ls_panel);
+
+  phoc_assert_screenshot (globals, "empty.png");
+  return TRUE;
+}
+
+
+static void
+test_layer_shell_arrange_surface (void)
+{
+  PhocTestClientIface iface = { .client_run = test_client_layer_shell_arrange_surface };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -222,6 +473,9 @@ main (gint argc, gchar *argv[])
   PHOC_TEST_ADD ("/phoc/layer-shell/anchor", test_layer_shell_anchor);
   PHOC_TEST_ADD ("/phoc/layer-shell/exclusive_zone", test_layer_shell_exclusive_zone);
   PHOC_TEST_ADD ("/phoc/layer-shell/set_layer", test_layer_shell_set_layer);
+  PHOC_TEST_ADD ("/phoc/layer-shell/transaction", test_layer_shell_transaction);
+  PHOC_TEST_ADD ("/phoc/layer-shell/transaction_acked", test_layer_shell_transaction_acked);
+  PHOC_TEST_ADD ("/phoc/layer-shell/arrange_surface", test_layer_shell_arrange_surface);
 
   return g_test_run ();
 }
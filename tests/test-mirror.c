@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Test which outputs mirror each other using two headless outputs
+ */
+
+#include "desktop.h"
+#include "output.h"
+#include "server.h"
+
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/util/box.h>
+
+
+static PhocServer *
+setup_server (const char *config_str)
+{
+  PhocConfig *config = phoc_config_new_from_data (config_str);
+  PhocServer *server = phoc_server_get_default ();
+
+  g_assert_true (config);
+  g_assert_true (phoc_server_setup (server, config, NULL, NULL, PHOC_SERVER_FLAG_NONE));
+
+  return server;
+}
+
+
+static PhocOutput *
+get_output (PhocServer *server, const char *name)
+{
+  PhocOutput *output = phoc_desktop_find_output_by_name (phoc_server_get_desktop (server), name);
+
+  g_assert_true (PHOC_IS_OUTPUT (output));
+  g_assert_true (output->wlr_output->enabled);
+
+  return output;
+}
+
+
+static void
+get_box (PhocServer *server, PhocOutput *output, struct wlr_box *box)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+
+  wlr_output_layout_get_box (desktop->layout, output->wlr_output, box);
+}
+
+
+static void
+test_phoc_mirror_auto (void)
+{
+  g_autoptr (PhocServer) server = setup_server ("[core]\nxwayland=false\n");
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output1 = get_output (server, "HEADLESS-1");
+  PhocOutput *output2 = get_output (server, "HEADLESS-2");
+  struct wlr_output_state state;
+  struct wlr_box box1, box2;
+
+  /* Placed next to each other */
+  g_assert_null (phoc_output_get_mirror_source (output1));
+  g_assert_null (phoc_output_get_mirror_source (output2));
+
+  /* Same position and resolution */
+  wlr_output_layout_add (desktop->layout, output2->wlr_output, 0, 0);
+  g_assert_true (phoc_output_get_mirror_source (output2) == output1);
+  g_assert_null (phoc_output_get_mirror_source (output1));
+
+  /* Same layout box at a higher resolution keeps rendering on its own */
+  wlr_output_state_init (&state);
+  wlr_output_state_set_custom_mode (&state, output1->wlr_output->width * 2,
+                                    output1->wlr_output->height * 2, 0);
+  wlr_output_state_set_scale (&state, 2.0);
+  g_assert_true (wlr_output_commit_state (output2->wlr_output, &state));
+  wlr_output_state_finish (&state);
+
+  get_box (server, output1, &box1);
+  get_box (server, output2, &box2);
+  g_assert_true (wlr_box_equal (&box1, &box2));
+  g_assert_null (phoc_output_get_mirror_source (output2));
+}
+
+
+static void
+test_phoc_mirror_config (void)
+{
+  g_autoptr (PhocServer) server = setup_server ("[core]\n"
+                                                "xwayland=false\n"
+                                                "\n"
+                                                "[output:HEADLESS-2]\n"
+                                                "mirror=HEADLESS-1\n");
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output1 = get_output (server, "HEADLESS-1");
+  PhocOutput *output2 = get_output (server, "HEADLESS-2");
+  struct wlr_box box1, box2;
+
+  /* Moved on top of the output it mirrors */
+  get_box (server, output1, &box1);
+  get_box (server, output2, &box2);
+  g_assert_cmpint (box1.x, ==, box2.x);
+  g_assert_cmpint (box1.y, ==, box2.y);
+  g_assert_true (phoc_output_get_mirror_source (output2) == output1);
+
+  /* Output management can still move it elsewhere */
+  wlr_output_layout_add (desktop->layout, output2->wlr_output, box1.width, 0);
+  get_box (server, output2, &box2);
+  g_assert_cmpint (box2.x, ==, box1.width);
+  g_assert_cmpint (box2.y, ==, 0);
+  g_assert_null (phoc_output_get_mirror_source (output2));
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "2", TRUE);
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/mirror/auto", test_phoc_mirror_auto);
+  g_test_add_func ("/phoc/mirror/config", test_phoc_mirror_config);
+
+  return g_test_run ();
+}
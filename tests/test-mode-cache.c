@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "mode-cache.h"
+
+#include <glib/gstdio.h>
+
+
+static void
+test_phoc_mode_cache_lookup (void)
+{
+  g_autoptr (PhocModeCache) cache = phoc_mode_cache_new (NULL);
+  g_autofree char *key = phoc_mode_cache_build_key ("DP-1", "make", "model", "serial");
+  g_autofree char *other = phoc_mode_cache_build_key ("DP-1", "make", "model", "other");
+  int width, height, refresh;
+
+  g_assert_cmpstr (key, !=, other);
+  g_assert_false (phoc_mode_cache_lookup (cache, key, &width, &height, &refresh));
+
+  phoc_mode_cache_set_mode (cache, key, 1920, 1080, 60000);
+  g_assert_true (phoc_mode_cache_lookup (cache, key, &width, &height, &refresh));
+  g_assert_cmpint (width, ==, 1920);
+  g_assert_cmpint (height, ==, 1080);
+  g_assert_cmpint (refresh, ==, 60000);
+  g_assert_false (phoc_mode_cache_lookup (cache, other, &width, &height, &refresh));
+
+  g_assert_false (phoc_mode_cache_is_rejected (cache, key, 3840, 2160, 60000));
+  phoc_mode_cache_add_rejected (cache, key, 3840, 2160, 60000);
+  phoc_mode_cache_add_rejected (cache, key, 2560, 1440, 60000);
+  /* A single rejection might have been transient */
+  g_assert_false (phoc_mode_cache_is_rejected (cache, key, 3840, 2160, 60000));
+  g_assert_false (phoc_mode_cache_is_rejected (cache, key, 2560, 1440, 60000));
+  phoc_mode_cache_add_rejected (cache, key, 3840, 2160, 60000);
+  phoc_mode_cache_add_rejected (cache, key, 2560, 1440, 60000);
+  phoc_mode_cache_add_rejected (cache, key, 2560, 1440, 60000);
+  g_assert_true (phoc_mode_cache_is_rejected (cache, key, 3840, 2160, 60000));
+  g_assert_true (phoc_mode_cache_is_rejected (cache, key, 2560, 1440, 60000));
+  g_assert_false (phoc_mode_cache_is_rejected (cache, key, 3840, 2160, 30000));
+  g_assert_false (phoc_mode_cache_is_rejected (cache, other, 3840, 2160, 60000));
+
+  /* Modes that pass later on aren't skipped anymore */
+  phoc_mode_cache_remove_rejected (cache, key, 3840, 2160, 60000);
+  g_assert_false (phoc_mode_cache_is_rejected (cache, key, 3840, 2160, 60000));
+  g_assert_true (phoc_mode_cache_is_rejected (cache, key, 2560, 1440, 60000));
+  phoc_mode_cache_remove_rejected (cache, key, 2560, 1440, 60000);
+  g_assert_false (phoc_mode_cache_is_rejected (cache, key, 2560, 1440, 60000));
+
+  /* Accepting a mode also resets the count */
+  phoc_mode_cache_add_rejected (cache, key, 2560, 1440, 60000);
+  phoc_mode_cache_remove_rejected (cache, key, 2560, 1440, 60000);
+  phoc_mode_cache_add_rejected (cache, key, 2560, 1440, 60000);
+  g_assert_false (phoc_mode_cache_is_rejected (cache, key, 2560, 1440, 60000));
+}
+
+
+static void
+test_phoc_mode_cache_persist (void)
+{
+  g_autoptr (GError) err = NULL;
+  g_autofree char *dir = g_dir_make_tmp ("phoc-mode-cache-XXXXXX", &err);
+  g_autofree char *filename = NULL;
+  g_autofree char *key = phoc_mode_cache_build_key ("HDMI-A-1", "make", "model", NULL);
+  int width, height, refresh;
+
+  g_assert_no_error (err);
+  filename = g_build_filename (dir, "phoc", "modes.ini", NULL);
+
+  {
+    g_autoptr (PhocModeCache) cache = phoc_mode_cache_new (filename);
+
+    phoc_mode_cache_set_mode (cache, key, 1280, 720, 50000);
+    phoc_mode_cache_add_rejected (cache, key, 1920, 1080, 60000);
+    g_assert_true (phoc_mode_cache_save (cache, &err));
+    g_assert_no_error (err);
+  }
+
+  g_assert_true (g_file_test (filename, G_FILE_TEST_EXISTS));
+
+  /* A rejection from a previous run counts */
+  {
+    g_autoptr (PhocModeCache) cache = phoc_mode_cache_new (filename);
+
+    g_assert_false (phoc_mode_cache_is_rejected (cache, key, 1920, 1080, 60000));
+    phoc_mode_cache_add_rejected (cache, key, 1920, 1080, 60000);
+    g_assert_true (phoc_mode_cache_save (cache, &err));
+    g_assert_no_error (err);
+  }
+
+  g_assert_true (g_file_test (filename, G_FILE_TEST_EXISTS));
+
+  {
+    g_autoptr (PhocModeCache) cache = phoc_mode_cache_new (filename);
+
+    g_assert_true (phoc_mode_cache_lookup (cache, key, &width, &height, &refresh));
+    g_assert_cmpint (width, ==, 1280);
+    g_assert_cmpint (height, ==, 720);
+    g_assert_cmpint (refresh, ==, 50000);
+    g_assert_true (phoc_mode_cache_is_rejected (cache, key, 1920, 1080, 60000));
+  }
+
+  {
+    g_autofree char *subdir = g_path_get_dirname (filename);
+
+    g_assert_cmpint (g_remove (filename), ==, 0);
+    g_assert_cmpint (g_rmdir (subdir), ==, 0);
+  }
+  g_assert_cmpint (g_rmdir (dir), ==, 0);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/mode-cache/lookup", test_phoc_mode_cache_lookup);
+  g_test_add_func ("/phoc/mode-cache/persist", test_phoc_mode_cache_persist);
+
+  return g_test_run ();
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Test applying output configurations via the output management
+ * protocol's server side using a headless output
+ */
+
+#include "testlib.h"
+
+#include "desktop.h"
+#include "output.h"
+
+#include <wlr/types/wlr_output_management_v1.h>
+
+typedef struct {
+  guint n_tests;
+  guint n_commits;
+  guint fail_commits;
+  int   last_mode_width;
+} OutputConfigTestData;
+
+
+/* Like DRM reject modesets without a buffer */
+static gboolean
+has_modeset_buffer (const struct wlr_output_state *state)
+{
+  if (!(state->committed & (WLR_OUTPUT_STATE_ENABLED | WLR_OUTPUT_STATE_MODE)))
+    return TRUE;
+
+  if ((state->committed & WLR_OUTPUT_STATE_ENABLED) && !state->enabled)
+    return TRUE;
+
+  return !!(state->committed & WLR_OUTPUT_STATE_BUFFER);
+}
+
+
+static bool
+on_test (struct wlr_output *wlr_output, const struct wlr_output_state *state, gpointer user_data)
+{
+  OutputConfigTestData *data = user_data;
+
+  data->n_tests++;
+  if (!has_modeset_buffer (state))
+    return false;
+
+  return phoc_test_output_impl_test (wlr_output, state);
+}
+
+
+static bool
+on_commit (struct wlr_output *wlr_output, const struct wlr_output_state *state, gpointer user_data)
+{
+  OutputConfigTestData *data = user_data;
+
+  data->n_commits++;
+  if (!has_modeset_buffer (state))
+    return false;
+
+  if (data->fail_commits) {
+    data->fail_commits--;
+    return false;
+  }
+
+  if (state->committed & WLR_OUTPUT_STATE_MODE)
+    data->last_mode_width = state->custom_mode.width;
+
+  return phoc_test_output_impl_commit (wlr_output, state);
+}
+
+
+static const PhocTestOutputHooks hooks = {
+  .test   = on_test,
+  .commit = on_commit,
+};
+
+
+static PhocServer *
+setup_server (void)
+{
+  PhocConfig *config = phoc_config_new_from_data ("[core]\nxwayland=false\n");
+  PhocServer *server = phoc_server_get_default ();
+
+  g_assert_true (config);
+  g_assert_true (phoc_server_setup (server, config, NULL, NULL, PHOC_SERVER_FLAG_NONE));
+
+  return server;
+}
+
+
+static struct wlr_output_configuration_v1 *
+config_new (PhocOutput *output, int width, int height)
+{
+  struct wlr_output_configuration_v1 *config = wlr_output_configuration_v1_create ();
+  struct wlr_output_configuration_head_v1 *head;
+
+  head = wlr_output_configuration_head_v1_create (config, output->wlr_output);
+  /* The headless backend only supports custom modes */
+  head->state.mode = NULL;
+  head->state.custom_mode.width = width;
+  head->state.custom_mode.height = height;
+  head->state.custom_mode.refresh = output->wlr_output->refresh;
+
+  return config;
+}
+
+
+static void
+test_phoc_output_config_test_apply (void)
+{
+  g_autoptr (PhocServer) server = setup_server ();
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output = phoc_desktop_find_output_by_name (desktop, "HEADLESS-1");
+  OutputConfigTestData data = { 0 };
+  int width, height;
+
+  g_assert_true (PHOC_IS_OUTPUT (output));
+  width = output->wlr_output->width;
+  height = output->wlr_output->height;
+  phoc_test_output_override_impl (output->wlr_output, &hooks, &data);
+
+  /* Testing passes but leaves the output alone */
+  wl_signal_emit (&desktop->output_manager_v1->events.test,
+                  config_new (output, width * 2, height * 2));
+  g_assert_cmpuint (data.n_tests, >, 0);
+  g_assert_cmpuint (data.n_commits, ==, 0);
+  g_assert_cmpint (output->wlr_output->width, ==, width);
+  g_assert_cmpint (output->wlr_output->height, ==, height);
+
+  /* Applying switches the mode */
+  wl_signal_emit (&desktop->output_manager_v1->events.apply,
+                  config_new (output, width * 2, height * 2));
+  g_assert_cmpuint (data.n_commits, ==, 1);
+  g_assert_cmpint (data.last_mode_width, ==, width * 2);
+  g_assert_cmpint (output->wlr_output->width, ==, width * 2);
+  g_assert_cmpint (output->wlr_output->height, ==, height * 2);
+
+  phoc_test_output_restore_impl (output->wlr_output);
+}
+
+
+static void
+test_phoc_output_config_rollback (void)
+{
+  g_autoptr (PhocServer) server = setup_server ();
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocOutput *output = phoc_desktop_find_output_by_name (desktop, "HEADLESS-1");
+  OutputConfigTestData data = { .fail_commits = 1 };
+  int width, height;
+
+  g_assert_true (PHOC_IS_OUTPUT (output));
+  width = output->wlr_output->width;
+  height = output->wlr_output->height;
+  phoc_test_output_override_impl (output->wlr_output, &hooks, &data);
+
+  /* The configuration passes the test but the commit fails */
+  g_test_expect_message ("phoc-output", G_LOG_LEVEL_WARNING,
+                         "Failed to commit output configuration*");
+  wl_signal_emit (&desktop->output_manager_v1->events.apply,
+                  config_new (output, width * 2, height * 2));
+  g_test_assert_expected_messages ();
+
+  /* The previous mode got committed again */
+  g_assert_cmpuint (data.n_commits, ==, 2);
+  g_assert_cmpint (data.last_mode_width, ==, width);
+  g_assert_true (output->wlr_output->enabled);
+  g_assert_cmpint (output->wlr_output->width, ==, width);
+  g_assert_cmpint (output->wlr_output->height, ==, height);
+
+  phoc_test_output_restore_impl (output->wlr_output);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", TRUE);
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/output-config/test_apply", test_phoc_output_config_test_apply);
+  g_test_add_func ("/phoc/output-config/rollback", test_phoc_output_config_rollback);
+
+  return g_test_run ();
+}
@@ -18,6 +18,13 @@ test_phoc_config_defaults (void)
 
   g_assert_true (config->xwayland);
   g_assert_true (config->xwayland_lazy);
+  g_assert_cmpuint (config->xwayland_idle_timeout, ==, 0);
+  g_assert_false (config->view_snapshots);
+  g_assert_false (config->suspend_on_memory_pressure);
+  g_assert_false (config->lazy_globals);
+  g_assert_false (config->persist_keymaps);
+  g_assert_false (config->persist_modes);
+  g_assert_cmpint (config->wayland_priority, ==, G_PRIORITY_DEFAULT);
   g_assert_cmpint (g_slist_length (config->outputs), ==, 0);
   g_assert_null (config->config_path);
 }
@@ -34,12 +41,28 @@ test_phoc_config_output (void)
     "[output:X11-1]\n"
     "scale = 3\n"
     "[output:X11-2]\n"
-    "scale = 3\n");
+    "scale = 3\n"
+    "adaptive-sync = true\n"
+    "idle-refresh-rate = 30\n"
+    "mirror = X11-1\n"
+    "color-temperature = 4000\n");
+  PhocOutputConfig *oc;
 
   g_assert_cmpint (g_slist_length (config1->outputs), ==, 1);
-  g_assert_cmpint (((PhocOutputConfig*)config1->outputs->data)->scale, ==, 3);
+  oc = config1->outputs->data;
+  g_assert_cmpint (oc->scale, ==, 3);
+  g_assert_false (oc->adaptive_sync);
+  g_assert_cmpfloat (oc->idle_refresh_rate, ==, 0);
+  g_assert_null (oc->mirror);
 
   g_assert_cmpint (g_slist_length (config2->outputs), ==, 2);
+  /* Outputs are prepended */
+  oc = config2->outputs->data;
+  g_assert_cmpstr (oc->name, ==, "X11-2");
+  g_assert_true (oc->adaptive_sync);
+  g_assert_cmpfloat (oc->idle_refresh_rate, ==, 30);
+  g_assert_cmpstr (oc->mirror, ==, "X11-1");
+  g_assert_cmpuint (oc->color_temperature, ==, 4000);
 }
 
 
@@ -60,6 +83,31 @@ test_phoc_config_modelines (void)
 }
 
 
+static void
+test_phoc_config_core (void)
+{
+  g_autoptr (PhocConfig) config = phoc_config_new_from_data (
+    "[core]\n"
+    "xwayland = false\n"
+    "xwayland-idle-timeout = 30\n"
+    "view-snapshots = true\n"
+    "suspend-on-memory-pressure = true\n"
+    "lazy-globals = true\n"
+    "persist-keymaps = true\n"
+    "persist-modes = true\n"
+    "wayland-priority = high\n");
+
+  g_assert_false (config->xwayland);
+  g_assert_cmpuint (config->xwayland_idle_timeout, ==, 30);
+  g_assert_true (config->view_snapshots);
+  g_assert_true (config->suspend_on_memory_pressure);
+  g_assert_true (config->lazy_globals);
+  g_assert_true (config->persist_keymaps);
+  g_assert_true (config->persist_modes);
+  g_assert_cmpint (config->wayland_priority, ==, G_PRIORITY_HIGH);
+}
+
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -68,6 +116,7 @@ main (gint argc, gchar *argv[])
   g_test_add_func ("/phoc/config/simple", test_phoc_config_defaults);
   g_test_add_func ("/phoc/config/output", test_phoc_config_output);
   g_test_add_func ("/phoc/config/modelines", test_phoc_config_modelines);
+  g_test_add_func ("/phoc/config/core", test_phoc_config_core);
 
   return g_test_run ();
 }
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2025 The Phosh Developers
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "testlib.h"
+
+#include "desktop.h"
+#include "suspend-policy.h"
+
+static gboolean
+server_memory_pressure (PhocServer *server, gpointer user_data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocSuspendPolicy *policy = phoc_server_get_suspend_policy (server);
+  GQueue *views = phoc_desktop_get_views (desktop);
+
+  g_assert_cmpint (g_queue_get_length (views), ==, 2);
+  for (GList *l = views->head; l; l = l->next)
+    g_assert_true (phoc_view_get_visibility (PHOC_VIEW (l->data)));
+
+  phoc_suspend_policy_notify_memory_pressure (policy);
+
+  /* Both views are on screen so none of them may get suspended */
+  g_assert_true (phoc_suspend_policy_get_memory_pressure (policy));
+  g_assert_cmpuint (phoc_suspend_policy_get_n_suspended (policy), ==, 0);
+  for (GList *l = views->head; l; l = l->next)
+    g_assert_false (phoc_view_is_suspended (PHOC_VIEW (l->data)));
+
+  return TRUE;
+}
+
+
+static gboolean
+server_prepare_visible (PhocServer *server, gpointer user_data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+
+  /* Keep both views on screen */
+  phoc_desktop_set_auto_maximize (desktop, FALSE);
+  return TRUE;
+}
+
+
+static gboolean
+client_run_visible (PhocTestClientGlobals *globals, gpointer user_data)
+{
+  PhocTestXdgToplevelSurface *bottom, *top;
+
+  bottom = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, NULL, 0xFF00FF00);
+  top = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, NULL, 0xFFFF0000);
+
+  g_assert_true (phoc_test_client_run_in_server (server_memory_pressure, NULL));
+
+  phoc_test_xdg_toplevel_free (top);
+  phoc_test_xdg_toplevel_free (bottom);
+
+  return TRUE;
+}
+
+
+static void
+test_phoc_suspend_policy_visible (void)
+{
+  PhocTestClientIface iface = {
+    .server_prepare = server_prepare_visible,
+    .client_run     = client_run_visible,
+    .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, NULL);
+}
+
+
+typedef struct {
+  PhocTestServerFunc check;
+} SuspendPolicyTestData;
+
+
+static gboolean
+server_is_occluded (PhocServer *server, gpointer user_data)
+{
+  PhocSuspendPolicy *policy = phoc_server_get_suspend_policy (server);
+
+  /* Everything but the maximized top view got covered */
+  return phoc_suspend_policy_get_n_suspended (policy) == 2;
+}
+
+
+static gboolean
+server_occluded (PhocServer *server, gpointer user_data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocSuspendPolicy *policy = phoc_server_get_suspend_policy (server);
+  GQueue *views = phoc_desktop_get_views (desktop);
+  PhocView *top = PHOC_VIEW (views->head->data);
+
+  g_assert_cmpint (g_queue_get_length (views), ==, 3);
+  g_assert_false (phoc_suspend_policy_get_memory_pressure (policy));
+  g_assert_true (phoc_view_get_visibility (top));
+  g_assert_false (phoc_view_is_suspended (top));
+  for (GList *l = views->head->next; l; l = l->next) {
+    g_assert_false (phoc_view_get_visibility (PHOC_VIEW (l->data)));
+    g_assert_true (phoc_view_is_suspended (PHOC_VIEW (l->data)));
+  }
+
+  /* No need to wait for anything once a view is covered */
+  phoc_view_set_visibility (top, FALSE);
+  g_assert_true (phoc_view_is_suspended (top));
+  g_assert_cmpuint (phoc_suspend_policy_get_n_suspended (policy), ==, 3);
+
+  phoc_view_set_visibility (top, TRUE);
+  g_assert_false (phoc_view_is_suspended (top));
+  g_assert_cmpuint (phoc_suspend_policy_get_n_suspended (policy), ==, 2);
+
+  return TRUE;
+}
+
+
+static gboolean
+server_escalate (PhocServer *server, gpointer user_data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocSuspendPolicy *policy = phoc_server_get_suspend_policy (server);
+  GQueue *views = phoc_desktop_get_views (desktop);
+  PhocView *top = PHOC_VIEW (views->head->data);
+  PhocView *middle = PHOC_VIEW (views->head->next->data);
+  PhocView *bottom = PHOC_VIEW (views->tail->data);
+
+  g_assert_cmpint (g_queue_get_length (views), ==, 3);
+
+  /* The least recently focused view gets escalated first */
+  phoc_suspend_policy_notify_memory_pressure (policy);
+  g_assert_true (phoc_suspend_policy_get_memory_pressure (policy));
+
+  phoc_view_set_visibility (middle, TRUE);
+  phoc_view_set_visibility (bottom, TRUE);
+  g_assert_false (phoc_view_is_suspended (middle));
+  g_assert_true (phoc_view_is_suspended (bottom));
+
+  /* Then the next one towards the top */
+  phoc_view_set_visibility (middle, FALSE);
+  phoc_view_set_visibility (bottom, FALSE);
+  phoc_suspend_policy_notify_memory_pressure (policy);
+  phoc_view_set_visibility (middle, TRUE);
+  g_assert_true (phoc_view_is_suspended (middle));
+  g_assert_true (phoc_view_is_suspended (bottom));
+
+  /* The top view is never escalated */
+  phoc_suspend_policy_notify_memory_pressure (policy);
+  g_assert_false (phoc_view_is_suspended (top));
+  g_assert_cmpuint (phoc_suspend_policy_get_n_suspended (policy), ==, 2);
+
+  return TRUE;
+}
+
+
+static gboolean
+server_move_to_top (PhocServer *server, gpointer user_data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+  PhocSuspendPolicy *policy = phoc_server_get_suspend_policy (server);
+  GQueue *views = phoc_desktop_get_views (desktop);
+  PhocView *bottom = PHOC_VIEW (views->tail->data);
+
+  phoc_suspend_policy_notify_memory_pressure (policy);
+  g_assert_true (phoc_view_is_suspended (bottom));
+
+  /* Resumed right away although the pressure persists */
+  phoc_desktop_move_view_to_top (desktop, bottom);
+  g_assert_true (views->head->data == bottom);
+  g_assert_true (phoc_suspend_policy_get_memory_pressure (policy));
+  g_assert_false (phoc_view_is_suspended (bottom));
+
+  /* It's not escalated anymore either */
+  phoc_view_set_visibility (bottom, FALSE);
+  phoc_view_set_visibility (bottom, TRUE);
+  g_assert_false (phoc_view_is_suspended (bottom));
+
+  return TRUE;
+}
+
+
+static gboolean
+server_prepare_maximized (PhocServer *server, gpointer user_data)
+{
+  PhocDesktop *desktop = phoc_server_get_desktop (server);
+
+  /* Have the top view cover the others */
+  phoc_desktop_set_auto_maximize (desktop, TRUE);
+  return TRUE;
+}
+
+
+static gboolean
+client_run_maximized (PhocTestClientGlobals *globals, gpointer user_data)
+{
+  SuspendPolicyTestData *data = user_data;
+  PhocTestXdgToplevelSurface *bottom, *middle, *top;
+
+  bottom = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, NULL, 0xFF00FF00);
+  middle = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, NULL, 0xFF0000FF);
+  top = phoc_test_xdg_toplevel_new_with_buffer (globals, 0, 0, NULL, 0xFFFF0000);
+
+  phoc_test_client_wait_for_server (server_is_occluded, NULL);
+  g_assert_true (phoc_test_client_run_in_server (data->check, NULL));
+
+  phoc_test_xdg_toplevel_free (top);
+  phoc_test_xdg_toplevel_free (middle);
+  phoc_test_xdg_toplevel_free (bottom);
+
+  return TRUE;
+}
+
+
+static void
+run_maximized (PhocTestServerFunc check)
+{
+  SuspendPolicyTestData data = { .check = check };
+  PhocTestClientIface iface = {
+    .server_prepare = server_prepare_maximized,
+    .client_run     = client_run_maximized,
+    .debug_flags    = PHOC_SERVER_DEBUG_FLAG_DISABLE_ANIMATIONS,
+  };
+
+  phoc_test_client_run (TEST_PHOC_CLIENT_TIMEOUT, &iface, &data);
+}
+
+
+static void
+test_phoc_suspend_policy_occluded (void)
+{
+  run_maximized (server_occluded);
+}
+
+
+static void
+test_phoc_suspend_policy_escalate (void)
+{
+  run_maximized (server_escalate);
+}
+
+
+static void
+test_phoc_suspend_policy_move_to_top (void)
+{
+  run_maximized (server_move_to_top);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  PHOC_TEST_ADD ("/phoc/suspend-policy/visible", test_phoc_suspend_policy_visible);
+  PHOC_TEST_ADD ("/phoc/suspend-policy/occluded", test_phoc_suspend_policy_occluded);
+  PHOC_TEST_ADD ("/phoc/suspend-policy/escalate", test_phoc_suspend_policy_escalate);
+  PHOC_TEST_ADD ("/phoc/suspend-policy/move-to-top", test_phoc_suspend_policy_move_to_top);
+
+  return g_test_run ();
+}
@@ -6,6 +6,9 @@
 
 #include "utils.h"
 
+#include <math.h>
+#include <wlr/types/wlr_compositor.h>
+
 /*
  * Test the scaling factor is properly calculated based on the
  * display properties of known devices.
@@ -44,12 +47,172 @@ test_phoc_utils_compute_scale (void)
   g_assert_cmpfloat (scale, ==, 1.0);
 }
 
+
+static gint64
+region_area (pixman_region32_t *region)
+{
+  int n_rects;
+  pixman_box32_t *rects = pixman_region32_rectangles (region, &n_rects);
+  gint64 area = 0;
+
+  for (int i = 0; i < n_rects; i++)
+    area += (gint64)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+
+  return area;
+}
+
+/*
+ * Damage of surfaces at fractional scales gets scaled and expanded
+ * so it's larger than the damaged buffer pixels. Pixel aligned
+ * surfaces can use their buffer damage as is instead.
+ */
+static void
+test_phoc_utils_scale_damage (void)
+{
+  const float scales[] = { 1.25, 1.5, 1.75 };
+  pixman_region32_t damage;
+  pixman_box32_t *extents;
+
+  for (guint i = 0; i < G_N_ELEMENTS (scales); i++) {
+    float scale = scales[i];
+    pixman_region32_t buffer_damage, uncovered;
+    int x1 = floor (20 / scale), y1 = floor (20 / scale);
+    int x2 = ceil (60 / scale), y2 = ceil (60 / scale);
+
+    /* 40x40 damaged buffer pixels of a pixel aligned surface */
+    pixman_region32_init_rect (&buffer_damage, 20, 20, 40, 40);
+    /* The same damage in surface local coordinates */
+    pixman_region32_init_rect (&damage, x1, y1, x2 - x1, y2 - y1);
+
+    phoc_utils_scale_damage (&damage, scale, 1);
+
+    pixman_region32_init (&uncovered);
+    pixman_region32_subtract (&uncovered, &buffer_damage, &damage);
+    g_assert_false (pixman_region32_not_empty (&uncovered));
+    g_assert_cmpint (region_area (&damage), >, region_area (&buffer_damage));
+
+    pixman_region32_fini (&uncovered);
+    pixman_region32_fini (&buffer_damage);
+    pixman_region32_fini (&damage);
+  }
+
+  /* Integer scale matching the buffer scale isn't expanded */
+  pixman_region32_init_rect (&damage, 10, 10, 20, 20);
+  phoc_utils_scale_damage (&damage, 2, 2);
+  extents = pixman_region32_extents (&damage);
+  g_assert_cmpint (extents->x1, ==, 20);
+  g_assert_cmpint (extents->y1, ==, 20);
+  g_assert_cmpint (extents->x2, ==, 60);
+  g_assert_cmpint (extents->y2, ==, 60);
+  pixman_region32_fini (&damage);
+}
+
+/* Pixel aligned surfaces skip the damage expansion */
+static void
+test_phoc_utils_scale_surface_damage (void)
+{
+  const float scales[] = { 1.25, 1.5, 1.75 };
+
+  for (guint i = 0; i < G_N_ELEMENTS (scales); i++) {
+    float scale = scales[i];
+    struct wlr_surface surface = { 0 };
+    struct wlr_box box = { 0, 0, 100, 100 };
+    pixman_region32_t buffer_damage, aligned, unaligned, uncovered;
+    int x1 = floor (20 / scale), y1 = floor (20 / scale);
+    int x2 = ceil (60 / scale), y2 = ceil (60 / scale);
+
+    phoc_utils_scale_box (&box, scale);
+    surface.current.scale = 1;
+    surface.current.transform = WL_OUTPUT_TRANSFORM_NORMAL;
+
+    /* 40x40 damaged buffer pixels of a pixel aligned surface */
+    pixman_region32_init_rect (&buffer_damage, 20, 20, 40, 40);
+    /* The same damage in surface local coordinates */
+    pixman_region32_init_rect (&aligned, x1, y1, x2 - x1, y2 - y1);
+    pixman_region32_init_rect (&unaligned, x1, y1, x2 - x1, y2 - y1);
+
+    surface.current.buffer_width = box.width;
+    surface.current.buffer_height = box.height;
+    phoc_utils_scale_surface_damage (&aligned, &surface, &box, scale);
+
+    /* Buffer at scale 1 gets scaled up */
+    surface.current.buffer_width = 100;
+    surface.current.buffer_height = 100;
+    phoc_utils_scale_surface_damage (&unaligned, &surface, &box, scale);
+
+    pixman_region32_init (&uncovered);
+    pixman_region32_subtract (&uncovered, &buffer_damage, &aligned);
+    g_assert_false (pixman_region32_not_empty (&uncovered));
+    pixman_region32_subtract (&uncovered, &aligned, &unaligned);
+    g_assert_false (pixman_region32_not_empty (&uncovered));
+    g_assert_cmpint (region_area (&aligned), >=, region_area (&buffer_damage));
+    g_assert_cmpint (region_area (&aligned), <, region_area (&unaligned));
+
+    pixman_region32_fini (&uncovered);
+    pixman_region32_fini (&buffer_damage);
+    pixman_region32_fini (&aligned);
+    pixman_region32_fini (&unaligned);
+  }
+}
+
+/* Adjacent boxes still tile after scaling */
+static void
+test_phoc_utils_scale_box (void)
+{
+  const float scales[] = { 1.25, 1.5, 1.75 };
+
+  for (guint i = 0; i < G_N_ELEMENTS (scales); i++) {
+    struct wlr_box left = { 0, 0, 33, 10 };
+    struct wlr_box right = { 33, 0, 33, 10 };
+
+    phoc_utils_scale_box (&left, scales[i]);
+    phoc_utils_scale_box (&right, scales[i]);
+    g_assert_cmpint (left.x + left.width, ==, right.x);
+    g_assert_cmpint (right.x + right.width, ==, round (66 * scales[i]));
+  }
+}
+
+/* Fractional scale clients rendering at the output's scale */
+static void
+test_phoc_utils_is_surface_pixel_aligned (void)
+{
+  struct wlr_surface surface = { 0 };
+  struct wlr_box box = { 10, 10, 100, 50 };
+
+  phoc_utils_scale_box (&box, 1.5);
+  surface.current.transform = WL_OUTPUT_TRANSFORM_NORMAL;
+  surface.current.buffer_width = 150;
+  surface.current.buffer_height = 75;
+  g_assert_true (phoc_utils_is_surface_pixel_aligned (&surface, &box));
+
+  /* Buffer gets scaled */
+  surface.current.buffer_width = 100;
+  surface.current.buffer_height = 50;
+  g_assert_false (phoc_utils_is_surface_pixel_aligned (&surface, &box));
+
+  /* Buffer gets rotated */
+  surface.current.buffer_width = 150;
+  surface.current.buffer_height = 75;
+  surface.current.transform = WL_OUTPUT_TRANSFORM_180;
+  g_assert_false (phoc_utils_is_surface_pixel_aligned (&surface, &box));
+
+  /* Buffer gets cropped */
+  surface.current.transform = WL_OUTPUT_TRANSFORM_NORMAL;
+  surface.current.viewport.has_src = true;
+  g_assert_false (phoc_utils_is_surface_pixel_aligned (&surface, &box));
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/phoc/utils/compute_scale", test_phoc_utils_compute_scale);
+  g_test_add_func ("/phoc/utils/scale_damage", test_phoc_utils_scale_damage);
+  g_test_add_func ("/phoc/utils/scale_surface_damage", test_phoc_utils_scale_surface_damage);
+  g_test_add_func ("/phoc/utils/scale_box", test_phoc_utils_scale_box);
+  g_test_add_func ("/phoc/utils/is_surface_pixel_aligned",
+                   test_phoc_utils_is_surface_pixel_aligned);
 
   return g_test_run ();
 }
@@ -14,6 +14,9 @@
 #include <cairo.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <wlr/interfaces/wlr_output.h>
+
+#define SERVER_POLL_MS 10
 
 struct task_data {
   PhocTestClientFunc   func;
@@ -520,11 +523,13 @@ build_compositor_config (PhocTestClientIface *iface)
     "[output:*%%*%%*]\n"
     "mode=%dx%d\n"
     "scale=%.2f\n"
-    "rotate=%s\n",
+    "rotate=%s\n"
+    "idle-refresh-rate=%.2f\n",
     iface->output_config.width,
     iface->output_config.height,
     iface->output_config.scale,
-    transform);
+    transform,
+    iface->output_config.idle_refresh_rate);
 
   config = phoc_config_new_from_data (config_str);
   config->xwayland = iface->xwayland;
@@ -575,6 +580,93 @@ phoc_test_client_run (gint timeout, PhocTestClientIface *iface, gpointer data)
 }
 
 
+typedef struct {
+  PhocTestServerFunc func;
+  gpointer           data;
+  gboolean           wait;
+  gboolean           result;
+  gboolean           done;
+  GMutex             mutex;
+  GCond              cond;
+} PhocTestServerCall;
+
+
+static gboolean
+on_server_call (gpointer user_data)
+{
+  PhocTestServerCall *call = user_data;
+  gboolean result;
+
+  result = call->func (phoc_server_get_default (), call->data);
+  if (call->wait && !result)
+    return G_SOURCE_CONTINUE;
+
+  g_mutex_lock (&call->mutex);
+  call->result = result;
+  call->done = TRUE;
+  g_cond_signal (&call->cond);
+  g_mutex_unlock (&call->mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static gboolean
+server_call (PhocTestServerFunc func, gpointer data, gboolean wait)
+{
+  PhocTestServerCall call = { .func = func, .data = data, .wait = wait };
+
+  g_mutex_init (&call.mutex);
+  g_cond_init (&call.cond);
+
+  if (wait)
+    g_timeout_add (SERVER_POLL_MS, on_server_call, &call);
+  else
+    g_idle_add (on_server_call, &call);
+
+  g_mutex_lock (&call.mutex);
+  while (!call.done)
+    g_cond_wait (&call.cond, &call.mutex);
+  g_mutex_unlock (&call.mutex);
+
+  g_cond_clear (&call.cond);
+  g_mutex_clear (&call.mutex);
+
+  return call.result;
+}
+
+/**
+ * phoc_test_client_run_in_server:
+ * @func: The function to run
+ * @data: Data passed verbatim to `func`
+ *
+ * Run `func` in the compositor's main loop and wait for it to
+ * finish. This allows the test client to check compositor internals.
+ *
+ * Returns: The return value of `func`
+ */
+gboolean
+phoc_test_client_run_in_server (PhocTestServerFunc func, gpointer data)
+{
+  return server_call (func, data, FALSE);
+}
+
+/**
+ * phoc_test_client_wait_for_server:
+ * @func: The function to run
+ * @data: Data passed verbatim to `func`
+ *
+ * Run `func` in the compositor's main loop until it returns %TRUE.
+ * This allows the test client to wait for the compositor to reach a
+ * certain state. If that never happens the test times out.
+ */
+void
+phoc_test_client_wait_for_server (PhocTestServerFunc func, gpointer data)
+{
+  server_call (func, data, TRUE);
+}
+
+
 static int
 create_anon_file (off_t size)
 {
@@ -725,6 +817,158 @@ phoc_test_client_capture_output (PhocTestClientGlobals *globals,
   return &output->screenshot.buffer;
 }
 
+typedef struct {
+  /* Must stay first so the impl leads back to the override */
+  struct wlr_output_impl        impl;
+  const struct wlr_output_impl *orig;
+  PhocTestOutputHooks           hooks;
+  gpointer                      data;
+  struct wlr_output            *wlr_output;
+  struct wl_listener            destroy;
+} PhocTestOutputOverride;
+
+
+static PhocTestOutputOverride *
+get_output_override (struct wlr_output *wlr_output)
+{
+  PhocTestOutputOverride *override = (PhocTestOutputOverride *)wlr_output->impl;
+
+  g_assert (override->wlr_output == wlr_output);
+  return override;
+}
+
+
+static bool
+override_test (struct wlr_output *wlr_output, const struct wlr_output_state *state)
+{
+  PhocTestOutputOverride *override = get_output_override (wlr_output);
+
+  if (override->hooks.test)
+    return override->hooks.test (wlr_output, state, override->data);
+
+  return phoc_test_output_impl_test (wlr_output, state);
+}
+
+
+static bool
+override_commit (struct wlr_output *wlr_output, const struct wlr_output_state *state)
+{
+  PhocTestOutputOverride *override = get_output_override (wlr_output);
+
+  if (override->hooks.commit)
+    return override->hooks.commit (wlr_output, state, override->data);
+
+  return phoc_test_output_impl_commit (wlr_output, state);
+}
+
+
+static size_t
+override_get_gamma_size (struct wlr_output *wlr_output)
+{
+  PhocTestOutputOverride *override = get_output_override (wlr_output);
+
+  return override->hooks.get_gamma_size (wlr_output, override->data);
+}
+
+
+static void
+on_overridden_output_destroy (struct wl_listener *listener, void *data)
+{
+  PhocTestOutputOverride *override = wl_container_of (listener, override, destroy);
+
+  /* wlroots still calls the impl's destroy after the signal */
+  phoc_test_output_restore_impl (override->wlr_output);
+}
+
+/**
+ * phoc_test_output_override_impl:
+ * @wlr_output: The output
+ * @hooks: The hooks to run instead of the backend's implementation
+ * @data: Data passed to the hooks
+ *
+ * Run the given hooks whenever wlroots tests or commits a state on
+ * the output or asks for its gamma size. This allows tests to count
+ * commits or to make the backend reject states. Hooks can invoke the
+ * backend's implementation via [func@test_output_impl_test] and
+ * [func@test_output_impl_commit]. The override is removed via
+ * [func@test_output_restore_impl] or when the output goes away.
+ */
+void
+phoc_test_output_override_impl (struct wlr_output         *wlr_output,
+                                const PhocTestOutputHooks *hooks,
+                                gpointer                   data)
+{
+  PhocTestOutputOverride *override = g_new0 (PhocTestOutputOverride, 1);
+
+  g_assert (wlr_output);
+  g_assert (hooks);
+
+  override->orig = wlr_output->impl;
+  override->impl = *wlr_output->impl;
+  override->impl.test = override_test;
+  override->impl.commit = override_commit;
+  if (hooks->get_gamma_size)
+    override->impl.get_gamma_size = override_get_gamma_size;
+  override->hooks = *hooks;
+  override->data = data;
+  override->wlr_output = wlr_output;
+
+  override->destroy.notify = on_overridden_output_destroy;
+  wl_signal_add (&wlr_output->events.destroy, &override->destroy);
+
+  wlr_output->impl = &override->impl;
+}
+
+/**
+ * phoc_test_output_restore_impl:
+ * @wlr_output: The output
+ *
+ * Undo [func@test_output_override_impl].
+ */
+void
+phoc_test_output_restore_impl (struct wlr_output *wlr_output)
+{
+  PhocTestOutputOverride *override = get_output_override (wlr_output);
+
+  wlr_output->impl = override->orig;
+  wl_list_remove (&override->destroy.link);
+  g_free (override);
+}
+
+/**
+ * phoc_test_output_impl_test:
+ * @wlr_output: The output
+ * @state: The state to test
+ *
+ * Test the state with the output's backend, skipping the hooks.
+ *
+ * Returns: %TRUE if the backend accepts the state
+ */
+bool
+phoc_test_output_impl_test (struct wlr_output *wlr_output, const struct wlr_output_state *state)
+{
+  PhocTestOutputOverride *override = get_output_override (wlr_output);
+
+  return override->orig->test ? override->orig->test (wlr_output, state) : true;
+}
+
+/**
+ * phoc_test_output_impl_commit:
+ * @wlr_output: The output
+ * @state: The state to commit
+ *
+ * Commit the state with the output's backend, skipping the hooks.
+ *
+ * Returns: %TRUE if the backend committed the state
+ */
+bool
+phoc_test_output_impl_commit (struct wlr_output *wlr_output, const struct wlr_output_state *state)
+{
+  PhocTestOutputOverride *override = get_output_override (wlr_output);
+
+  return override->orig->commit (wlr_output, state);
+}
+
 /**
  * phoc_test_buffer_equal:
  *
@@ -7,6 +7,7 @@
 #include "server.h"
 
 #include <glib.h>
+#include <wlr/types/wlr_output.h>
 #include "gtk-shell-client-protocol.h"
 #include "xdg-shell-client-protocol.h"
 #include "xdg-decoration-unstable-v1-client-protocol.h"
@@ -44,6 +45,7 @@ typedef struct _PhocTestOutputConfig {
   guint height;
   float scale;
   enum wl_output_transform transform;
+  float idle_refresh_rate;
 } PhocTestOutputConfig;
 
 
@@ -97,6 +99,19 @@ typedef struct PhocTestClientIface {
 } PhocTestClientIface;
 
 
+/* Hooks run instead of the output's test, commit and get_gamma_size implementation */
+typedef struct _PhocTestOutputHooks {
+  bool   (* test)           (struct wlr_output             *wlr_output,
+                             const struct wlr_output_state *state,
+                             gpointer                       data);
+  bool   (* commit)         (struct wlr_output             *wlr_output,
+                             const struct wlr_output_state *state,
+                             gpointer                       data);
+  size_t (* get_gamma_size) (struct wlr_output             *wlr_output,
+                             gpointer                       data);
+} PhocTestOutputHooks;
+
+
 typedef struct _PhocTestXdgToplevelSurface
 {
   struct wl_surface *wl_surface;
@@ -118,6 +133,8 @@ typedef struct _PhocTestFixture {
 
 /* Test client */
 void phoc_test_client_run (gint timeout, PhocTestClientIface *iface, gpointer data);
+gboolean phoc_test_client_run_in_server (PhocTestServerFunc func, gpointer data);
+void phoc_test_client_wait_for_server (PhocTestServerFunc func, gpointer data);
 int  phoc_test_client_create_shm_buffer (PhocTestClientGlobals *globals,
                                          PhocTestBuffer *buffer,
                                          int width, int height, guint32 format);
@@ -144,6 +161,15 @@ void            phoc_test_xdg_toplevel_free (PhocTestXdgToplevelSurface *xs);
 void            phoc_test_xdg_update_buffer (PhocTestClientGlobals      *globals,
                                              PhocTestXdgToplevelSurface *xs,
                                              guint32                     color);
+/* Outputs */
+void     phoc_test_output_override_impl (struct wlr_output         *wlr_output,
+                                         const PhocTestOutputHooks *hooks,
+                                         gpointer                   data);
+void     phoc_test_output_restore_impl  (struct wlr_output         *wlr_output);
+bool     phoc_test_output_impl_test     (struct wlr_output             *wlr_output,
+                                         const struct wlr_output_state *state);
+bool     phoc_test_output_impl_commit   (struct wlr_output             *wlr_output,
+                                         const struct wlr_output_state *state);
 /* Buffers */
 gboolean phoc_test_buffer_equal (PhocTestBuffer *buf1, PhocTestBuffer *buf2);
 gboolean phoc_test_buffer_save (PhocTestBuffer *buffer, const gchar *filename);